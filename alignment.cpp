@@ -11,8 +11,16 @@
 //
 #include "alignment.h"
 #include "myreader.h"
+#include "timeutil.h"
 #include <numeric>
 #include <sstream>
+#include <iterator>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 using namespace std;
 
 char symbols_protein[] = "ARNDCQEGHILKMFPSTWYVX"; // X for unknown AA
@@ -235,29 +243,31 @@ void Alignment::checkSeqName() {
 int Alignment::checkIdenticalSeq()
 {
 	int num_identical = 0;
-    IntVector checked;
-    checked.resize(getNSeq(), 0);
+	// group the sequences by their pattern rows, so that only sequences in the same group are compared
+	StringIntMap first_seq;
+	IntVector next_seq(getNSeq(), -1), last_seq(getNSeq(), -1);
 	for (int seq1 = 0; seq1 < getNSeq(); seq1++) {
-        if (checked[seq1]) continue;
-		bool first = true;
-		for (int seq2 = seq1+1; seq2 < getNSeq(); seq2++) {
-			bool equal_seq = true;
-			for (iterator it = begin(); it != end(); it++)
-				if  ((*it)[seq1] != (*it)[seq2]) {
-					equal_seq = false;
-					break;
-				}
-			if (equal_seq) {
-				if (first)
-					cerr << "WARNING: Identical sequences " << getSeqName(seq1); 
-				cerr << ", " << getSeqName(seq2);
-				num_identical++;
-				checked[seq2] = 1;
-				first = false;
-			}
+		string row;
+		row.reserve(getNPattern());
+		for (iterator it = begin(); it != end(); it++)
+			row.push_back((*it)[seq1]);
+		pair<StringIntMap::iterator, bool> ins = first_seq.insert(StringIntMap::value_type(row, seq1));
+		if (ins.second)
+			last_seq[seq1] = seq1;
+		else {
+			int first = ins.first->second;
+			next_seq[last_seq[first]] = seq1;
+			last_seq[first] = seq1;
 		}
-		checked[seq1] = 1;
-		if (!first) cerr << endl;
+	}
+	for (int seq1 = 0; seq1 < getNSeq(); seq1++) {
+		if (last_seq[seq1] < 0 || next_seq[seq1] < 0) continue;
+		cerr << "WARNING: Identical sequences " << getSeqName(seq1);
+		for (int seq2 = next_seq[seq1]; seq2 >= 0; seq2 = next_seq[seq2]) {
+			cerr << ", " << getSeqName(seq2);
+			num_identical++;
+		}
+		cerr << endl;
 	}
 	if (num_identical)
 		outWarning("Some identical sequences found that should be discarded before the analysis");
@@ -407,6 +417,7 @@ Alignment::Alignment(char *filename, char *sequence_type, InputType &intype) : v
     seq_type = SEQ_UNKNOWN;
     STATE_UNKNOWN = 126;
     cout << "Reading alignment file " << filename << " ... ";
+    double read_start = getRealTime();
     intype = detectInputFile(filename);
 
     try {
@@ -436,6 +447,10 @@ Alignment::Alignment(char *filename, char *sequence_type, InputType &intype) : v
 
     cout << "Alignment has " << getNSeq() << " sequences with " << getNSite() <<
          " columns and " << getNPattern() << " patterns"<< endl;
+    cout << "Time for reading alignment: " << getRealTime() - read_start << " seconds";
+    if (getPeakMemory())
+        cout << " (peak memory " << getPeakMemory() / (1024*1024) << " MB)";
+    cout << endl;
     buildSeqStates();
     checkSeqName();
     // OBSOLETE: identical sequences are handled later
@@ -618,15 +633,15 @@ bool Alignment::addPattern(Pattern &pat, int site, int freq) {
             cout << "Site " << site << " contains only gaps or ambiguous characters" << endl;
         //return true;
     }
-    PatternIntMap::iterator pat_it = pattern_index.find(pat);
-    if (pat_it == pattern_index.end()) { // not found
+    // one hash lookup, which inserts the pattern if it is new
+    pair<PatternIntMap::iterator, bool> pat_it = pattern_index.insert(PatternIntMap::value_type(pat, size()));
+    if (pat_it.second) { // not found
         pat.frequency = freq;
         pat.computeConst(STATE_UNKNOWN);
         push_back(pat);
-        pattern_index[pat] = size()-1;
         site_pattern[site] = size()-1;
     } else {
-        int index = pat_it->second;
+        int index = pat_it.first->second;
         at(index).frequency += freq;
         site_pattern[site] = index;
     }
@@ -1089,14 +1104,13 @@ int Alignment::buildPattern(StrVector &sequences, char *sequence_type, int nseq,
     if (nseq != seq_names.size()) throw "Different number of sequences than specified";
 
     /* now check that all sequence names are correct */
+    StringIntMap name_count;
     for (seq_id = 0; seq_id < nseq; seq_id ++) {
-        ostringstream err_str;
         if (seq_names[seq_id] == "")
             err_str << "Sequence number " << seq_id+1 << " has no names\n";
         // check that all the names are different
-        for (int i = 0; i < seq_id; i++)
-            if (seq_names[i] == seq_names[seq_id])
-                err_str << "The sequence name " << seq_names[seq_id] << " is dupplicated\n";
+        else if (name_count[seq_names[seq_id]]++ == 1)
+            err_str << "The sequence name " << seq_names[seq_id] << " is dupplicated\n";
     }
     if (err_str.str() != "")
         throw err_str.str();
@@ -1188,6 +1202,47 @@ int Alignment::buildPattern(StrVector &sequences, char *sequence_type, int nseq,
     clear();
     pattern_index.clear();
 
+    if (seq_type != SEQ_CODON) {
+        /* transpose the sequences into columns chunk by chunk, the states of blocks of
+           COLUMN_BLOCK sites are converted in parallel, the patterns are then hashed in site order */
+        const int COLUMN_BLOCK = 64;
+        int chunk = max(COLUMN_BLOCK, (1 << 24) / max(nseq, 1) / COLUMN_BLOCK * COLUMN_BLOCK);
+        if (chunk > nsite) chunk = nsite;
+        vector<char> columns((size_t)chunk * nseq);
+        vector<char> invalid(chunk);
+        for (int start = 0; start < nsite; start += chunk) {
+            int end = min(start + chunk, nsite);
+            int nblock = (end - start + COLUMN_BLOCK - 1) / COLUMN_BLOCK;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+            for (int block = 0; block < nblock; block++) {
+                int block_start = start + block * COLUMN_BLOCK;
+                int block_end = min(block_start + COLUMN_BLOCK, end);
+                for (int i = block_start; i < block_end; i++)
+                    invalid[i - start] = 0;
+                for (int j = 0; j < nseq; j++) {
+                    const char *seq_str = sequences[j].c_str();
+                    for (int i = block_start; i < block_end; i++) {
+                        char state = char_to_state[(int)(seq_str[i])];
+                        columns[(size_t)(i - start) * nseq + j] = state;
+                        if (state == STATE_INVALID) invalid[i - start] = 1;
+                    }
+                }
+            }
+            for (site = start; site < end; site++) {
+                const char *col = &columns[(size_t)(site - start) * nseq];
+                if (invalid[site - start]) {
+                    for (seq = 0; seq < nseq; seq++)
+                        if (col[seq] == STATE_INVALID)
+                            err_str << "Sequence " << seq_names[seq] << " has invalid character " << sequences[seq][site]
+                                << " at site " << site+1 << endl;
+                }
+                pat.assign(col, nseq);
+                num_gaps_only += addPattern(pat, site);
+            }
+        }
+    } else
     for (site = 0; site < nsite; site+=step) {
         for (seq = 0; seq < nseq; seq++) {
             //char state = convertState(sequences[seq][site], seq_type);
@@ -1233,30 +1288,105 @@ int Alignment::buildPattern(StrVector &sequences, char *sequence_type, int nseq,
     return 1;
 }
 
+/**
+    the whole content of an alignment file, memory-mapped if possible, otherwise read in one go.
+    Throws ios::failure if the file cannot be opened, like ifstream with exceptions enabled.
+*/
+class AlignmentFileBuffer {
+public:
+    AlignmentFileBuffer(const char *filename) {
+        data = NULL;
+        size = pos = 0;
+        mapped = false;
+#if !defined(_WIN32)
+        int fd = open(filename, O_RDONLY);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+                madvise(addr, st.st_size, MADV_SEQUENTIAL);
+#endif
+                data = (const char*)addr;
+                size = st.st_size;
+                mapped = true;
+            }
+        }
+        if (fd >= 0) close(fd);
+        if (mapped) return;
+#endif
+        ifstream in;
+        in.exceptions(ios::failbit | ios::badbit);
+        in.open(filename, ios::binary);
+        in.exceptions(ios::badbit);
+        content.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        in.close();
+        data = content.data();
+        size = content.size();
+    }
+
+    ~AlignmentFileBuffer() {
+#if !defined(_WIN32)
+        if (mapped) munmap((void*)data, size);
+#endif
+    }
+
+    /**
+        get the next line without the trailing newline
+        @return false at the end of the file
+    */
+    bool getLine(const char *&line, size_t &len) {
+        if (pos >= size) return false;
+        line = data + pos;
+        const char *eol = (const char*)memchr(line, '\n', size - pos);
+        len = eol ? eol - line : size - pos;
+        pos += len + 1;
+        return true;
+    }
+
+private:
+    const char *data;
+    size_t size, pos;
+    bool mapped;
+    string content;
+};
+
+/**
+    append the alignment characters of a line to a sequence, white spaces are skipped
+    @return the first unrecognized character, 0 if none
+*/
+static char appendSequenceChars(string &seq, const char *line, const char *end) {
+    for (; line != end; line++) {
+        char ch = *line;
+        if (ch <= ' ') continue;
+        if (isalnum(ch) || ch == '-' || ch == '?'|| ch == '.')
+            seq.push_back(toupper(ch));
+        else
+            return ch;
+    }
+    return 0;
+}
+
 int Alignment::readPhylip(char *filename, char *sequence_type) {
 
     StrVector sequences;
     ostringstream err_str;
-    ifstream in;
+    AlignmentFileBuffer in(filename);
     int line_num = 1;
-    // set the failbit and badbit
-    in.exceptions(ios::failbit | ios::badbit);
-    in.open(filename);
     int nseq = 0, nsite = 0;
     int seq_id = 0;
-    string line;
-    // remove the failbit
-    in.exceptions(ios::badbit);
+    const char *line;
+    size_t len;
     bool tina_state = (sequence_type && strcmp(sequence_type,"TINA") == 0);
     num_states = 0;
 
-    for (; !in.eof(); line_num++) {
-        getline(in, line);
-        if (line == "") continue;
+    for (; in.getLine(line, len); line_num++) {
+        if (len == 0) continue;
+        const char *end = line + len;
 
         //cout << line << endl;
         if (nseq == 0) { // read number of sequences and sites
-            istringstream line_in(line);
+            istringstream line_in(string(line, len));
             if (!(line_in >> nseq >> nsite))
                 throw "Invalid PHYLIP format. First line must contain number of sequences and sites";
             //cout << "nseq: " << nseq << "  nsite: " << nsite << endl;
@@ -1267,17 +1397,20 @@ int Alignment::readPhylip(char *filename, char *sequence_type) {
 
             seq_names.resize(nseq, "");
             sequences.resize(nseq, "");
+            for (int i = 0; i < nseq; i++)
+                sequences[i].reserve(nsite);
 
         } else { // read sequence contents
             if (seq_names[seq_id] == "") { // cut out the sequence name
-                string::size_type pos = line.find_first_of(" \t");
-                if (pos == string::npos) pos = 10; //  assume standard phylip
-                seq_names[seq_id] = line.substr(0, pos);
-                line.erase(0, pos);
+                const char *name_end = line;
+                while (name_end != end && *name_end != ' ' && *name_end != '\t') name_end++;
+                if (name_end == end) name_end = line + min(len, (size_t)10); //  assume standard phylip
+                seq_names[seq_id].assign(line, name_end);
+                line = name_end;
             }
             int old_len = sequences[seq_id].length();
             if (tina_state) {
-                stringstream linestr(line);
+                stringstream linestr(string(line, end));
                 int state;
                 while (!linestr.eof() ) {
                     state = -1;
@@ -1286,16 +1419,10 @@ int Alignment::readPhylip(char *filename, char *sequence_type) {
                     sequences[seq_id].append(1, state);
                     if (num_states < state+1) num_states = state+1;
                 }
-            } else
-                for (string::iterator it = line.begin(); it != line.end(); it++) {
-                    if ((*it) <= ' ') continue;
-                    if (isalnum(*it) || (*it) == '-' || (*it) == '?'|| (*it) == '.')
-                        sequences[seq_id].append(1, toupper(*it));
-                    else {
-                        err_str << "Unrecognized character " << *it << " on line " << line_num;
-                        throw err_str.str();
-                    }
-                }
+            } else if (char ch = appendSequenceChars(sequences[seq_id], line, end)) {
+                err_str << "Unrecognized character " << ch << " on line " << line_num;
+                throw err_str.str();
+            }
             if (sequences[seq_id].length() != sequences[0].length()) {
                 err_str << "Line " << line_num << ": alignment block has variable sequence lengths" << endl;
                 throw err_str.str();
@@ -1309,10 +1436,6 @@ int Alignment::readPhylip(char *filename, char *sequence_type) {
         }
         //sequences.
     }
-    in.clear();
-    // set the failbit again
-    in.exceptions(ios::failbit | ios::badbit);
-    in.close();
 
     return buildPattern(sequences, sequence_type, nseq, nsite);
 }
@@ -1321,43 +1444,33 @@ int Alignment::readFasta(char *filename, char *sequence_type) {
 
     StrVector sequences;
     ostringstream err_str;
-    ifstream in;
+    AlignmentFileBuffer in(filename);
     int line_num = 1;
-    string line;
+    const char *line;
+    size_t len;
 
-    // set the failbit and badbit
-    in.exceptions(ios::failbit | ios::badbit);
-    in.open(filename);
-    // remove the failbit
-    in.exceptions(ios::badbit);
-
-    for (; !in.eof(); line_num++) {
-        getline(in, line);
-        if (line == "") continue;
+    for (; in.getLine(line, len); line_num++) {
+        if (len == 0) continue;
+        const char *end = line + len;
 
         //cout << line << endl;
         if (line[0] == '>') { // next sequence
-            string::size_type pos = line.find_first_of(" \n\r\t");
-            seq_names.push_back(line.substr(1, pos-1));
+            const char *name_end = line + 1;
+            while (name_end != end && !strchr(" \n\r\t", *name_end)) name_end++;
+            seq_names.push_back(string(line + 1, name_end));
             sequences.push_back("");
+            // sequences usually have the same length
+            if (sequences.size() > 1)
+                sequences.back().reserve(sequences[sequences.size()-2].length());
             continue;
         }
         // read sequence contents
         if (sequences.empty()) throw "First line must begin with '>' to define sequence name";
-        for (string::iterator it = line.begin(); it != line.end(); it++) {
-            if ((*it) <= ' ') continue;
-            if (isalnum(*it) || (*it) == '-' || (*it) == '?'|| (*it) == '.')
-                sequences.back().append(1, toupper(*it));
-            else {
-                err_str << "Unrecognized character " << *it << " on line " << line_num;
-                throw err_str.str();
-            }
+        if (char ch = appendSequenceChars(sequences.back(), line, end)) {
+            err_str << "Unrecognized character " << ch << " on line " << line_num;
+            throw err_str.str();
         }
     }
-    in.clear();
-    // set the failbit again
-    in.exceptions(ios::failbit | ios::badbit);
-    in.close();
 
     return buildPattern(sequences, sequence_type, seq_names.size(), sequences.front().length());
 }
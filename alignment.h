@@ -33,6 +33,7 @@ typedef unordered_map<string, double> StringDoubleHashMap;
 typedef unordered_map<string, int> PatternIntMap;
 //typedef map<string, int> PatternIntMap;
 #else
+typedef map<string, int> StringIntMap;
 typedef map<string, double> StringDoubleHashMap;
 typedef map<string, int> PatternIntMap;
 #endif
@@ -44,6 +45,7 @@ Multiple Sequence Alignment. Stored by a vector of site-patterns
  */
 class Alignment : public vector<Pattern> {
     friend class SuperAlignment;
+    friend class AlignmentWeightView;
 
 public:
 
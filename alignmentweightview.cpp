@@ -0,0 +1,92 @@
+/*
+ * alignmentweightview.cpp
+ *
+ *  Alignment re-weighting the patterns of another alignment, see AlignmentWeightView
+ */
+
+#include "alignmentweightview.h"
+
+AlignmentWeightView::AlignmentWeightView(Alignment *aln) : Alignment() {
+	if (aln->isSuperAlignment()) outError("Internal error: ", __func__);
+	base = aln;
+	seq_names = aln->seq_names;
+	num_states = aln->num_states;
+	seq_type = aln->seq_type;
+	STATE_UNKNOWN = aln->STATE_UNKNOWN;
+	seq_states = aln->seq_states;
+	// the patterns are copied by the first re-weighting, which may drop some of them
+	base_freq.resize(aln->getNPattern());
+}
+
+void AlignmentWeightView::setPatternFreq(const int *pattern_freq, bool drop_zero) {
+	int nptn = base->getNPattern();
+	for (int p = 0; p < nptn; p++)
+		base_freq[p] = pattern_freq[p];
+	updatePatterns(drop_zero);
+}
+
+void AlignmentWeightView::setPatternFreq(const unsigned short *pattern_freq, bool drop_zero) {
+	int nptn = base->getNPattern();
+	for (int p = 0; p < nptn; p++)
+		base_freq[p] = pattern_freq[p];
+	updatePatterns(drop_zero);
+}
+
+void AlignmentWeightView::setPerturbFreq(int percentage, int weight) {
+	int nptn = base->getNPattern();
+	for (int p = 0; p < nptn; p++)
+		base_freq[p] = base->at(p).frequency;
+
+	int ratchet_nsite = base->n_informative_sites * percentage / 100; // only resample from informative site
+	int orig_nsite = base->getNSite();
+	vector<bool> selected_sites(orig_nsite, false);
+	for (int s = 0; s < ratchet_nsite; s++) {
+		// Select informative site, drawn exactly as in Alignment::createPerturbAlignment
+		int site_id, ptn_id, ras;
+		do {
+			site_id = random_int(orig_nsite);
+			ptn_id = base->site_pattern[site_id];
+			ras = base->at(ptn_id).ras_pars_score;
+		} while (ras == 0 || (selected_sites[site_id]));
+		selected_sites[site_id] = true;
+		// Upweight
+		base_freq[ptn_id] += weight;
+	}
+	updatePatterns(false);
+}
+
+void AlignmentWeightView::setBootstrapFreq(const char *spec) {
+	base->createBootstrapAlignment(&base_freq[0], spec);
+	updatePatterns(true);
+}
+
+void AlignmentWeightView::updatePatterns(bool drop_zero) {
+	int nptn = base->getNPattern();
+	int nsite = 0, p;
+	if (!drop_zero && getNPattern() == nptn) {
+		// same patterns as the base: only the frequencies change
+		for (p = 0; p < nptn; p++) {
+			at(p).frequency = base_freq[p];
+			nsite += base_freq[p];
+		}
+	} else {
+		clear();
+		reserve(nptn);
+		for (p = 0; p < nptn; p++) {
+			if (drop_zero && base_freq[p] == 0)
+				continue;
+			push_back(base->at(p));
+			back().frequency = base_freq[p];
+			nsite += base_freq[p];
+		}
+	}
+	// sites are listed in the order of the patterns, as after updateSitePatternAfterOptimized
+	site_pattern.resize(nsite);
+	int site = 0;
+	nptn = getNPattern();
+	for (p = 0; p < nptn; p++)
+		for (int i = 0; i < at(p).frequency; i++)
+			site_pattern[site++] = p;
+	countConstSite();
+	countInformative();
+}
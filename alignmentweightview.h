@@ -0,0 +1,72 @@
+/*
+ * alignmentweightview.h
+ *
+ *  Alignment re-weighting the patterns of another alignment, see AlignmentWeightView
+ */
+
+#ifndef ALIGNMENTWEIGHTVIEW_H_
+#define ALIGNMENTWEIGHTVIEW_H_
+
+#include "alignment.h"
+
+/**
+ * Alignment with the patterns of a base alignment but its own pattern frequencies.
+ * The MP consumers of a perturbed or resampled alignment (ratchet, -opt_btree, standard bootstrap) only need
+ * new weights over the same patterns: instead of calling addPattern once per site (createPerturbAlignment,
+ * createBootstrapAlignment, modifyPatternFreq), the patterns are copied from the base once and re-weighting
+ * then only rewrites the frequencies, site_pattern and the constant/informative site bookkeeping.
+ * As long as no pattern is dropped, pattern i of the view is pattern i of the base, so the PLL weights can be
+ * synchronised with _updateInternalPllOnRatchet.
+ * NOTE: pattern_index is not maintained (until updateSitePatternAfterOptimized) and the base must not be
+ * modified or deleted while the view is in use.
+ */
+class AlignmentWeightView : public Alignment {
+public:
+
+	/**
+	 * constructor, the view has no patterns until the first call of setPatternFreq, setPerturbFreq
+	 * or setBootstrapFreq
+	 * @param aln the base alignment, must not be a SuperAlignment
+	 */
+	AlignmentWeightView(Alignment *aln);
+
+	/** @return the base alignment */
+	Alignment *getBase() { return base; }
+
+	/**
+	 * set the pattern frequencies
+	 * @param pattern_freq new frequency of every pattern of the base alignment
+	 * @param drop_zero TRUE to keep only the patterns of non-zero frequency (in the order of the base),
+	 *        needed when the PLL instance is rebuilt from this alignment; otherwise they are kept with frequency 0
+	 */
+	void setPatternFreq(const int *pattern_freq, bool drop_zero);
+	void setPatternFreq(const unsigned short *pattern_freq, bool drop_zero);
+
+	/**
+	 * upweight a subset of informative sites of the base for the ratchet, with the same random draws
+	 * as Alignment::createPerturbAlignment
+	 * @param percentage percentage of the informative sites to upweight
+	 * @param weight number of copies added for every selected site
+	 */
+	void setPerturbFreq(int percentage, int weight);
+
+	/**
+	 * resample the base by a non-parametric bootstrap, with the same random draws as
+	 * Alignment::createBootstrapAlignment; the patterns not drawn are dropped
+	 * @param spec bootstrap specification, see Alignment::createBootstrapAlignment
+	 */
+	void setBootstrapFreq(const char *spec = NULL);
+
+protected:
+
+	/** the base alignment */
+	Alignment *base;
+
+	/** frequencies of the patterns of base, kept to avoid reallocation */
+	IntVector base_freq;
+
+	/** copy the patterns of base with frequencies base_freq, dropping those of frequency 0 if drop_zero */
+	void updatePatterns(bool drop_zero);
+};
+
+#endif /* ALIGNMENTWEIGHTVIEW_H_ */
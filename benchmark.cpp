@@ -0,0 +1,356 @@
+/*
+ * benchmark.cpp
+ *
+ *  Benchmark of the parsimony engine on synthetic alignments, see benchmark.h
+ */
+
+#include <iqtree_config.h>
+#include "iqtree.h"
+#include "benchmark.h"
+#include "alignment.h"
+#include "parstree.h"
+#include "phyloanalysis.h"
+#include "sprparsimony.h"
+#include "perfcounter.h"
+#include "timeutil.h"
+
+extern Params *globalParam;
+
+/** mean branch length of the simulated trees, in expected changes per site */
+#define BENCH_BRANCH_LENGTH 0.1
+
+string BenchDataSet::getName() const {
+	stringstream name;
+	name << type << (cost ? "_cost" : "") << "_" << ntaxa << "x" << nsites;
+	return name.str();
+}
+
+/* @return the characters of the states of a data type of the benchmark */
+static const char *benchStates(const string &type) {
+	if (type == "dna")
+		return "ACGT";
+	if (type == "aa")
+		return "ARNDCQEGHILKMFPSTWYV";
+	return "01";
+}
+
+/* @return the sequence type of a data type of the benchmark for Alignment */
+static char *benchSequenceType(const string &type) {
+	if (type == "dna")
+		return (char*)"DNA";
+	if (type == "aa")
+		return (char*)"AA";
+	return (char*)"BIN";
+}
+
+void parseBenchDataSets(const char *spec, vector<BenchDataSet> &data_sets) {
+	string str = spec;
+	size_t pos = 0;
+	data_sets.clear();
+	while (pos <= str.length()) {
+		size_t end = str.find(',', pos);
+		if (end == string::npos)
+			end = str.length();
+		string item = str.substr(pos, end - pos);
+		pos = end + 1;
+		if (item.empty())
+			continue;
+
+		BenchDataSet data;
+		data.ntaxa = 100;
+		data.nsites = 2000;
+		size_t colon = item.find(':');
+		if (colon != string::npos) {
+			string size = item.substr(colon + 1);
+			item = item.substr(0, colon);
+			if (sscanf(size.c_str(), "%dx%d", &data.ntaxa, &data.nsites) != 2 || data.ntaxa < 4 || data.nsites < 1)
+				outError("Wrong size of benchmark data set (use <taxa>x<sites> with at least 4 taxa): ", size);
+		}
+		data.cost = false;
+		size_t plus = item.find('+');
+		if (plus != string::npos) {
+			if (item.substr(plus + 1) != "cost")
+				outError("Unknown option of benchmark data set: ", item);
+			data.cost = true;
+			item = item.substr(0, plus);
+		}
+		if (item != "dna" && item != "aa" && item != "bin")
+			outError("Unknown benchmark data type (use dna, aa or bin): ", item);
+		data.type = item;
+		data_sets.push_back(data);
+	}
+	if (data_sets.empty())
+		outError("No benchmark data set given");
+}
+
+/**
+ * simulate an alignment along a random rooted tree with exponential branch lengths: along a branch a site
+ * changes to a random state with probability 1 - exp(-rate * length), the rates of the sites are exponential
+ * (gamma with shape 1). Uses the random number generator of tools.h.
+ */
+static void simulateBenchAlignment(const BenchDataSet &data, const char *file_name) {
+	const char *states = benchStates(data.type);
+	int nstates = strlen(states);
+	int ntaxa = data.ntaxa, nsites = data.nsites;
+	int nnodes = 2 * ntaxa - 1;
+
+	// random tree by joining random pairs of subtrees, the children of a node have smaller ids
+	IntVector children(2 * nnodes, -1);
+	DoubleVector length(nnodes, 0.0);
+	IntVector subtrees;
+	for (int taxon = 0; taxon < ntaxa; taxon++)
+		subtrees.push_back(taxon);
+	for (int node = ntaxa; node < nnodes; node++) {
+		for (int child = 0; child < 2; child++) {
+			int pick = random_int(subtrees.size());
+			children[2 * node + child] = subtrees[pick];
+			length[subtrees[pick]] = -BENCH_BRANCH_LENGTH * log(1.0 - random_double());
+			subtrees[pick] = subtrees.back();
+			subtrees.pop_back();
+		}
+		subtrees.push_back(node);
+	}
+
+	DoubleVector rates(nsites);
+	for (int site = 0; site < nsites; site++)
+		rates[site] = -log(1.0 - random_double());
+
+	vector<string> seqs(nnodes, string(nsites, ' '));
+	for (int site = 0; site < nsites; site++)
+		seqs[nnodes - 1][site] = states[random_int(nstates)];
+	for (int node = nnodes - 1; node >= ntaxa; node--)
+		for (int child = 0; child < 2; child++) {
+			int id = children[2 * node + child];
+			for (int site = 0; site < nsites; site++) {
+				if (random_double() < 1.0 - exp(-rates[site] * length[id]))
+					seqs[id][site] = states[random_int(nstates)];
+				else
+					seqs[id][site] = seqs[node][site];
+			}
+		}
+
+	try {
+		ofstream out;
+		out.exceptions(ios::failbit | ios::badbit);
+		out.open(file_name);
+		out << ntaxa << " " << nsites << endl;
+		for (int taxon = 0; taxon < ntaxa; taxon++)
+			out << "T" << taxon + 1 << " " << seqs[taxon] << endl;
+		out.close();
+	} catch (ios::failure) {
+		outError(ERR_WRITE_OUTPUT, file_name);
+	}
+}
+
+/**
+ * write a Sankoff cost matrix for the states of a data type: 1 between states of equal parity
+ * (the transitions A-G and C-T of DNA), 2 otherwise
+ */
+static void writeBenchCostMatrix(const BenchDataSet &data, const char *file_name) {
+	int nstates = strlen(benchStates(data.type));
+	try {
+		ofstream out;
+		out.exceptions(ios::failbit | ios::badbit);
+		out.open(file_name);
+		out << nstates << endl;
+		for (int i = 0; i < nstates; i++) {
+			for (int j = 0; j < nstates; j++)
+				out << ((i == j) ? 0 : ((i + j) % 2 == 0 ? 1 : 2)) << ((j < nstates - 1) ? " " : "");
+			out << endl;
+		}
+		out.close();
+	} catch (ios::failure) {
+		outError(ERR_WRITE_OUTPUT, file_name);
+	}
+}
+
+/** results of the benchmark on one data set */
+struct BenchResult {
+	BenchDataSet data;
+	int npatterns, ninformative;
+	int kernel_score; // score of the tree the kernels were timed on
+	int search_score; // score of the tree found by the search
+	double newview_time, evaluate_time;
+	double search_wall, search_cpu;
+	uint64_t phase_calls[PERF_NUM_PHASES];
+	double phase_wall[PERF_NUM_PHASES], phase_cpu[PERF_NUM_PHASES];
+	uint64_t counts[PERF_NUM_EVENTS];
+};
+
+/* @return a / b, or 0 if b is 0 */
+static double benchRate(double a, double b) {
+	return (b > 0.0) ? a / b : 0.0;
+}
+
+static void writeBenchReport(Params &params, const char *kernel, int nboot, vector<BenchResult> &results,
+		const char *file_name) {
+	ofstream out;
+	out.exceptions(ios::failbit | ios::badbit);
+	try {
+		out.open(file_name);
+		out.setf(ios::fixed);
+		out.precision(6);
+		out << "{" << endl;
+		out << "  \"version\": \"" << iqtree_VERSION_MAJOR << "." << iqtree_VERSION_MINOR << "."
+			<< iqtree_VERSION_PATCH << "\"," << endl;
+		out << "  \"fitch_kernel\": \"" << kernel << "\"," << endl;
+		out << "  \"threads\": " << max(params.num_threads, 1) << "," << endl;
+		out << "  \"seed\": " << params.bench_seed << "," << endl;
+		out << "  \"kernel_repeats\": " << params.bench_repeats << "," << endl;
+		out << "  \"search_iterations\": " << params.bench_iterations << "," << endl;
+		out << "  \"bootstrap_replicates\": " << nboot << "," << endl;
+		out << "  \"datasets\": [" << endl;
+		for (int i = 0; i < results.size(); i++) {
+			BenchResult &res = results[i];
+			uint64_t nodes = (uint64_t)params.bench_repeats * (res.data.ntaxa - 2);
+			out << "    {" << endl;
+			out << "      \"name\": \"" << res.data.getName() << "\", \"type\": \"" << res.data.type
+				<< "\", \"cost\": " << (res.data.cost ? "true" : "false") << ", \"taxa\": " << res.data.ntaxa
+				<< ", \"sites\": " << res.data.nsites << "," << endl;
+			out << "      \"patterns\": " << res.npatterns << ", \"informative_patterns\": " << res.ninformative
+				<< ", \"kernel_tree_score\": " << res.kernel_score << ", \"search_score\": " << res.search_score
+				<< "," << endl;
+			out << "      \"kernels\": {" << endl;
+			out << "        \"newview\": {\"calls\": " << params.bench_repeats << ", \"wall\": " << res.newview_time
+				<< ", \"nodes_per_second\": " << benchRate(nodes, res.newview_time) << "}," << endl;
+			out << "        \"evaluate\": {\"calls\": " << params.bench_repeats << ", \"wall\": " << res.evaluate_time
+				<< ", \"calls_per_second\": " << benchRate(params.bench_repeats, res.evaluate_time) << "}" << endl;
+			out << "      }," << endl;
+			out << "      \"search\": {\"wall\": " << res.search_wall << ", \"cpu\": " << res.search_cpu << "," << endl;
+			out << "        \"spr_candidates_per_second\": "
+				<< benchRate(res.counts[PERF_SPR_CANDIDATES], res.phase_wall[PERF_SPR])
+				<< ", \"rell_evaluations_per_second\": "
+				<< benchRate(res.counts[PERF_RELL_EVALS], res.phase_wall[PERF_SAVE_TREE]) << "," << endl;
+			out << "        \"phases\": {" << endl;
+			for (int phase = 0; phase < PERF_NUM_PHASES; phase++)
+				out << "          \"" << perfPhaseName((PerfPhase)phase) << "\": {\"calls\": " << res.phase_calls[phase]
+					<< ", \"wall\": " << res.phase_wall[phase] << ", \"cpu\": " << res.phase_cpu[phase] << "}"
+					<< ((phase < PERF_NUM_PHASES - 1) ? "," : "") << endl;
+			out << "        }," << endl;
+			out << "        \"counters\": {" << endl;
+			for (int event = 0; event < PERF_NUM_EVENTS; event++)
+				out << "          \"" << perfEventName((PerfEvent)event) << "\": " << res.counts[event]
+					<< ((event < PERF_NUM_EVENTS - 1) ? "," : "") << endl;
+			out << "        }" << endl;
+			out << "      }" << endl;
+			out << "    }" << ((i < results.size() - 1) ? "," : "") << endl;
+		}
+		out << "  ]" << endl;
+		out << "}" << endl;
+		out.close();
+	} catch (ios::failure) {
+		outError(ERR_WRITE_OUTPUT, file_name);
+	}
+}
+
+/**
+ * time the Fitch kernels on a random stepwise addition tree of the data set, then score the tree found by
+ * the search (tree_file) with the same kernels of IQTree
+ */
+static void benchmarkKernels(Params &run_params, int repeats, const char *tree_file, BenchResult &res) {
+	resetGlobalParamOnNewAln();
+	Alignment *aln = new Alignment(run_params.aln_file, run_params.sequence_type, run_params.intype);
+	IQTree *tree;
+	if (run_params.sankoff_cost_file) {
+		tree = new ParsTree(aln);
+		dynamic_cast<ParsTree *>(tree)->initParsData(&run_params);
+	} else
+		tree = new IQTree(aln);
+	globalParam = &run_params;
+	optimizeAlignment(tree, run_params);
+	tree->initializePLL(run_params);
+	res.npatterns = tree->getAlnNPattern();
+	res.ninformative = tree->aln->n_informative_patterns;
+
+	_pllComputeRandomizedStepwiseAdditionParsimonyTree(tree->pllInst, tree->pllPartitions, run_params.sprDist, tree);
+	pllBenchmarkFitchKernels(tree->pllInst, tree->pllPartitions, repeats, res.newview_time, res.evaluate_time);
+	res.kernel_score = tree->pllInst->bestParsimony;
+
+	bool rooted = false;
+	tree->readTree(tree_file, rooted);
+	tree->setAlignment(tree->aln);
+	tree->clearAllPartialLH();
+	res.search_score = tree->computeParsimony();
+
+	delete tree;
+	delete aln;
+}
+
+void runBenchmark(Params &params) {
+	vector<BenchDataSet> data_sets;
+	parseBenchDataSets(params.bench_data, data_sets);
+	const char *kernel = pllSelectFitchKernel(params.fitch_kernel);
+	int nboot = (params.gbo_replicates > 0) ? params.gbo_replicates : 1000;
+	perfInit(true);
+
+	vector<BenchResult> results(data_sets.size());
+	for (int i = 0; i < data_sets.size(); i++) {
+		BenchResult &res = results[i];
+		res.data = data_sets[i];
+		string prefix = string(params.out_prefix) + ".bench." + res.data.getName();
+		string aln_file = prefix + ".phy";
+		string cost_file = prefix + ".cost";
+		cout << endl << "===> BENCHMARK " << res.data.getName() << endl << endl;
+
+		// every data set is simulated and searched with the same seed, independent of the other data sets
+		finish_random();
+		init_random(params.bench_seed);
+		simulateBenchAlignment(res.data, aln_file.c_str());
+		if (res.data.cost)
+			writeBenchCostMatrix(res.data, cost_file.c_str());
+
+		Params run_params = params;
+		run_params.bench_mode = false;
+		run_params.aln_file = (char*)aln_file.c_str();
+		run_params.out_prefix = (char*)prefix.c_str();
+		run_params.sequence_type = benchSequenceType(res.data.type);
+		run_params.intype = IN_PHYLIP;
+		run_params.sankoff_cost_file = res.data.cost ? (char*)cost_file.c_str() : NULL;
+		run_params.user_file = NULL;
+		run_params.ran_seed = params.bench_seed;
+		run_params.gbo_replicates = nboot;
+		run_params.avoid_duplicated_trees = true;
+		run_params.consensus_type = CT_CONSENSUS_TREE;
+		run_params.min_iterations = params.bench_iterations;
+		run_params.stop_condition = SC_FIXED_ITERATION;
+		run_params.checkpoint_resume = false;
+		run_params.checkpoint_dump_interval = 0.0;
+
+		perfReset();
+		double wall_start = getRealTime(), cpu_start = getCPUTime();
+		resetGlobalParamOnNewAln();
+		runPhyloAnalysis(run_params);
+		res.search_wall = getRealTime() - wall_start;
+		res.search_cpu = getCPUTime() - cpu_start;
+		for (int phase = 0; phase < PERF_NUM_PHASES; phase++)
+			res.phase_calls[phase] = perfGetPhase((PerfPhase)phase, res.phase_wall[phase], res.phase_cpu[phase]);
+		for (int event = 0; event < PERF_NUM_EVENTS; event++)
+			res.counts[event] = perfGetCount((PerfEvent)event);
+
+		// the kernels are timed on their own, thus they do not show up in the search counters
+		Params kernel_params = run_params;
+		kernel_params.gbo_replicates = 0;
+		finish_random();
+		init_random(params.bench_seed);
+		string tree_file = prefix + ".treefile";
+		benchmarkKernels(kernel_params, params.bench_repeats, tree_file.c_str(), res);
+	}
+
+	string report = string(params.out_prefix) + ".bench.json";
+	writeBenchReport(params, kernel, nboot, results, report.c_str());
+
+	cout.precision(3);
+	cout << endl << "BENCHMARK RESULTS (Fitch kernel " << kernel << ", seed " << params.bench_seed << ")" << endl;
+	cout << "Data set              Score   newview(nodes/s)  evaluate(calls/s)  SPR(cand/s)  RELL(evals/s)  search(s)" << endl;
+	for (int i = 0; i < results.size(); i++) {
+		BenchResult &res = results[i];
+		cout << setw(20) << left << res.data.getName() << right
+			<< setw(8) << res.search_score
+			<< setw(19) << (uint64_t)benchRate((double)params.bench_repeats * (res.data.ntaxa - 2), res.newview_time)
+			<< setw(19) << (uint64_t)benchRate(params.bench_repeats, res.evaluate_time)
+			<< setw(13) << (uint64_t)benchRate(res.counts[PERF_SPR_CANDIDATES], res.phase_wall[PERF_SPR])
+			<< setw(15) << (uint64_t)benchRate(res.counts[PERF_RELL_EVALS], res.phase_wall[PERF_SAVE_TREE])
+			<< setw(11) << res.search_wall << endl;
+	}
+	cout << endl << "Benchmark results written to " << report << endl;
+}
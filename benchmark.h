@@ -0,0 +1,43 @@
+/*
+ * benchmark.h
+ *
+ *  Benchmark of the parsimony engine on synthetic alignments (-bench), see runBenchmark()
+ */
+
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include "tools.h"
+
+/**
+ * one synthetic data set of the benchmark
+ */
+struct BenchDataSet {
+	string type; // dna, aa or bin
+	bool cost; // TRUE for Sankoff parsimony with a cost matrix
+	int ntaxa;
+	int nsites;
+
+	/** @return name of the data set, e.g. dna_cost_100x2000 */
+	string getName() const;
+};
+
+/**
+ * parse the data sets of the benchmark
+ * @param spec comma-separated list of <type>[+cost][:<taxa>x<sites>] (see Params::bench_data)
+ * @param[out] data_sets the data sets
+ */
+void parseBenchDataSets(const char *spec, vector<BenchDataSet> &data_sets);
+
+/**
+ * Run the benchmark: for every data set of params.bench_data an alignment is simulated along a random tree
+ * with the fixed seed params.bench_seed, then
+ * - newviewParsimonyIterativeFast and evaluateParsimonyIterativeFast are timed params.bench_repeats times on
+ *   a random stepwise addition tree (see pllBenchmarkFitchKernels())
+ * - a UFBoot-MP search of params.bench_iterations iterations is run, reporting the phase timers and event
+ *   counters of perfcounter.h: SPR rounds, RELL of saveCurrentTree, summarizeBootstrap, ...
+ * The results are written into <prefix>.bench.json; runs with the same options are comparable across versions.
+ */
+void runBenchmark(Params &params);
+
+#endif /* BENCHMARK_H_ */
@@ -7,6 +7,7 @@
 
 #include "phylotree.h"
 #include "candidateset.h"
+#include "checkpoint.h"
 
 CandidateSet::CandidateSet(int limit, int max_candidates, Alignment *aln) {
     assert(max_candidates <= limit);
@@ -24,6 +25,28 @@ CandidateSet::CandidateSet() {
 	bestScore = -DBL_MAX;
 }
 
+CandidateSet::CandidateSet(const CandidateSet &other) : multimap<double, CandidateTree>(other),
+		maxCandidates(other.maxCandidates), bestScore(other.bestScore), popSize(other.popSize),
+		parentTrees(other.parentTrees), aln(other.aln), candidateTreeVec(other.candidateTreeVec),
+		candidateVecIndex(other.candidateVecIndex) {
+	rebuildIndex();
+}
+
+CandidateSet &CandidateSet::operator=(const CandidateSet &other) {
+	if (this == &other)
+		return *this;
+	multimap<double, CandidateTree>::operator=(other);
+	maxCandidates = other.maxCandidates;
+	bestScore = other.bestScore;
+	popSize = other.popSize;
+	parentTrees = other.parentTrees;
+	aln = other.aln;
+	candidateTreeVec = other.candidateTreeVec;
+	candidateVecIndex = other.candidateVecIndex;
+	rebuildIndex();
+	return *this;
+}
+
 vector<string> CandidateSet::getEquallyOptimalTrees() {
 	vector<string> res;
 	for (reverse_iterator rit = rbegin(); rit != rend() && rit->second.score == bestScore; rit++) {
@@ -37,11 +60,7 @@ string CandidateSet::getRandCandTree() {
 	if (empty())
 		return "";
 	int id = random_int(min(popSize, (int)size()) );
-	for (reverse_iterator i = rbegin(); i != rend(); i++, id--)
-		if (id == 0)
-			return i->second.tree;
-	assert(0);
-	return "";
+	return rankedTrees[id]->second.tree;
 }
 
 vector<string> CandidateSet::getHighestScoringTrees(int numTree) {
@@ -62,18 +81,11 @@ bool CandidateSet::replaceTree(string tree, double score) {
     candidate.tree = tree;
     candidate.score = score;
     candidate.topology = getTopology(tree);
-    if (treeTopologyExist(candidate.topology)) {
-        topologies[candidate.topology] = score;
-        for (reverse_iterator i = rbegin(); i != rend(); i++) {
-            if (i->second.topology == candidate.topology) {
-                erase( --(i.base()) );
-                break;
-            }
-            insert(CandidateSet::value_type(score, candidate));
-        }
-    } else {
+    TopologyIndex::iterator topo_it = topologies.find(candidate.topology);
+    if (topo_it == topologies.end())
         return false;
-    }
+    eraseCandidate(topo_it->second);
+    insertCandidate(candidate);
     return true;
 }
 
@@ -99,56 +111,96 @@ void CandidateSet::initParentTrees() {
 }
 
 bool CandidateSet::update(string tree, double score) {
+	return update(tree, score, getTopology(tree));
+}
+
+bool CandidateSet::update(const string &tree, double score, const string &topology) {
 	bool newTree;
 	CandidateTree candidate;
 	candidate.tree = tree;
 	candidate.score = score;
-	candidate.topology = getTopology(tree);
+	candidate.topology = topology;
 	if (candidate.score > bestScore)
 		bestScore = candidate.score;
-	if (treeTopologyExist(candidate.topology)) {
+	TopologyIndex::iterator topo_it = topologies.find(candidate.topology);
+	if (topo_it != topologies.end()) {
 	    // if tree topology already exist, we replace the old
 	    // by the new one (with new branch lengths) and update the score
-		if (topologies[candidate.topology] < score) {
-			topologies[candidate.topology] = score;
-			for (CandidateSet::iterator i = begin(); i != end(); i++)
-				if (i->second.topology == candidate.topology) {
-					erase(i);
-					break;
-				}
+		if (topo_it->second->first < score) {
+			eraseCandidate(topo_it->second);
 			// insert tree into candidate set
-			insert(CandidateSet::value_type(score, candidate));
+			insertCandidate(candidate);
 		}
 		newTree = false;
 	} else {
 		newTree = true;
 		if (size() < maxCandidates) {
 			// insert tree into candidate set
-			insert(CandidateSet::value_type(score, candidate));
-			topologies[candidate.topology] = score;
-			candidateTreeVec.push_back(tree); // Diep added
+			insertCandidate(candidate);
+			setCandidateVec(candidateTreeVec.size(), tree); // Diep added
 		} else if (getWorstScore() <= score){
-			// remove the worst-scoring tree
-			topologies.erase(begin()->second.topology);
-
 			// Diep added
-			int n = candidateTreeVec.size();
-			for(int i = 0; i < n; i++)
-				if(candidateTreeVec[i] == begin()->second.tree){
-					candidateTreeVec[i] = tree;
-					break;
-				}
-
-			erase(begin());
+			unordered_map<string, set<int> >::iterator vec_it = candidateVecIndex.find(begin()->second.tree);
+			if (vec_it != candidateVecIndex.end())
+				setCandidateVec(*vec_it->second.begin(), tree);
+
+			// remove the worst-scoring tree
+			eraseCandidate(begin());
 			// insert tree into candidate set
-			insert(CandidateSet::value_type(score, candidate));
-			topologies[candidate.topology] = score;
+			insertCandidate(candidate);
 		}else
 			newTree = false; // Diep added
 	}
 	return newTree;
 }
 
+/* orders rankedTrees by descending scores */
+struct HigherCandidateScore {
+	bool operator()(const CandidateSet::iterator &a, double score) const {
+		return a->first > score;
+	}
+};
+
+CandidateSet::iterator CandidateSet::insertCandidate(const CandidateTree &candidate) {
+	iterator it = insert(CandidateSet::value_type(candidate.score, candidate));
+	// the multimap inserts after trees with equal score, i.e. before them in rankedTrees
+	rankedTrees.insert(std::lower_bound(rankedTrees.begin(), rankedTrees.end(), candidate.score, HigherCandidateScore()), it);
+	topologies[candidate.topology] = it;
+	return it;
+}
+
+void CandidateSet::eraseCandidate(iterator it) {
+	vector<iterator>::iterator rank = std::lower_bound(rankedTrees.begin(), rankedTrees.end(), it->first, HigherCandidateScore());
+	while (*rank != it)
+		rank++;
+	rankedTrees.erase(rank);
+	topologies.erase(it->second.topology);
+	erase(it);
+}
+
+void CandidateSet::rebuildIndex() {
+	topologies.clear();
+	rankedTrees.clear();
+	rankedTrees.reserve(size());
+	for (reverse_iterator rit = rbegin(); rit != rend(); rit++) {
+		rankedTrees.push_back(--(rit.base()));
+		topologies[rit->second.topology] = rankedTrees.back();
+	}
+}
+
+void CandidateSet::setCandidateVec(int id, const string &tree) {
+	if (id == candidateTreeVec.size())
+		candidateTreeVec.push_back(tree);
+	else {
+		unordered_map<string, set<int> >::iterator vec_it = candidateVecIndex.find(candidateTreeVec[id]);
+		vec_it->second.erase(id);
+		if (vec_it->second.empty())
+			candidateVecIndex.erase(vec_it);
+		candidateTreeVec[id] = tree;
+	}
+	candidateVecIndex[tree].insert(id);
+}
+
 vector<double> CandidateSet::getBestScores(int numBestScore) {
 	if (numBestScore == 0)
 		numBestScore = size();
@@ -174,9 +226,19 @@ string CandidateSet::getTopology(string tree) {
 	return ostr.str();
 }
 
+string CandidateSet::getTopology(PhyloTree *tree) {
+	Node *saved_root = tree->root;
+	tree->root = tree->findNodeName(aln->getSeqName(0));
+	ostringstream ostr;
+	tree->printTree(ostr, WT_TAXON_ID | WT_SORT_TAXA);
+	tree->root = saved_root;
+	return ostr.str();
+}
+
 void CandidateSet::clear() {
 	multimap<double, CandidateTree>::clear();
 	topologies.clear();
+	rankedTrees.clear();
 	bestScore = -DBL_MAX;
 }
 
@@ -187,6 +249,7 @@ CandidateSet CandidateSet::getBestCandidateTrees(int numTrees) {
 	for (reverse_iterator rit = rbegin(); rit != rend() && numTrees > 0; rit++, numTrees--) {
 		res.insert(*rit);
 	}
+	res.rebuildIndex();
 	return res;
 }
 
@@ -206,8 +269,9 @@ void CandidateSet::copyToCandidateVec(){
 	if (empty())
 		return;
 	candidateTreeVec.clear();
+	candidateVecIndex.clear();
 	for (reverse_iterator i = rbegin(); i != rend(); i++)
-		candidateTreeVec.push_back(i->second.tree);
+		setCandidateVec(candidateTreeVec.size(), i->second.tree);
 }
 
 string CandidateSet::getRandCandVecTree(){
@@ -220,3 +284,47 @@ string CandidateSet::getRandCandVecTree(){
 	assert(0);
 	return "";
 }
+
+void CandidateSet::saveCheckpoint(Checkpoint &checkpoint) {
+	checkpoint.put("candidate.count", size());
+	checkpoint.put("candidate.best_score", bestScore);
+	int id = 0;
+	for (iterator i = begin(); i != end(); i++, id++) {
+		stringstream key;
+		key << "candidate." << id;
+		checkpoint.put(key.str() + ".score", i->first);
+		checkpoint.put(key.str() + ".tree", i->second.tree);
+		checkpoint.put(key.str() + ".topology", i->second.topology);
+	}
+	checkpoint.put("candidate_vec.count", candidateTreeVec.size());
+	for (id = 0; id < candidateTreeVec.size(); id++) {
+		stringstream key;
+		key << "candidate_vec." << id;
+		checkpoint.put(key.str(), candidateTreeVec[id]);
+	}
+}
+
+void CandidateSet::restoreCheckpoint(Checkpoint &checkpoint) {
+	clear();
+	int count = checkpoint.getInt("candidate.count");
+	for (int id = 0; id < count; id++) {
+		stringstream key;
+		key << "candidate." << id;
+		CandidateTree candidate;
+		candidate.score = checkpoint.getDouble(key.str() + ".score");
+		candidate.tree = checkpoint[key.str() + ".tree"];
+		candidate.topology = checkpoint[key.str() + ".topology"];
+		// trees are saved in ascending order, equal scores thus keep their order in the multimap
+		insert(end(), CandidateSet::value_type(candidate.score, candidate));
+	}
+	rebuildIndex();
+	bestScore = checkpoint.getDouble("candidate.best_score");
+	candidateTreeVec.clear();
+	candidateVecIndex.clear();
+	count = checkpoint.getInt("candidate_vec.count");
+	for (int id = 0; id < count; id++) {
+		stringstream key;
+		key << "candidate_vec." << id;
+		setCandidateVec(id, checkpoint[key.str()]);
+	}
+}
@@ -11,6 +11,9 @@
 #include "alignment.h"
 #include <stack>
 
+class Checkpoint;
+class PhyloTree;
+
 struct CandidateTree {
 	string tree; // with branch length
 	string topology; // tree topology WITHOUT branch lengths and WITH TAXON ID (instead of taxon names) for sorting purpose
@@ -19,11 +22,16 @@ struct CandidateTree {
 
 
 /**
- * Candidate tree set, sorted in ascending order of scores, i.e. the last element is the highest scoring tree
+ * Candidate tree set, sorted in ascending order of scores, i.e. the last element is the highest scoring tree.
+ * Trees should only be added and removed via the member functions, which keep the topology
+ * and score indices below up to date.
  */
 class CandidateSet : public multimap<double, CandidateTree> {
 
 public:
+    /** index from tree topologies to the candidate trees */
+    typedef unordered_map<string, iterator> TopologyIndex;
+
     /**
      * constructor
      */
@@ -31,6 +39,13 @@ public:
 
 	CandidateSet();
 
+	/**
+	 * copy constructor and assignment, the indices are rebuilt for the copied trees
+	 */
+	CandidateSet(const CandidateSet &other);
+
+	CandidateSet &operator=(const CandidateSet &other);
+
     /**
      * return randomly one candidate tree from max_candidate
      */
@@ -64,6 +79,11 @@ public:
      */
     bool update(string tree, double score);
 
+    /**
+     * same as above, with the topology of \a tree already computed by getTopology()
+     */
+    bool update(const string &tree, double score, const string &topology);
+
     /**
      *  print score of max_candidates best trees
      *
@@ -115,7 +135,7 @@ public:
     /** index of tree topologies in set
      *
      */
-    StringDoubleHashMap topologies;
+    TopologyIndex topologies;
 
     /**
      *  Trees used for reproduction
@@ -142,6 +162,12 @@ public:
      */
     string getTopology(string tree);
 
+    /**
+     * same as above for a tree already in memory, without re-reading it from a tree string
+     * @param tree a tree whose leaf IDs are the sequence IDs of aln
+     */
+    string getTopology(PhyloTree *tree);
+
     /**
      *  Empty the candidate set
      */
@@ -167,9 +193,49 @@ public:
      */
     string getRandCandVecTree();
 
+    /**
+     * save all candidate trees with their scores into a checkpoint
+     */
+    void saveCheckpoint(Checkpoint &checkpoint);
+
+    /**
+     * replace the candidate trees by those saved by saveCheckpoint(), keeping their order
+     */
+    void restoreCheckpoint(Checkpoint &checkpoint);
+
 private:
 	vector<string> candidateTreeVec; // Diep added to avoid bias in support values for big group
 
+	/** positions of the tree strings in candidateTreeVec */
+	unordered_map<string, set<int> > candidateVecIndex;
+
+	/**
+	 * the candidate trees in descending order of scores, i.e. reverse order of the multimap,
+	 * to sample the best trees in constant time
+	 */
+	vector<iterator> rankedTrees;
+
+	/**
+	 * insert a tree into the multimap and the indices
+	 * @return the multimap position of the tree
+	 */
+	iterator insertCandidate(const CandidateTree &candidate);
+
+	/**
+	 * remove a tree from the multimap and the indices
+	 */
+	void eraseCandidate(iterator it);
+
+	/**
+	 * recompute topologies and rankedTrees from the multimap
+	 */
+	void rebuildIndex();
+
+	/**
+	 * set candidateTreeVec[id] and update candidateVecIndex
+	 */
+	void setCandidateVec(int id, const string &tree);
+
 };
 
 #endif /* CANDIDATESET_H_ */
@@ -6,6 +6,7 @@
  */
 
 #include "checkpoint.h"
+#include "gzstream.h"
 
 /*
  * The following parameters have been saved for checkpoint in IQPNNI
@@ -59,7 +60,8 @@ void Checkpoint::setFileName(string filename) {
 void Checkpoint::load() {
 	assert(filename != "");
     try {
-        ifstream in;
+        // igzstream also reads uncompressed files
+        igzstream in;
         // set the failbit and badbit
         in.exceptions(ios::failbit | ios::badbit);
         in.open(filename.c_str());
@@ -71,17 +73,19 @@ void Checkpoint::load() {
         in.exceptions(ios::badbit);
         while (!in.eof()) {
         	getline(in, line);
+        	if (line.empty())
+        		continue;
         	size_t pos = line.find(" := ");
         	if (pos == string::npos)
         		throw "':=' is expected between key and value";
-        	(*this)[line.substr(0, pos)] = line.substr(pos+3);
+        	(*this)[line.substr(0, pos)] = line.substr(pos+4);
         }
         in.clear();
         // set the failbit again
         in.exceptions(ios::failbit | ios::badbit);
         in.close();
     } catch (ios::failure &) {
-        outError(ERR_READ_INPUT);
+        outError(ERR_READ_INPUT, filename);
     } catch (const char *str) {
         outError(str);
     } catch (string &str) {
@@ -91,17 +95,21 @@ void Checkpoint::load() {
 
 void Checkpoint::commit() {
 	assert(filename != "");
+	string tmp_filename = filename + ".tmp";
     try {
-        ofstream out;
+        ogzstream out;
         out.exceptions(ios::failbit | ios::badbit);
-        out.open(filename.c_str());
+        out.open(tmp_filename.c_str());
         out << "Checkpoint file for IQ-TREE" << endl;
         for (iterator i = begin(); i != end(); i++)
         	out << i->first << " := " << i->second << endl;
         out.close();
     } catch (ios::failure &) {
-        outError(ERR_WRITE_OUTPUT, filename.c_str());
+        outError(ERR_WRITE_OUTPUT, tmp_filename);
     }
+    // rename() replaces the old checkpoint in one step
+    if (rename(tmp_filename.c_str(), filename.c_str()) != 0)
+        outError(ERR_WRITE_OUTPUT, filename);
 }
 
 bool Checkpoint::containsKey(string key) {
@@ -112,13 +120,6 @@ bool Checkpoint::containsKey(string key) {
  * series of get functions
  */
 
-template<class T>
-void Checkpoint::get(string key, T& value) {
-	assert(containsKey(key));
-	stringstream ss((*this)[key]);
-	ss >> value;
-}
-
 bool Checkpoint::getBool(string key) {
 	assert(containsKey(key));
 	if ((*this)[key] == "1") return true;
@@ -142,28 +143,6 @@ int Checkpoint::getInt(string key) {
 
 }
 
-/**
- * series of put functions
- */
-
-template<class T>
-void Checkpoint::put(string key, T value) {
-	stringstream ss;
-	ss << value;
-	(*this)[key] = ss.str();
-}
-
-template<class T>
-void Checkpoint::putArray(string key, int num, T* value) {
-	stringstream ss;
-	for (int i = 0; i < num; i++) {
-		if (i > 0) ss << ',';
-		ss << value[i];
-	}
-	(*this)[key] = ss.str();
-}
-
-
 Checkpoint::~Checkpoint() {
 }
 
@@ -26,7 +26,9 @@ public:
 	void load();
 
 	/**
-	 * commit checkpoint information into file
+	 * commit checkpoint information into file.
+	 * The file is first written to filename + ".tmp" and then renamed,
+	 * so that a crash while writing never leaves a truncated checkpoint behind
 	 */
 	void commit();
 
@@ -40,7 +42,27 @@ public:
 	 * series of get functions
 	 */
 	template<class T>
-	void get(string key, T& value);
+	void get(string key, T& value) {
+		assert(containsKey(key));
+		stringstream ss((*this)[key]);
+		ss >> value;
+	}
+
+	/**
+	 * get a vector saved by putVector()
+	 */
+	template<class T>
+	void getVector(string key, vector<T> &value) {
+		assert(containsKey(key));
+		value.clear();
+		stringstream ss((*this)[key]);
+		T elem;
+		char sep;
+		while (ss >> elem) {
+			value.push_back(elem);
+			ss >> sep;
+		}
+	}
 
 	bool getBool(string key);
 	char getChar(string key);
@@ -52,10 +74,28 @@ public:
 	 * series of put functions
 	 */
 	template<class T>
-	void put(string key, T value);
+	void put(string key, T value) {
+		stringstream ss;
+		ss.precision(17);
+		ss << value;
+		(*this)[key] = ss.str();
+	}
+
+	template<class T>
+	void putArray(string key, int num, T* value) {
+		stringstream ss;
+		ss.precision(17);
+		for (int i = 0; i < num; i++) {
+			if (i > 0) ss << ',';
+			ss << value[i];
+		}
+		(*this)[key] = ss.str();
+	}
 
 	template<class T>
-	void putArray(string key, int num, T* value);
+	void putVector(string key, vector<T> &value) {
+		putArray(key, value.size(), value.empty() ? (T*)NULL : &value[0]);
+	}
 
 	virtual ~Checkpoint();
 
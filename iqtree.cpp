@@ -31,6 +31,9 @@
 #include "vectorclass/vectorclass.h"
 #include "vectorclass/vectormath_common.h"
 #include "parstree.h"
+#include "checkpoint.h"
+#include "perfcounter.h"
+#include "alignmentweightview.h"
 
 Params *globalParam;
 Alignment *globalAlignment;
@@ -79,6 +82,11 @@ void IQTree::init() {
     reps_segments = -1;
     segment_upper = NULL;
     original_sample = NULL;
+    boot_samples_pars_tiled = NULL;
+    boot_tiled_nunit = 0;
+    walker_weights = NULL;
+    checkpoint = NULL;
+    last_checkpoint_time = 0.0;
 }
 
 IQTree::IQTree(Alignment *aln) : PhyloTree(aln) {
@@ -219,6 +227,10 @@ void IQTree::setParams(Params &params) {
 			// Diep: For parsimony bootstrap
 			boot_samples_pars.resize(params.gbo_replicates);
 			boot_samples_pars_remain_bounds.resize(params.gbo_replicates, NULL);
+			if(boot_samples_pars_tiled){
+				aligned_free(boot_samples_pars_tiled);
+				boot_samples_pars_tiled = NULL;
+			}
 			nunit = getAlnNPattern() + VCSIZE_USHORT;
 
 //			BootValTypePars *mem = aligned_alloc<BootValTypePars>(nunit * (size_t)(params.gbo_replicates));
@@ -376,36 +388,8 @@ void IQTree::initTopologyByPLLRandomAdition(Params &params){
 #endif
 
 	tmpInst = pllCreateInstance (&tmpAttr);      /* Create the PLL instance */
-    /* Read in the aln file */
-    stringstream pllAln;
-	if (aln->isSuperAlignment()) {
-		((SuperAlignment*) aln)->printCombinedAlignment(pllAln);
-	} else {
-		aln->printPhylip(pllAln);
-	}
-	string pllAlnStr = pllAln.str();
-	tmpAlignmentData = pllParsePHYLIPString(pllAlnStr.c_str(), pllAlnStr.length());
-
-    /* Read in the partition information */
-    // BQM: to avoid printing file
-    stringstream pllPartitionFileHandle;
-    createPLLPartition(params, pllPartitionFileHandle);
-    pllQueue *partitionInfo = pllPartitionParseString(pllPartitionFileHandle.str().c_str());
-
-    /* Validate the partitions */
-    if (!pllPartitionsValidate(partitionInfo, tmpAlignmentData)) {
-        outError("pllPartitionsValidate");
-    }
+	createPLLAlignment(params, tmpPartitions, tmpAlignmentData, false);
 
-    /* Commit the partitions and build a partitions structure */
-    tmpPartitions = pllPartitionsCommit(partitionInfo, tmpAlignmentData);
-
-    /* We don't need the the intermediate partition queue structure anymore */
-    pllQueuePartitionsDestroy(&partitionInfo);
-
-    if(params.maximum_parsimony)
-    	pllSortedAlignmentRemoveDups(tmpAlignmentData, tmpPartitions); // to sync IQTree aln and PLL one
-    
     pllTreeInitTopologyForAlignment(tmpInst, tmpAlignmentData);
 
     /* Connect the aln and partition structure with the tree structure */
@@ -414,8 +398,7 @@ void IQTree::initTopologyByPLLRandomAdition(Params &params){
     }
 
     pllComputeRandomizedStepwiseAdditionParsimonyTree(tmpInst, tmpPartitions, 1);
-	pllTreeToNewick(tmpInst->tree_string, tmpInst, tmpPartitions, tmpInst->start->back, PLL_TRUE,
-			PLL_TRUE, 0, 0, 0, PLL_SUMMARIZE_LH, 0, 0);
+	pllTreeToNewickString(tmpInst, tmpPartitions);
 	string treeString = string(tmpInst->tree_string);
 	readTreeString(treeString);
 
@@ -448,9 +431,7 @@ IQTree::~IQTree() {
     for (vector<double*>::reverse_iterator it = treels_ptnlh.rbegin(); it != treels_ptnlh.rend(); it++)
         delete[] (*it);
     treels_ptnlh.clear();
-    for (vector<SplitGraph*>::reverse_iterator it2 = boot_splits.rbegin(); it2 != boot_splits.rend(); it2++)
-        delete (*it2);
-    //if (boot_splits) delete boot_splits;
+    destroyWalkers();
     if (pllPartitions)
     	myPartitionsDestroy(pllPartitions);
     if (pllAlignment)
@@ -473,11 +454,15 @@ IQTree::~IQTree() {
 
     if(segment_upper) delete [] segment_upper;
 
+    if(boot_samples_pars_tiled) aligned_free(boot_samples_pars_tiled);
+
     if(original_sample){
     	aligned_free(original_sample);
     	original_sample = NULL;
     }
 
+    if(checkpoint) delete checkpoint;
+
 #if (defined(__SSE3) || defined(__AVX))
 	if(vectorCostMatrix != NULL){
 		rax_free(vectorCostMatrix);
@@ -487,7 +472,7 @@ IQTree::~IQTree() {
 
 }
 
-void IQTree::createPLLPartition(Params &params, ostream &pllPartitionFileHandle) {
+void IQTree::createPLLPartition(Params &params, ostream &pllPartitionFileHandle, IntVector *part_widths) {
     if (isSuperTree()) {
         PhyloSuperTree *siqtree = (PhyloSuperTree*) this;
         // additional check for stupid PLL hard limit
@@ -497,7 +482,7 @@ void IQTree::createPLLPartition(Params &params, ostream &pllPartitionFileHandle)
         int startPos = 1;
         for (PhyloSuperTree::iterator it = siqtree->begin(); it != siqtree->end(); it++) {
             i++;
-            int curLen = ((*it))->getAlnNSite();
+            int curLen = part_widths ? part_widths->at(i-1) : ((*it))->getAlnNSite();
             if ((*it)->aln->seq_type == SEQ_DNA) {
                 pllPartitionFileHandle << "DNA";
             } else if ((*it)->aln->seq_type == SEQ_PROTEIN) {
@@ -529,53 +514,99 @@ void IQTree::createPLLPartition(Params &params, ostream &pllPartitionFileHandle)
         	model = "WAG";
         	//outError("PLL currently only supports DNA/protein alignments");
         }
-        pllPartitionFileHandle << model << ", p1 = " << "1-" << getAlnNSite() << endl;
+        pllPartitionFileHandle << model << ", p1 = " << "1-" << (part_widths ? part_widths->at(0) : getAlnNSite()) << endl;
     }
 }
 
 extern void initializeCostMatrix();
 
-void IQTree::initializePLL(Params &params) {
-    pllAttr.rateHetModel = PLL_GAMMA;
-    pllAttr.fastScaling = PLL_FALSE;
-    pllAttr.saveMemory = PLL_FALSE;
-    pllAttr.useRecom = PLL_FALSE;
-    pllAttr.randomNumberSeed = params.ran_seed;
-#ifdef _OPENMP
-    pllAttr.numberOfThreads = params.num_threads; /* This only affects the pthreads version */
-#else
-    pllAttr.numberOfThreads = 1;
-#endif
-    if (pllInst != NULL) {
-        pllDestroyInstance(pllInst);
-    }
-
-    /* Create a PLL instance */
-    pllInst = pllCreateInstance(&pllAttr);
+pllAlignmentData *IQTree::buildPLLAlignment(bool merge_dups, IntVector &part_widths) {
+	vector<Alignment*> alns;
+	if (aln->isSuperAlignment())
+		alns = ((SuperAlignment*) aln)->partitions;
+	else
+		alns.push_back(aln);
+	int nseq = aln->getNSeq();
+	int part, seq, site, ptn;
+	for (part = 0; part < alns.size(); part++)
+		if (alns[part]->seq_type == SEQ_CODON)
+			return NULL;
+
+	// characters of the patterns, ptn_chars[part][ptn * nseq + seq], and the pattern of each PLL site
+	vector<vector<unsigned char> > ptn_chars(alns.size());
+	vector<IntVector> site_ptns(alns.size());
+	IntVector site_weights;
+	part_widths.resize(alns.size());
+	for (part = 0; part < alns.size(); part++) {
+		Alignment *part_aln = alns[part];
+		vector<unsigned char> &chars = ptn_chars[part];
+		chars.resize((size_t)part_aln->getNPattern() * nseq);
+		for (ptn = 0; ptn < part_aln->getNPattern(); ptn++)
+			for (seq = 0; seq < nseq; seq++) {
+				int part_seq = (part_aln == aln) ? seq : ((SuperAlignment*) aln)->taxa_index[seq][part];
+				chars[(size_t)ptn * nseq + seq] = (part_seq >= 0) ? part_aln->convertStateBack(part_aln->at(ptn)[part_seq]) : '?';
+			}
+		for (site = 0; site < part_aln->getNSite(); site++) {
+			ptn = part_aln->getPatternID(site);
+			int last = site_ptns[part].empty() ? -1 : site_ptns[part].back();
+			if (merge_dups && last >= 0 && (ptn == last ||
+					memcmp(&chars[(size_t)ptn * nseq], &chars[(size_t)last * nseq], nseq) == 0)) {
+				site_weights.back()++;
+			} else {
+				site_ptns[part].push_back(ptn);
+				site_weights.push_back(1);
+			}
+		}
+		part_widths[part] = site_ptns[part].size();
+	}
 
-    /* Read in the alignment file */
-    stringstream pllAln;
-	if (aln->isSuperAlignment()) {
-		((SuperAlignment*) aln)->printCombinedAlignment(pllAln);
-	} else {
-		aln->printPhylip(pllAln);
+	pllAlignmentData *alignment = pllInitAlignmentData(nseq, site_weights.size());
+	for (seq = 0; seq < nseq; seq++) {
+		string name = aln->getSeqName(seq);
+		alignment->sequenceLabels[seq + 1] = (char *) rax_malloc((name.length() + 1) * sizeof(char));
+		strcpy(alignment->sequenceLabels[seq + 1], name.c_str());
+		unsigned char *row = alignment->sequenceData[seq + 1];
+		for (part = 0; part < alns.size(); part++) {
+			unsigned char *chars = &ptn_chars[part][seq];
+			for (IntVector::iterator it = site_ptns[part].begin(); it != site_ptns[part].end(); it++)
+				*row++ = chars[(size_t)(*it) * nseq];
+		}
 	}
-	string pllAlnStr = pllAln.str();
-    pllAlignment = pllParsePHYLIPString(pllAlnStr.c_str(), pllAlnStr.length());
+	alignment->siteWeights = (int *) rax_malloc(site_weights.size() * sizeof(int));
+	copy(site_weights.begin(), site_weights.end(), alignment->siteWeights);
+	return alignment;
+}
+
+void IQTree::createPLLAlignment(Params &params, partitionList *&partitions, pllAlignmentData *&alignment, bool remove_dups) {
+    IntVector part_widths;
+    alignment = buildPLLAlignment(params.maximum_parsimony, part_widths);
+    bool merged = alignment != NULL && params.maximum_parsimony;
+
+    if (!alignment) {
+        /* Read in the alignment file */
+        stringstream pllAln;
+        if (aln->isSuperAlignment()) {
+            ((SuperAlignment*) aln)->printCombinedAlignment(pllAln);
+        } else {
+            aln->printPhylip(pllAln);
+        }
+        string pllAlnStr = pllAln.str();
+        alignment = pllParsePHYLIPString(pllAlnStr.c_str(), pllAlnStr.length());
+    }
 
     /* Read in the partition information */
     // BQM: to avoid printing file
     stringstream pllPartitionFileHandle;
-    createPLLPartition(params, pllPartitionFileHandle);
+    createPLLPartition(params, pllPartitionFileHandle, merged ? &part_widths : NULL);
     pllQueue *partitionInfo = pllPartitionParseString(pllPartitionFileHandle.str().c_str());
 
     /* Validate the partitions */
-    if (!pllPartitionsValidate(partitionInfo, pllAlignment)) {
+    if (!pllPartitionsValidate(partitionInfo, alignment)) {
         outError("pllPartitionsValidate");
     }
 
     /* Commit the partitions and build a partitions structure */
-    pllPartitions = pllPartitionsCommit(partitionInfo, pllAlignment);
+    partitions = pllPartitionsCommit(partitionInfo, alignment);
 
     /* We don't need the the intermediate partition queue structure anymore */
     pllQueuePartitionsDestroy(&partitionInfo);
@@ -586,17 +617,52 @@ void IQTree::initializePLL(Params &params) {
     // Diep 2021-12-29: 
     //  For maximum parsimony, SYNCING between two cores (IQ-TREE and PLL) must always be guaranteed!!!!!!!!
     //  Especially necessary if having ratchet on.
-    if(params.maximum_parsimony)
-    	pllSortedAlignmentRemoveDups(pllAlignment, pllPartitions); // to sync IQTree aln and PLL one
-    else
-        pllAlignmentRemoveDups(pllAlignment, pllPartitions);
+    if(params.maximum_parsimony) {
+        if (!merged)
+            pllSortedAlignmentRemoveDups(alignment, partitions); // to sync IQTree aln and PLL one
+    } else if (remove_dups)
+        pllAlignmentRemoveDups(alignment, partitions);
+}
+
+void IQTree::createPLLInstance(Params &params, pllInstance *&inst, partitionList *&partitions, pllAlignmentData *&alignment) {
+    /* Create a PLL instance */
+    inst = pllCreateInstance(&pllAttr);
 
-    pllTreeInitTopologyForAlignment(pllInst, pllAlignment);
+    createPLLAlignment(params, partitions, alignment);
+
+    pllTreeInitTopologyForAlignment(inst, alignment);
 
     /* Connect the alignment and partition structure with the tree structure */
-    if (!pllLoadAlignment(pllInst, pllAlignment, pllPartitions)) {
+    if (!pllLoadAlignment(inst, alignment, partitions)) {
         outError("Incompatible tree/alignment combination");
     }
+}
+
+void IQTree::destroyPLLInstance(pllInstance *inst, partitionList *partitions, pllAlignmentData *alignment) {
+    if (partitions)
+    	myPartitionsDestroy(partitions);
+    if (alignment)
+    	pllAlignmentDataDestroy(alignment);
+    if (inst)
+        pllDestroyInstance(inst);
+}
+
+void IQTree::initializePLL(Params &params) {
+    pllAttr.rateHetModel = PLL_GAMMA;
+    pllAttr.fastScaling = PLL_FALSE;
+    pllAttr.saveMemory = PLL_FALSE;
+    pllAttr.useRecom = PLL_FALSE;
+    pllAttr.randomNumberSeed = params.ran_seed;
+#ifdef _OPENMP
+    pllAttr.numberOfThreads = params.num_threads; /* This only affects the pthreads version */
+#else
+    pllAttr.numberOfThreads = 1;
+#endif
+    if (pllInst != NULL) {
+        pllDestroyInstance(pllInst);
+    }
+
+    createPLLInstance(params, pllInst, pllPartitions, pllAlignment);
 
     globalParam = &params;
 
@@ -1127,7 +1193,7 @@ void IQTree::doIQP() {
 double IQTree::inputTree2PLL(string treestring, bool computeLH) {
     double res = 0.0;
     // read in the tree string from IQTree kernel
-    pllNewickTree *newick = pllNewickParseString(treestring.c_str());
+    pllNewickTree *newick = pllParseNewickString(treestring.c_str());
     pllTreeInitTopologyNewick(pllInst, newick, PLL_FALSE);
     pllNewickParseDestroy(&newick);
     if (computeLH) {
@@ -1137,6 +1203,56 @@ double IQTree::inputTree2PLL(string treestring, bool computeLH) {
     return res;
 }
 
+void IQTree::linkPLLSubtree(pllInstance *inst, Node *node, Node *dad, nodeptr parent, int &inner) {
+    nodeptr child = node->isLeaf() ? inst->nodep[node->id + 1] : inst->nodep[inner++];
+    parent->back = child;
+    child->back = parent;
+
+    double len = node->findNeighbor(dad)->length;
+    if (len != len) len = 0.0; // nan
+    double z = exp(-len / inst->fracchange);
+    if (z < PLL_ZMIN) z = PLL_ZMIN;
+    if (z > PLL_ZMAX) z = PLL_ZMAX;
+    for (int j = 0; j < PLL_NUM_BRANCHES; j++)
+        parent->z[j] = child->z[j] = z;
+
+    if (node->isLeaf())
+        return;
+    Node *children[2];
+    int n = 0;
+    FOR_NEIGHBOR_IT(node, dad, it) {
+        assert(n < 2);
+        children[n++] = (*it)->node;
+    }
+    assert(n == 2);
+    // right to left, as the newick parser numbers the inner nodes
+    linkPLLSubtree(inst, children[1], node, child->next->next, inner);
+    linkPLLSubtree(inst, children[0], node, child->next, inner);
+}
+
+void IQTree::initPLLTopology(pllInstance *inst, bool default_branches) {
+    if (rooted) {
+        pllNewickTree *newick = pllParseNewickString(getTreeString().c_str());
+        pllTreeInitTopologyNewick(inst, newick, default_branches ? PLL_TRUE : PLL_FALSE);
+        pllNewickParseDestroy(&newick);
+        return;
+    }
+    assert(inst->nameHash && inst->mxtips == leafNum);
+
+    // the top node of getTreeString(), its children are linked to p->next->next, p->next and p
+    Node *top = root->isLeaf() ? root->neighbors[0]->node : root;
+    assert(top->degree() == 3);
+    int inner = inst->mxtips + 1;
+    nodeptr p = inst->nodep[inner++];
+    linkPLLSubtree(inst, top->neighbors[2]->node, top, p->next->next, inner);
+    linkPLLSubtree(inst, top->neighbors[1]->node, top, p->next, inner);
+    linkPLLSubtree(inst, top->neighbors[0]->node, top, p, inner);
+
+    inst->start = inst->nodep[1];
+    if (default_branches)
+        resetBranches(inst);
+}
+
 double* IQTree::getModelRatesFromPLL() {
     assert(aln->num_states == 4);
     int numberOfRates = (pllPartitions->partitionData[0]->states * pllPartitions->partitionData[0]->states
@@ -1419,6 +1535,7 @@ void IQTree::pllBaseSubstitute (char *seq, int dataType)
 }
 
 double IQTree::swapTaxa(PhyloNode *node1, PhyloNode *node2) {
+    pars_topology.clear();
     assert(node1->isLeaf());
     assert(node2->isLeaf());
 
@@ -1497,10 +1614,7 @@ string IQTree::optimizeModelParameters(bool printInfo) {
 		curScore = pllInst->likelihood;
 		double etime = getCPUTime();
 		cout << etime - stime << " seconds (logl: " << curScore << ")" << endl;
-		pllTreeToNewick(pllInst->tree_string, pllInst, pllPartitions,
-				pllInst->start->back, PLL_TRUE,
-				PLL_TRUE, PLL_FALSE, PLL_FALSE, PLL_FALSE, PLL_SUMMARIZE_LH,
-				PLL_FALSE, PLL_FALSE);
+		pllTreeToNewickString(pllInst, pllPartitions);
 		if (printInfo) {
 			pllPrintModelParams();
 		}
@@ -1551,9 +1665,7 @@ void IQTree::printBestScores(int numBestScore) {
 
 void IQTree::computeLogL() {
 	if (params->pll) {
-        pllNewickTree *newick = pllNewickParseString(getTreeString().c_str());
-        pllTreeInitTopologyNewick(pllInst, newick, PLL_FALSE);
-        pllNewickParseDestroy(&newick);
+        initPLLTopology(pllInst);
         pllEvaluateLikelihood(pllInst, pllPartitions, pllInst->start, PLL_TRUE, PLL_FALSE);
         curScore = pllInst->likelihood;
 	} else {
@@ -1564,14 +1676,11 @@ void IQTree::computeLogL() {
 string IQTree::optimizeBranches(int maxTraversal) {
 	string tree;
     if (params->pll) {
-        pllNewickTree *newick = pllNewickParseString(getTreeString().c_str());
-        pllTreeInitTopologyNewick(pllInst, newick, PLL_FALSE);
-        pllNewickParseDestroy(&newick);
+        initPLLTopology(pllInst);
         pllEvaluateLikelihood(pllInst, pllPartitions, pllInst->start, PLL_TRUE, PLL_FALSE);
         pllOptimizeBranchLengths(pllInst, pllPartitions, maxTraversal);
         curScore = pllInst->likelihood;
-        pllTreeToNewick(pllInst->tree_string, pllInst, pllPartitions, pllInst->start->back, PLL_TRUE, PLL_TRUE, PLL_FALSE, PLL_FALSE, PLL_FALSE,
-                PLL_SUMMARIZE_LH, PLL_FALSE, PLL_FALSE);
+        pllTreeToNewickString(pllInst, pllPartitions);
         tree = string(pllInst->tree_string);
     } else {
     	curScore = optimizeAllBranches(maxTraversal);
@@ -1624,11 +1733,46 @@ double IQTree::doTreeSearch() {
 
 	double cur_correlation = 0.0;
 	int ratchet_iter_count = 0;
+	AlignmentWeightView *ratchet_aln = NULL; // perturbed alignment of the ratchet iterations
+
+	if (params->checkpoint_resume && !params->maximum_parsimony)
+		outWarning("-resume is only supported for maximum parsimony, starting a new tree search");
+	if (params->maximum_parsimony && (params->checkpoint_dump_interval > 0 || params->checkpoint_resume)) {
+		checkpoint = new Checkpoint;
+		checkpoint->setFileName(string(params->out_prefix) + ".ckp.gz");
+		if (params->checkpoint_resume) {
+			checkpoint->load();
+			restoreSearchCheckpoint(ratchet_iter_count, cur_correlation);
+			cout << "Resuming tree search from iteration " << curIt << " (best score: " << -bestScore << ")" << endl;
+			readTreeString(bestTreeString);
+			setRootNode(params->root);
+			bestTopoStream.str("");
+			printTree(bestTopoStream, WT_TAXON_ID + WT_SORT_TAXA);
+			best_tree_topo = bestTopoStream.str();
+			printResultTree();
+		}
+		last_checkpoint_time = getRealTime();
+	}
+
+	// the sectors are climbed without per-site scores (see sectorialSearch in sprparsimony.cpp)
+	if (params->maximum_parsimony && params->sector_size > 0 && params->gbo_replicates > 0)
+		outWarning("With -sector, the trees visited while a sector is hill-climbed are not UFBoot candidates, "
+				"only the whole tree after each sector put back");
+
+	// several walkers per iteration instead of one perturbation and hill-climbing (-walkers)
+	bool use_walkers = canUseWalkers();
+	if (use_walkers)
+		initWalkers();
 
 	/*====================================================
 	 * MAIN LOOP OF THE IQ-TREE ALGORITHM
 	 *====================================================*/
     for ( ; !stop_rule.meetStopCondition(curIt, cur_correlation); curIt++) {
+        // the state at the start of an iteration is all that is needed to resume the search
+        if (checkpoint && params->checkpoint_dump_interval > 0
+        		&& getRealTime() - last_checkpoint_time >= params->checkpoint_dump_interval)
+        	saveSearchCheckpoint(ratchet_iter_count, cur_correlation);
+
         searchinfo.curIter = curIt;
 		if(params->cutoff_percent > 100){
 			// old way of updating logl_cutoff
@@ -1691,18 +1835,23 @@ double IQTree::doTreeSearch() {
          * -------------------------------------------------------------------------*/
 //		long tmp_num_ratchet_trees = treels_logl.size();
 //		long tmp_num_ratchet_bootcands = treels.size();
-        if(params->ratchet_iter >= 0){
+        if(params->ratchet_iter >= 0 && !use_walkers){
         	if(params->ratchet_iter == ratchet_iter_count){
 //				string candidateTree = candidateTrees.getRandCandVecTree(); // Diep: to pick from vector-stored candidates
 				string candidateTree = candidateTrees.getRandCandTree();
 				readTreeString(candidateTree);
 
 				Alignment* perturb_alignment;
-				if (aln->isSuperAlignment())
+				if (aln->isSuperAlignment()) {
 					perturb_alignment = new SuperAlignment;
-				else
-					perturb_alignment = new Alignment;
-				perturb_alignment->createPerturbAlignment(aln, params->ratchet_percent, params->ratchet_wgt, params->sort_alignment);
+					perturb_alignment->createPerturbAlignment(aln, params->ratchet_percent, params->ratchet_wgt, params->sort_alignment);
+				} else {
+					// only the pattern weights change: the view is reused across the ratchet iterations
+					if (!ratchet_aln)
+						ratchet_aln = new AlignmentWeightView(aln);
+					ratchet_aln->setPerturbFreq(params->ratchet_percent, params->ratchet_wgt);
+					perturb_alignment = ratchet_aln;
+				}
 				saved_aln_on_ratchet_iter = aln;
 
 				setAlignment(perturb_alignment);
@@ -1720,8 +1869,8 @@ double IQTree::doTreeSearch() {
     	/*----------------------------------------
     	 * Perturb the tree
     	 *---------------------------------------*/
-		double perturbScore;
-		if(!on_ratchet_hclimb1){
+		double perturbScore = 0.0;
+		if(!on_ratchet_hclimb1 && !use_walkers){
 			if (iqp_assess_quartet == IQP_BOOTSTRAP) {
 				// create bootstrap sample
 				Alignment* bootstrap_alignment;
@@ -1767,12 +1916,11 @@ double IQTree::doTreeSearch() {
 //					pllNewickTree *perturbTree = pllNewickParseString(perturb_tree_string.c_str());
 //					assert(perturbTree != NULL);
 //					pllTreeInitTopologyNewick(pllInst, perturbTree, PLL_FALSE);
-					initializeAllPartialPars();
 					clearAllPartialLH();
 					curScore = perturbScore = -computeParsimony();
 //                    pllNewickParseDestroy(&perturbTree);
 				}else if (params->pll) {
-					pllNewickTree *perturbTree = pllNewickParseString(perturb_tree_string.c_str());
+					pllNewickTree *perturbTree = pllParseNewickString(perturb_tree_string.c_str());
 					assert(perturbTree != NULL);
 					pllTreeInitTopologyNewick(pllInst, perturbTree, PLL_FALSE);
 					pllEvaluateLikelihood(pllInst, pllPartitions, pllInst->start, PLL_TRUE, PLL_FALSE);
@@ -1799,7 +1947,14 @@ double IQTree::doTreeSearch() {
         int nni_count = 0;
         int nni_steps = 0;
 
-		imd_tree = doNNISearch(nni_count, nni_steps);
+		if (on_ratchet_hclimb1)
+			perfStartPhase(PERF_RATCHET);
+		if (use_walkers)
+			imd_tree = doWalkerSearch();
+		else
+			imd_tree = doNNISearch(nni_count, nni_steps);
+		if (on_ratchet_hclimb1)
+			perfStopPhase(PERF_RATCHET);
 
         if (iqp_assess_quartet == IQP_BOOTSTRAP) {
             // restore alignment
@@ -1820,7 +1975,8 @@ double IQTree::doTreeSearch() {
 			ratchet_iter_count = 0;
 
 			// restore alignment
-			delete aln;
+			if (aln != ratchet_aln)
+				delete aln;
 			setAlignment(saved_aln_on_ratchet_iter);
 			on_ratchet_hclimb1 = false;
 
@@ -1885,6 +2041,16 @@ double IQTree::doTreeSearch() {
         }
 
 		if(on_ratchet_hclimb2) on_ratchet_hclimb2 = false;
+
+		// tree fusing with the candidate trees, a fused tree is hill-climbed again
+		if (params->maximum_parsimony && params->snni && params->fuse_iter > 0 && curIt % params->fuse_iter == 0
+				&& fuseCandidateTrees()) {
+			int nni_count = 0;
+			int nni_steps = 0;
+			imd_tree = doNNISearch(nni_count, nni_steps);
+			if (verbose_mode >= VB_MED)
+				cout << "Iteration " << curIt << " / Score after tree fusing: " << -curScore << endl;
+		}
     	/*----------------------------------------
     	 * Update if better tree is found
     	 *---------------------------------------*/
@@ -1962,7 +2128,8 @@ double IQTree::doTreeSearch() {
 
         // check whether the tree can be put into the reference set
         if (params->snni) {
-        	candidateTrees.update(imd_tree, curScore);
+        	// the current tree is imd_tree, its topology is thus printed without re-reading imd_tree
+        	candidateTrees.update(imd_tree, curScore, candidateTrees.getTopology(this));
         	if (verbose_mode >= VB_MED) {
             	printBestScores(candidateTrees.popSize);
         	}
@@ -1982,9 +2149,8 @@ double IQTree::doTreeSearch() {
     	 *---------------------------------------*/
         if ((curIt) % (params->step_iterations / 2) == 0 && params->stop_condition == SC_BOOTSTRAP_CORRELATION) {
         	// compute split support every half step
-            SplitGraph *sg = new SplitGraph;
-            summarizeBootstrap(*sg);
-            boot_splits.push_back(sg);
+            updateBootSplitWeights();
+            boot_splits.push_back(boot_split_weights);
             if (params->max_candidate_trees == 0)
                 max_candidate_trees = treels_logl.size() * (curIt + (params->step_iterations / 2)) / curIt;
             string cutoff_name = params->maximum_parsimony ? "candidate-score-cutoff" : "logl-cutoff";
@@ -2008,6 +2174,13 @@ double IQTree::doTreeSearch() {
         } // end of bootstrap convergence test
     }
 
+    if (use_walkers)
+    	destroyWalkers();
+
+    // a resumed run that was killed after this point does not repeat the search
+    if (checkpoint && params->checkpoint_dump_interval > 0)
+    	saveSearchCheckpoint(ratchet_iter_count, cur_correlation);
+
 	// Diep: optimize bootstrap trees if -opt_btree is specified along with -bb -mpars
 	if(params->gbo_replicates && params->maximum_parsimony){
 		if(params->optimize_boot_trees){
@@ -2023,6 +2196,16 @@ double IQTree::doTreeSearch() {
     	cout << "NOTE: At the end, " << treels_logl.size() << " bootstrap candidate trees evaluated." << endl;
     }
 
+    if(params->maximum_parsimony && params->spr_parsimony && params->spr_bound){
+    	unsigned long bound_candidates, bound_cuts;
+    	double bound_cut_fraction;
+    	pllGetSprBoundStats(bound_candidates, bound_cuts, bound_cut_fraction);
+    	if(bound_candidates > 0)
+    		cout << "NOTE: Bounded SPR scoring stopped " << bound_cuts << " of " << bound_candidates
+    			<< " regraft candidates early (" << (int) round(100.0 * bound_cuts / bound_candidates)
+    			<< "%), after " << (int) round(100.0 * bound_cut_fraction) << "% of the patterns on average" << endl;
+    }
+
     readTreeString(bestTreeString);
 
     if (testNNI)
@@ -2034,6 +2217,9 @@ double IQTree::doTreeSearch() {
         out_sitelh.close();
     }
 
+    if (ratchet_aln)
+        delete ratchet_aln;
+
     // DTH: pllUFBoot deallocation
     if(params->pll & !params->maximum_parsimony) {
         pllDestroyUFBootData();
@@ -2063,6 +2249,196 @@ double IQTree::doTreeSearch() {
     return bestScore;
 }
 
+void IQTree::saveSearchCheckpoint(int ratchet_iter_count, double cur_correlation) {
+	Checkpoint &ckp = *checkpoint;
+	size_t i;
+	ckp.clear();
+
+	// to detect a checkpoint of another analysis
+	ckp.put("ran_seed", params->ran_seed);
+	ckp.put("ntaxa", aln->getNSeq());
+	ckp.put("npatterns", aln->getNPattern());
+	ckp.put("gbo_replicates", params->gbo_replicates);
+
+	ckp.put("search.cur_it", curIt);
+	ckp.put("search.ratchet_iter_count", ratchet_iter_count);
+	ckp.put("search.cur_correlation", cur_correlation);
+	ckp.put("search.cur_per_strength", searchinfo.curPerStrength);
+	ckp.put("search.best_score", bestScore);
+	ckp.put("search.best_tree", bestTreeString);
+	ckp.put("search.logl_cutoff", logl_cutoff);
+	ckp.put("search.max_candidate_trees", max_candidate_trees);
+	ckp.put("search.duplication_counter", duplication_counter);
+	ckp.put("random_state", get_random_state());
+	if (pllInst)
+		ckp.put("pll_random_seed", pllInst->randomNumberSeed);
+	stop_rule.saveCheckpoint(ckp);
+	candidateTrees.saveCheckpoint(ckp);
+
+	/* bootstrap candidate trees */
+	ckp.putVector("treels_logl", treels_logl);
+	ckp.put("treels.count", treels.size());
+	i = 0;
+	for (StringIntMap::iterator it = treels.begin(); it != treels.end(); it++, i++) {
+		stringstream key;
+		key << "treels." << i;
+		ckp.put(key.str() + ".index", it->second);
+		ckp.put(key.str() + ".tree", it->first);
+	}
+	ckp.put("treels_newick.count", treels_newick.size());
+	for (i = 0; i < treels_newick.size(); i++) {
+		stringstream key;
+		key << "treels_newick." << i;
+		ckp.put(key.str(), treels_newick[i]);
+	}
+
+	/* bootstrap trees */
+	ckp.putVector("boot_logl", boot_logl);
+	ckp.putVector("boot_trees", boot_trees);
+	ckp.putVector("boot_counts", boot_counts);
+	ckp.putVector("boot_tree_orig_logl", boot_tree_orig_logl);
+	ckp.putVector("boot_threshold", boot_threshold);
+	for (i = 0; i < boot_trees_parsimony.size(); i++) {
+		stringstream key;
+		key << "boot_trees_parsimony." << i;
+		IntVector trees(boot_trees_parsimony[i].begin(), boot_trees_parsimony[i].end());
+		ckp.putVector(key.str(), trees);
+	}
+	for (i = 0; i < boot_trees_parsimony_top.size(); i++) {
+		stringstream key;
+		key << "boot_trees_parsimony_top." << i;
+		IntVector trees, scores;
+		for (IntPairVector::iterator it = boot_trees_parsimony_top[i].begin(); it != boot_trees_parsimony_top[i].end(); it++) {
+			trees.push_back(it->first);
+			scores.push_back(it->second);
+		}
+		ckp.putVector(key.str() + ".trees", trees);
+		ckp.putVector(key.str() + ".scores", scores);
+	}
+	for (i = 0; i < boot_trees_parsimony_top_iter.size(); i++) {
+		stringstream key;
+		key << "boot_trees_parsimony_top_iter." << i;
+		ckp.putVector(key.str(), boot_trees_parsimony_top_iter[i]);
+	}
+
+	/* split table (bit-words of each split ID) and split supports of the convergence test */
+	ckp.put("boot_split_table.count", boot_split_table.size());
+	for (i = 0; i < boot_split_table.size(); i++) {
+		stringstream key;
+		key << "boot_split_table." << i;
+		ckp.putVector(key.str(), *boot_split_table[i]);
+	}
+	ckp.put("boot_splits.count", boot_splits.size());
+	for (i = 0; i < boot_splits.size(); i++) {
+		stringstream key;
+		key << "boot_splits." << i;
+		ckp.putVector(key.str(), boot_splits[i]);
+	}
+
+	ckp.commit();
+	last_checkpoint_time = getRealTime();
+	if (verbose_mode >= VB_MED)
+		cout << "Checkpoint written to " << ckp.filename << " at iteration " << curIt << endl;
+}
+
+void IQTree::restoreSearchCheckpoint(int &ratchet_iter_count, double &cur_correlation) {
+	Checkpoint &ckp = *checkpoint;
+	size_t i;
+
+	if (!ckp.containsKey("search.cur_it"))
+		outError("Checkpoint file does not contain a tree search: ", ckp.filename);
+	if (ckp.getInt("ntaxa") != aln->getNSeq() || ckp.getInt("npatterns") != aln->getNPattern()
+			|| ckp.getInt("gbo_replicates") != params->gbo_replicates)
+		outError("Checkpoint file was written for another alignment or different options: ", ckp.filename);
+
+	curIt = ckp.getInt("search.cur_it");
+	ratchet_iter_count = ckp.getInt("search.ratchet_iter_count");
+	cur_correlation = ckp.getDouble("search.cur_correlation");
+	ckp.get("search.cur_per_strength", searchinfo.curPerStrength);
+	bestScore = ckp.getDouble("search.best_score");
+	bestTreeString = ckp["search.best_tree"];
+	logl_cutoff = ckp.getDouble("search.logl_cutoff");
+	max_candidate_trees = ckp.getInt("search.max_candidate_trees");
+	duplication_counter = ckp.getInt("search.duplication_counter");
+	set_random_state(ckp["random_state"]);
+	if (pllInst && ckp.containsKey("pll_random_seed"))
+		ckp.get("pll_random_seed", pllInst->randomNumberSeed);
+	stop_rule.restoreCheckpoint(ckp);
+	candidateTrees.restoreCheckpoint(ckp);
+
+	/* bootstrap candidate trees */
+	ckp.getVector("treels_logl", treels_logl);
+	treels.clear();
+	int count = ckp.getInt("treels.count");
+	for (i = 0; i < count; i++) {
+		stringstream key;
+		key << "treels." << i;
+		treels[ckp[key.str() + ".tree"]] = ckp.getInt(key.str() + ".index");
+	}
+	treels_newick.clear();
+	count = ckp.getInt("treels_newick.count");
+	for (i = 0; i < count; i++) {
+		stringstream key;
+		key << "treels_newick." << i;
+		treels_newick.push_back(ckp[key.str()]);
+	}
+
+	/* bootstrap trees */
+	ckp.getVector("boot_logl", boot_logl);
+	ckp.getVector("boot_trees", boot_trees);
+	ckp.getVector("boot_counts", boot_counts);
+	ckp.getVector("boot_tree_orig_logl", boot_tree_orig_logl);
+	ckp.getVector("boot_threshold", boot_threshold);
+	for (i = 0; i < boot_trees_parsimony.size(); i++) {
+		stringstream key;
+		key << "boot_trees_parsimony." << i;
+		IntVector trees;
+		ckp.getVector(key.str(), trees);
+		boot_trees_parsimony[i] = IntegerSet(trees.begin(), trees.end());
+	}
+	for (i = 0; i < boot_trees_parsimony_top.size(); i++) {
+		stringstream key;
+		key << "boot_trees_parsimony_top." << i;
+		IntVector trees, scores;
+		ckp.getVector(key.str() + ".trees", trees);
+		ckp.getVector(key.str() + ".scores", scores);
+		boot_trees_parsimony_top[i].clear();
+		for (int j = 0; j < trees.size(); j++)
+			boot_trees_parsimony_top[i].push_back(std::make_pair(trees[j], scores[j]));
+	}
+	for (i = 0; i < boot_trees_parsimony_top_iter.size(); i++) {
+		stringstream key;
+		key << "boot_trees_parsimony_top_iter." << i;
+		ckp.getVector(key.str(), boot_trees_parsimony_top_iter[i]);
+	}
+
+	/* split table and split supports of the convergence test; split weights of the
+	   current bootstrap trees are rebuilt from treels at the next update */
+	boot_split_table.freeMem();
+	boot_splits_map = SplitIntMap();
+	treels_splits.clear();
+	boot_split_contrib.clear();
+	count = ckp.getInt("boot_split_table.count");
+	for (i = 0; i < count; i++) {
+		stringstream key;
+		key << "boot_split_table." << i;
+		Split *sp = new Split(leafNum);
+		ckp.getVector(key.str(), *sp);
+		boot_split_table.push_back(sp);
+		boot_splits_map.insertSplit(sp, i);
+	}
+	boot_split_weights.assign(boot_split_table.size(), 0);
+	boot_splits.clear();
+	count = ckp.getInt("boot_splits.count");
+	for (i = 0; i < count; i++) {
+		stringstream key;
+		key << "boot_splits." << i;
+		IntVector supports;
+		ckp.getVector(key.str(), supports);
+		boot_splits.push_back(supports);
+	}
+}
+
 /****************************************************************************
  Fast Nearest Neighbor Interchange by maximum likelihood
  ****************************************************************************/
@@ -2070,6 +2446,8 @@ string IQTree::doNNISearch(int& nniCount, int& nniSteps) {
 	string treeString;
 	if(params->maximum_parsimony && params->spr_parsimony && (params->snni || params->pll)){ // SPR for mpars
 		if(on_opt_btree){
+			if (pllInst && pllPartitions)
+				_pllFreeParsimonyDataStructures(pllInst, pllPartitions); // e.g. kept from the ratchet iterations
 			if (pllPartitions){
 				myPartitionsDestroy(pllPartitions);
 				pllPartitions = NULL;
@@ -2089,10 +2467,7 @@ string IQTree::doNNISearch(int& nniCount, int& nniSteps) {
 			aln->updateSitePatternAfterOptimized();
 
 			initializePLL(*params); // because the set of patterns might be a subset of the orig
-			pllNewickTree *btree = pllNewickParseString(getTreeString().c_str());
-			assert(btree != NULL);
-			pllTreeInitTopologyNewick(pllInst, btree, PLL_FALSE);
-            pllNewickParseDestroy(&btree);
+			initPLLTopology(pllInst);
 
             // update segmenting information
             if(params->sankoff_cost_file){
@@ -2107,6 +2482,7 @@ string IQTree::doNNISearch(int& nniCount, int& nniSteps) {
 			curScore = optimizeNNI(nniCount, nniSteps);
 			treeString = getTreeString();
 		}else{
+			// only printed to check that PLL returns a different tree string, PLL gets the tree by initPLLTopology
 			string treeString1 = getTreeString();
 			size_t index = 0;
 			while (true) {
@@ -2124,28 +2500,21 @@ string IQTree::doNNISearch(int& nniCount, int& nniSteps) {
 			int max_spr_rad = params->spr_maxtrav;
 			if(on_opt_btree && params->opt_btree_nni) params->spr_maxtrav = 1;
 
-			pllNewickTree *sprStartTree = pllNewickParseString(treeString1.c_str());
-			assert(sprStartTree != NULL);
-			pllTreeInitTopologyNewick(pllInst, sprStartTree, PLL_FALSE);
+			initPLLTopology(pllInst);
 
             // ----------------- Key step: ask PLL to run SPR hill-climbing
 			pllOptimizeSprParsimony(pllInst, pllPartitions, params->spr_mintrav, max_spr_rad, this);
 
-			pllNewickParseDestroy(&sprStartTree);
-
-			pllTreeToNewick(pllInst->tree_string, pllInst, pllPartitions, pllInst->start->back, PLL_TRUE,
-					PLL_TRUE, 0, 0, 0, PLL_SUMMARIZE_LH, 0, 0);
+			pllTreeToNewickString(pllInst, pllPartitions);
 			treeString = string(pllInst->tree_string);
 			if(treeString == treeString1) outError("Tree string stays the same after SPR.");
 			readTreeString(treeString);
-			initializeAllPartialPars();
 			clearAllPartialLH();
 			curScore = -computeParsimony();
 
-			// deallocation will occur once at the end of runTreeReconstruction() if not running ratchet
-			// oct 23: in non-ratchet iteration, free is not triggered
-			if((((params->ratchet_iter >= 0 && (!on_ratchet_hclimb2)) || on_opt_btree)
-				&& (!params->hclimb1_nni))){
+			// deallocation will occur once at the end of runTreeReconstruction(),
+			// the ratchet iterations only reweight the patterns (see _reweightParsimonyDataStructures)
+			if(on_opt_btree && (!params->hclimb1_nni)){
 //			if(((params->ratchet_iter >= 0) && (!params->hclimb1_nni))){
 				_pllFreeParsimonyDataStructures(pllInst, pllPartitions);
 			}
@@ -2155,8 +2524,7 @@ string IQTree::doNNISearch(int& nniCount, int& nniSteps) {
     	if (params->partition_file)
     		outError("Unsupported -pll -sp combination!");
         curScore = pllOptimizeNNI(nniCount, nniSteps, searchinfo);
-        pllTreeToNewick(pllInst->tree_string, pllInst, pllPartitions, pllInst->start->back, PLL_TRUE,
-                PLL_TRUE, 0, 0, 0, PLL_SUMMARIZE_LH, 0, 0);
+        pllTreeToNewickString(pllInst, pllPartitions);
         treeString = string(pllInst->tree_string);
         readTreeString(treeString);
     } else {
@@ -2472,7 +2840,556 @@ void IQTree::pllDestroyUFBootData(){
 }
 
 
+bool IQTree::canRefineBootTreesParallel() {
+	return params->maximum_parsimony && params->spr_parsimony && (params->snni || params->pll)
+			&& !params->sankoff_cost_file && pllInst != NULL;
+}
+
+void IQTree::refineBootTreesParallel(IntVector &samples, StrVector &start_trees, bool taxon_ids,
+		IntVector &scores, StrVector &trees) {
+	int njobs = samples.size();
+	scores.resize(njobs);
+	trees.resize(njobs);
+	if (njobs == 0)
+		return;
+	int nthreads = 1;
+#ifdef _OPENMP
+	nthreads = max(1, min(omp_get_max_threads(), njobs));
+#endif
+	int maxtrav = params->opt_btree_nni ? 1 : params->spr_maxtrav;
+	assert(pllInst->originalCrunchedLength == getAlnNPattern());
+
+	map<string, int> taxon_id;
+	for (int seq = 0; seq < aln->getNSeq(); seq++)
+		taxon_id[aln->getSeqName(seq)] = seq;
+
+	// PLL parsers are not thread-safe, thus create all instances beforehand
+	vector<pllInstance*> insts(nthreads);
+	vector<partitionList*> partitions(nthreads);
+	vector<pllAlignmentData*> alignments(nthreads);
+	for (int i = 0; i < nthreads; i++)
+		createPLLInstance(*params, insts[i], partitions[i], alignments[i]);
+
+	int ndone = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+#endif
+	for (int job = 0; job < njobs; job++) {
+		int id = 0;
+#ifdef _OPENMP
+		id = omp_get_thread_num();
+#endif
+		pllInstance *inst = insts[id];
+		string newick = start_trees[job];
+		if (taxon_ids) {
+			// change the taxa name from ID to real name
+			MTree tree;
+			stringstream in(newick);
+			bool myrooted = rooted;
+			tree.readTree(in, myrooted);
+			NodeVector taxa;
+			tree.getTaxa(taxa);
+			for (NodeVector::iterator it = taxa.begin(); it != taxa.end(); it++)
+				(*it)->name = aln->getSeqName(atoi((*it)->name.c_str()));
+			stringstream out;
+			tree.printTree(out);
+			newick = out.str();
+		}
+#ifdef _OPENMP
+#pragma omp critical(pll_newick_parser)
+#endif
+		{
+			pllNewickTree *start_tree = pllParseNewickString(newick.c_str());
+			assert(start_tree != NULL);
+			pllTreeInitTopologyNewick(inst, start_tree, PLL_FALSE);
+			pllNewickParseDestroy(&start_tree);
+		}
+		// ties only depend on the job, not on the thread running it
+		inst->randomNumberSeed = params->ran_seed + (job + 1) * 23456;
+		scores[job] = pllOptimizeSprParsimonyReweighted(inst, partitions[id], boot_samples_pars[samples[job]],
+				params->spr_mintrav, maxtrav);
+
+		pllTreeToNewickString(inst, partitions[id]);
+		MTree tree;
+		stringstream in(inst->tree_string);
+		bool myrooted = rooted;
+		tree.readTree(in, myrooted);
+		NodeVector taxa;
+		tree.getTaxa(taxa);
+		for (NodeVector::iterator it = taxa.begin(); it != taxa.end(); it++)
+			(*it)->id = taxon_id.find((*it)->name)->second;
+		ostringstream out;
+		tree.printTree(out, WT_TAXON_ID | WT_SORT_TAXA);
+		trees[job] = out.str();
+
+#ifdef _OPENMP
+#pragma omp critical(boot_refine_progress)
+#endif
+		{
+			ndone++;
+			if (ndone % 100 == 0)
+				cout << ndone << " bootstrap trees refined" << endl;
+		}
+	}
+
+	for (int i = 0; i < nthreads; i++) {
+		_pllFreeParsimonyDataStructures(insts[i], partitions[i]); // kept by pllOptimizeSprParsimonyReweighted
+		destroyPLLInstance(insts[i], partitions[i], alignments[i]);
+	}
+}
+
+int IQTree::findOrAddTreels(string &tree, double cur_score) {
+	StringIntMap::iterator mit = treels.find(tree);
+	if (mit != treels.end())
+		return mit->second;
+	treels_logl.push_back(cur_score); // TEMPORARILY
+	int tree_index = treels_logl.size() - 1;
+	treels[tree] = tree_index;
+	return tree_index;
+}
+
+bool IQTree::canUseWalkers() {
+	if (params->num_walkers <= 1)
+		return false;
+	if (!canRefineBootTreesParallel() || !params->snni || params->iqp || aln->isSuperAlignment()) {
+		outWarning("-walkers is only supported for the MP tree search with parsimony SPR, running one walker");
+		return false;
+	}
+	if (params->multiple_hits || params->distinct_iter_top_boot >= 1 || params->store_top_boot_trees
+			|| params->auto_vectorize || params->save_trees_off || params->ibest_as_cand || params->hclimb1_nni
+			|| params->store_candidate_trees || params->count_trees
+			|| print_tree_lh || write_intermediate_trees || save_all_br_lens) {
+		outWarning("-walkers only supports the default UFBoot-MP options, running one walker");
+		return false;
+	}
+	return true;
+}
+
+void IQTree::initWalkers() {
+	int nwalkers = params->num_walkers;
+	int nptn = getAlnNPattern();
+	assert(pllInst->originalCrunchedLength == nptn);
+
+	walker_insts.resize(nwalkers);
+	walker_partitions.resize(nwalkers);
+	walker_alignments.resize(nwalkers);
+	walker_pattern_pars.resize(nwalkers);
+	for (int w = 0; w < nwalkers; w++) {
+		createPLLInstance(*params, walker_insts[w], walker_partitions[w], walker_alignments[w]);
+		walker_pattern_pars[w] = aligned_alloc<BootValTypePars>(nptn + VCSIZE_USHORT);
+		memset(walker_pattern_pars[w], 0, sizeof(BootValTypePars) * (nptn + VCSIZE_USHORT));
+	}
+
+	walker_weights = aligned_alloc<BootValTypePars>(nptn + VCSIZE_USHORT);
+	memset(walker_weights, 0, sizeof(BootValTypePars) * (nptn + VCSIZE_USHORT));
+	for (int ptn = 0; ptn < nptn; ptn++)
+		walker_weights[ptn] = aln->at(ptn).frequency;
+
+	if (!boot_samples_pars.empty()) {
+		// built lazily by the serial search, but the walkers share them
+		if (!boot_samples_pars_tiled)
+			buildTiledBootSamplesPars();
+		if (reps_segments > 1 && boot_samples_pars_remain_bounds[0] == NULL) {
+			int nunit = params->sort_alignment ? aln->n_informative_patterns : nptn;
+			pllComputeRellRemainBound(params->do_first_rell ? nunit / 2 : nunit);
+		}
+	}
+
+#ifdef _OPENMP
+	for (int i = 0; i < WALKER_BOOT_LOCKS; i++)
+		omp_init_lock(&walker_boot_locks[i]);
+#endif
+	cout << "Running " << nwalkers << " UFBoot-MP walkers per iteration" << endl;
+}
+
+void IQTree::destroyWalkers() {
+	if (walker_insts.empty())
+		return;
+	for (int w = 0; w < walker_insts.size(); w++) {
+		_pllFreeParsimonyDataStructures(walker_insts[w], walker_partitions[w]); // kept by pllOptimizeSprParsimonyWalker
+		destroyPLLInstance(walker_insts[w], walker_partitions[w], walker_alignments[w]);
+		aligned_free(walker_pattern_pars[w]);
+	}
+	walker_insts.clear();
+	walker_partitions.clear();
+	walker_alignments.clear();
+	walker_pattern_pars.clear();
+	aligned_free(walker_weights);
+	walker_weights = NULL;
+#ifdef _OPENMP
+	for (int i = 0; i < WALKER_BOOT_LOCKS; i++)
+		omp_destroy_lock(&walker_boot_locks[i]);
+#endif
+}
+
+string IQTree::doWalkerSearch() {
+	int nwalkers = params->num_walkers;
+	int nptn = getAlnNPattern();
+	int numNNI = floor(searchinfo.curPerStrength * (aln->getNSeq() - 3));
+	vector<BootValTypePars*> ratchet_weights(nwalkers, NULL);
+
+	// the start trees and ratchet weights are drawn one walker after the other, so that they only depend
+	// on the random seed; the candidate trees are thus perturbed in the IQ-TREE structure as in doTreeSearch
+	for (int w = 0; w < nwalkers; w++) {
+		int job = (curIt - 1) * nwalkers + w;
+		bool ratchet = params->ratchet_iter >= 0 && (job + 1) % (params->ratchet_iter + 1) == 0;
+		readTreeString(candidateTrees.getRandCandTree());
+		if (ratchet) {
+			BootValTypePars *weights = aligned_alloc<BootValTypePars>(nptn + VCSIZE_USHORT);
+			memcpy(weights, walker_weights, sizeof(BootValTypePars) * (nptn + VCSIZE_USHORT));
+			// upweight informative sites as Alignment::createPerturbAlignment
+			int ratchet_nsite = aln->n_informative_sites * params->ratchet_percent / 100;
+			int nsite = aln->getNSite();
+			vector<bool> selected_sites(nsite, false);
+			for (int s = 0; s < ratchet_nsite; s++) {
+				int site_id;
+				do {
+					site_id = random_int(nsite);
+				} while (aln->at(aln->getPatternID(site_id)).ras_pars_score == 0 || selected_sites[site_id]);
+				selected_sites[site_id] = true;
+				weights[aln->getPatternID(site_id)] += params->ratchet_wgt;
+			}
+			ratchet_weights[w] = weights;
+		} else
+			doRandomNNIs(numNNI);
+		setRootNode(params->root);
+		initPLLTopology(walker_insts[w]);
+		// ties only depend on the walker, not on the thread running it
+		walker_insts[w]->randomNumberSeed = params->ran_seed + (job + 1) * 45678;
+	}
+
+	int nthreads = 1;
+#ifdef _OPENMP
+	nthreads = max(1, min(omp_get_max_threads(), nwalkers));
+#endif
+	IntVector scores(nwalkers);
+	StrVector trees(nwalkers);
+	perfStartPhase(PERF_SPR);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+#endif
+	for (int w = 0; w < nwalkers; w++) {
+		pllInstance *inst = walker_insts[w];
+		if (ratchet_weights[w])
+			pllOptimizeSprParsimonyReweighted(inst, walker_partitions[w], ratchet_weights[w],
+					params->spr_mintrav, params->spr_maxtrav);
+		scores[w] = pllOptimizeSprParsimonyWalker(inst, walker_partitions[w], walker_weights,
+				params->spr_mintrav, params->spr_maxtrav, this);
+		pllTreeToNewickString(inst, walker_partitions[w]);
+		trees[w] = string(inst->tree_string);
+	}
+	perfStopPhase(PERF_SPR);
+
+	int best = 0;
+	for (int w = 0; w < nwalkers; w++) {
+		if (ratchet_weights[w])
+			aligned_free(ratchet_weights[w]);
+		if (scores[w] < scores[best])
+			best = w;
+	}
+	// the best tree is offered to the candidate set by doTreeSearch
+	for (int w = 0; w < nwalkers; w++) {
+		if (w == best)
+			continue;
+		readTreeString(trees[w]);
+		candidateTrees.update(trees[w], -scores[w], candidateTrees.getTopology(this));
+	}
+	readTreeString(trees[best]);
+	clearAllPartialLH();
+	curScore = -computeParsimony();
+	return trees[best];
+}
+
+/** a clade of a tree rooted at a leaf, see collectFuseClades() */
+struct FuseClade {
+	uint64_t taxa; // fingerprint of the taxon set
+	uint64_t topology; // fingerprint of the rooted topology
+	int size; // # of taxa
+	Node *node; // the clade is the subtree at node seen from dad
+	Node *dad;
+};
+
+/* 64-bit mixing function of the clade fingerprints (splitmix64 finalizer) */
+static inline uint64_t mixFuseFingerprint(uint64_t x) {
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+/**
+ * post-order: add the clades of the subtree at node with at least 3 taxa to clades
+ * @param[out] taxa, topology, size of the subtree at node
+ */
+static void collectFuseClades(Node *node, Node *dad, vector<FuseClade> &clades, uint64_t &taxa, uint64_t &topology, int &size) {
+	if (node->isLeaf()) {
+		taxa = topology = mixFuseFingerprint(node->id + 1);
+		size = 1;
+		return;
+	}
+	taxa = topology = 0;
+	size = 0;
+	FOR_NEIGHBOR_IT(node, dad, it) {
+		uint64_t child_taxa, child_topology;
+		int child_size;
+		collectFuseClades((*it)->node, node, clades, child_taxa, child_topology, child_size);
+		taxa ^= child_taxa;
+		topology += child_topology; // independent of the order of the children
+		size += child_size;
+	}
+	topology = mixFuseFingerprint(topology ^ 0x9e3779b97f4a7c15ULL);
+	if (size >= 3) {
+		FuseClade clade = {taxa, topology, size, node, dad};
+		clades.push_back(clade);
+	}
+}
+
+/* Newick of the subtree at node seen from dad with taxon names, the subtree at clade is replaced by clade_newick */
+static void printFuseSubtree(ostream &out, Node *node, Node *dad, Node *clade, const string &clade_newick) {
+	if (node == clade) {
+		out << clade_newick;
+		return;
+	}
+	if (node->isLeaf() && dad) {
+		out << node->name;
+		return;
+	}
+	bool first = true;
+	out << "(";
+	if (!dad) {
+		// the root leaf, unrooted at its neighbor
+		out << node->name;
+		first = false;
+		dad = node;
+		node = node->neighbors[0]->node;
+	}
+	FOR_NEIGHBOR_IT(node, dad, it) {
+		if (!first)
+			out << ",";
+		printFuseSubtree(out, (*it)->node, node, clade, clade_newick);
+		first = false;
+	}
+	out << ")";
+}
+
+bool IQTree::fuseCandidateTrees() {
+	string cur_tree = getTreeString();
+	vector<string> donors;
+	{
+		string cur_topo = candidateTrees.getTopology(this);
+		int cnt = 0;
+		for (CandidateSet::reverse_iterator rit = candidateTrees.rbegin(); rit != candidateTrees.rend() && cnt < candidateTrees.popSize; rit++, cnt++)
+			if (rit->second.topology != cur_topo)
+				donors.push_back(rit->second.tree);
+	}
+	if (donors.empty())
+		return false;
+
+	int cur_pars = -(int)round(curScore);
+	bool improved = false;
+	size_t block_size = getFlatParsBlockSize();
+	vector<FuseClade> clades;
+	uint64_t taxa, topology;
+	int size;
+
+	for (vector<string>::iterator donor = donors.begin(); donor != donors.end(); donor++) {
+		bool donor_improved;
+		do {
+			donor_improved = false;
+
+			// clades of the current tree
+			readTreeString(cur_tree);
+			setRootNode(params->root);
+			clades.clear();
+			collectFuseClades(root->neighbors[0]->node, root, clades, taxa, topology, size);
+			unordered_map<uint64_t, uint64_t> cur_clades; // taxa -> topology
+			for (vector<FuseClade>::iterator it = clades.begin(); it != clades.end(); it++)
+				if (it->size < leafNum - 1)
+					cur_clades[it->taxa] = it->topology;
+
+			// vectors of the shared clades of the donor whose topology differs
+			readTreeString(*donor);
+			setRootNode(params->root);
+			initializeAllPartialPars();
+			clearAllPartialLH();
+			computeParsimonyBranch((PhyloNeighbor*) root->neighbors[0], (PhyloNode*) root);
+			clades.clear();
+			collectFuseClades(root->neighbors[0]->node, root, clades, taxa, topology, size);
+			unordered_map<uint64_t, size_t> donor_clades; // taxa -> index in donor_pars
+			vector<UINT> donor_pars;
+			for (vector<FuseClade>::iterator it = clades.begin(); it != clades.end(); it++) {
+				unordered_map<uint64_t, uint64_t>::iterator cit = cur_clades.find(it->taxa);
+				if (cit == cur_clades.end() || cit->second == it->topology)
+					continue;
+				UINT *pars = ((PhyloNeighbor*) it->dad->findNeighbor(it->node))->partial_pars;
+				donor_clades[it->taxa] = donor_pars.size();
+				donor_pars.insert(donor_pars.end(), pars, pars + block_size);
+			}
+			if (donor_clades.empty())
+				break;
+
+			// score of the current tree with each of these clades of the donor
+			readTreeString(cur_tree);
+			setRootNode(params->root);
+			initializeAllPartialPars();
+			clearAllPartialLH();
+			clades.clear();
+			collectFuseClades(root->neighbors[0]->node, root, clades, taxa, topology, size);
+			int best_pars = cur_pars;
+			FuseClade best_clade;
+			for (vector<FuseClade>::iterator it = clades.begin(); it != clades.end(); it++) {
+				unordered_map<uint64_t, size_t>::iterator dit = donor_clades.find(it->taxa);
+				if (dit == donor_clades.end())
+					continue;
+				computeParsimonyBranch((PhyloNeighbor*) it->dad->findNeighbor(it->node), (PhyloNode*) it->dad);
+				UINT *rest = ((PhyloNeighbor*) it->node->findNeighbor(it->dad))->partial_pars;
+				int pars = computeBranchParsimony(rest, &donor_pars[dit->second]);
+				if (pars < best_pars) {
+					best_pars = pars;
+					best_clade = *it;
+				}
+			}
+			if (best_pars >= cur_pars)
+				break;
+
+			// exchange the subtree of the best clade
+			ostringstream cur_newick, clade_newick;
+			readTreeString(*donor);
+			setRootNode(params->root);
+			clades.clear();
+			collectFuseClades(root->neighbors[0]->node, root, clades, taxa, topology, size);
+			for (vector<FuseClade>::iterator it = clades.begin(); it != clades.end(); it++)
+				if (it->taxa == best_clade.taxa)
+					printFuseSubtree(clade_newick, it->node, it->dad, NULL, "");
+			readTreeString(cur_tree);
+			setRootNode(params->root);
+			clades.clear();
+			collectFuseClades(root->neighbors[0]->node, root, clades, taxa, topology, size);
+			for (vector<FuseClade>::iterator it = clades.begin(); it != clades.end(); it++)
+				if (it->taxa == best_clade.taxa)
+					printFuseSubtree(cur_newick, root, NULL, it->node, clade_newick.str());
+			string fused_tree = cur_newick.str() + ";";
+
+			readTreeString(fused_tree);
+			setRootNode(params->root);
+			clearAllPartialLH();
+			int pars = computeParsimony();
+			if (pars < cur_pars) { // unless two different taxon sets have the same fingerprint
+				if (verbose_mode >= VB_MED)
+					cout << "Tree fusing: " << cur_pars << " -> " << pars << endl;
+				cur_tree = getTreeString();
+				cur_pars = pars;
+				improved = donor_improved = true;
+			}
+		} while (donor_improved);
+	}
+
+	readTreeString(cur_tree);
+	setRootNode(params->root);
+	clearAllPartialLH();
+	curScore = -computeParsimony();
+	return improved;
+}
+
+void IQTree::saveWalkerTree(pllInstance *tr, partitionList *pr, int score) {
+	if (boot_samples_pars.empty() || (params->minimize_iter1_candidates && curIt == 1))
+		return;
+	double cur_logl = -score;
+
+	// as in saveCurrentTree, a tree already in treels is only saved again with a better score; walkers share the
+	// taxon order of pllInst, so the topology string is the treels key of findTreels
+	string tree_str;
+	pllTreeTopologyString(tr, tree_str);
+	int tree_index = -1;
+	bool skip = false;
+#ifdef _OPENMP
+#pragma omp critical(walker_treels)
+#endif
+	{
+		StringIntMap::iterator it = treels.find(tree_str);
+		if (it != treels.end()) {
+			duplication_counter++;
+			tree_index = it->second;
+			if (cur_logl <= treels_logl[tree_index] + 1e-4)
+				skip = true;
+			else
+				treels_logl[tree_index] = cur_logl;
+		} else if (logl_cutoff != 0.0 && cur_logl <= logl_cutoff - 1e-4)
+			skip = true;
+		else {
+			tree_index = treels_logl.size();
+			treels[tree_str] = tree_index;
+			treels_logl.push_back(cur_logl);
+		}
+	}
+	if (skip)
+		return;
+
+	int walker = find(walker_insts.begin(), walker_insts.end(), tr) - walker_insts.begin();
+	assert(walker < walker_insts.size());
+	BootValTypePars *pattern_pars = walker_pattern_pars[walker];
+	int test_pars = 0;
+	pllComputePatternParsimony(tr, pr, pattern_pars, &test_pars);
+	if (test_pars != score)
+		outError("WRONG pllComputeSiteParsimony: sum of site parsimony is different from alignment parsimony");
+
+	int nptn = params->sort_alignment ? aln->n_informative_patterns : getAlnNPattern();
+	int nsamples = boot_samples_pars.size();
+	int *reps_scores = new int[nsamples];
+	bool *reps_skipped = new bool[nsamples];
+
+	// other walkers update boot_logl, thus it is copied under the locks of the replicates
+	DoubleVector logl_bound(nsamples);
+	for (int lock = 0; lock < WALKER_BOOT_LOCKS; lock++) {
+#ifdef _OPENMP
+		omp_set_lock(&walker_boot_locks[lock]);
+#endif
+		for (int sample = lock; sample < nsamples; sample += WALKER_BOOT_LOCKS)
+			logl_bound[sample] = boot_logl[sample];
+#ifdef _OPENMP
+		omp_unset_lock(&walker_boot_locks[lock]);
+#endif
+	}
+	computeRellParsBatched(pattern_pars, nptn, reps_scores, reps_skipped, &logl_bound[0]);
+
+	// boot_logl only increases, thus a replicate rejected by the copy would also be rejected under its lock
+	IntVector candidates;
+	for (int sample = 0; sample < nsamples; sample++)
+		if (!reps_skipped[sample] && -(double)reps_scores[sample] >= logl_bound[sample] - params->ufboot_epsilon)
+			candidates.push_back(sample);
+
+	for (IntVector::iterator it = candidates.begin(); it != candidates.end(); it++) {
+		int sample = *it;
+		double rell = -(double)reps_scores[sample];
+#ifdef _OPENMP
+		omp_set_lock(&walker_boot_locks[sample % WALKER_BOOT_LOCKS]);
+#endif
+		// same update as the default rule of saveCurrentTree
+		if (rell > boot_logl[sample] + params->ufboot_epsilon
+				|| (rell > boot_logl[sample] - params->ufboot_epsilon
+						&& randum(&tr->randomNumberSeed) <= 1.0 / (boot_counts[sample] + 1))) {
+			if (rell > boot_logl[sample])
+				boot_counts[sample] = 1;
+			if (params->cutoff_from_btrees)
+				boot_tree_orig_logl[sample] = cur_logl;
+			boot_logl[sample] = max(boot_logl[sample], rell);
+			boot_trees[sample] = tree_index;
+		}
+		if (rell == boot_logl[sample])
+			boot_counts[sample]++;
+#ifdef _OPENMP
+		omp_unset_lock(&walker_boot_locks[sample % WALKER_BOOT_LOCKS]);
+#endif
+	}
+
+	delete [] reps_scores;
+	delete [] reps_skipped;
+}
+
 void IQTree::optimizeBootTrees(){
+	PerfPhaseTimer perf_timer(PERF_OPTIMIZE_BOOT);
 	if(params->save_trees_off){
 		optimizeBootTreesPure();
 		return;
@@ -2495,7 +3412,7 @@ void IQTree::optimizeBootTrees(){
 	int nptn = getAlnNPattern();
 	string tree;
 	int tree_index;
-	Alignment * bootstrap_aln;
+	AlignmentWeightView * bootstrap_aln;
 
 //	string btree_before_file = params->out_prefix;
 //	btree_before_file += ".btree.before";
@@ -2512,12 +3429,63 @@ void IQTree::optimizeBootTrees(){
 
 
 	int nmultifurcate = 0;
-	for(int sample = 0; sample < num_boot_rep; sample++){
+
+	// refine all trees at once with PLL, unless consensus of top trees is needed (done one by one below)
+	bool refine_parallel = canRefineBootTreesParallel()
+			&& (params->multiple_hits || params->distinct_iter_top_boot < 1);
+	if(refine_parallel){
+		IntVector samples, scores;
+		StrVector start_trees, trees;
+		vector<const string*> treels_strings(treels_logl.size(), NULL);
+		for(StringIntMap::iterator mit = treels.begin(); mit != treels.end(); ++mit)
+			treels_strings[mit->second] = &mit->first;
+		for(int sample = 0; sample < num_boot_rep; sample++){
+			if(params->multiple_hits){
+				for(IntegerSet::iterator it = boot_trees_parsimony[sample].begin();
+						it != boot_trees_parsimony[sample].end(); ++it){
+					assert(treels_strings[*it]);
+					samples.push_back(sample);
+					start_trees.push_back(*treels_strings[*it]);
+				}
+			}else{
+				assert(boot_trees[sample] >= 0 && treels_strings[boot_trees[sample]]);
+				samples.push_back(sample);
+				start_trees.push_back(*treels_strings[boot_trees[sample]]);
+			}
+		}
+
+		refineBootTreesParallel(samples, start_trees, true, scores, trees);
+
+		// update treels in the order of the bootstrap samples
+		for(int job = 0; job < samples.size(); job++){
+			int sample = samples[job];
+			curScore = -scores[job];
+			tree_index = findOrAddTreels(trees[job], curScore);
+			if(!params->multiple_hits){
+				boot_trees[sample] = tree_index;
+				boot_logl[sample] = curScore;
+				continue;
+			}
+			if(job == 0 || samples[job-1] != sample){
+				boot_trees_parsimony[sample].clear();
+				boot_logl[sample] = curScore;
+			}
+			if(curScore > boot_logl[sample]){
+				boot_trees_parsimony[sample].clear();
+				boot_logl[sample] = curScore;
+			}
+			if(curScore == boot_logl[sample])
+				boot_trees_parsimony[sample].insert(tree_index);
+		}
+	}
+
+	// only the pattern weights change: the view is reused across the replicates
+	bootstrap_aln = refine_parallel ? NULL : new AlignmentWeightView(saved_aln_on_opt_btree);
+	for(int sample = 0; sample < num_boot_rep && !refine_parallel; sample++){
         if ((sample+1) % 100 == 0)
             cout << sample+1 << " replicates done" << endl;
 //		out << sample << "\t" << boot_update_iter[sample] << "\t" << boot_trees[sample] << endl;
-		bootstrap_aln = new Alignment;
-		bootstrap_aln->modifyPatternFreq(*saved_aln_on_opt_btree, boot_samples_pars[sample], nptn);
+		bootstrap_aln->setPatternFreq(boot_samples_pars[sample], true);
 
 		setAlignment(bootstrap_aln);
         bootstrap_aln->computeUnknownState();
@@ -2860,7 +3828,6 @@ void IQTree::optimizeBootTrees(){
 			boot_trees[sample] = tree_index;
 			boot_logl[sample] = curScore;
 		}
-		delete aln;
 
 //		out << -boot_logl[sample] << endl; // to examine score after refinement
 	}
@@ -2875,6 +3842,8 @@ void IQTree::optimizeBootTrees(){
 	params->gbo_replicates = num_boot_rep;
 	params->ratchet_iter = saved_ratchet_iter;
 	setAlignment(saved_aln_on_opt_btree);
+	if (bootstrap_aln)
+		delete bootstrap_aln;
 	readTreeString(saved_tree);
 
 
@@ -2928,17 +3897,35 @@ void IQTree::optimizeBootTreesPure(){
 	int nptn = getAlnNPattern();
 	string tree;
 	int tree_index;
-	Alignment * bootstrap_aln;
+	AlignmentWeightView * bootstrap_aln;
 
 //	string boot_score_file = params->out_prefix;
 //	boot_score_file += ".boot.score";
 //	ofstream out(boot_score_file.c_str());
 //	out << "sample\tunrefined\trefined" << endl;
 
-	for(int sample = 0; sample < num_boot_rep; sample++){
+	bool refine_parallel = canRefineBootTreesParallel();
+	if(refine_parallel){
+		IntVector samples, scores;
+		StrVector start_trees, trees;
+		for(int sample = 0; sample < num_boot_rep; sample++){
+			samples.push_back(sample);
+			start_trees.push_back(candidateTrees.getRandCandTree());
+		}
+
+		refineBootTreesParallel(samples, start_trees, false, scores, trees);
+
+		for(int sample = 0; sample < num_boot_rep; sample++){
+			boot_logl[sample] = -scores[sample];
+			boot_trees[sample] = findOrAddTreels(trees[sample], boot_logl[sample]);
+		}
+	}
+
+	// only the pattern weights change: the view is reused across the replicates
+	bootstrap_aln = refine_parallel ? NULL : new AlignmentWeightView(saved_aln_on_opt_btree);
+	for(int sample = 0; sample < num_boot_rep && !refine_parallel; sample++){
 //		out << sample << "\t" << boot_logl[sample] << "\t";
-		bootstrap_aln = new Alignment;
-		bootstrap_aln->modifyPatternFreq(*saved_aln_on_opt_btree, boot_samples_pars[sample], nptn);
+		bootstrap_aln->setPatternFreq(boot_samples_pars[sample], true);
 
 		setAlignment(bootstrap_aln);
 
@@ -2974,7 +3961,6 @@ void IQTree::optimizeBootTreesPure(){
 		boot_trees[sample] = tree_index;
 		boot_logl[sample] = curScore;
 
-		delete aln;
 //		out << boot_logl[sample] << endl;
 	}
 
@@ -2984,6 +3970,8 @@ void IQTree::optimizeBootTreesPure(){
 	params->gbo_replicates = num_boot_rep;
 	params->ratchet_iter = saved_ratchet_iter;
 	setAlignment(saved_aln_on_opt_btree);
+	if (bootstrap_aln)
+		delete bootstrap_aln;
 	readTreeString(saved_tree);
 
 
@@ -3263,12 +4251,44 @@ void IQTree::estimateNNICutoff(Params* params) {
     delete[] delta;
 }
 
+int IQTree::findTreels(string &tree_str, bool pll_tree) {
+	// PLL trees are printed straight from their nodeptr structure, without a Newick round trip
+	if (pll_tree)
+		pllTreeTopologyString(pllInst, tree_str);
+	else {
+		ostringstream ostr;
+		printTree(ostr, WT_TAXON_ID | WT_SORT_TAXA);
+		tree_str = ostr.str();
+	}
+
+	StringIntMap::iterator it = treels.find(tree_str);
+	if (it == treels.end())
+		return -1;
+	return it->second;
+}
+
+int IQTree::getCurrentTreeIndex(string &tree_str, bool pll_tree) {
+	int tree_index = findTreels(tree_str, pll_tree);
+	if (tree_index < 0) {
+		tree_index = treels_logl.size() - 1; // old statement is wrong: treels.size();
+		treels[tree_str] = tree_index;
+	}
+	return tree_index;
+}
+
+void IQTree::readPllTree() {
+	pllTreeToNewickString(pllInst, pllPartitions);
+	string imd_tree = string(pllInst->tree_string);
+	readTreeString(imd_tree);
+}
+
 /*
  * Diep: 	For maximum parsimony, REMEMBER that
  * 			params->spr_parsimony && !on_ratchet_hclimb1 && !params->hclimb1_nni
  * 			means the tree is already in IQTREE data structure
  */
 void IQTree::saveCurrentTree(double cur_logl) {
+	PerfPhaseTimer perf_timer(PERF_SAVE_TREE);
 	/* -------------------------------------
 	 * Diep: Preprocess for MP
 	 * -------------------------------------*/
@@ -3298,43 +4318,41 @@ void IQTree::saveCurrentTree(double cur_logl) {
 	 * -------------------------------------*/
     ostringstream ostr;
     string tree_str;
-    StringIntMap::iterator it = treels.end();
-    if (params->store_candidate_trees) {
-    	if(params->spr_parsimony && !(params->ratchet_iter >= 0 && on_ratchet_hclimb1 && params->hclimb1_nni)){
-			pllTreeToNewick(pllInst->tree_string, pllInst, pllPartitions, pllInst->start->back, PLL_TRUE, PLL_TRUE, 0, 0, 0, PLL_SUMMARIZE_LH, 0, 0);
-			string imd_tree = string(pllInst->tree_string);
-			readTreeString(imd_tree);
-    	}
-
-        printTree(ostr, WT_TAXON_ID | WT_SORT_TAXA);
-        tree_str = ostr.str();
-        it = treels.find(tree_str);
-    }
+    // PLL trees are looked up by a topology string printed directly from PLL (see findTreels),
+    // they are only read into this tree if it is printed below
+    bool pll_tree = params->spr_parsimony && !(params->ratchet_iter >= 0 && on_ratchet_hclimb1 && params->hclimb1_nni);
+    bool tree_loaded = !pll_tree;
     int tree_index = -1;
-    if (it != treels.end()) { // already in treels
+    bool tree_indexed = params->store_candidate_trees; // TRUE if tree_index of the current tree is known
+    if (params->store_candidate_trees)
+    	tree_index = findTreels(tree_str, pll_tree);
+    if (tree_index >= 0) { // already in treels
         duplication_counter++;
-        tree_index = it->second;
-        if (cur_logl <= treels_logl[it->second] + 1e-4) {
-            if (cur_logl < treels_logl[it->second] - 5.0)
+        if (cur_logl <= treels_logl[tree_index] + 1e-4) {
+            if (cur_logl < treels_logl[tree_index] - 5.0)
                 if (verbose_mode >= VB_MED)
-                    cout << "Current lh " << cur_logl << " is much worse than expected " << treels_logl[it->second]
+                    cout << "Current lh " << cur_logl << " is much worse than expected " << treels_logl[tree_index]
                             << endl;
             return;
         }
         if (verbose_mode >= VB_MAX)
-            cout << "Updated logl " << treels_logl[it->second] << " to " << cur_logl << endl;
-        treels_logl[it->second] = cur_logl;
+            cout << "Updated logl " << treels_logl[tree_index] << " to " << cur_logl << endl;
+        treels_logl[tree_index] = cur_logl;
         if (save_all_br_lens) {
+            if (!tree_loaded) {
+                readPllTree();
+                tree_loaded = true;
+            }
             ostr.seekp(ios::beg);
             printTree(ostr, WT_TAXON_ID | WT_SORT_TAXA | WT_BR_LEN | WT_BR_SCALE | WT_BR_LEN_ROUNDING);
-            treels_newick[it->second] = ostr.str();
+            treels_newick[tree_index] = ostr.str();
         }
         if ((!params->maximum_parsimony) && boot_samples.empty()) {
-            computePatternLikelihood(treels_ptnlh[it->second], &cur_logl);
+            computePatternLikelihood(treels_ptnlh[tree_index], &cur_logl);
             return;
         }
         if (params->maximum_parsimony && boot_samples_pars.empty()) {
-			computePatternLikelihood(treels_ptnlh[it->second], &cur_logl);
+			computePatternLikelihood(treels_ptnlh[tree_index], &cur_logl);
 			return;
 		}
         if (verbose_mode >= VB_MAX)
@@ -3350,6 +4368,10 @@ void IQTree::saveCurrentTree(double cur_logl) {
             cout << "Add    treels_logl[" << tree_index << "] := " << cur_logl << endl;
     }
 
+    if ((write_intermediate_trees || save_all_br_lens) && !tree_loaded) {
+        readPllTree();
+        tree_loaded = true;
+    }
     if (write_intermediate_trees)
         printTree(out_treels, WT_NEWLINE | WT_BR_LEN);
 
@@ -3408,6 +4430,15 @@ void IQTree::saveCurrentTree(double cur_logl) {
         int updated = 0;
         int nsamples = (params->maximum_parsimony) ? boot_samples_pars.size() : boot_samples.size();
 
+        // UFBoot-MP: score all replicates in one batched pass before updating them one by one
+        int *reps_scores = NULL;
+        bool *reps_skipped = NULL;
+        if(params->maximum_parsimony && !params->auto_vectorize){
+        	reps_scores = new int[nsamples];
+        	reps_skipped = new bool[nsamples];
+        	computeRellParsBatched(_pattern_pars, nptn, reps_scores, reps_skipped);
+        }
+
         for (int sample = 0; sample < nsamples; sample++) {
             double rell = 0.0;
             bool skipped = false;
@@ -3420,32 +4451,10 @@ void IQTree::saveCurrentTree(double cur_logl) {
 					for (; ptn < nptn; ptn++)
 						res += _pattern_pars[ptn] * boot_sample[ptn];
 					rell = -(double)res;
+					perfCount(PERF_RELL_EVALS);
 				}else{
-					int ptn = 0, segment_id = 0, res = 0;
-					VectorClassUShort vc_rell = 0;
-					int max_nptn = nptn / 2;
-					for(; segment_id < reps_segments; segment_id++){
-						for (; ptn < segment_upper[segment_id]; ptn+=VCSIZE_USHORT){
-							if(params->do_first_rell && ptn >= max_nptn) break;
-							vc_rell = VectorClassUShort().load_a(&_pattern_pars[ptn]) * VectorClassUShort().load_a(&boot_sample[ptn]) + vc_rell;
-						}
-						res += horizontal_add(vc_rell);
-						vc_rell = 0;
-
-						if((!skipped) && (reps_segments > 1) && (segment_id > reps_segments / 4) && (segment_id < reps_segments - 1)){
-							int reps_total = res + boot_samples_pars_remain_bounds[sample][segment_id];
-							if((double)(-reps_total) < boot_logl[sample] - params->ufboot_epsilon){
-//								cout << "Current best of sample " << sample << " = " << int(-boot_logl[sample]) << endl;
-//								cout << "REPS at segment " << segment_id << " = " << res + boot_samples_pars_remain_bounds[sample][segment_id] << endl;
-//								cout << "NOTE: estimated value for boot sample parsimony exceeds its current best."
-//										<< "Skip on sample " << sample << " at site " << segment_upper[segment_id] << endl;
-								skipped = true;
-								break;
-							}
-						}
-					}
-
-					rell = -(double)res;
+					skipped = reps_skipped[sample];
+					rell = -(double)reps_scores[sample];
 				}
 			} else {
 				// TODO: The following parallel is not very efficient, should wrap the above loop
@@ -3498,21 +4507,9 @@ void IQTree::saveCurrentTree(double cur_logl) {
 			if(params->multiple_hits){
 				// Implementing -mulhits option (without -top10boot) BEGIN
 				if(rell >= boot_logl[sample] && !params->store_top_boot_trees){
-					if (tree_str == "") {
-						if(params->spr_parsimony && !(params->ratchet_iter >= 0 && on_ratchet_hclimb1 && params->hclimb1_nni)){
-							pllTreeToNewick(pllInst->tree_string, pllInst, pllPartitions, pllInst->start->back, PLL_TRUE, PLL_TRUE, 0, 0, 0, PLL_SUMMARIZE_LH, 0, 0);
-							string imd_tree = string(pllInst->tree_string);
-							readTreeString(imd_tree);
-						}
-						printTree(ostr, WT_TAXON_ID | WT_SORT_TAXA);
-						tree_str = ostr.str();
-						it = treels.find(tree_str);
-						if (it != treels.end()) {
-							tree_index = it->second;
-						} else {
-							tree_index = treels_logl.size() - 1; // old statement is wrong: treels.size();
-							treels[tree_str] = tree_index;
-						}
+					if (!tree_indexed) {
+						tree_index = getCurrentTreeIndex(tree_str, pll_tree);
+						tree_indexed = true;
 					}
 
 					if (rell > boot_logl[sample]){
@@ -3538,21 +4535,9 @@ void IQTree::saveCurrentTree(double cur_logl) {
 				// Implementing -mulhits -topboot 10 option BEGIN
 				if(params->store_top_boot_trees){
 					if(boot_trees_parsimony_top[sample].size() < params->store_top_boot_trees || rell > boot_threshold[sample]){
-						if (tree_str == "") {
-							if(params->spr_parsimony && !(params->ratchet_iter >= 0 && on_ratchet_hclimb1 && params->hclimb1_nni)){
-								pllTreeToNewick(pllInst->tree_string, pllInst, pllPartitions, pllInst->start->back, PLL_TRUE, PLL_TRUE, 0, 0, 0, PLL_SUMMARIZE_LH, 0, 0);
-								string imd_tree = string(pllInst->tree_string);
-								readTreeString(imd_tree);
-							}
-							printTree(ostr, WT_TAXON_ID | WT_SORT_TAXA);
-							tree_str = ostr.str();
-							it = treels.find(tree_str);
-							if (it != treels.end()) {
-								tree_index = it->second;
-							} else {
-								tree_index = treels_logl.size() - 1; // old statement is wrong: treels.size();
-								treels[tree_str] = tree_index;
-							}
+						if (!tree_indexed) {
+							tree_index = getCurrentTreeIndex(tree_str, pll_tree);
+							tree_indexed = true;
 						}
 
 						// if newly added
@@ -3597,22 +4582,9 @@ void IQTree::saveCurrentTree(double cur_logl) {
 					if (rell > boot_logl[sample]){
 						boot_counts[sample] = 1;
 					}
-					if (tree_str == "") {
-						if(params->spr_parsimony && !(params->ratchet_iter >= 0 && on_ratchet_hclimb1 && params->hclimb1_nni)){
-							pllTreeToNewick(pllInst->tree_string, pllInst, pllPartitions, pllInst->start->back, PLL_TRUE, PLL_TRUE, 0, 0, 0, PLL_SUMMARIZE_LH, 0, 0);
-							string imd_tree = string(pllInst->tree_string);
-							readTreeString(imd_tree);
-						}
-						printTree(ostr, WT_TAXON_ID | WT_SORT_TAXA);
-						tree_str = ostr.str();
-
-						it = treels.find(tree_str);
-						if (it != treels.end()) {
-							tree_index = it->second;
-						} else {
-							tree_index = treels_logl.size() - 1; // old statement is wrong: treels.size();
-							treels[tree_str] = tree_index;
-						}
+					if (!tree_indexed) {
+						tree_index = getCurrentTreeIndex(tree_str, pll_tree);
+						tree_indexed = true;
 					}
 					// Diep: for new logl_cutoff computation
 					if(params->cutoff_from_btrees)
@@ -3689,22 +4661,9 @@ void IQTree::saveCurrentTree(double cur_logl) {
 				if (rell > boot_logl[sample] + params->ufboot_epsilon
 						|| (rell > boot_logl[sample] - params->ufboot_epsilon
 								&& random_double() <= 1.0 / (boot_counts[sample] + 1))) {
-					if (tree_str == "") {
-						if(params->spr_parsimony && !(params->ratchet_iter >= 0 && on_ratchet_hclimb1 && params->hclimb1_nni)){
-							pllTreeToNewick(pllInst->tree_string, pllInst, pllPartitions, pllInst->start->back, PLL_TRUE, PLL_TRUE, 0, 0, 0, PLL_SUMMARIZE_LH, 0, 0);
-							string imd_tree = string(pllInst->tree_string);
-							readTreeString(imd_tree);
-						}
-						printTree(ostr, WT_TAXON_ID | WT_SORT_TAXA);
-						tree_str = ostr.str();
-
-						it = treels.find(tree_str);
-						if (it != treels.end()) {
-							tree_index = it->second;
-						} else {
-							tree_index = treels_logl.size() - 1; // old statement is wrong: treels.size();
-							treels[tree_str] = tree_index;
-						}
+					if (!tree_indexed) {
+						tree_index = getCurrentTreeIndex(tree_str, pll_tree);
+						tree_indexed = true;
 					}
 
 
@@ -3731,6 +4690,8 @@ void IQTree::saveCurrentTree(double cur_logl) {
 				}
 			}
         }
+        if(reps_scores) delete [] reps_scores;
+        if(reps_skipped) delete [] reps_skipped;
         if (updated && verbose_mode >= VB_MAX)
             cout << updated << " boot trees updated" << endl;
 
@@ -3854,6 +4815,109 @@ void IQTree::pllComputeRellRemainBound(int nunit){
 	delete [] min_unit_pars;
 }
 
+void IQTree::buildTiledBootSamplesPars(){
+	int nsamples = boot_samples_pars.size();
+	int ntiles = (nsamples + REPS_TILE - 1) / REPS_TILE;
+	boot_tiled_nunit = getAlnNPattern() + VCSIZE_USHORT; // same padding as boot_samples_pars
+
+	size_t tiled_size = boot_tiled_nunit * ntiles * REPS_TILE;
+	if(boot_samples_pars_tiled) aligned_free(boot_samples_pars_tiled);
+	boot_samples_pars_tiled = aligned_alloc<BootValTypePars>(tiled_size);
+	memset(boot_samples_pars_tiled, 0, tiled_size * sizeof(BootValTypePars));
+
+	for(int sample = 0; sample < nsamples; sample++){
+		BootValTypePars *dst = boot_samples_pars_tiled
+				+ (sample / REPS_TILE) * boot_tiled_nunit * REPS_TILE + (sample % REPS_TILE);
+		BootValTypePars *src = boot_samples_pars[sample];
+		for(size_t ptn = 0; ptn < boot_tiled_nunit; ptn++)
+			dst[ptn * REPS_TILE] = src[ptn];
+	}
+}
+
+#if REPS_TILE != RELL_KERNEL_REPS
+#error "REPS_TILE must be the # of replicates of the RELL kernels (see sprparsimonykernel.h)"
+#endif
+
+/**
+ * accumulate pattern parsimony times replicate weight over patterns [begin, end)
+ * for one tile of REPS_TILE replicates (pattern-major weights, see boot_samples_pars_tiled).
+ * Lanes wrap modulo 2^16 like the horizontal_add of the per-replicate VectorClassUShort loop,
+ * so a segment gives exactly the same sum as before.
+ */
+static void computeRellTileSegment(BootValTypePars *pattern_pars, BootValTypePars *tile_weights,
+		int begin, int end, BootValTypePars *lane_sums){
+	// AVX2/AVX-512 kernel for the CPU running the program (see pllSelectFitchKernel)
+	RellTileKernel rell_kernel = pllRellTileKernel();
+	if(rell_kernel){
+		rell_kernel(pattern_pars, tile_weights, begin, end, lane_sums);
+		return;
+	}
+	const int nvec = REPS_TILE / VCSIZE_USHORT;
+	VectorClassUShort vc_rell[nvec];
+	for(int k = 0; k < nvec; k++) vc_rell[k] = 0;
+	for(int ptn = begin; ptn < end; ptn++){
+		VectorClassUShort vc_pars(pattern_pars[ptn]);
+		BootValTypePars *w = &tile_weights[ptn * REPS_TILE];
+		for(int k = 0; k < nvec; k++)
+			vc_rell[k] = vc_pars * VectorClassUShort().load_a(w + k * VCSIZE_USHORT) + vc_rell[k];
+	}
+	for(int k = 0; k < nvec; k++)
+		vc_rell[k].store(lane_sums + k * VCSIZE_USHORT);
+}
+
+void IQTree::computeRellParsBatched(BootValTypePars *pattern_pars, int nptn, int *reps_scores, bool *reps_skipped,
+		const double *logl_bound){
+	if(!boot_samples_pars_tiled) buildTiledBootSamplesPars();
+
+	int nsamples = boot_samples_pars.size();
+	int max_nptn = nptn / 2;
+	if(!logl_bound) logl_bound = &boot_logl[0];
+
+	// pattern range of each segment, advanced in whole vectors as in the per-replicate loop
+	int *segment_bound = new int[reps_segments + 1];
+	int ptn = 0;
+	segment_bound[0] = 0;
+	for(int segment_id = 0; segment_id < reps_segments; segment_id++){
+		for(; ptn < segment_upper[segment_id]; ptn += VCSIZE_USHORT)
+			if(params->do_first_rell && ptn >= max_nptn) break;
+		segment_bound[segment_id + 1] = ptn;
+	}
+
+	BootValTypePars lane_sums[REPS_TILE];
+	int nskipped = 0;
+	for(int first = 0; first < nsamples; first += REPS_TILE){
+		int nreps = min(REPS_TILE, nsamples - first);
+		BootValTypePars *tile_weights = boot_samples_pars_tiled + (first / REPS_TILE) * boot_tiled_nunit * REPS_TILE;
+		int active = nreps;
+		for(int r = 0; r < nreps; r++){
+			reps_scores[first + r] = 0;
+			reps_skipped[first + r] = false;
+		}
+
+		for(int segment_id = 0; segment_id < reps_segments && active > 0; segment_id++){
+			computeRellTileSegment(pattern_pars, tile_weights, segment_bound[segment_id], segment_bound[segment_id + 1], lane_sums);
+
+			bool check_bound = (reps_segments > 1) && (segment_id > reps_segments / 4) && (segment_id < reps_segments - 1);
+			for(int r = 0; r < nreps; r++){
+				int sample = first + r;
+				if(reps_skipped[sample]) continue;
+				reps_scores[sample] += lane_sums[r];
+				if(check_bound){
+					int reps_total = reps_scores[sample] + boot_samples_pars_remain_bounds[sample][segment_id];
+					if((double)(-reps_total) < logl_bound[sample] - params->ufboot_epsilon){
+						reps_skipped[sample] = true;
+						active--;
+						nskipped++;
+					}
+				}
+			}
+		}
+	}
+	perfCount(PERF_RELL_EVALS, nsamples);
+	perfCount(PERF_RELL_SKIPPED, nskipped);
+	delete [] segment_bound;
+}
+
 void IQTree::saveNNITrees(PhyloNode *node, PhyloNode *dad) {
     if (!node) {
         node = (PhyloNode*) root;
@@ -3888,11 +4952,7 @@ void IQTree::summarizeBootstrap(Params &params, MTreeSet &trees) {
     // make the taxa name
     vector<string> taxname;
     taxname.resize(leafNum);
-    if (boot_splits.empty()) {
-        getTaxaName(taxname);
-    } else {
-        boot_splits.back()->getTaxaName(taxname);
-    }
+    getTaxaName(taxname);
     /*if (!tree.save_all_trees)
      trees.convertSplits(taxname, sg, hash_ss, SW_COUNT, -1);
      else
@@ -4018,6 +5078,7 @@ void IQTree::writeUFBootTrees(Params &params, StrVector &removed_seqs, StrVector
 }
 
 void IQTree::summarizeBootstrap(Params &params) {
+	PerfPhaseTimer perf_timer(PERF_SUMMARIZE_BOOT);
 	if(params.maximum_parsimony && params.multiple_hits){
 		if(params.store_top_boot_trees)
 			summarizeBootstrapParsimonyTop(params);
@@ -4310,40 +5371,132 @@ double computeCorrelation(IntVector &ix, IntVector &iy) {
     return f1 / (sqrt(f2) * sqrt(f3));
 }
 
+void IQTree::computeTreeSplits(int tree_index, const string &tree_str) {
+    MTree tree;
+    stringstream ss(tree_str);
+    bool myrooted = rooted;
+    tree.readTree(ss, myrooted);
+    NodeVector taxa;
+    tree.getTaxa(taxa);
+    for (NodeVector::iterator taxit = taxa.begin(); taxit != taxa.end(); taxit++)
+        (*taxit)->id = atoi((*taxit)->name.c_str());
+    SplitGraph sg;
+    Split resp(tree.leafNum);
+    tree.convertSplits(sg, &resp);
+
+    if (tree_index >= treels_splits.size())
+        treels_splits.resize(tree_index + 1);
+    IntVector &split_ids = treels_splits[tree_index];
+    split_ids.clear();
+    for (SplitGraph::iterator it = sg.begin(); it != sg.end(); it++) {
+        if ((*it)->trivial() != -1)
+            continue;
+        int id;
+        if (!boot_splits_map.findSplit(*it, id)) {
+            id = boot_split_table.size();
+            Split *sp = new Split(*(*it));
+            sp->setWeight(1.0);
+            boot_split_table.push_back(sp);
+            boot_splits_map.insertSplit(sp, id);
+            boot_split_weights.push_back(0);
+        }
+        split_ids.push_back(id);
+    }
+    // mark the tree as done even if it has no non-trivial split
+    if (split_ids.empty())
+        split_ids.push_back(-1);
+}
+
+void IQTree::getBootSampleTrees(int sample, IntPairVector &trees) {
+    trees.clear();
+    if (params->maximum_parsimony && params->multiple_hits) {
+        if (params->store_top_boot_trees) {
+            for (int i = 0; i < boot_trees_parsimony_top[sample].size(); i++)
+                trees.push_back(IntPair(boot_trees_parsimony_top[sample][i].first, 1));
+        } else if (!boot_trees_parsimony[sample].empty()) {
+            int scale = params->gbo_replicates / boot_trees_parsimony[sample].size();
+            for (IntegerSet::iterator it = boot_trees_parsimony[sample].begin(); it != boot_trees_parsimony[sample].end(); ++it)
+                trees.push_back(IntPair(*it, scale));
+        }
+    } else if (boot_trees[sample] >= 0)
+        trees.push_back(IntPair(boot_trees[sample], 1));
+}
+
+void IQTree::updateBootSplitWeights() {
+    int sample, i, j;
+    int nsamples = params->gbo_replicates;
+    if (boot_split_contrib.size() != nsamples)
+        boot_split_contrib.resize(nsamples);
+
+    // collect the samples whose trees changed, and the trees whose splits are not known yet
+    IntVector changed;
+    vector<IntPairVector> new_contrib;
+    IntegerSet missing;
+    IntPairVector trees;
+    for (sample = 0; sample < nsamples; sample++) {
+        getBootSampleTrees(sample, trees);
+        if (trees == boot_split_contrib[sample])
+            continue;
+        changed.push_back(sample);
+        new_contrib.push_back(trees);
+        for (i = 0; i < trees.size(); i++)
+            if (trees[i].first >= treels_splits.size() || treels_splits[trees[i].first].empty())
+                missing.insert(trees[i].first);
+    }
+    if (changed.empty())
+        return;
+
+    // one pass over treels to compute splits of trees entering the bootstrap tree set
+    if (!missing.empty()) {
+        for (StringIntMap::iterator it = treels.begin(); it != treels.end(); it++)
+            if (missing.find(it->second) != missing.end())
+                computeTreeSplits(it->second, it->first);
+    }
+
+    for (i = 0; i < changed.size(); i++) {
+        sample = changed[i];
+        IntPairVector &old_trees = boot_split_contrib[sample];
+        for (j = 0; j < old_trees.size(); j++) {
+            IntVector &split_ids = treels_splits[old_trees[j].first];
+            for (IntVector::iterator it = split_ids.begin(); it != split_ids.end(); it++)
+                if (*it >= 0)
+                    boot_split_weights[*it] -= old_trees[j].second;
+        }
+        IntPairVector &new_trees = new_contrib[i];
+        for (j = 0; j < new_trees.size(); j++) {
+            // trees not stored in treels are skipped, as MTreeSet::init() would do
+            if (new_trees[j].first >= treels_splits.size())
+                treels_splits.resize(new_trees[j].first + 1);
+            IntVector &split_ids = treels_splits[new_trees[j].first];
+            for (IntVector::iterator it = split_ids.begin(); it != split_ids.end(); it++)
+                if (*it >= 0)
+                    boot_split_weights[*it] += new_trees[j].second;
+        }
+        old_trees = new_trees;
+    }
+}
+
 double IQTree::computeBootstrapCorrelation() {
     if (boot_splits.size() < 2)
         return 0.0;
-    IntVector split_supports;
-    SplitIntMap split_map;
     int i;
-    // collect split supports
-    SplitGraph *sg = boot_splits.back();
-    SplitGraph *half = boot_splits[(boot_splits.size() - 1) / 2];
-    for (i = 0; i < half->size(); i++)
-        if (half->at(i)->trivial() == -1) {
-            split_map.insertSplit(half->at(i), split_supports.size());
-            split_supports.push_back((int) (half->at(i)->getWeight()));
-        }
-
-    // collect split supports for new tree collection
+    // collect supports of splits occuring in either snapshot
+    IntVector &cur = boot_splits.back();
+    IntVector &half = boot_splits[(boot_splits.size() - 1) / 2];
+    IntVector split_supports;
     IntVector split_supports_new;
-    split_supports_new.resize(split_supports.size(), 0);
-    for (i = 0; i < sg->size(); i++)
-        if ((*sg)[i]->trivial() == -1) {
-            int index;
-            Split *sp = split_map.findSplit((*sg)[i], index);
-            if (sp) {
-                // split found
-                split_supports_new[index] = (int) ((*sg)[i]->getWeight());
-            } else {
-                // new split
-                split_supports_new.push_back((int) ((*sg)[i]->getWeight()));
-            }
-        }
+    int new_splits = 0;
+    for (i = 0; i < cur.size(); i++) {
+        int half_weight = (i < half.size()) ? half[i] : 0;
+        if (half_weight == 0 && cur[i] == 0)
+            continue;
+        if (half_weight == 0)
+            new_splits++;
+        split_supports.push_back(half_weight);
+        split_supports_new.push_back(cur[i]);
+    }
     if (verbose_mode >= VB_MED)
-    	cout << split_supports_new.size() - split_supports.size() << " new splits compared to old boot_splits" << endl;
-    if (split_supports_new.size() > split_supports.size())
-        split_supports.resize(split_supports_new.size(), 0);
+    	cout << new_splits << " new splits compared to old boot_splits" << endl;
 
     // now compute correlation coefficient
     double corr = computeCorrelation(split_supports, split_supports_new);
@@ -4422,8 +5575,7 @@ void IQTree::printPhylolibModelParams(const char* suffix) {
 */
 
 void IQTree::printPhylolibTree(const char* suffix) {
-    pllTreeToNewick(pllInst->tree_string, pllInst, pllPartitions, pllInst->start->back, PLL_TRUE, 1, 0, 0, 0,
-            PLL_SUMMARIZE_LH, 0, 0);
+    pllTreeToNewickString(pllInst, pllPartitions);
     char phylolibTree[1024];
     strcpy(phylolibTree, params->out_prefix);
     strcat(phylolibTree, suffix);
@@ -34,10 +34,22 @@
 #include "nnisearch.h"
 #include "candidateset.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+class Checkpoint;
+
 #define BOOT_VAL_FLOAT
 #define BootValType float
 //#define BootValType double
 
+// number of bootstrap replicates scored together by the batched RELL kernel (UFBoot-MP)
+#define REPS_TILE 32
+
+// number of locks the bootstrap replicates are spread over when several UFBoot-MP walkers update them
+#define WALKER_BOOT_LOCKS 64
+
 
 typedef std::map< string, double > mapString2Double;
 typedef std::multiset< double, std::less< double > > multiSetDB;
@@ -110,10 +122,41 @@ public:
      */
     virtual void setParams(Params& params);
 
-    void createPLLPartition(Params &params, ostream &pllPartitionFileHandle);
+    /**
+     * print the PLL partition file of the current alignment
+     * @param part_widths # of PLL sites of each partition, NULL for the # of sites of the alignment
+     */
+    void createPLLPartition(Params &params, ostream &pllPartitionFileHandle, IntVector *part_widths = NULL);
+
+    /**
+     * build the PLL alignment and partitions of the current alignment from its patterns.
+     * For maximum parsimony, identical consecutive sites are merged to keep IQTree aln and PLL one in sync.
+     * @param remove_dups for likelihood, remove the duplicate sites with pllAlignmentRemoveDups()
+     * @param partitions, alignment (OUT) the PLL structures
+     */
+    void createPLLAlignment(Params &params, partitionList *&partitions, pllAlignmentData *&alignment, bool remove_dups = true);
+
+    /**
+     * set the topology and branch lengths of a PLL instance created for the current alignment to the current tree,
+     * the same as parsing getTreeString() with pllTreeInitTopologyNewick() but without the newick string
+     * @param default_branches TRUE to reset the branch lengths to the PLL default
+     */
+    void initPLLTopology(pllInstance *inst, bool default_branches = false);
 
     void initializePLL(Params &params);
 
+    /**
+     * create a PLL instance for the current alignment using the attributes in pllAttr,
+     * e.g. to build several parsimony trees at the same time. initializePLL() must be called before
+     * @param inst, partitions, alignment (OUT) the new PLL structures, free them with destroyPLLInstance()
+     */
+    void createPLLInstance(Params &params, pllInstance *&inst, partitionList *&partitions, pllAlignmentData *&alignment);
+
+    /**
+     * free the PLL structures created by createPLLInstance()
+     */
+    void destroyPLLInstance(pllInstance *inst, partitionList *partitions, pllAlignmentData *alignment);
+
     void initializeModel(Params &params);
 
     /**
@@ -261,6 +304,21 @@ public:
      */
     double doTreeSearch();
 
+    /**
+     * write the state of the MP tree search (candidate trees, bootstrap trees, stopping rule,
+     * random number generator, ...) into the checkpoint file, called between two iterations of doTreeSearch()
+     * @param ratchet_iter_count number of iterations since the last ratchet iteration
+     * @param cur_correlation current bootstrap correlation coefficient
+     */
+    void saveSearchCheckpoint(int ratchet_iter_count, double cur_correlation);
+
+    /**
+     * restore the state written by saveSearchCheckpoint(), to continue an interrupted MP tree search
+     * @param ratchet_iter_count (OUT) number of iterations since the last ratchet iteration
+     * @param cur_correlation (OUT) current bootstrap correlation coefficient
+     */
+    void restoreSearchCheckpoint(int &ratchet_iter_count, double &cur_correlation);
+
     /**
      *  Wrapper function that uses either PLL or IQ-TREE to optimize the branch length
      *  @param maxTraversal
@@ -515,6 +573,34 @@ public:
     // Diep: move from protected to public to be callable from sprparsimony.cpp
     virtual void saveCurrentTree(double logl); // save current tree
 
+    /**
+     * saveCurrentTree() for the tree of a UFBoot-MP walker (see doWalkerSearch), called by several threads at once.
+     * Only the default UFBoot-MP update rule is supported (see canUseWalkers). As in saveCurrentTree(), a tree
+     * already in treels is skipped unless its score improved.
+     * @param tr PLL instance of the walker, its per-site scores are computed
+     * @param score parsimony score of the tree
+     */
+    void saveWalkerTree(pllInstance *tr, partitionList *pr, int score);
+
+    /**
+     * look up the current tree in treels.
+     * PLL trees are printed directly from the PLL structure (see pllTreeTopologyString), without a Newick round trip.
+     * @param tree_str (OUT) the topology string (taxon IDs, sorted) of the current tree
+     * @param pll_tree TRUE if the current tree is in PLL structure, FALSE if it is in IQ-TREE structure
+     * @return index of the current tree in treels_logl, -1 if not found
+     */
+    int findTreels(string &tree_str, bool pll_tree);
+
+    /**
+     * same as findTreels() but add the current tree as the last tree of treels_logl if it is not found
+     */
+    int getCurrentTreeIndex(string &tree_str, bool pll_tree);
+
+    /**
+     * read the current tree of pllInst into this tree
+     */
+    void readPllTree();
+
     /**
      * Do memory allocation and initialize parameter for UFBoot to run with PLL
      */
@@ -574,6 +660,64 @@ public:
     */
    void optimizeBootTreesPure();
 
+   /**
+    * @return TRUE if the bootstrap trees can be refined by refineBootTreesParallel(),
+    * i.e. by PLL parsimony SPR without Sankoff cost matrix
+    */
+   bool canRefineBootTreesParallel();
+
+   /**
+    * refine trees by parsimony SPR on their bootstrap samples, several trees at the same time with OpenMP.
+    * Each thread keeps one PLL instance for the whole run and only changes its pattern weights
+    * between bootstrap samples.
+    * @param samples bootstrap sample of each tree
+    * @param start_trees Newick string of each starting tree
+    * @param taxon_ids TRUE if start_trees are printed with taxon IDs (as in treels), FALSE for taxon names
+    * @param scores (OUT) parsimony score of each refined tree on its bootstrap sample
+    * @param trees (OUT) each refined tree, printed with taxon IDs and sorted taxa to look up treels
+    */
+   void refineBootTreesParallel(IntVector &samples, StrVector &start_trees, bool taxon_ids,
+		   IntVector &scores, StrVector &trees);
+
+   /**
+    * @return index of tree in treels, add the tree with score cur_score if not found
+    */
+   int findOrAddTreels(string &tree, double cur_score);
+
+   /**
+    * @return TRUE if the tree search can run several UFBoot-MP walkers at the same time (-walkers),
+    * print a warning and return FALSE if -walkers is given with options they do not support
+    */
+   bool canUseWalkers();
+
+   /**
+    * one iteration of the tree search with params->num_walkers UFBoot-MP walkers: each walker perturbs a
+    * random candidate tree (by random NNIs or by a ratchet on reweighted patterns) and hill-climbs it by
+    * parsimony SPR. The walkers run at the same time with OpenMP and update the shared bootstrap trees by
+    * saveWalkerTree(). All resulting trees are offered to the candidate set, the best one becomes the current tree.
+    * @return Newick string of the best tree
+    */
+   string doWalkerSearch();
+
+   /**
+    * create the PLL instance of each walker and the shared data used by saveWalkerTree()
+    */
+   void initWalkers();
+
+   /**
+    * free the structures created by initWalkers()
+    */
+   void destroyWalkers();
+
+   /**
+    * Tree fusing (-fuse): for each of the best candidate trees, the current tree takes over the subtree of a clade
+    * both trees share (same taxa, other topology) as long as this lowers the score. The score of an exchange is
+    * that of the partial parsimony vector of the rest of the current tree joined with the one of the clade in
+    * the candidate tree.
+    * @return TRUE if the current tree was improved, it is then loaded and curScore is its score
+    */
+   bool fuseCandidateTrees();
+
    /**
     * Diep:
     * Sankoff cost matrix, to be inherited and used in ParsTree
@@ -584,6 +728,19 @@ public:
     StrVector removedTaxons;
 protected:
 
+    /**
+     * the PLL alignment of the current alignment, built from the characters of its patterns
+     * @param merge_dups TRUE to merge identical consecutive sites of a partition, see pllSortedAlignmentRemoveDups()
+     * @param part_widths (OUT) # of PLL sites of each partition
+     * @return NULL for codon alignments, which are still printed and parsed
+     */
+    pllAlignmentData *buildPLLAlignment(bool merge_dups, IntVector &part_widths);
+
+    /**
+     * link the subtree below node to the PLL node parent, numbering its inner nodes from inner on
+     */
+    void linkPLLSubtree(pllInstance *inst, Node *node, Node *dad, nodeptr parent, int &inner);
+
     /**
      *  Current IQPNNI iteration number
      */
@@ -691,6 +848,16 @@ public:
 
     CandidateSet candidateTrees;
 
+    /**
+     *  checkpoint of the MP tree search, NULL if checkpointing is off
+     */
+    Checkpoint *checkpoint;
+
+    /**
+     *  wall-clock time of the last checkpoint
+     */
+    double last_checkpoint_time;
+
 
     /****** following variables are for ultra-fast bootstrap *******/
 
@@ -735,6 +902,43 @@ public:
 
     void pllComputeRellRemainBound(int nunit);
 
+    /**
+     * boot_samples_pars transposed into pattern-major tiles of REPS_TILE replicates:
+     * weight of replicate (t * REPS_TILE + r) at pattern ptn is stored at
+     * [(t * boot_tiled_nunit + ptn) * REPS_TILE + r]. Built lazily by buildTiledBootSamplesPars().
+     */
+    BootValTypePars *boot_samples_pars_tiled;
+    size_t boot_tiled_nunit;
+    void buildTiledBootSamplesPars();
+
+    /**
+     * compute the RELL parsimony scores of a tree for all bootstrap replicates,
+     * scoring a whole tile of replicates per pass over the patterns
+     * @param pattern_pars pattern parsimony of the tree
+     * @param nptn number of patterns taken into account
+     * @param reps_scores (OUT) sum of pattern parsimony times replicate weight
+     * @param reps_skipped (OUT) true if the replicate was abandoned early by its remain bound
+     * @param logl_bound score of each replicate a skipped replicate cannot reach, boot_logl if NULL
+     */
+    void computeRellParsBatched(BootValTypePars *pattern_pars, int nptn, int *reps_scores, bool *reps_skipped,
+    		const double *logl_bound = NULL);
+
+    /** PLL structures of the UFBoot-MP walkers (see initWalkers) */
+    vector<pllInstance*> walker_insts;
+    vector<partitionList*> walker_partitions;
+    vector<pllAlignmentData*> walker_alignments;
+
+    /** pattern parsimony of the current tree of each walker */
+    vector<BootValTypePars*> walker_pattern_pars;
+
+    /** pattern weights of the original alignment */
+    BootValTypePars *walker_weights;
+
+#ifdef _OPENMP
+    /** replicate b of boot_logl, boot_counts, boot_trees is guarded by walker_boot_locks[b % WALKER_BOOT_LOCKS] */
+    omp_lock_t walker_boot_locks[WALKER_BOOT_LOCKS];
+#endif
+
     void initTopologyByPLLRandomAdition(Params &params); // Diep: this is for reorder columns in aln (UFBoot-MP)
     BootValTypePars * getPatternPars();
 
@@ -770,11 +974,23 @@ public:
     /** corresponding RELL log-likelihood */
     DoubleVector boot_logl;
 
-    /** Set of splits occuring in bootstrap trees */
-    vector<SplitGraph*> boot_splits;
+    /** Set of non-trivial splits occuring in bootstrap trees, indexed by split ID */
+    SplitGraph boot_split_table;
+
+    /** Corresponding map for set of splits occuring in bootstrap trees, split -> split ID */
+    SplitIntMap boot_splits_map;
 
-    /** Corresponding map for set of splits occuring in bootstrap trees */
-    //SplitIntMap boot_splits_map;
+    /** split IDs of each bootstrap candidate tree, indexed by tree index (computed once per tree) */
+    vector<IntVector> treels_splits;
+
+    /** current number of bootstrap trees containing each split, indexed by split ID */
+    IntVector boot_split_weights;
+
+    /** (tree index, weight) pairs that each bootstrap sample currently adds to boot_split_weights */
+    vector<IntPairVector> boot_split_contrib;
+
+    /** snapshots of boot_split_weights taken every half step for the convergence test */
+    vector<IntVector> boot_splits;
 
     /** summarize all bootstrap trees */
     void summarizeBootstrap(Params &params, MTreeSet &trees);
@@ -792,6 +1008,26 @@ public:
 
     void writeUFBootTrees(Params &params, StrVector &removed_seqs, StrVector &twin_seqs);
 
+    /**
+     * compute the non-trivial splits of a bootstrap candidate tree into treels_splits
+     * @param tree_index index of the tree in treels
+     * @param tree_str Newick string of the tree with taxon IDs
+     */
+    void computeTreeSplits(int tree_index, const string &tree_str);
+
+    /**
+     * get the trees and weights a bootstrap sample contributes to the split supports
+     * @param sample bootstrap sample
+     * @param trees (OUT) vector of (tree index, weight)
+     */
+    void getBootSampleTrees(int sample, IntPairVector &trees);
+
+    /**
+     * bring boot_split_weights up to date with the current bootstrap trees, only
+     * touching the splits of samples whose trees changed since the last call
+     */
+    void updateBootSplitWeights();
+
     /** @return bootstrap correlation coefficient for assessing convergence */
     double computeBootstrapCorrelation();
 
@@ -13,6 +13,7 @@
 #include "phylotree.h"
 #include "nnisearch.h"
 #include "alignment.h"
+#include "sprparsimony.h"
 
 /* program options */
 int nni0;
@@ -632,8 +633,7 @@ string convertQuartet2String(nodeptr p) {
 }
 
 void countDistinctTrees(pllInstance* pllInst, partitionList *pllPartitions) {
-    pllTreeToNewick(pllInst->tree_string, pllInst, pllPartitions, pllInst->start->back, PLL_FALSE,
-            PLL_TRUE, PLL_FALSE, PLL_FALSE, PLL_FALSE, PLL_SUMMARIZE_LH, PLL_FALSE, PLL_FALSE);
+    pllTreeToNewickString(pllInst, pllPartitions, false);
 	PhyloTree mtree;
 	mtree.rooted = false;
 	mtree.aln = globalAlignment;
@@ -0,0 +1,94 @@
+/*
+ * parstopology.cpp
+ *
+ *  Flat representation of an unrooted binary tree for computing its parsimony score
+ *  (see parstopology.h).
+ */
+
+#include "parstopology.h"
+#include "mtree.h"
+
+ParsTopology::ParsTopology() {
+	ntaxa = 0;
+	root_taxon = -1;
+	top = -1;
+}
+
+void ParsTopology::clear() {
+	root_taxon = -1;
+	top = -1;
+	left.clear();
+	right.clear();
+	post_order.clear();
+}
+
+bool ParsTopology::build(Node *root, int ntaxa) {
+	clear();
+	this->ntaxa = ntaxa;
+	if (!root || !root->isLeaf() || root->name == ROOT_NAME || root->id < 0 || root->id >= ntaxa || ntaxa < 3)
+		return false;
+	Node *top_node = root->neighbors[0]->node;
+	if (top_node->isLeaf())
+		return false;
+
+	left.reserve(ntaxa - 2);
+	right.reserve(ntaxa - 2);
+	post_order.reserve(ntaxa - 2);
+
+	// pre-order walk with an explicit stack of (node, dad, its number); reversed it is a post-order
+	vector<Node*> stack_node, stack_dad;
+	IntVector stack_id;
+	root_taxon = root->id;
+	top = ntaxa;
+	stack_node.push_back(top_node);
+	stack_dad.push_back(root);
+	stack_id.push_back(top);
+	left.push_back(-1);
+	right.push_back(-1);
+	while (!stack_node.empty()) {
+		Node *node = stack_node.back(), *dad = stack_dad.back();
+		int id = stack_id.back();
+		stack_node.pop_back();
+		stack_dad.pop_back();
+		stack_id.pop_back();
+		post_order.push_back(id);
+		if (node->degree() != 3) {
+			clear();
+			return false;
+		}
+		int nchild = 0;
+		FOR_NEIGHBOR_IT(node, dad, it) {
+			Node *child = (*it)->node;
+			int child_id;
+			if (child->isLeaf()) {
+				if (child->name == ROOT_NAME || child->id < 0 || child->id >= ntaxa) {
+					clear();
+					return false;
+				}
+				child_id = child->id;
+			} else {
+				child_id = ntaxa + left.size();
+				left.push_back(-1);
+				right.push_back(-1);
+				stack_node.push_back(child);
+				stack_dad.push_back(node);
+				stack_id.push_back(child_id);
+			}
+			if (nchild++ == 0)
+				left[id - ntaxa] = child_id;
+			else
+				right[id - ntaxa] = child_id;
+		}
+	}
+	if (left.size() != ntaxa - 2) {
+		clear();
+		return false;
+	}
+	reverse(post_order.begin(), post_order.end());
+	return true;
+}
+
+bool ParsTopology::operator==(const ParsTopology &other) const {
+	return ntaxa == other.ntaxa && root_taxon == other.root_taxon && top == other.top
+			&& left == other.left && right == other.right;
+}
@@ -0,0 +1,58 @@
+/*
+ * parstopology.h
+ *
+ *  Flat representation of an unrooted binary tree for computing its parsimony score
+ *  without walking the Node/Neighbor objects (see PhyloTree::computeParsimonyFlat).
+ */
+
+#ifndef PARSTOPOLOGY_H_
+#define PARSTOPOLOGY_H_
+
+#include "tools.h"
+
+class Node;
+
+/**
+ * Unrooted binary tree rooted at one of its leaves, stored as arrays indexed by node:
+ * leaves are numbered by their taxon ID (0..ntaxa-1), internal nodes by ntaxa, ntaxa+1, ...
+ * in the order they are reached from the root leaf. Copying a ParsTopology only copies a few arrays.
+ */
+class ParsTopology {
+public:
+	ParsTopology();
+
+	/**
+	 * build the arrays from a tree
+	 * @param root a leaf of the tree, the tree is rooted at it
+	 * @param ntaxa number of taxa of the tree
+	 * @return FALSE if the tree cannot be represented (multifurcating tree or rooted tree with a virtual root),
+	 * the arrays are then cleared
+	 */
+	bool build(Node *root, int ntaxa);
+
+	/** remove the tree */
+	void clear();
+
+	/** @return number of nodes, i.e. leaves and internal nodes */
+	int getNNodes() { return ntaxa + left.size(); }
+
+	/** @return TRUE if the same tree rooted at the same leaf is stored, with the same node numbers */
+	bool operator==(const ParsTopology &other) const;
+
+	/** number of taxa */
+	int ntaxa;
+
+	/** taxon ID of the leaf the tree is rooted at, -1 if no tree is stored */
+	int root_taxon;
+
+	/** the node below the root leaf */
+	int top;
+
+	/** children of internal node ntaxa + i */
+	IntVector left, right;
+
+	/** internal nodes in post-order, i.e. every node after its children */
+	IntVector post_order;
+};
+
+#endif /* PARSTOPOLOGY_H_ */
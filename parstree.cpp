@@ -102,17 +102,7 @@ int ParsTree::computeParsimony(){
 //	assert(root && root->isLeaf());
 //    cout << "nstates = " << aln->num_states << endl;
 //	clearAllPartialLH();
-    assert(root->isLeaf());
-    PhyloNeighbor *nei = ((PhyloNeighbor*) root->neighbors[0]);
-    current_it = nei;
-    assert(current_it);
-    current_it_back = (PhyloNeighbor*) nei->node->findNeighbor(root);
-    assert(current_it_back);
-
-    int nptn = aln->size();
-    if(_pattern_pars == NULL) _pattern_pars = aligned_alloc<BootValTypePars>(nptn + VCSIZE_USHORT);
-
-    return computeParsimonyBranch((PhyloNeighbor*) root->neighbors[0], (PhyloNode*) root);
+    return PhyloTree::computeParsimony();
 }
 
 //inline UINT computeCostFromChild(UINT child_cost, UINT transition_cost){
@@ -130,197 +120,182 @@ void ParsTree::computePartialParsimony(PhyloNeighbor *dad_branch, PhyloNode *dad
         return;
 
     Node *node = dad_branch->node;
-    //assert(node->degree() <= 3);
-    int ptn;
+    assert(dad_branch->partial_pars);
+
+    if (node->isLeaf() && dad) {
+        // external node
+        computeLeafPartialPars(dad_branch->partial_pars, (node->name == ROOT_NAME) ? -1 : node->id);
+    } else {
+        // internal node
+        vector<UINT*> children;
+        FOR_NEIGHBOR_IT(node, dad, it)if ((*it)->node->name != ROOT_NAME) {
+            computePartialParsimony((PhyloNeighbor*) (*it), (PhyloNode*) node);
+            children.push_back(((PhyloNeighbor*)*it)->partial_pars);
+        }
+        computeInternalPartialPars(dad_branch->partial_pars, &children[0], children.size());
+    }
+
+    dad_branch->partial_lh_computed |= 2;
+}
+
+void ParsTree::computeLeafPartialPars(UINT *partial_pars, int taxon){
     if(aln->num_states != cost_nstates){
         cout << "Your cost matrix is not compatible with the alignment"
             << " in terms of number of states. Please check!" << endl;
         exit(1);
     }
     int nstates = aln->num_states;
-    assert(dad_branch->partial_pars);
-
     int pars_block_size = getParsBlockSize();
 
-    if (node->isLeaf() && dad) {
-//        cout << "############# leaf!" << endl;
-        // external node
-        for(int i = 0; i < pars_block_size - 1; i++)
-            dad_branch->partial_pars[i] = 1000;
-        dad_branch->partial_pars[pars_block_size - 1] = 0; // reserved for corresponding subtree pars
-        for (ptn = 0; ptn < aln->size(); ptn++){
-            // ignore const ptn because it does not affect pars score
-            if (!aln->at(ptn).is_const) {
-                int ptn_start_index = ptn * nstates;
-                char state;
-                if (node->name == ROOT_NAME) {
-                    state = aln->STATE_UNKNOWN;
-                } else {
-                    assert(node->id < aln->getNSeq());
-                    state = (aln->at(ptn))[node->id];
-                }
+    for(int i = 0; i < pars_block_size - 1; i++)
+        partial_pars[i] = 1000;
+    partial_pars[pars_block_size - 1] = 0; // reserved for corresponding subtree pars
+    for (int ptn = 0; ptn < aln->size(); ptn++){
+        // ignore const ptn because it does not affect pars score
+        if (!aln->at(ptn).is_const) {
+            int ptn_start_index = ptn * nstates;
+            char state;
+            if (taxon < 0) {
+                state = aln->STATE_UNKNOWN;
+            } else {
+                assert(taxon < aln->getNSeq());
+                state = (aln->at(ptn))[taxon];
+            }
 
-                if (state < nstates) {
-                    dad_branch->partial_pars[ptn_start_index + state] = 0;
-                } else {
-                    // unknown, ambiguous character
-//                    cout << "####### ambigous state = " << int(state) << endl;
-                    initLeafSiteParsForAmbiguousState(state, dad_branch->partial_pars + ptn_start_index);
-                }
+            if (state < nstates) {
+                partial_pars[ptn_start_index + state] = 0;
+            } else {
+                // unknown, ambiguous character
+//                cout << "####### ambigous state = " << int(state) << endl;
+                initLeafSiteParsForAmbiguousState(state, partial_pars + ptn_start_index);
             }
         }
-    } else {
-//        cout << "############# internal!" << endl;
-        // internal node
-        UINT i, j, ptn, min_child_ptn_pars;
-
-        UINT * partial_pars = dad_branch->partial_pars;
-        for(int i = 0; i < pars_block_size; i++)
-            partial_pars[i] = 0;
-        UINT *left = NULL, *right = NULL;
+    }
+}
 
-        FOR_NEIGHBOR_IT(node, dad, it)if ((*it)->node->name != ROOT_NAME) {
-            computePartialParsimony((PhyloNeighbor*) (*it), (PhyloNode*) node);
-            if (!left)
-                left = ((PhyloNeighbor*)*it)->partial_pars;
-            else
-                right = ((PhyloNeighbor*)*it)->partial_pars;
+void ParsTree::computeInternalPartialPars(UINT *partial_pars, UINT **children, int nchildren){
+    int nstates = aln->num_states;
+    int pars_block_size = getParsBlockSize();
+    UINT i, j, ptn, min_child_ptn_pars;
+
+    for(int i = 0; i < pars_block_size; i++)
+        partial_pars[i] = 0;
+
+    if (nchildren != 2) {
+        for (int child = 0; child < nchildren; child++) {
+            UINT *partial_pars_child = children[child];
+            for (ptn = 0; ptn < aln->size(); ptn++){
+                // ignore const ptn because it does not affect pars score
+                if (aln->at(ptn).is_const) continue;
+                int ptn_start_index = ptn*nstates;
+
+                UINT *partial_pars_child_ptr = &partial_pars_child[ptn_start_index];
+                UINT *partial_pars_ptr = &partial_pars[ptn_start_index];
+                UINT *cost_matrix_ptr = cost_matrix;
+
+                for(i = 0; i < nstates; i++){
+                    // min(j->i) from child_branch
+                    min_child_ptn_pars = partial_pars_child_ptr[0] + cost_matrix_ptr[0];
+                    for(j = 1; j < nstates; j++) {
+                        UINT value = partial_pars_child_ptr[j] + cost_matrix_ptr[j];
+                        min_child_ptn_pars = min(value, min_child_ptn_pars);
+                    }
+                    partial_pars_ptr[i] += min_child_ptn_pars;
+                    cost_matrix_ptr += nstates;
+                }
+            }
         }
+        return;
+    }
 
+    // bifurcating node
+    UINT *left = children[0], *right = children[1];
+    switch (nstates) {
+    case 4:
+        for (ptn = 0; ptn < aln->size(); ptn++){
+            // ignore const ptn because it does not affect pars score
+            if (aln->at(ptn).is_const) continue;
+            int ptn_start_index = ptn*4;
 
-        if (node->degree() > 3) {
-            FOR_NEIGHBOR_IT(node, dad, it) if ((*it)->node->name != ROOT_NAME) {
-                UINT *partial_pars_child = ((PhyloNeighbor*) (*it))->partial_pars;
-                for (ptn = 0; ptn < aln->size(); ptn++){
-                    // ignore const ptn because it does not affect pars score
-                    if (aln->at(ptn).is_const) continue;
-                    int ptn_start_index = ptn*nstates;
-
-                    UINT *partial_pars_child_ptr = &partial_pars_child[ptn_start_index];
-                    UINT *partial_pars_ptr = &partial_pars[ptn_start_index];
-                    UINT *cost_matrix_ptr = cost_matrix;
-
-                    for(i = 0; i < nstates; i++){
-                        // min(j->i) from child_branch
-                        min_child_ptn_pars = partial_pars_child_ptr[0] + cost_matrix_ptr[0];
-                        for(j = 1; j < nstates; j++) {
-                            UINT value = partial_pars_child_ptr[j] + cost_matrix_ptr[j];
-                            min_child_ptn_pars = min(value, min_child_ptn_pars);
-                        }
-                        partial_pars_ptr[i] += min_child_ptn_pars;
-                        cost_matrix_ptr += nstates;
-                    }
+            UINT *left_ptr = &left[ptn_start_index];
+            UINT *right_ptr = &right[ptn_start_index];
+            UINT *partial_pars_ptr = &partial_pars[ptn_start_index];
+            UINT *cost_matrix_ptr = cost_matrix;
+            UINT left_contrib, right_contrib;
+
+            for(i = 0; i < 4; i++){
+                // min(j->i) from child_branch
+                left_contrib = left_ptr[0] + cost_matrix_ptr[0];
+                right_contrib = right_ptr[0] + cost_matrix_ptr[0];
+                for(j = 1; j < 4; j++) {
+                    UINT value = left_ptr[j] + cost_matrix_ptr[j];
+                    left_contrib = min(value, left_contrib);
+                    value = right_ptr[j] + cost_matrix_ptr[j];
+                    right_contrib = min(value, right_contrib);
                 }
+                partial_pars_ptr[i] = left_contrib+right_contrib;
+                cost_matrix_ptr += 4;
             }
-        } else {
-            // bifurcating node
-            assert(node->degree() == 3);
-
-            switch (nstates) {
-            case 4:
-                for (ptn = 0; ptn < aln->size(); ptn++){
-                    // ignore const ptn because it does not affect pars score
-                    if (aln->at(ptn).is_const) continue;
-                    int ptn_start_index = ptn*4;
-
-                    UINT *left_ptr = &left[ptn_start_index];
-                    UINT *right_ptr = &right[ptn_start_index];
-                    UINT *partial_pars_ptr = &partial_pars[ptn_start_index];
-                    UINT *cost_matrix_ptr = cost_matrix;
-                    UINT left_contrib, right_contrib;
-
-                    for(i = 0; i < 4; i++){
-                        // min(j->i) from child_branch
-                        left_contrib = left_ptr[0] + cost_matrix_ptr[0];
-                        right_contrib = right_ptr[0] + cost_matrix_ptr[0];
-                        for(j = 1; j < 4; j++) {
-                            UINT value = left_ptr[j] + cost_matrix_ptr[j];
-                            left_contrib = min(value, left_contrib);
-                            value = right_ptr[j] + cost_matrix_ptr[j];
-                            right_contrib = min(value, right_contrib);
-                        }
-                        partial_pars_ptr[i] = left_contrib+right_contrib;
-                        cost_matrix_ptr += 4;
-                    }
-                }
-                break;
-            case 20:
-                for (ptn = 0; ptn < aln->size(); ptn++){
-                    // ignore const ptn because it does not affect pars score
-                    if (aln->at(ptn).is_const) continue;
-                    int ptn_start_index = ptn*20;
-
-                    UINT *left_ptr = &left[ptn_start_index];
-                    UINT *right_ptr = &right[ptn_start_index];
-                    UINT *partial_pars_ptr = &partial_pars[ptn_start_index];
-                    UINT *cost_matrix_ptr = cost_matrix;
-                    UINT left_contrib, right_contrib;
-
-                    for(i = 0; i < 20; i++){
-                        // min(j->i) from child_branch
-                        left_contrib = left_ptr[0] + cost_matrix_ptr[0];
-                        right_contrib = right_ptr[0] + cost_matrix_ptr[0];
-                        for(j = 1; j < 20; j++) {
-                            UINT value = left_ptr[j] + cost_matrix_ptr[j];
-                            left_contrib = min(value, left_contrib);
-                            value = right_ptr[j] + cost_matrix_ptr[j];
-                            right_contrib = min(value, right_contrib);
-                        }
-                        partial_pars_ptr[i] = left_contrib+right_contrib;
-                        cost_matrix_ptr += 20;
-                    }
-                }
-                break;
-            default:
-                for (ptn = 0; ptn < aln->size(); ptn++){
-                    // ignore const ptn because it does not affect pars score
-                    if (aln->at(ptn).is_const) continue;
-                    int ptn_start_index = ptn*nstates;
-
-                    UINT *left_ptr = &left[ptn_start_index];
-                    UINT *right_ptr = &right[ptn_start_index];
-                    UINT *partial_pars_ptr = &partial_pars[ptn_start_index];
-                    UINT *cost_matrix_ptr = cost_matrix;
-                    UINT left_contrib, right_contrib;
-
-                    for(i = 0; i < nstates; i++){
-                        // min(j->i) from child_branch
-                        left_contrib = left_ptr[0] + cost_matrix_ptr[0];
-                        right_contrib = right_ptr[0] + cost_matrix_ptr[0];
-                        for(j = 1; j < nstates; j++) {
-                            UINT value = left_ptr[j] + cost_matrix_ptr[j];
-                            left_contrib = min(value, left_contrib);
-                            value = right_ptr[j] + cost_matrix_ptr[j];
-                            right_contrib = min(value, right_contrib);
-                        }
-                        partial_pars_ptr[i] = left_contrib+right_contrib;
-                        cost_matrix_ptr += nstates;
-                    }
+        }
+        break;
+    case 20:
+        for (ptn = 0; ptn < aln->size(); ptn++){
+            // ignore const ptn because it does not affect pars score
+            if (aln->at(ptn).is_const) continue;
+            int ptn_start_index = ptn*20;
+
+            UINT *left_ptr = &left[ptn_start_index];
+            UINT *right_ptr = &right[ptn_start_index];
+            UINT *partial_pars_ptr = &partial_pars[ptn_start_index];
+            UINT *cost_matrix_ptr = cost_matrix;
+            UINT left_contrib, right_contrib;
+
+            for(i = 0; i < 20; i++){
+                // min(j->i) from child_branch
+                left_contrib = left_ptr[0] + cost_matrix_ptr[0];
+                right_contrib = right_ptr[0] + cost_matrix_ptr[0];
+                for(j = 1; j < 20; j++) {
+                    UINT value = left_ptr[j] + cost_matrix_ptr[j];
+                    left_contrib = min(value, left_contrib);
+                    value = right_ptr[j] + cost_matrix_ptr[j];
+                    right_contrib = min(value, right_contrib);
                 }
-                break;
+                partial_pars_ptr[i] = left_contrib+right_contrib;
+                cost_matrix_ptr += 20;
             }
-
         }
-        /*
-
-        // calc subtree pars
+        break;
+    default:
         for (ptn = 0; ptn < aln->size(); ptn++){
             // ignore const ptn because it does not affect pars score
             if (aln->at(ptn).is_const) continue;
-            int ptn_start_index = ptn * nstates;
-            UINT min_ptn_pars = partial_pars[ptn_start_index];
-            for(i = 1; i < nstates; i++){
-                if(partial_pars[ptn_start_index + i] < min_ptn_pars)
-                    min_ptn_pars = partial_pars[ptn_start_index + i];
+            int ptn_start_index = ptn*nstates;
+
+            UINT *left_ptr = &left[ptn_start_index];
+            UINT *right_ptr = &right[ptn_start_index];
+            UINT *partial_pars_ptr = &partial_pars[ptn_start_index];
+            UINT *cost_matrix_ptr = cost_matrix;
+            UINT left_contrib, right_contrib;
+
+            for(i = 0; i < nstates; i++){
+                // min(j->i) from child_branch
+                left_contrib = left_ptr[0] + cost_matrix_ptr[0];
+                right_contrib = right_ptr[0] + cost_matrix_ptr[0];
+                for(j = 1; j < nstates; j++) {
+                    UINT value = left_ptr[j] + cost_matrix_ptr[j];
+                    left_contrib = min(value, left_contrib);
+                    value = right_ptr[j] + cost_matrix_ptr[j];
+                    right_contrib = min(value, right_contrib);
+                }
+                partial_pars_ptr[i] = left_contrib+right_contrib;
+                cost_matrix_ptr += nstates;
             }
-            partial_pars[pars_block_size - 1] += min_ptn_pars * aln->at(ptn).frequency;
         }
-        */
+        break;
     }
-
-    dad_branch->partial_lh_computed |= 2;
 }
 
+
 void ParsTree::initLeafSiteParsForAmbiguousState(char state, UINT * site_partial_pars){
     int i, nstates = aln->num_states;
     if(state < nstates) return; // no need for manipulate normal state
@@ -441,7 +416,7 @@ int ParsTree::computeParsimonyBranch(PhyloNeighbor *dad_branch, PhyloNode *dad,
     PhyloNeighbor *node_branch = (PhyloNeighbor*) node->findNeighbor(dad);
     assert(node_branch);
 
-    if (!central_partial_pars)
+    if (!central_partial_pars || !dad_branch->partial_pars || !node_branch->partial_pars)
         initializeAllPartialPars();
 
     // DTH: I don't really understand what this is for. ###########
@@ -456,15 +431,19 @@ int ParsTree::computeParsimonyBranch(PhyloNeighbor *dad_branch, PhyloNode *dad,
 //        cout << "swapped\n";
     }
 
-    int nptn = aln->size();
-    if(!_pattern_pars) _pattern_pars = aligned_alloc<BootValTypePars>(nptn+VCSIZE_USHORT);
-    memset(_pattern_pars, 0, sizeof(BootValTypePars) * (nptn+VCSIZE_USHORT));
-
     if ((dad_branch->partial_lh_computed & 2) == 0)
         computePartialParsimony(dad_branch, dad);
     if ((node_branch->partial_lh_computed & 2) == 0)
         computePartialParsimony(node_branch, node);
 
+    return computeBranchParsimony(node_branch->partial_pars, dad_branch->partial_pars, branch_subst);
+}
+
+int ParsTree::computeBranchParsimony(UINT *node_pars, UINT *dad_pars, int *branch_subst) {
+    int nptn = aln->size();
+    if(!_pattern_pars) _pattern_pars = aligned_alloc<BootValTypePars>(nptn+VCSIZE_USHORT);
+    memset(_pattern_pars, 0, sizeof(BootValTypePars) * (nptn+VCSIZE_USHORT));
+
     // now combine likelihood at the branch
     tree_pars = 0;
     int nstates = aln->num_states;
@@ -483,8 +462,8 @@ int ParsTree::computeParsimonyBranch(PhyloNeighbor *dad_branch, PhyloNode *dad,
             if (aln->at(ptn).is_const) continue;
             
             int ptn_start_index = ptn * 4;
-            UINT *node_branch_ptr = &node_branch->partial_pars[ptn_start_index];
-            UINT *dad_branch_ptr = &dad_branch->partial_pars[ptn_start_index];
+            UINT *node_branch_ptr = &node_pars[ptn_start_index];
+            UINT *dad_branch_ptr = &dad_pars[ptn_start_index];
             UINT *cost_matrix_ptr = cost_matrix;
             UINT min_ptn_pars = UINT_MAX;
             for(i = 0; i < 4; i++){
@@ -510,8 +489,8 @@ int ParsTree::computeParsimonyBranch(PhyloNeighbor *dad_branch, PhyloNode *dad,
             if (aln->at(ptn).is_const) continue;
             
             int ptn_start_index = ptn * nstates;
-            UINT *node_branch_ptr = &node_branch->partial_pars[ptn_start_index];
-            UINT *dad_branch_ptr = &dad_branch->partial_pars[ptn_start_index];
+            UINT *node_branch_ptr = &node_pars[ptn_start_index];
+            UINT *dad_branch_ptr = &dad_pars[ptn_start_index];
             UINT *cost_matrix_ptr = cost_matrix;
             UINT min_ptn_pars = UINT_MAX;
             for(i = 0; i < nstates; i++){
@@ -540,6 +519,11 @@ int ParsTree::computeParsimonyBranch(PhyloNeighbor *dad_branch, PhyloNode *dad,
     return tree_pars;
 }
 
+size_t ParsTree::getFlatParsBlockSize(){
+    return getParsBlockSize();
+}
+
+
 void ParsTree::initializeAllPartialPars() {
 	PhyloTree::initializeAllPartialPars();
 //    if(params->maximum_parsimony && (!_pattern_pars))
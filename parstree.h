@@ -66,6 +66,14 @@ public:
     */
     int computeParsimonyBranch(PhyloNeighbor *dad_branch, PhyloNode *dad, int *branch_subst = NULL);
 
+    /**
+        Sankoff versions of the per-node steps of PhyloTree::computeParsimonyFlat()
+     */
+    virtual void computeLeafPartialPars(UINT *partial_pars, int taxon);
+    virtual void computeInternalPartialPars(UINT *partial_pars, UINT **children, int nchildren);
+    virtual int computeBranchParsimony(UINT *node_pars, UINT *dad_pars, int *branch_subst = NULL);
+    virtual size_t getFlatParsBlockSize();
+
     /**
         initialize partial_pars vector of all PhyloNeighbors, allocating central_partial_pars
      */
@@ -66,6 +66,9 @@
 //#include <unistd.h>
 #include <stdlib.h>
 #include "sprparsimony.h"
+#include "checkpoint.h"
+#include "perfcounter.h"
+#include "benchmark.h"
 #include "vectorclass/vectorclass.h"
 
 #ifdef _OPENMP
@@ -2185,10 +2188,14 @@ int main(int argc, char *argv[])
 
 	Params params;
 	parseArg(argc, argv, params);
+	perfInit(params.perf_report);
 
 	_log_file = params.out_prefix;
 	_log_file += ".log";
-	startLogFile();
+	if (params.checkpoint_resume)
+		appendLogFile();
+	else
+		startLogFile();
 	atexit(funcExit);
 	signal(SIGABRT, &funcAbort);
 	signal(SIGFPE, &funcAbort);
@@ -2267,6 +2274,22 @@ int main(int argc, char *argv[])
 		cout << " " << argv[i];
 	cout << endl;
 
+	if (params.checkpoint_resume) {
+		// bootstrap samples and initial trees are generated again before the search resumes,
+		// thus the interrupted run must be continued with its own seed
+		Checkpoint checkpoint;
+		checkpoint.setFileName(string(params.out_prefix) + ".ckp.gz");
+		if (fileExists(checkpoint.filename)) {
+			checkpoint.load();
+			if (checkpoint.containsKey("ran_seed"))
+				checkpoint.get("ran_seed", params.ran_seed);
+			cout << "Resume:  " << checkpoint.filename << endl;
+		} else {
+			outWarning("Checkpoint file " + checkpoint.filename + " not found, starting a new run");
+			params.checkpoint_resume = false;
+		}
+	}
+
 	cout << "Seed:    " << params.ran_seed <<  " ";
 	init_random(params.ran_seed);
 
@@ -2298,8 +2321,8 @@ int main(int argc, char *argv[])
 			break;
 		}
 	}
-
-
+	if (params.maximum_parsimony)
+		cout << " - Fitch " << pllSelectFitchKernel(params.fitch_kernel);
 
 #ifdef _OPENMP
 	if (params.num_threads) omp_set_num_threads(params.num_threads);
@@ -2332,6 +2355,10 @@ int main(int argc, char *argv[])
 		test(params);
 	} else if(params.print_site_pars_user_tree){
 		printSiteParsimonyUserTree(params);
+	} else if (params.compute_parsimony_batch) {
+		computeUserTreesParsimonyBatch(params);
+	} else if (params.bench_mode) {
+		runBenchmark(params);
 	} else if (params.compute_parsimony) {
 		computeUserTreeParsimomy(params);
 	}
@@ -2428,6 +2455,15 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (params.perf_report) {
+		string command = argv[0];
+		for (int i = 1; i < argc; i++)
+			command = command + " " + argv[i];
+		string perf_file = string(params.out_prefix) + ".perf.json";
+		perfWriteReport(perf_file.c_str(), command.c_str());
+		cout << "Performance report written to " << perf_file << endl;
+	}
+
 	time(&cur_time);
 	cout << "Date and Time: " << ctime(&cur_time);
 
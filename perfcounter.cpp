@@ -0,0 +1,145 @@
+/*
+ * perfcounter.cpp
+ *
+ *  Phase timers and event counters of a run, see perfcounter.h
+ */
+
+#include "perfcounter.h"
+#include "timeutil.h"
+#include "tools.h"
+
+PerfThreadCounts perf_counts[PERF_MAX_THREADS];
+
+static const char *perf_phase_names[PERF_NUM_PHASES] = {
+	"alignment_load", "ras", "spr", "ratchet", "save_tree", "summarize_bootstrap", "optimize_boot_trees"
+};
+
+static const char *perf_event_names[PERF_NUM_EVENTS] = {
+	"spr_candidates", "newview_nodes", "rell_evaluations", "rell_skipped", "newick_conversions"
+};
+
+struct PerfPhaseTime {
+	int depth; // # of nested starts
+	uint64_t calls;
+	double wall, cpu; // accumulated times
+	double wall_start, cpu_start; // of the running outermost call
+};
+
+static PerfPhaseTime perf_phases[PERF_NUM_PHASES];
+static double perf_wall_start = 0.0, perf_cpu_start = 0.0;
+static bool perf_timers = false;
+
+/* @return TRUE if called from inside an active parallel region */
+static inline bool perfInParallel() {
+#ifdef _OPENMP
+	return omp_in_parallel();
+#else
+	return false;
+#endif
+}
+
+void perfInit(bool timers) {
+	perf_timers = timers;
+	perf_wall_start = getRealTime();
+	perf_cpu_start = getCPUTime();
+}
+
+void perfStartPhase(PerfPhase phase) {
+	if (!perf_timers || perfInParallel())
+		return;
+	PerfPhaseTime &t = perf_phases[phase];
+	if (t.depth++ > 0)
+		return;
+	t.calls++;
+	t.wall_start = getRealTime();
+	t.cpu_start = getCPUTime();
+}
+
+void perfStopPhase(PerfPhase phase) {
+	if (!perf_timers || perfInParallel())
+		return;
+	PerfPhaseTime &t = perf_phases[phase];
+	if (--t.depth > 0)
+		return;
+	t.wall += getRealTime() - t.wall_start;
+	t.cpu += getCPUTime() - t.cpu_start;
+}
+
+/* write s as a JSON string */
+static void perfWriteString(ostream &out, const char *s) {
+	out << '"';
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			out << '\\' << *s;
+		else if ((unsigned char)*s < 0x20)
+			out << ' ';
+		else
+			out << *s;
+	}
+	out << '"';
+}
+
+void perfWriteReport(const char *file_name, const char *command) {
+	ofstream out;
+	out.exceptions(ios::failbit | ios::badbit);
+	try {
+		out.open(file_name);
+		out.setf(ios::fixed);
+		out.precision(6);
+		out << "{" << endl;
+		out << "  \"command\": ";
+		perfWriteString(out, command);
+		out << "," << endl;
+		out << "  \"total\": {\"wall\": " << getRealTime() - perf_wall_start
+			<< ", \"cpu\": " << getCPUTime() - perf_cpu_start << "}," << endl;
+
+		out << "  \"phases\": {" << endl;
+		for (int i = 0; i < PERF_NUM_PHASES; i++) {
+			PerfPhaseTime &t = perf_phases[i];
+			out << "    \"" << perf_phase_names[i] << "\": {\"calls\": " << t.calls << ", \"wall\": " << t.wall
+				<< ", \"cpu\": " << t.cpu << "}" << ((i < PERF_NUM_PHASES - 1) ? "," : "") << endl;
+		}
+		out << "  }," << endl;
+
+		out << "  \"counters\": {" << endl;
+		for (int i = 0; i < PERF_NUM_EVENTS; i++)
+			out << "    \"" << perf_event_names[i] << "\": " << perfGetCount((PerfEvent)i)
+				<< ((i < PERF_NUM_EVENTS - 1) ? "," : "") << endl;
+		out << "  }" << endl;
+		out << "}" << endl;
+		out.close();
+	} catch (ios::failure) {
+		outError(ERR_WRITE_OUTPUT, file_name);
+	}
+}
+
+void perfReset() {
+	for (int i = 0; i < PERF_NUM_PHASES; i++) {
+		perf_phases[i].calls = 0;
+		perf_phases[i].wall = perf_phases[i].cpu = 0.0;
+	}
+	for (int thread = 0; thread < PERF_MAX_THREADS; thread++)
+		for (int i = 0; i < PERF_NUM_EVENTS; i++)
+			perf_counts[thread].count[i] = 0;
+}
+
+const char *perfPhaseName(PerfPhase phase) {
+	return perf_phase_names[phase];
+}
+
+const char *perfEventName(PerfEvent event) {
+	return perf_event_names[event];
+}
+
+uint64_t perfGetPhase(PerfPhase phase, double &wall, double &cpu) {
+	wall = perf_phases[phase].wall;
+	cpu = perf_phases[phase].cpu;
+	return perf_phases[phase].calls;
+}
+
+uint64_t perfGetCount(PerfEvent event) {
+	uint64_t sum = 0;
+	for (int thread = 0; thread < PERF_MAX_THREADS; thread++)
+		sum += perf_counts[thread].count[event];
+	return sum;
+}
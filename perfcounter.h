@@ -0,0 +1,116 @@
+/*
+ * perfcounter.h
+ *
+ *  Phase timers and event counters of a run, written as a JSON report with -perf (see perfWriteReport()).
+ */
+
+#ifndef PERFCOUNTER_H_
+#define PERFCOUNTER_H_
+
+#include <stdint.h>
+#ifdef _OPENMP
+	#include <omp.h>
+#endif
+
+/**
+ * phases of a run, timed by PerfPhaseTimer. Phases are inclusive and may nest,
+ * e.g. save_tree is also counted in the spr phase it is called from.
+ */
+enum PerfPhase {
+	PERF_ALN_LOAD, // reading and compressing the alignment
+	PERF_RAS, // random stepwise addition trees (including their SPR rounds)
+	PERF_SPR, // SPR hill-climbing of the tree search and of optimizeBootTrees
+	PERF_RATCHET, // hill-climbing on the perturbed alignment of the ratchet
+	PERF_SAVE_TREE, // IQTree::saveCurrentTree, i.e. RELL of a tree on all bootstrap replicates
+	PERF_SUMMARIZE_BOOT, // building the consensus tree and supports
+	PERF_OPTIMIZE_BOOT, // IQTree::optimizeBootTrees
+	PERF_NUM_PHASES
+};
+
+/** events counted by perfCount() */
+enum PerfEvent {
+	PERF_SPR_CANDIDATES, // SPR regraft positions evaluated
+	PERF_NEWVIEW_NODES, // nodes updated by newviewParsimonyIterativeFast
+	PERF_RELL_EVALS, // bootstrap replicates a tree was evaluated on
+	PERF_RELL_SKIPPED, // of them, those stopped early by boot_samples_pars_remain_bounds
+	PERF_NEWICK, // PLL trees converted to or from Newick strings (pllTreeToNewickString, pllParseNewickString)
+	PERF_NUM_EVENTS
+};
+
+/** max # of threads with their own counters, further threads share the last one */
+#define PERF_MAX_THREADS 256
+
+/** counters of one thread, padded to a cache line to avoid false sharing */
+struct PerfThreadCounts {
+	uint64_t count[PERF_NUM_EVENTS];
+	char pad[64 - (PERF_NUM_EVENTS * sizeof(uint64_t)) % 64];
+};
+
+extern PerfThreadCounts perf_counts[PERF_MAX_THREADS];
+
+/**
+ * add n to the counter of an event, cheap enough to be called from the parsimony kernels
+ */
+inline void perfCount(PerfEvent event, uint64_t n = 1) {
+	int thread = 0;
+#ifdef _OPENMP
+	thread = omp_get_thread_num();
+	if (thread >= PERF_MAX_THREADS) {
+#pragma omp atomic
+		perf_counts[PERF_MAX_THREADS - 1].count[event] += n;
+		return;
+	}
+#endif
+	perf_counts[thread].count[event] += n;
+}
+
+/**
+ * start/stop timing a phase. Only the outermost start/stop pair of a phase is timed, and calls
+ * from inside a parallel region are ignored: phases run in parallel are timed by their serial caller.
+ * Nothing is timed unless enabled by perfInit().
+ */
+void perfStartPhase(PerfPhase phase);
+void perfStopPhase(PerfPhase phase);
+
+/** times a phase for the lifetime of the object */
+class PerfPhaseTimer {
+public:
+	PerfPhaseTimer(PerfPhase phase) : phase(phase) { perfStartPhase(phase); }
+	~PerfPhaseTimer() { perfStopPhase(phase); }
+private:
+	PerfPhase phase;
+};
+
+/**
+ * start the clocks of the whole run
+ * @param timers TRUE to time the phases, the events are always counted
+ */
+void perfInit(bool timers);
+
+/**
+ * write the phase times and event counts as JSON
+ * @param file_name output file
+ * @param command the command line of the run
+ */
+void perfWriteReport(const char *file_name, const char *command);
+
+/** clear the phase times and event counts, e.g. between the runs of the benchmark (see benchmark.h) */
+void perfReset();
+
+/** @return name of a phase as written into the report */
+const char *perfPhaseName(PerfPhase phase);
+
+/** @return name of an event as written into the report */
+const char *perfEventName(PerfEvent event);
+
+/**
+ * get the accumulated time of a phase
+ * @param[out] wall, cpu wall-clock and CPU seconds
+ * @return # of (outermost) calls of the phase
+ */
+uint64_t perfGetPhase(PerfPhase phase, double &wall, double &cpu);
+
+/** @return count of an event summed over all threads */
+uint64_t perfGetCount(PerfEvent event);
+
+#endif /* PERFCOUNTER_H_ */
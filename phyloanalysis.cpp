@@ -28,6 +28,7 @@
 #include "phyloanalysis.h"
 #include "alignment.h"
 #include "superalignment.h"
+#include "alignmentweightview.h"
 #include "iqtree.h"
 #include "model/modelgtr.h"
 #include "model/modeldna.h"
@@ -51,6 +52,7 @@
 #include "model/modelset.h"
 #include "timeutil.h"
 #include "parstree.h"
+#include "perfcounter.h"
 #include "tinatree.h"
 #include "sprparsimony.h"
 #include <algorithm>
@@ -1168,8 +1170,7 @@ void computeInitialTree(Params &params, IQTree &iqtree, string &dist_file, int &
 			pllComputeRandomizedStepwiseAdditionParsimonyTree(iqtree.pllInst, iqtree.pllPartitions, params.sprDist);
 
 		resetBranches(iqtree.pllInst);
-		pllTreeToNewick(iqtree.pllInst->tree_string, iqtree.pllInst, iqtree.pllPartitions, iqtree.pllInst->start->back,
-				PLL_TRUE, PLL_TRUE, PLL_FALSE, PLL_FALSE, PLL_FALSE, PLL_SUMMARIZE_LH, PLL_FALSE, PLL_FALSE);
+		pllTreeToNewickString(iqtree.pllInst, iqtree.pllPartitions);
 		iqtree.readTreeString(string(iqtree.pllInst->tree_string));
 		iqtree.initializeAllPartialPars();
 		iqtree.clearAllPartialLH();
@@ -1206,9 +1207,7 @@ void computeInitialTree(Params &params, IQTree &iqtree, string &dist_file, int &
     }
     initTree = iqtree.getTreeString();
     if (params.pll) {
-        pllNewickTree *newick = pllNewickParseString(initTree.c_str());
-        pllTreeInitTopologyNewick(iqtree.pllInst, newick, PLL_TRUE);
-        pllNewickParseDestroy(&newick);
+        iqtree.initPLLTopology(iqtree.pllInst, true);
 //        pllInitModel(iqtree.pllInst, iqtree.pllPartitions, iqtree.pllAlignment);
         pllInitModel(iqtree.pllInst, iqtree.pllPartitions);
     }
@@ -1253,6 +1252,44 @@ void initializeParams(Params &params, IQTree &iqtree, vector<ModelInfo> &model_i
     // set parameter for the current tree
     iqtree.setParams(params);
 }
+/*
+ *  Build the randomized stepwise addition (+SPR) parsimony trees 1..numInitTrees-1 with several threads.
+ *  Each thread works on its own PLL instance and tree treeNr always uses the seed params.ran_seed + treeNr * 12345,
+ *  so the trees do not depend on the number of threads.
+ *  @param parsTrees (OUT) parsTrees[treeNr] is the Newick string of tree treeNr,
+ *  left empty if only one thread is available (the caller then builds the trees one by one)
+ */
+void computeRASTreesParallel(Params &params, IQTree &iqtree, int numInitTrees, vector<string> &parsTrees) {
+#ifdef _OPENMP
+	int nthreads = min(omp_get_max_threads(), numInitTrees - 1);
+	if (nthreads <= 1)
+		return;
+
+	// PLL parsers are not thread-safe, thus create all instances beforehand
+	vector<pllInstance*> insts(nthreads);
+	vector<partitionList*> partitions(nthreads);
+	vector<pllAlignmentData*> alignments(nthreads);
+	for (int i = 0; i < nthreads; i++)
+		iqtree.createPLLInstance(params, insts[i], partitions[i], alignments[i]);
+
+	parsTrees.resize(numInitTrees);
+
+	PerfPhaseTimer perf_timer(PERF_RAS);
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+	for (int treeNr = 1; treeNr < numInitTrees; treeNr++) {
+		int id = omp_get_thread_num();
+		pllInstance *inst = insts[id];
+		inst->randomNumberSeed = params.ran_seed + treeNr * 12345;
+		_pllComputeRandomizedStepwiseAdditionParsimonyTree(inst, partitions[id], params.sprDist, NULL);
+		pllTreeToNewickString(inst, partitions[id]);
+		parsTrees[treeNr] = string(inst->tree_string);
+	}
+
+	for (int i = 0; i < nthreads; i++)
+		iqtree.destroyPLLInstance(insts[i], partitions[i], alignments[i]);
+#endif
+}
+
 /*
  *  Generate the initial candidate tree set
  *  @param numInitTrees number of parsimony trees to use
@@ -1267,9 +1304,14 @@ int initCandidateTreeSet(Params &params, IQTree &iqtree, int numInitTrees) {
     double startTime = getCPUTime();
     int numDupPars = 0;
 //    if(params.maximum_parsimony) iqtree.candidateTrees.clear(); // Diep: added this to fix the bug of sorted aln <> orig aln
+    vector<string> parsTrees;
+    if (params.start_tree == STT_PLL_PARSIMONY && params.maximum_parsimony && !params.sankoff_cost_file)
+    	computeRASTreesParallel(params, iqtree, numInitTrees, parsTrees);
     for (int treeNr = 1; treeNr < numInitTrees; treeNr++) {
         string curParsTree;
-        if (params.start_tree == STT_PLL_PARSIMONY) {
+        if (!parsTrees.empty()) {
+        	curParsTree = parsTrees[treeNr];
+        } else if (params.start_tree == STT_PLL_PARSIMONY) {
 			iqtree.pllInst->randomNumberSeed = params.ran_seed + treeNr * 12345;
 
 			if(params.maximum_parsimony){
@@ -1278,15 +1320,19 @@ int initCandidateTreeSet(Params &params, IQTree &iqtree, int numInitTrees) {
 			else
 				pllComputeRandomizedStepwiseAdditionParsimonyTree(iqtree.pllInst, iqtree.pllPartitions, params.sprDist);
 
-	        pllTreeToNewick(iqtree.pllInst->tree_string, iqtree.pllInst, iqtree.pllPartitions,
-					iqtree.pllInst->start->back, PLL_TRUE, PLL_TRUE, PLL_FALSE, PLL_FALSE, PLL_FALSE,
-					PLL_SUMMARIZE_LH, PLL_FALSE, PLL_FALSE);
+	        pllTreeToNewickString(iqtree.pllInst, iqtree.pllPartitions);
 			curParsTree = string(iqtree.pllInst->tree_string);
         } else {
             iqtree.computeParsimonyTree(NULL, iqtree.aln);
             curParsTree = iqtree.getTreeString();
         }
-        if (iqtree.candidateTrees.treeExist(curParsTree)) {
+        // the topology is computed once for the duplicate check and the candidate set
+        string curParsTopo;
+        if (params.start_tree == STT_PLL_PARSIMONY)
+            curParsTopo = iqtree.candidateTrees.getTopology(curParsTree);
+        else
+            curParsTopo = iqtree.candidateTrees.getTopology(&iqtree);
+        if (iqtree.candidateTrees.treeTopologyExist(curParsTopo)) {
             numDupPars++;
             continue;
         } else {
@@ -1304,15 +1350,14 @@ int initCandidateTreeSet(Params &params, IQTree &iqtree, int numInitTrees) {
         	}
             // Diep added IF statement for MP doesn't need branch optimization
             if(params.maximum_parsimony){
-        		iqtree.initializeAllPartialPars();
         		iqtree.clearAllPartialLH();
         		iqtree.curScore = -iqtree.computeParsimony();
-        		iqtree.candidateTrees.update(curParsTree, iqtree.curScore);
+        		iqtree.candidateTrees.update(curParsTree, iqtree.curScore, curParsTopo);
                 if (iqtree.curScore > iqtree.bestScore) {
                     iqtree.setBestTree(curParsTree, iqtree.curScore);
                 }
             }else
-            	iqtree.candidateTrees.update(curParsTree, -DBL_MAX);
+            	iqtree.candidateTrees.update(curParsTree, -DBL_MAX, curParsTopo);
         }
     }
     double parsTime = getCPUTime() - startTime;
@@ -1732,7 +1777,6 @@ void runTreeReconstruction(Params &params, string &original_model, IQTree &iqtre
     	initTree = iqtree.optimizeModelParameters(true);
     else{
     	iqtree.readTreeString(initTree);
-		iqtree.initializeAllPartialPars();
 		iqtree.clearAllPartialLH();
 		iqtree.curScore = -iqtree.computeParsimony();
     }
@@ -1924,8 +1968,8 @@ void runTreeReconstruction(Params &params, string &original_model, IQTree &iqtre
 	iqtree.printResultTree();
 
 
-	// To free data structures of PLL parsimony at the very end if NOT running ratchet or NOT -opt_btree
-    if(params.maximum_parsimony && params.spr_parsimony && (params.ratchet_iter < 0) && (!params.optimize_boot_trees) && (params.snni || params.pll)){
+	// To free data structures of PLL parsimony at the very end if NOT -opt_btree
+    if(params.maximum_parsimony && params.spr_parsimony && (!params.optimize_boot_trees) && (params.snni || params.pll)){
     	_pllFreeParsimonyDataStructures(iqtree.pllInst, iqtree.pllPartitions);
     }
 
@@ -1942,6 +1986,194 @@ void runTreeReconstruction(Params &params, string &original_model, IQTree &iqtre
 /**********************************************************
  * STANDARD NON-PARAMETRIC BOOTSTRAP
  ***********************************************************/
+/**
+ * @return TRUE if the MP trees of the standard bootstrap can be computed by computeBootTreesParallel()
+ */
+bool canComputeBootTreesParallel(Params &params, Alignment *alignment) {
+	// also with one thread, so that the trees do not depend on the number of threads
+	return params.maximum_parsimony && params.spr_parsimony && !params.sankoff_cost_file
+			&& !params.user_file && !params.bootstrap_spec && !alignment->isSuperAlignment()
+			&& alignment->getNSite() < USHRT_MAX && params.num_bootstrap_samples > 1;
+}
+
+/*
+ *  Compute the MP trees of the standard bootstrap (-b), with several threads if -omp is given.
+ *  The bootstrap samples are drawn one by one in replicate order (so .bootaln and .bootlh do not change),
+ *  then each replicate is searched on the PLL instance of the thread running it: randomized stepwise addition
+ *  + SPR on the sample weights, followed by ratchet cycles (or new random starting trees with -ratchet_off)
+ *  until params.unsuccess_iteration cycles did not improve the score. Replicate sample only uses the seed
+ *  params.ran_seed + (sample + 1) * 34567, hence the trees do not depend on the number of threads.
+ *  @param boot_trees (OUT) boot_trees[sample] is the tree of replicate sample, rooted as in .treefile
+ */
+void computeBootTreesParallel(Params &params, Alignment *alignment, StrVector &boot_trees) {
+	int nsample = params.num_bootstrap_samples;
+#ifdef _OPENMP
+	int nthreads = max(1, min(omp_get_max_threads(), nsample));
+#else
+	int nthreads = 1;
+#endif
+	string bootaln_name = params.out_prefix;
+	bootaln_name += ".bootaln";
+	string bootlh_name = params.out_prefix;
+	bootlh_name += ".bootlh";
+
+	// all replicates share the same sorted alignment, only the pattern weights differ
+	resetGlobalParamOnNewAln();
+	Alignment *ref_aln = new Alignment;
+	ref_aln->copyAlignment(alignment);
+	IQTree *ref_tree = new IQTree(ref_aln);
+	optimizeAlignment(ref_tree, params);
+	ref_tree->initializePLL(params);
+	int nptn = ref_tree->getAlnNPattern();
+	assert(ref_tree->pllInst->originalCrunchedLength == nptn);
+
+	StringIntMap ref_ptn;
+	for (int ptn = 0; ptn < nptn; ptn++)
+		ref_ptn[ref_tree->aln->at(ptn)] = ptn;
+	IntVector orig2ref(alignment->getNPattern());
+	for (int ptn = 0; ptn < alignment->getNPattern(); ptn++)
+		orig2ref[ptn] = ref_ptn.find(alignment->at(ptn))->second;
+	vector<bool> informative(nptn);
+	for (int ptn = 0; ptn < nptn; ptn++)
+		informative[ptn] = ref_tree->aln->at(ptn).ras_pars_score != 0;
+
+	cout << endl << "===> COMPUTE " << nsample << " BOOTSTRAP TREES WITH " << nthreads << " THREADS" << endl << endl;
+	vector<BootValTypePars> sample_wgt((size_t)nsample * nptn, 0);
+	int *pattern_freq = new int[alignment->getNPattern()];
+	for (int sample = 0; sample < nsample; sample++) {
+		BootValTypePars *wgt = &sample_wgt[(size_t)sample * nptn];
+		if (params.print_bootaln || params.print_tree_lh) {
+			Alignment bootstrap_alignment;
+			IntVector freq;
+			bootstrap_alignment.createBootstrapAlignment(alignment, &freq, params.bootstrap_spec);
+			for (int ptn = 0; ptn < freq.size(); ptn++)
+				wgt[orig2ref[ptn]] = freq[ptn];
+			if (params.print_tree_lh) {
+				double prob;
+				bootstrap_alignment.multinomialProb(*alignment, prob);
+				ofstream boot_lh;
+				if (sample == 0)
+					boot_lh.open(bootlh_name.c_str());
+				else
+					boot_lh.open(bootlh_name.c_str(), ios_base::out | ios_base::app);
+				boot_lh << "0\t" << prob << endl;
+				boot_lh.close();
+			}
+			if (params.print_bootaln)
+				bootstrap_alignment.printPhylip(bootaln_name.c_str(), true);
+		} else {
+			alignment->createBootstrapAlignment(pattern_freq, params.bootstrap_spec);
+			for (int ptn = 0; ptn < alignment->getNPattern(); ptn++)
+				wgt[orig2ref[ptn]] = pattern_freq[ptn];
+		}
+	}
+	delete [] pattern_freq;
+
+	int nseq = ref_tree->aln->getNSeq();
+	int max_cycles = (params.max_iterations > 1) ? params.max_iterations : 10 * nseq;
+	int max_unsuccess = (params.unsuccess_iteration >= 0) ? params.unsuccess_iteration : ((nseq - 1) / 100 + 1) * 100;
+	map<string, int> taxon_id;
+	for (int seq = 0; seq < nseq; seq++)
+		taxon_id[ref_tree->aln->getSeqName(seq)] = seq;
+	string root_name = params.root ? params.root : ref_tree->aln->getSeqName(0);
+
+	// PLL parsers are not thread-safe, thus create all instances beforehand
+	vector<pllInstance*> insts(nthreads);
+	vector<partitionList*> partitions(nthreads);
+	vector<pllAlignmentData*> alignments(nthreads);
+	for (int i = 0; i < nthreads; i++)
+		ref_tree->createPLLInstance(params, insts[i], partitions[i], alignments[i]);
+
+	boot_trees.resize(nsample);
+	int ndone = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+#endif
+	for (int sample = 0; sample < nsample; sample++) {
+#ifdef _OPENMP
+		int id = omp_get_thread_num();
+#else
+		int id = 0;
+#endif
+		pllInstance *inst = insts[id];
+		partitionList *part = partitions[id];
+		const BootValTypePars *wgt = &sample_wgt[(size_t)sample * nptn];
+		inst->randomNumberSeed = params.ran_seed + (sample + 1) * 34567;
+
+		for (int ptn = 0; ptn < nptn; ptn++)
+			inst->aliaswgt[ptn] = wgt[ptn];
+		_pllComputeRandomizedStepwiseAdditionParsimonyTree(inst, part, params.sprDist, NULL);
+		int best_score = pllOptimizeSprParsimonyReweighted(inst, part, wgt, params.spr_mintrav, params.spr_maxtrav);
+		pllTreeToNewickString(inst, part);
+		string best_tree = inst->tree_string;
+
+		// the informative sites of the sample, one entry per drawn site, for the ratchet
+		IntVector inf_sites;
+		for (int ptn = 0; ptn < nptn; ptn++)
+			if (informative[ptn])
+				inf_sites.insert(inf_sites.end(), wgt[ptn], ptn);
+		int ratchet_nsite = inf_sites.size() * params.ratchet_percent / 100;
+		vector<BootValTypePars> perturb_wgt(nptn);
+
+		for (int cycle = 0, unsuccess = 0; cycle < max_cycles && unsuccess < max_unsuccess; cycle++) {
+			if (params.ratchet_iter >= 0) {
+				// Nixon's ratchet: search on upweighted informative sites, then again on the sample weights
+				perturb_wgt.assign(wgt, wgt + nptn);
+				for (int i = 0; i < ratchet_nsite; i++) {
+					int j = i + (int)(randum(&inst->randomNumberSeed) * (inf_sites.size() - i));
+					swap(inf_sites[i], inf_sites[j]);
+					perturb_wgt[inf_sites[i]] += params.ratchet_wgt;
+				}
+				pllOptimizeSprParsimonyReweighted(inst, part, &perturb_wgt[0], params.spr_mintrav, params.spr_maxtrav);
+			} else {
+				for (int ptn = 0; ptn < nptn; ptn++)
+					inst->aliaswgt[ptn] = wgt[ptn];
+				_pllComputeRandomizedStepwiseAdditionParsimonyTree(inst, part, params.sprDist, NULL);
+			}
+			int score = pllOptimizeSprParsimonyReweighted(inst, part, wgt, params.spr_mintrav, params.spr_maxtrav);
+			if (score < best_score) {
+				best_score = score;
+				pllTreeToNewickString(inst, part);
+				best_tree = inst->tree_string;
+				unsuccess = 0;
+			} else
+				unsuccess++;
+		}
+
+		// same format as .treefile, see IQTree::printResultTree()
+		MTree tree;
+		stringstream in(best_tree);
+		bool rooted = false;
+		tree.readTree(in, rooted);
+		NodeVector taxa;
+		tree.getTaxa(taxa);
+		for (NodeVector::iterator it = taxa.begin(); it != taxa.end(); it++)
+			(*it)->id = taxon_id.find((*it)->name)->second;
+		tree.root = tree.findNodeName(root_name);
+		assert(tree.root);
+		ostringstream out;
+		tree.printTree(out, WT_SORT_TAXA);
+		boot_trees[sample] = out.str();
+
+#ifdef _OPENMP
+#pragma omp critical(boot_tree_progress)
+#endif
+		{
+			ndone++;
+			cout << "Bootstrap tree " << sample + 1 << " (" << ndone << "/" << nsample
+					<< " done): parsimony score " << best_score << endl;
+		}
+	}
+
+	for (int i = 0; i < nthreads; i++) {
+		_pllFreeParsimonyDataStructures(insts[i], partitions[i]); // kept by pllOptimizeSprParsimonyReweighted
+		ref_tree->destroyPLLInstance(insts[i], partitions[i], alignments[i]);
+	}
+	delete ref_tree->aln;
+	delete ref_tree;
+	resetGlobalParamOnNewAln();
+}
+
 void runStandardBootstrap(Params &params, string &original_model, Alignment *alignment, IQTree *tree) {
 	vector<ModelInfo> model_info;
 	StrVector removed_seqs, twin_seqs;
@@ -1981,6 +2213,20 @@ void runStandardBootstrap(Params &params, string &original_model, Alignment *ali
 	double start_time = getCPUTime();
 
 	// do bootstrap analysis
+	if (canComputeBootTreesParallel(params, alignment)) {
+		StrVector boot_trees;
+		computeBootTreesParallel(params, alignment, boot_trees);
+		try {
+			ofstream tree_out;
+			tree_out.exceptions(ios::failbit | ios::badbit);
+			tree_out.open(boottrees_name.c_str());
+			for (int sample = 0; sample < boot_trees.size(); sample++)
+				tree_out << boot_trees[sample] << endl;
+			tree_out.close();
+		} catch (ios::failure) {
+			outError(ERR_WRITE_OUTPUT, boottrees_name);
+		}
+	} else
 	for (int sample = 0; sample < params.num_bootstrap_samples; sample++) {
         resetGlobalParamOnNewAln();
 		cout << endl << "===> START BOOTSTRAP REPLICATE NUMBER "
@@ -1988,11 +2234,18 @@ void runStandardBootstrap(Params &params, string &original_model, Alignment *ali
 
 		Alignment* bootstrap_alignment;
 		cout << "Creating bootstrap alignment..." << endl;
-		if (alignment->isSuperAlignment())
-			bootstrap_alignment = new SuperAlignment;
-		else
-			bootstrap_alignment = new Alignment;
-		bootstrap_alignment->createBootstrapAlignment(alignment, NULL, params.bootstrap_spec);
+		if (params.maximum_parsimony && !params.print_tree_lh && !alignment->isSuperAlignment()) {
+			// MP only needs new pattern weights, the patterns are re-sorted by optimizeAlignment below
+			AlignmentWeightView *boot_view = new AlignmentWeightView(alignment);
+			boot_view->setBootstrapFreq(params.bootstrap_spec);
+			bootstrap_alignment = boot_view;
+		} else {
+			if (alignment->isSuperAlignment())
+				bootstrap_alignment = new SuperAlignment;
+			else
+				bootstrap_alignment = new Alignment;
+			bootstrap_alignment->createBootstrapAlignment(alignment, NULL, params.bootstrap_spec);
+		}
 		if (params.print_tree_lh) {
 			double prob;
 			bootstrap_alignment->multinomialProb(*alignment, prob);
@@ -2181,6 +2434,7 @@ void runPhyloAnalysis(Params &params) {
 	IQTree *tree;
 
 	/****************** read in alignment **********************/
+	perfStartPhase(PERF_ALN_LOAD);
 	if (params.partition_file) {
 		// Partition model analysis
 		if(params.partition_type){
@@ -2213,6 +2467,7 @@ void runPhyloAnalysis(Params &params) {
 
 
 	}
+	perfStopPhase(PERF_ALN_LOAD);
 
 
 	string original_model = params.model_name;
@@ -2342,7 +2597,6 @@ void printSiteParsimonyUserTree(Params &params) {
     ptree->setAlignment(&alignment); // IMPORTANT: Always call setAlignment() after readTree()
     ptree->params = &params; // Diep: 2020-08-17, there are two variables with identical name as 'params'
 
-    ptree->initializeAllPartialPars();
     ptree->clearAllPartialLH();
     ptree->computeParsimony();
 
@@ -2784,7 +3038,6 @@ void optimizeAlignment(IQTree * & tree, Params & params){
         cout << "Time for random stepwise addition parsimony tree construction: " << getCPUTime() - start << " seconds" << endl;
     }
 	// extract the vector of pattern pars of the initialized tree
-	tree->initializeAllPartialPars();
 	tree->clearAllPartialLH();
 //	tree->fixNegativeBranch(true);
 	int pars_before = tree->computeParsimony();
@@ -2806,7 +3059,6 @@ void optimizeAlignment(IQTree * & tree, Params & params){
 		sort(tree->aln->begin(), tree->aln->end(), pcomp);
 		tree->aln->updateSitePatternAfterOptimized();
 
-		tree->initializeAllPartialPars();
 		tree->clearAllPartialLH();
 		int pars_after = tree->computeParsimony();
 		if(pars_after != pars_before) outError("Reordering alignment has bug.");
@@ -21,6 +21,7 @@
 #include "phylosupertree.h"
 #include "parstree.h"
 #include "sprparsimony.h"
+#include "perfcounter.h"
 //const static int BINARY_SCALE = floor(log2(1/SCALING_THRESHOLD));
 //const static double LOG_BINARY_SCALE = -(log(2) * BINARY_SCALE);
 
@@ -64,6 +65,8 @@ void PhyloTree::init() {
     tip_partial_lh_computed = false;
     central_scale_num = NULL;
     central_partial_pars = NULL;
+    flat_partial_pars = NULL;
+    flat_partial_pars_size = 0;
     model_factory = NULL;
     tmp_partial_lh1 = NULL;
     tmp_partial_lh2 = NULL;
@@ -110,6 +113,10 @@ PhyloTree::~PhyloTree() {
     if (central_partial_pars)
         delete[] central_partial_pars;
     central_partial_pars = NULL;
+    if (flat_partial_pars)
+        aligned_free(flat_partial_pars);
+    flat_partial_pars = NULL;
+    flat_partial_pars_size = 0;
     if (model_factory)
         delete model_factory;
     if (model)
@@ -185,6 +192,7 @@ void PhyloTree::copyPhyloTree(PhyloTree *tree) {
 }
 
 void PhyloTree::setAlignment(Alignment *alignment) {
+    pars_topology.clear();
     aln = alignment;
     //alnSize = aln->size();
     //ptn_freqs.resize(alnSize);
@@ -309,6 +317,7 @@ Node* PhyloTree::newNode(int node_id, int node_name) {
 }
 
 void PhyloTree::clearAllPartialLH() {
+    pars_topology.clear();
     if (!root)
         return;
     ((PhyloNode*) root->neighbors[0]->node)->clearAllPartialLh((PhyloNode*) root);
@@ -689,12 +698,7 @@ void decodeProtState(UINT *encode, UINT *sites, int num_sites) {
 		sites[7] = encode[4] >> 12;
 }
 
-void PhyloTree::computePartialParsimony(PhyloNeighbor *dad_branch, PhyloNode *dad) {
-    // don't recompute the parsimony
-    if (dad_branch->partial_lh_computed & 2)
-        return;
-    Node *node = dad_branch->node;
-    //assert(node->degree() <= 3);
+void PhyloTree::computeLeafPartialPars(UINT *partial_pars, int taxon) {
     int ptn;
     int nstates = aln->num_states;
     int pars_size = getBitsBlockSize();
@@ -702,244 +706,191 @@ void PhyloTree::computePartialParsimony(PhyloNeighbor *dad_branch, PhyloNode *da
     int nptn = aln->size();
     int ptn_pars_start_id = pars_size - nptn - 1;
 
-    assert(dad_branch->partial_pars);
-    dad_branch->partial_lh_computed |= 2;
-
-    if (nstates == 4 && aln->seq_type == SEQ_DNA && (node->isLeaf() || node->degree() == 3)) {
+    if (nstates == 4 && aln->seq_type == SEQ_DNA) {
     	// ULTRAFAST VERSION FOR DNA, assuming that UINT is 32-bit integer
-        if (node->isLeaf() && dad) {
-            // external node
-            for (ptn = 0; ptn < aln->size(); ptn+=8) {
-            	UINT states = 0;
-            	int maxi = aln->size() - ptn;
-            	if(maxi > 8) maxi = 8;
-            	for (int i = 0; i< maxi; i++) {
-            		UINT bit_state = dna_state_map[(aln->at(ptn+i))[node->id]];
-            		states |= (bit_state << (i*4));
-            		dad_branch->partial_pars[ptn_pars_start_id + ptn + i] = 0;
-            	}
-            	dad_branch->partial_pars[ptn/8] = states;
-            }
-//			// the remaining bits
-//			UINT states = 0;
-//			int maxi = aln->size() - ptn;
-//			for (int i = 0; i< maxi; i++) {
-//				UINT bit_state = dna_state_map[(aln->at(ptn+i))[node->id]];
-//				states |= (bit_state << (i*4));
-//			}
-//			dad_branch->partial_pars[(ptn/8)] = states;
-            dad_branch->partial_pars[pars_size - 1] = 0; // set subtree score = 0
-        } else {
-            // internal node
-        	memset(dad_branch->partial_pars + ptn_pars_start_id, 0, nptn * sizeof(int));
-        	UINT *left = NULL, *right = NULL;
-        	int pars_steps = 0;
-            FOR_NEIGHBOR_IT(node, dad, it)if ((*it)->node->name != ROOT_NAME) {
-                computePartialParsimony((PhyloNeighbor*) (*it), (PhyloNode*) node);
-                if (!left)
-                	left = ((PhyloNeighbor*) (*it))->partial_pars;
-                else
-                	right = ((PhyloNeighbor*) (*it))->partial_pars;
-                pars_steps += ((PhyloNeighbor*) (*it))->partial_pars[pars_size-1];
-                for(int p = 0; p < nptn; p++)
-                	dad_branch->partial_pars[ptn_pars_start_id + p] += ((PhyloNeighbor*) (*it))->partial_pars[ptn_pars_start_id + p];
-            }
-            for (ptn = 0; ptn < aln->size(); ptn+=8) {
-            	UINT states_left = left[ptn/8];
-            	UINT states_right = right[ptn/8];
-            	UINT states_dad = 0;
-            	int maxi = aln->size() - ptn;
-            	if(maxi > 8) maxi = 8;
-            	for (int i = 0; i< maxi; i++) {
-            		UINT state_left = (states_left >> (i*4)) & 15;
-            		UINT state_right = (states_right >> (i*4)) & 15;
-            		UINT state_both = state_left | (state_right << 4);
-            		states_dad |= dna_fitch_result[state_both] << (i*4);
-            		pars_steps += dna_fitch_step[state_both] * aln->at(ptn+i).frequency;
-            		dad_branch->partial_pars[ptn_pars_start_id + ptn + i] += dna_fitch_step[state_both];
-            	}
-            	dad_branch->partial_pars[ptn/8] = states_dad;
-            }
-//            // remaining bits
-//			UINT states_left = left[ptn/8];
-//			UINT states_right = right[ptn/8];
-//			UINT states_dad = 0;
-//			int maxi = aln->size() - ptn;
-//			for (int i = 0; i< maxi; i++) {
-//				UINT state_left = (states_left >> (i*4)) & 15;
-//				UINT state_right = (states_right >> (i*4)) & 15;
-//				UINT state_both = state_left | (state_right << 4);
-//				states_dad |= dna_fitch_result[state_both] << (i*4);
-//				pars_steps += dna_fitch_step[state_both] * aln->at(ptn+i).frequency;
-//			}
-//			dad_branch->partial_pars[ptn/8] = states_dad;
-            dad_branch->partial_pars[pars_size - 1] = pars_steps;
+        for (ptn = 0; ptn < nptn; ptn+=8) {
+        	UINT states = 0;
+        	int maxi = nptn - ptn;
+        	if(maxi > 8) maxi = 8;
+        	for (int i = 0; i< maxi; i++) {
+        		UINT bit_state = dna_state_map[(taxon < 0) ? aln->STATE_UNKNOWN : (aln->at(ptn+i))[taxon]];
+        		states |= (bit_state << (i*4));
+        		partial_pars[ptn_pars_start_id + ptn + i] = 0;
+        	}
+        	partial_pars[ptn/8] = states;
         }
+        partial_pars[pars_size - 1] = 0; // set subtree score = 0
         return;
-    } // END OF DNA VERSION
+    }
 
-    if (nstates == 20 && aln->seq_type == SEQ_PROTEIN && (node->isLeaf() || node->degree() == 3)) {
+    if (nstates == 20 && aln->seq_type == SEQ_PROTEIN) {
     	// ULTRAFAST VERSION FOR protein, assuming that UINT is 32-bit integer
-        if (node->isLeaf() && dad) {
-            // external node
-        	UINT bit_ptn[8];
-        	int id = 0;
-            for (ptn = 0; ptn < aln->size(); ptn+=8, id+=5) {
-            	int maxi = aln->size()-ptn;
-            	if (maxi > 8) maxi = 8;
-            	for (int i = 0; i < maxi; i++) {
-            		bit_ptn[i] = prot_state_map[(aln->at(ptn+i))[node->id]];
-            		dad_branch->partial_pars[ptn_pars_start_id + ptn + i] = 0;
-            	}
-            	encodeProtState(dad_branch->partial_pars+id, bit_ptn, maxi);
-            }
-            dad_branch->partial_pars[pars_size - 1] = 0; // set subtree score = 0
-        } else {
-        	// internal node
-        	memset(dad_branch->partial_pars + ptn_pars_start_id, 0, nptn * sizeof(int));
-        	UINT *left = NULL, *right = NULL;
-        	int pars_steps = 0;
-            FOR_NEIGHBOR_IT(node, dad, it)if ((*it)->node->name != ROOT_NAME) {
-                computePartialParsimony((PhyloNeighbor*) (*it), (PhyloNode*) node);
-                if (!left)
-                	left = ((PhyloNeighbor*) (*it))->partial_pars;
-                else
-                	right = ((PhyloNeighbor*) (*it))->partial_pars;
-                pars_steps += ((PhyloNeighbor*) (*it))->partial_pars[pars_size-1];
-                for(int p = 0; p < nptn; p++)
-                	dad_branch->partial_pars[ptn_pars_start_id + p] += ((PhyloNeighbor*) (*it))->partial_pars[ptn_pars_start_id + p];
+    	UINT bit_ptn[8];
+    	int id = 0;
+        for (ptn = 0; ptn < nptn; ptn+=8, id+=5) {
+        	int maxi = nptn-ptn;
+        	if (maxi > 8) maxi = 8;
+        	for (int i = 0; i < maxi; i++) {
+        		bit_ptn[i] = prot_state_map[(taxon < 0) ? aln->STATE_UNKNOWN : (aln->at(ptn+i))[taxon]];
+        		partial_pars[ptn_pars_start_id + ptn + i] = 0;
+        	}
+        	encodeProtState(partial_pars+id, bit_ptn, maxi);
+        }
+        partial_pars[pars_size - 1] = 0; // set subtree score = 0
+        return;
+    }
+
+    UINT *bits_entry = new UINT[entry_size];
+    setBitsAll(partial_pars, nstates * nptn);
+    partial_pars[pars_size - 1] = 0;
+    for (ptn = 0; ptn < nptn; ptn++)
+        if (!aln->at(ptn).is_const) {
+            char state;
+            if (taxon < 0) {
+                state = aln->STATE_UNKNOWN;
+            } else {
+                assert(taxon < aln->getNSeq());
+                state = (aln->at(ptn))[taxon];
             }
-        	UINT state_left[8], state_right[8], bit_ptn[8];
-        	int id = 0;
-            for (ptn = 0; ptn < aln->size(); ptn+=8, id+=5) {
-            	int maxi = aln->size()-ptn;
-            	if (maxi > 8) maxi = 8;
-            	decodeProtState(left+id, state_left, maxi);
-            	decodeProtState(right+id, state_right, maxi);
-            	for (int i = 0; i < maxi; i++) {
-            		bit_ptn[i] = state_left[i] & state_right[i];
-            		if (!bit_ptn[i]) {
-            			bit_ptn[i] = state_left[i] | state_right[i];
-            			pars_steps += aln->at(ptn+i).frequency;
-            			dad_branch->partial_pars[ptn_pars_start_id + ptn + i] += 1;
-            		}
-            	}
-            	encodeProtState(dad_branch->partial_pars + id, bit_ptn, maxi);
+            if (state == aln->STATE_UNKNOWN) {
+                // fill all entries with bit 1
+                //setBitsBlock(partial_pars, ptn, (1 << nstates) - 1);
+            } else if (state < nstates) {
+                memset(bits_entry, 0, sizeof(UINT) * entry_size);
+                setBitsEntry(bits_entry, state);
+                setBitsBlock(partial_pars, ptn, bits_entry);
+            } else {
+                // ambiguous character, for DNA, RNA
+                state = state - (nstates - 1);
+                memset(bits_entry, 0, sizeof(UINT) * entry_size);
+                bits_entry[0] = state;
+                setBitsBlock(partial_pars, ptn, bits_entry);
             }
+            partial_pars[ptn_pars_start_id + ptn] = 0;
+        }
+    delete[] bits_entry;
+}
+
+void PhyloTree::computeInternalPartialPars(UINT *partial_pars, UINT **children, int nchildren) {
+    int ptn;
+    int nstates = aln->num_states;
+    int pars_size = getBitsBlockSize();
+    int entry_size = getBitsEntrySize();
+    int nptn = aln->size();
+    int ptn_pars_start_id = pars_size - nptn - 1;
+    int pars_steps = 0;
+    int child;
+
+	memset(partial_pars + ptn_pars_start_id, 0, nptn * sizeof(int));
+	for (child = 0; child < nchildren; child++) {
+		pars_steps += children[child][pars_size-1];
+		for(int p = 0; p < nptn; p++)
+			partial_pars[ptn_pars_start_id + p] += children[child][ptn_pars_start_id + p];
+	}
+
+    if (nstates == 4 && aln->seq_type == SEQ_DNA && nchildren == 2) {
+    	// ULTRAFAST VERSION FOR DNA, assuming that UINT is 32-bit integer
+    	UINT *left = children[0], *right = children[1];
+        for (ptn = 0; ptn < nptn; ptn+=8) {
+        	UINT states_left = left[ptn/8];
+        	UINT states_right = right[ptn/8];
+        	UINT states_dad = 0;
+        	int maxi = nptn - ptn;
+        	if(maxi > 8) maxi = 8;
+        	for (int i = 0; i< maxi; i++) {
+        		UINT state_left = (states_left >> (i*4)) & 15;
+        		UINT state_right = (states_right >> (i*4)) & 15;
+        		UINT state_both = state_left | (state_right << 4);
+        		states_dad |= dna_fitch_result[state_both] << (i*4);
+        		pars_steps += dna_fitch_step[state_both] * aln->at(ptn+i).frequency;
+        		partial_pars[ptn_pars_start_id + ptn + i] += dna_fitch_step[state_both];
+        	}
+        	partial_pars[ptn/8] = states_dad;
+        }
+        partial_pars[pars_size - 1] = pars_steps;
+        return;
+    } // END OF DNA VERSION
 
-            dad_branch->partial_pars[pars_size - 1] = pars_steps;
+    if (nstates == 20 && aln->seq_type == SEQ_PROTEIN && nchildren == 2) {
+    	// ULTRAFAST VERSION FOR protein, assuming that UINT is 32-bit integer
+    	UINT *left = children[0], *right = children[1];
+    	UINT state_left[8], state_right[8], bit_ptn[8];
+    	int id = 0;
+        for (ptn = 0; ptn < nptn; ptn+=8, id+=5) {
+        	int maxi = nptn-ptn;
+        	if (maxi > 8) maxi = 8;
+        	decodeProtState(left+id, state_left, maxi);
+        	decodeProtState(right+id, state_right, maxi);
+        	for (int i = 0; i < maxi; i++) {
+        		bit_ptn[i] = state_left[i] & state_right[i];
+        		if (!bit_ptn[i]) {
+        			bit_ptn[i] = state_left[i] | state_right[i];
+        			pars_steps += aln->at(ptn+i).frequency;
+        			partial_pars[ptn_pars_start_id + ptn + i] += 1;
+        		}
+        	}
+        	encodeProtState(partial_pars + id, bit_ptn, maxi);
         }
+        partial_pars[pars_size - 1] = pars_steps;
         return;
     } // END OF PROTEIN VERSION
 
     UINT *bits_entry = new UINT[entry_size];
     UINT *bits_entry_child = new UINT[entry_size];
-    //UINT *bits_entry1 = new UINT[entry_size];
-    //UINT *bits_entry2 = new UINT[entry_size];
-
-    if (node->isLeaf() && dad) {
-        // external node
-        setBitsAll(dad_branch->partial_pars, nstates * aln->size());
-        dad_branch->partial_pars[pars_size - 1] = 0;
-        for (ptn = 0; ptn < aln->size(); ptn++)
-            if (!aln->at(ptn).is_const) {
-                char state;
-                if (node->name == ROOT_NAME) {
-                    state = aln->STATE_UNKNOWN;
-                } else {
-                    assert(node->id < aln->getNSeq());
-                    state = (aln->at(ptn))[node->id];
-                }
-                if (state == aln->STATE_UNKNOWN) {
-                    // fill all entries with bit 1
-                    //setBitsBlock(dad_branch->partial_pars, ptn, (1 << nstates) - 1);
-                } else if (state < nstates) {
-                    memset(bits_entry, 0, sizeof(UINT) * entry_size);
-                    setBitsEntry(bits_entry, state);
-                    setBitsBlock(dad_branch->partial_pars, ptn, bits_entry);
-                } else {
-                    // ambiguous character, for DNA, RNA
-                    state = state - (nstates - 1);
-                    memset(bits_entry, 0, sizeof(UINT) * entry_size);
-                    bits_entry[0] = state;
-                    setBitsBlock(dad_branch->partial_pars, ptn, bits_entry);
+    // take the intersection of the child states (with &= bit operation)
+    memset(partial_pars, 255, (pars_size - nptn - 1) * sizeof(int));
+    for (child = 0; child < nchildren; child++)
+        for (int i = 0; i < pars_size - nptn - 1; i++)
+            partial_pars[i] &= children[child][i];
+    // now check if some intersection is empty, change to union (Fitch algorithm) and increase the parsimony score
+    memset(bits_entry, 0, entry_size * sizeof(UINT));
+    for (ptn = 0; ptn < nptn; ptn++)
+        if (!aln->at(ptn).is_const) {
+            getBitsBlock(partial_pars, ptn, bits_entry);
+            if (isEmptyBitsEntry(bits_entry)) {
+                for (child = 0; child < nchildren; child++) {
+                    getBitsBlock(children[child], ptn, bits_entry_child);
+                    unionBitsEntry(bits_entry, bits_entry_child, bits_entry);
                 }
-                dad_branch->partial_pars[ptn_pars_start_id + ptn] = 0;
+                setBitsBlock(partial_pars, ptn, bits_entry);
+                pars_steps += aln->at(ptn).frequency;
+                partial_pars[ptn_pars_start_id + ptn] += 1;
             }
-    } else {
-        // internal node
-        memset(dad_branch->partial_pars, 255, (pars_size - nptn - 1) * sizeof(int));
-        memset(dad_branch->partial_pars + ptn_pars_start_id, 0, nptn * sizeof(int));
-        UINT *partial_pars_dad = dad_branch->partial_pars;
-        int partial_pars = 0;
-        //UINT *partial_pars_child1 = NULL, *partial_pars_child2 = NULL;
-        // take the intersection of two child states (with &= bit operation)
-        FOR_NEIGHBOR_IT(node, dad, it)if ((*it)->node->name != ROOT_NAME) {
-            computePartialParsimony((PhyloNeighbor*) (*it), (PhyloNode*) node);
-            /*
-             if (!partial_pars_child1)
-             partial_pars_child1 = ((PhyloNeighbor*) (*it))->partial_pars;
-             else
-             partial_pars_child2 = ((PhyloNeighbor*) (*it))->partial_pars;
-             */
-            UINT *partial_pars_child = ((PhyloNeighbor*) (*it))->partial_pars;
-            for (int i = 0; i < pars_size - 1; i++)
-            partial_pars_dad[i] &= partial_pars_child[i];
-            partial_pars += partial_pars_child[pars_size - 1];
-            for(int p = 0; p < nptn; p++)
-            	dad_branch->partial_pars[ptn_pars_start_id + p] += ((PhyloNeighbor*) (*it))->partial_pars[ptn_pars_start_id + p];
         }
-        //assert(partial_pars_child1 && partial_pars_child2);
-        // take the intersection of two bits block
-        //for (int i = 0; i < pars_size - 1; i++)
-        //    partial_pars_dad[i] = partial_pars_child1[i] & partial_pars_child2[i];
-        //int partial_pars = partial_pars_child1[pars_size - 1] + partial_pars_child2[pars_size - 1];
-        // now check if some intersection is empty, change to union (Fitch algorithm) and increase the parsimony score
-        memset(bits_entry, 0, entry_size * sizeof(UINT));
-        for (ptn = 0; ptn < aln->size(); ptn++)
-            if (!aln->at(ptn).is_const) {
-                getBitsBlock(partial_pars_dad, ptn, bits_entry);
-                if (isEmptyBitsEntry(bits_entry)) {
-                    FOR_NEIGHBOR_IT(node, dad, it2)if ((*it2)->node->name != ROOT_NAME) {
-                        UINT *partial_pars_child = ((PhyloNeighbor*) (*it2))->partial_pars;
-                        getBitsBlock(partial_pars_child, ptn, bits_entry_child);
-                        unionBitsEntry(bits_entry, bits_entry_child, bits_entry);
-                    }
-                    //getBitsBlock(partial_pars_child2, ptn, bits_entry2);
-                    //unionBitsEntry(bits_entry1, bits_entry2, bits_entry);
-                    //cout << bits_entry[0] << " " << bits_entry[1] << endl;
-                    setBitsBlock(partial_pars_dad, ptn, bits_entry);
-                    partial_pars += aln->at(ptn).frequency;
-                    dad_branch->partial_pars[ptn_pars_start_id + ptn] += 1;
-                }
-            }
-
-            /*
-             for (ptn = 0; ptn < aln->size(); ptn++)
-             if (!aln->at(ptn).is_const) {
-             getBitsBlock(partial_pars_dad, ptn, bits_entry);
-             if (isEmptyBitsEntry(bits_entry)) {
-             getBitsBlock(partial_pars_child1, ptn, bits_entry1);
-             getBitsBlock(partial_pars_child2, ptn, bits_entry2);
-             unionBitsEntry(bits_entry1, bits_entry2, bits_entry);
-             //cout << bits_entry[0] << " " << bits_entry[1] << endl;
-             setBitsBlock(partial_pars_dad, ptn, bits_entry);
-             partial_pars += aln->at(ptn).frequency;
-             }
-             }*/
-        partial_pars_dad[pars_size - 1] = partial_pars;
-    }
-    //delete[] bits_entry2;
-    //delete[] bits_entry1;
+    partial_pars[pars_size - 1] = pars_steps;
     delete[] bits_entry_child;
     delete[] bits_entry;
 }
 
+void PhyloTree::computePartialParsimony(PhyloNeighbor *dad_branch, PhyloNode *dad) {
+    // don't recompute the parsimony
+    if (dad_branch->partial_lh_computed & 2)
+        return;
+    Node *node = dad_branch->node;
+
+    assert(dad_branch->partial_pars);
+    dad_branch->partial_lh_computed |= 2;
+
+    if (node->isLeaf() && dad) {
+        // external node
+        computeLeafPartialPars(dad_branch->partial_pars, (node->name == ROOT_NAME) ? -1 : node->id);
+        return;
+    }
+    // internal node
+    vector<UINT*> children;
+    FOR_NEIGHBOR_IT(node, dad, it)if ((*it)->node->name != ROOT_NAME) {
+        computePartialParsimony((PhyloNeighbor*) (*it), (PhyloNode*) node);
+        children.push_back(((PhyloNeighbor*) (*it))->partial_pars);
+    }
+    computeInternalPartialPars(dad_branch->partial_pars, &children[0], children.size());
+}
+
 int PhyloTree::computeParsimonyBranch(PhyloNeighbor *dad_branch, PhyloNode *dad, int *branch_subst) {
     PhyloNode *node = (PhyloNode*) dad_branch->node;
     PhyloNeighbor *node_branch = (PhyloNeighbor*) node->findNeighbor(dad);
     assert(node_branch);
-    if (!central_partial_pars)
+    // computeParsimony() does not need the vectors per neighbor, thus they are assigned on first use
+    if (!central_partial_pars || !dad_branch->partial_pars || !node_branch->partial_pars)
         initializeAllPartialPars();
     // swap node and dad if dad is a leaf
     if (node->isLeaf()) {
@@ -952,69 +903,59 @@ int PhyloTree::computeParsimonyBranch(PhyloNeighbor *dad_branch, PhyloNode *dad,
         //cout << "swapped\n";
     }
 
-    int nptn = aln->size();
-    if(!_pattern_pars) _pattern_pars = aligned_alloc<BootValTypePars>(nptn+VCSIZE_USHORT);
-    memset(_pattern_pars, 0, sizeof(BootValTypePars) * (nptn+VCSIZE_USHORT));
-
     if ((dad_branch->partial_lh_computed & 2) == 0)
         computePartialParsimony(dad_branch, dad);
     if ((node_branch->partial_lh_computed & 2) == 0)
         computePartialParsimony(node_branch, node);
-    // now combine likelihood at the branch
 
+    return computeBranchParsimony(node_branch->partial_pars, dad_branch->partial_pars, branch_subst);
+}
+
+int PhyloTree::computeBranchParsimony(UINT *node_pars, UINT *dad_pars, int *branch_subst) {
+    int nptn = aln->size();
+    if(!_pattern_pars) _pattern_pars = aligned_alloc<BootValTypePars>(nptn+VCSIZE_USHORT);
+    memset(_pattern_pars, 0, sizeof(BootValTypePars) * (nptn+VCSIZE_USHORT));
+
+    // now combine likelihood at the branch
     int pars_size = getBitsBlockSize();
     int entry_size = getBitsEntrySize();
     int ptn_pars_start_id = pars_size - nptn - 1;
-    //int nstates = aln->num_states;
     int i, ptn;
     int tree_pars = 0;
 
     if (aln->num_states == 4 && aln->seq_type == SEQ_DNA) {
     	// ULTRAFAST VERSION FOR DNA
-        for (ptn = 0; ptn < aln->size(); ptn+=8) {
-        	UINT states_left = node_branch->partial_pars[ptn/8];
-        	UINT states_right = dad_branch->partial_pars[ptn/8];
-        	UINT states_dad = 0;
-        	int maxi = aln->size() - ptn;
+        for (ptn = 0; ptn < nptn; ptn+=8) {
+        	UINT states_left = node_pars[ptn/8];
+        	UINT states_right = dad_pars[ptn/8];
+        	int maxi = nptn - ptn;
         	if(maxi > 8) maxi = 8;
 			for (i = 0; i< maxi; i++) {
 				UINT state_left = (states_left >> (i*4)) & 15;
 				UINT state_right = (states_right >> (i*4)) & 15;
 				UINT state_both = state_left | (state_right << 4);
-				states_dad |= dna_fitch_result[state_both] << (i*4);
 				tree_pars += dna_fitch_step[state_both] * aln->at(ptn+i).frequency;
-				_pattern_pars[ptn + i] = node_branch->partial_pars[ptn_pars_start_id + ptn + i] +
-					dad_branch->partial_pars[ptn_pars_start_id + ptn + i] + dna_fitch_step[state_both];
+				_pattern_pars[ptn + i] = node_pars[ptn_pars_start_id + ptn + i] +
+					dad_pars[ptn_pars_start_id + ptn + i] + dna_fitch_step[state_both];
 			}
         }
-//		// the remaining bits
-//		UINT states_left = node_branch->partial_pars[ptn/8];
-//		UINT states_right = dad_branch->partial_pars[ptn/8];
-//		int maxi = aln->size() - ptn;
-//		for (i = 0; i< maxi; i++) {
-//			UINT state_left = (states_left >> (i*4)) & 15;
-//			UINT state_right = (states_right >> (i*4)) & 15;
-//			UINT state_both = state_left | (state_right << 4);
-//			_pattern_pars[ptn + i] += dna_fitch_step[state_both];
-//			tree_pars += dna_fitch_step[state_both] * aln->at(ptn+i).frequency;
-//		}
     } else if (aln->num_states == 20 && aln->seq_type == SEQ_PROTEIN) {
     	// ULTRAFAST VERSION FOR PROTEIN
     	UINT state_left[8], state_right[8];
     	int id = 0;
-        for (ptn = 0; ptn < aln->size(); ptn+=8, id+=5) {
-        	int maxi = aln->size()-ptn;
+        for (ptn = 0; ptn < nptn; ptn+=8, id+=5) {
+        	int maxi = nptn-ptn;
         	if (maxi > 8) maxi = 8;
-        	decodeProtState(node_branch->partial_pars+id, state_left, maxi);
-        	decodeProtState(dad_branch->partial_pars+id, state_right, maxi);
+        	decodeProtState(node_pars+id, state_left, maxi);
+        	decodeProtState(dad_pars+id, state_right, maxi);
         	for (i = 0; i < maxi; i++) {
         		if (!(state_left[i] & state_right[i])) {
         			tree_pars += aln->at(ptn+i).frequency;
-    				_pattern_pars[ptn + i] = node_branch->partial_pars[ptn_pars_start_id + ptn + i] +
-    					dad_branch->partial_pars[ptn_pars_start_id + ptn + i] + 1;
+    				_pattern_pars[ptn + i] = node_pars[ptn_pars_start_id + ptn + i] +
+    					dad_pars[ptn_pars_start_id + ptn + i] + 1;
         		}else
-    				_pattern_pars[ptn + i] = node_branch->partial_pars[ptn_pars_start_id + ptn + i] +
-    					dad_branch->partial_pars[ptn_pars_start_id + ptn + i];
+    				_pattern_pars[ptn + i] = node_pars[ptn_pars_start_id + ptn + i] +
+    					dad_pars[ptn_pars_start_id + ptn + i];
         	}
         }
     } else {
@@ -1022,18 +963,18 @@ int PhyloTree::computeParsimonyBranch(PhyloNeighbor *dad_branch, PhyloNode *dad,
 		UINT *partial_pars = newBitsBlock();
 		UINT *bits_entry = new UINT[entry_size];
 		for (i = 0; i < pars_size - 1; i++)
-			partial_pars[i] = (node_branch->partial_pars[i] & dad_branch->partial_pars[i]);
+			partial_pars[i] = (node_pars[i] & dad_pars[i]);
 
-		for (ptn = 0; ptn < aln->size(); ptn++)
+		for (ptn = 0; ptn < nptn; ptn++)
 			if (!aln->at(ptn).is_const) {
 				getBitsBlock(partial_pars, ptn, bits_entry);
 				if (isEmptyBitsEntry(bits_entry)){
 					tree_pars += aln->at(ptn).frequency;
-					_pattern_pars[ptn] = node_branch->partial_pars[ptn_pars_start_id + ptn] +
-						dad_branch->partial_pars[ptn_pars_start_id + ptn] + 1;
+					_pattern_pars[ptn] = node_pars[ptn_pars_start_id + ptn] +
+						dad_pars[ptn_pars_start_id + ptn] + 1;
 				}else
-    				_pattern_pars[ptn] = node_branch->partial_pars[ptn_pars_start_id + ptn] +
-    					dad_branch->partial_pars[ptn_pars_start_id + ptn];
+    				_pattern_pars[ptn] = node_pars[ptn_pars_start_id + ptn] +
+    					dad_pars[ptn_pars_start_id + ptn];
 			}
 	    delete[] bits_entry;
 	    delete[] partial_pars;
@@ -1041,11 +982,38 @@ int PhyloTree::computeParsimonyBranch(PhyloNeighbor *dad_branch, PhyloNode *dad,
     if (branch_subst)
         *branch_subst = tree_pars;
 
-    tree_pars += node_branch->partial_pars[pars_size - 1] + dad_branch->partial_pars[pars_size - 1];
+    tree_pars += node_pars[pars_size - 1] + dad_pars[pars_size - 1];
 
     return tree_pars;
 }
 
+size_t PhyloTree::getFlatParsBlockSize() {
+	return getBitsBlockSize();
+}
+
+int PhyloTree::computeParsimonyFlat() {
+	size_t block_size = getFlatParsBlockSize();
+	size_t size = block_size * pars_topology.getNNodes();
+	if (flat_partial_pars_size < size) {
+		if (flat_partial_pars)
+			aligned_free(flat_partial_pars);
+		flat_partial_pars = aligned_alloc<UINT>(size);
+		flat_partial_pars_size = size;
+	}
+	int ntaxa = pars_topology.ntaxa;
+	for (int taxon = 0; taxon < ntaxa; taxon++)
+		computeLeafPartialPars(flat_partial_pars + taxon * block_size, taxon);
+	UINT *children[2];
+	for (IntVector::iterator it = pars_topology.post_order.begin(); it != pars_topology.post_order.end(); it++) {
+		children[0] = flat_partial_pars + pars_topology.left[*it - ntaxa] * block_size;
+		children[1] = flat_partial_pars + pars_topology.right[*it - ntaxa] * block_size;
+		computeInternalPartialPars(flat_partial_pars + (*it) * block_size, children, 2);
+	}
+	// as computeParsimonyBranch on the branch below the root leaf
+	return computeBranchParsimony(flat_partial_pars + pars_topology.root_taxon * block_size,
+			flat_partial_pars + pars_topology.top * block_size, NULL);
+}
+
 int PhyloTree::computeParsimony() {
     assert(root->isLeaf());
     PhyloNeighbor *nei = ((PhyloNeighbor*) root->neighbors[0]);
@@ -1057,6 +1025,12 @@ int PhyloTree::computeParsimony() {
     int nptn = aln->size();
     if(_pattern_pars == NULL) _pattern_pars = aligned_alloc<BootValTypePars>(nptn + VCSIZE_USHORT);
 
+    // the whole tree is computed anyway, thus on the flat topology if possible;
+    // the topology is kept until the tree or its root changes
+    if (pars_topology.root_taxon != root->id || pars_topology.ntaxa != leafNum)
+    	pars_topology.build(root, leafNum);
+    if (pars_topology.root_taxon >= 0)
+    	return computeParsimonyFlat();
     return computeParsimonyBranch((PhyloNeighbor*) root->neighbors[0], (PhyloNode*) root);
 }
 
@@ -1174,6 +1148,7 @@ int PhyloTree::computeParsimonyScore() {
  ****************************************************************************/
 
 double PhyloTree::swapNNI(double cur_score, PhyloNode *node1, PhyloNode *node2) {
+    pars_topology.clear();
     assert(node1->degree() == 3 && node2->degree() == 3);
     FOR_NEIGHBOR_DECLARE(node1, node2, it1)
         break;
@@ -1241,6 +1216,7 @@ void PhyloTree::searchNNI() {
 //ptrdiff_t (*p_myrandom)(ptrdiff_t) = myrandom;
 
 void PhyloTree::computeParsimonyTree(const char *out_prefix, Alignment *alignment) {
+    PerfPhaseTimer perf_timer(PERF_RAS);
 //    cout << "Computing parsimony tree by random stepwise addition..." << endl;
     double start_time = getCPUTime();
     aln = alignment;
@@ -1320,6 +1296,7 @@ void PhyloTree::computeParsimonyTree(const char *out_prefix, Alignment *alignmen
 }
 
 int PhyloTree::addTaxonMPFast(Node* added_node, Node*& target_node, Node*& target_dad, Node* node, Node* dad) {
+    pars_topology.clear();
     Neighbor *dad_nei = dad->findNeighbor(node);
     //Node *added_taxon = added_node->neighbors[0]->node;
     Node *added_taxon = NULL;
@@ -1378,6 +1355,7 @@ int PhyloTree::addTaxonMPFast(Node* added_node, Node*& target_node, Node*& targe
 }
 
 int PhyloTree::addTaxonMP(Node *added_node, Node* &target_node, Node* &target_dad, Node *node, Node *dad) {
+    pars_topology.clear();
     Neighbor *dad_nei = dad->findNeighbor(node);
 
     // now insert the new node in the middle of the branch node-dad
@@ -1544,6 +1522,10 @@ void PhyloTree::deleteAllPartialLh() {
 	central_partial_lh = NULL;
 	central_scale_num = NULL;
 	central_partial_pars = NULL;
+	if (flat_partial_pars)
+		aligned_free(flat_partial_pars);
+	flat_partial_pars = NULL;
+	flat_partial_pars_size = 0;
     clearAllPartialLH();
 }
 
@@ -3299,6 +3281,7 @@ double PhyloTree::optimizeAllBranches(int my_iterations, double tolerance, int m
  ****************************************************************************/
 
 double PhyloTree::addTaxonML(Node *added_node, Node* &target_node, Node* &target_dad, Node *node, Node *dad) {
+    pars_topology.clear();
 
     Neighbor *dad_nei = dad->findNeighbor(node);
 
@@ -3663,6 +3646,7 @@ int PhyloTree::fixNegativeBranch(bool force, Node *node, Node *dad) {
  ****************************************************************************/
 
 void PhyloTree::doOneRandomNNI(Node *node1, Node *node2) {
+    pars_topology.clear();
 	assert(!node1->isLeaf() && !node2->isLeaf());
     assert(node1->degree() == 3 && node2->degree() == 3);
     assert(node1->neighbors.size() == 3 && node2->neighbors.size() == 3);
@@ -3713,6 +3697,7 @@ void PhyloTree::doOneRandomNNI(Node *node1, Node *node2) {
 }
 
 void PhyloTree::doNNI(NNIMove &move, bool clearLH) {
+    pars_topology.clear();
     PhyloNode *node1 = move.node1;
     PhyloNode *node2 = move.node2;
     NeighborVec::iterator node1Nei_it = move.node1Nei_it;
@@ -3805,6 +3790,7 @@ void PhyloTree::changeNNIBrans(NNIMove nnimove) {
 }
 
 NNIMove PhyloTree::getBestNNIForBran(PhyloNode *node1, PhyloNode *node2, NNIMove* nniMoves) {
+    pars_topology.clear();
 	assert(!node1->isLeaf() && !node2->isLeaf());
     assert(node1->degree() == 3 && node2->degree() == 3);
 
@@ -4068,6 +4054,7 @@ double PhyloTree::optimizeSPR_old(double cur_score, PhyloNode *node, PhyloNode *
  */
 double PhyloTree::swapSPR_old(double cur_score, int cur_depth, PhyloNode *node1, PhyloNode *dad1, PhyloNode *orig_node1,
         PhyloNode *orig_node2, PhyloNode *node2, PhyloNode *dad2, vector<PhyloNeighbor*> &spr_path) {
+    pars_topology.clear();
     PhyloNeighbor *node1_nei = (PhyloNeighbor*) node1->findNeighbor(dad1);
     PhyloNeighbor *dad1_nei = (PhyloNeighbor*) dad1->findNeighbor(node1);
     double node1_dad1_len = node1_nei->length;
@@ -4245,6 +4232,7 @@ double PhyloTree::optimizeSPR(double cur_score, PhyloNode *node, PhyloNode *dad)
  */
 double PhyloTree::swapSPR(double cur_score, int cur_depth, PhyloNode *node1, PhyloNode *dad1, PhyloNode *orig_node1,
         PhyloNode *orig_node2, PhyloNode *node2, PhyloNode *dad2, vector<PhyloNeighbor*> &spr_path) {
+    pars_topology.clear();
 
     PhyloNeighbor *node1_nei = (PhyloNeighbor*) node1->findNeighbor(dad1);
     PhyloNeighbor *dad1_nei = (PhyloNeighbor*) dad1->findNeighbor(node1);
@@ -4375,6 +4363,7 @@ double PhyloTree::swapSPR(double cur_score, int cur_depth, PhyloNode *node1, Phy
 }
 
 double PhyloTree::assessSPRMove(double cur_score, const SPRMove &spr) {
+    pars_topology.clear();
 
     PhyloNode *dad = spr.prune_dad;
     PhyloNode *node = spr.prune_node;
@@ -4503,6 +4492,7 @@ double PhyloTree::optimizeSPRBranches() {
 }
 
 void PhyloTree::pruneSubtree(PhyloNode *node, PhyloNode *dad, PruningInfo &info) {
+    pars_topology.clear();
 
     bool first = true;
     info.node = node;
@@ -4537,6 +4527,7 @@ void PhyloTree::pruneSubtree(PhyloNode *node, PhyloNode *dad, PruningInfo &info)
 }
 
 void PhyloTree::regraftSubtree(PruningInfo &info, PhyloNode *in_node, PhyloNode *in_dad) {
+    pars_topology.clear();
 
     NeighborVec::iterator in_node_it = in_node->findNeighborIt(in_dad);
     NeighborVec::iterator in_dad_it = in_dad->findNeighborIt(in_node);
@@ -4818,6 +4809,7 @@ int PhyloTree::testAllBranches(int threshold, double best_score, double *pattern
  ****************************************************************************/
 
 void PhyloTree::deleteLeaf(Node *leaf) {
+    pars_topology.clear();
 
     Node *near_node = leaf->neighbors[0]->node;
     assert(leaf->isLeaf() && near_node->degree() == 3);
@@ -4841,6 +4833,7 @@ void PhyloTree::deleteLeaf(Node *leaf) {
 }
 
 void PhyloTree::reinsertLeaf(Node *leaf, Node *node, Node *dad) {
+    pars_topology.clear();
 
     bool first = true;
     Node *adjacent_node = leaf->neighbors[0]->node;
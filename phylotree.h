@@ -31,6 +31,7 @@
 #include "optimization.h"
 #include "model/rateheterogeneity.h"
 #include "phyloanalysis.h"
+#include "parstopology.h"
 
 const double MIN_BRANCH_LEN = 0.000001; // NEVER TOUCH THIS CONSTANT AGAIN PLEASE!
 const double MAX_BRANCH_LEN = 100.0;
@@ -448,6 +449,40 @@ public:
      */
     virtual int computeParsimonyBranch(PhyloNeighbor *dad_branch, PhyloNode *dad, int *branch_subst = NULL);
 
+    /**
+            compute the partial parsimony vector of a leaf
+            @param partial_pars (OUT) the vector
+            @param taxon taxon ID of the leaf, -1 for the virtual root (all states unknown)
+     */
+    virtual void computeLeafPartialPars(UINT *partial_pars, int taxon);
+
+    /**
+            compute the partial parsimony vector of an internal node from those of its children
+            @param partial_pars (OUT) the vector
+            @param children partial parsimony vectors of the children
+            @param nchildren number of children
+     */
+    virtual void computeInternalPartialPars(UINT *partial_pars, UINT **children, int nchildren);
+
+    /**
+            combine the partial parsimony vectors at the two ends of a branch, filling _pattern_pars
+            @param branch_subst (OUT) if not NULL, the number of substitutions on this branch
+            @return parsimony score of the tree
+     */
+    virtual int computeBranchParsimony(UINT *node_pars, UINT *dad_pars, int *branch_subst = NULL);
+
+    /**
+            @return size of the partial parsimony vector of one node used by computeParsimonyFlat()
+     */
+    virtual size_t getFlatParsBlockSize();
+
+    /**
+            compute the tree parsimony score on pars_topology, keeping one partial parsimony
+            vector per node in flat_partial_pars instead of one per neighbor
+            @return parsimony score of the tree
+     */
+    int computeParsimonyFlat();
+
     void printParsimonyStates(PhyloNeighbor *dad_branch = NULL, PhyloNode *dad = NULL);
 
 
@@ -1432,6 +1467,20 @@ protected:
      */
     UINT *central_partial_pars;
 
+    /**
+            flat copy of the tree used by computeParsimony(), kept until the tree changes:
+            cleared by clearAllPartialLH(), setAlignment() and the tree rearrangements of PhyloTree
+     */
+    ParsTopology pars_topology;
+
+    /**
+            partial parsimony vectors of the nodes of pars_topology, getFlatParsBlockSize() entries per node
+     */
+    UINT *flat_partial_pars;
+
+    /** number of entries allocated for flat_partial_pars */
+    size_t flat_partial_pars_size;
+
     /**
             TRUE to discard saturated for Meyer & von Haeseler (2003) model
      */
@@ -6,7 +6,13 @@
  */
 #include "sprparsimony.h"
 #include "parstree.h"
+#include "gzstream.h"
+#include "timeutil.h"
+#include "perfcounter.h"
 #include <string>
+#ifdef _OPENMP
+	#include <omp.h>
+#endif
 /**
  * PLL (version 1.0.0) a software library for phylogenetic inference
  * Copyright (C) 2013 Tomas Flouri and Alexandros Stamatakis
@@ -54,6 +60,7 @@
 #define VECTOR_BIT_AND _mm512_and_epi32
 #define VECTOR_BIT_OR  _mm512_or_epi32
 #define VECTOR_AND_NOT _mm512_andnot_epi32
+#define VECTOR_BIT_XOR _mm512_xor_epi32
 
 #elif defined(__AVX)
 
@@ -77,6 +84,7 @@
 #define VECTOR_BIT_OR  _mm256_or_pd
 #define VECTOR_STORE  _mm256_store_pd
 #define VECTOR_AND_NOT _mm256_andnot_pd
+#define VECTOR_BIT_XOR _mm256_xor_pd
 
 #elif (defined(__SSE3))
 
@@ -105,6 +113,7 @@
 #define VECTOR_BIT_OR  _mm_or_si128
 #define VECTOR_STORE  _mm_store_si128
 #define VECTOR_AND_NOT _mm_andnot_si128
+#define VECTOR_BIT_XOR _mm_xor_si128
 
 #else
     // no vectorization
@@ -113,6 +122,13 @@
 
 #include "pllrepo/src/pll.h"
 #include "pllrepo/src/pllInternal.h"
+#include "sprparsimonykernel.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#include <cpuid.h>
+#endif
+
+/* alignment of the Fitch parsimony vectors, enough for the AVX-512 kernels */
+#define PARS_VECTOR_ALIGNMENT 64
 
 
 static pllBoolean tipHomogeneityCheckerPars(pllInstance *tr, nodeptr p, int grouping);
@@ -139,6 +155,138 @@ extern int * pllSegmentUpper; // array of first index of the next segment, see I
 parsimonyNumber * pllRemainderLowerBounds; // array of lower bound score for the un-calculated part to the right of a segment
 bool first_call = true; // is this the first call to pllOptimizeSprParsimony
 bool doing_stepwise_addition = false; // is the stepwise addition on
+bool doing_reweighted_spr = false; // is pllOptimizeSprParsimonyReweighted on
+static IQTree *walkerTree = NULL; // the tree search of the UFBoot-MP walker run by pllOptimizeSprParsimonyWalker
+static bool doing_sector_spr = false; // is a sector of sectorialSearch() hill-climbed
+
+#ifdef _OPENMP
+// several randomized stepwise addition trees (see initCandidateTreeSet), bootstrap trees (see
+// IQTree::refineBootTreesParallel) or UFBoot-MP walkers (see IQTree::doWalkerSearch) can be built at the same time
+#pragma omp threadprivate(bestTreeScoreHits, doing_stepwise_addition, doing_reweighted_spr, walkerTree, doing_sector_spr)
+#endif
+
+/**
+ * random number for breaking ties between equally parsimonious trees:
+ * during stepwise addition, reweighted, walker and sector SPR the seed of the PLL instance is used so that each tree
+ * only depends on tr->randomNumberSeed and not on the order in which the trees are built
+ */
+static double randomTieBreak(pllInstance *tr)
+{
+	return (doing_stepwise_addition || doing_reweighted_spr || walkerTree || doing_sector_spr) ?
+			randum(&tr->randomNumberSeed) : random_double();
+}
+
+/**
+ * Bounded evaluation of SPR regraft candidates (on unless -spr_bound_off):
+ * the Fitch score of a candidate is only accumulated until it exceeds the bound computed by sprCandidateBound().
+ * As the patterns are sorted by decreasing parsimony (see optimizeAlignment), most bad candidates are cut
+ * after a short prefix of the parsimony vectors.
+ */
+static size_t boundStopWidth = 0; // # of vector elements scanned by the last evaluation that was cut
+static unsigned long boundCandidates = 0; // # of candidates evaluated with a bound by this thread
+static unsigned long boundCuts = 0; // # of them that were cut
+static double boundCutFraction = 0.0; // sum of the fractions of the vectors scanned by the cut evaluations
+
+#ifdef _OPENMP
+#pragma omp threadprivate(boundStopWidth, boundCandidates, boundCuts, boundCutFraction)
+#endif
+
+// the same over all threads, see sprFlushBoundStats()
+static unsigned long boundCandidatesTotal = 0;
+static unsigned long boundCutsTotal = 0;
+static double boundCutFractionTotal = 0.0;
+
+static inline unsigned int boundedEvaluationCut(unsigned int sum, size_t scanned)
+{
+	boundStopWidth = scanned;
+	return sum;
+}
+
+/* # of vector elements of the parsimony vector of a node over all partitions */
+static size_t parsimonyVectorWidth(partitionList *pr)
+{
+	size_t width = 0;
+	for(int model = 0; model < pr->numberOfPartitions; model++)
+		width += pr->partitionData[model]->parsimonyLength;
+	return width;
+}
+
+static void sprFlushBoundStats()
+{
+#ifdef _OPENMP
+#pragma omp critical(spr_bound_stats)
+#endif
+	{
+		boundCandidatesTotal += boundCandidates;
+		boundCutsTotal += boundCuts;
+		boundCutFractionTotal += boundCutFraction;
+	}
+	boundCandidates = boundCuts = 0;
+	boundCutFraction = 0.0;
+}
+
+void pllGetSprBoundStats(unsigned long &candidates, unsigned long &cuts, double &cutFraction)
+{
+	candidates = boundCandidatesTotal;
+	cuts = boundCutsTotal;
+	cutFraction = cuts ? boundCutFractionTotal / cuts : 0.0;
+}
+
+/**
+ * Fitch kernels chosen at runtime for the instruction sets of the CPU (see pllSelectFitchKernel()),
+ * NULL to use the SSE3/AVX code compiled into this file. Not used for per-site scores.
+ */
+static const FitchKernels *fitchKernels = NULL;
+
+/* @return TRUE if the CPU and the OS support AVX-512F, AVX-512BW and AVX-512 VPOPCNTDQ */
+static bool cpuHasAVX512Popcount()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	unsigned int eax, ebx, ecx, edx, xcr0, xcr0High;
+	if(!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+		return false;
+	if(!(ebx & (1 << 16)) || !(ebx & (1 << 30)) || !(ecx & (1 << 14)))
+		return false;
+	__get_cpuid(1, &eax, &ebx, &ecx, &edx);
+	if(!(ecx & (1 << 27))) // no OSXSAVE
+		return false;
+	__asm__ ("xgetbv" : "=a"(xcr0), "=d"(xcr0High) : "c"(0));
+	return (xcr0 & 0xE6) == 0xE6; // XMM, YMM and ZMM states enabled by the OS
+#else
+	return false;
+#endif
+}
+
+const char *pllSelectFitchKernel(const char *kernel)
+{
+	fitchKernels = NULL;
+#if (defined(__SSE3) || defined(__AVX)) && !defined(__MIC_NATIVE)
+	bool automatic = !kernel || strcmp(kernel, "auto") == 0;
+	if((automatic || strcmp(kernel, "avx512") == 0) && cpuHasAVX512Popcount())
+		fitchKernels = fitchKernelsAVX512();
+	if(!fitchKernels && (automatic || strcmp(kernel, "avx512") == 0 || strcmp(kernel, "avx2") == 0)
+			&& instrset_detect() >= 8)
+		fitchKernels = fitchKernelsAVX2();
+	if(fitchKernels)
+		return fitchKernels->name;
+#endif
+#if defined(__MIC_NATIVE)
+	return "MIC";
+#elif defined(__AVX)
+	return "AVX";
+#elif defined(__SSE3)
+	return "SSE3";
+#else
+	return "no SIMD";
+#endif
+}
+
+RellTileKernel pllRellTileKernel()
+{
+	return fitchKernels ? fitchKernels->rellTile : NULL;
+}
+
+static void freeReweightCache();
 
 void resetGlobalParamOnNewAln(){
     globalParam = NULL;
@@ -154,6 +302,11 @@ void resetGlobalParamOnNewAln(){
     pllRemainderLowerBounds = NULL;
     first_call = true; 
     doing_stepwise_addition = false;
+    doing_reweighted_spr = false;
+    walkerTree = NULL;
+    boundCandidates = boundCuts = boundCandidatesTotal = boundCutsTotal = 0;
+    boundCutFraction = boundCutFractionTotal = 0.0;
+    freeReweightCache();
 }
 
 void initializeCostMatrix() {
@@ -252,124 +405,63 @@ static inline unsigned int vectorPopcount(INT_TYPE v)
 
 
 // Diep:
-// store per site score to nodeNumber
-#if (defined(__SSE3) || defined(__AVX))
-
-#ifdef _WIN32
+// Per site scores (for UFBoot) of the subtree below each node. They are stored bit-sliced: bit x of
+// perSitePartialPars[width * (bits * nodeNumber + b) + k] is bit b of the score of pattern bit x of
+// parsimonyNumber k, for b < bits = perSiteBits(tr). The scores of the children and the state changes at
+// a node are then added by whole vectors and the memory per node is width * bits instead of width * PLL_PCF.
 
-static inline void storePerSiteNodeScores (partitionList * pr, int model, INT_TYPE v, unsigned int offset , int nodeNumber)
+// # of bit planes per node, enough for the largest per site score mxtips - 1
+static inline int perSiteBits(pllInstance *tr)
 {
-  PLL_ALIGN_BEGIN unsigned int counts[INTS_PER_VECTOR] PLL_ALIGN_END;
-	parsimonyNumber * buf;
-
-	int
-		i,
-		j;
-
-	VECTOR_STORE((CAST)counts, v);
-
-  // int sum =0;
-
-  // for(i = 0; i < INTS_PER_VECTOR; i++)
-  //   sum += __builtin_popcount(counts[i]);
-  // cout<<sum<<"\n";
-
-	int partialParsLength = pr->partitionData[model]->parsimonyLength * PLL_PCF;
-	int nodeStart = partialParsLength * nodeNumber;
-	int nodeStartPlusOffset = nodeStart + offset * PLL_PCF;
-	for (i = 0; i < INTS_PER_VECTOR; ++i){
-		buf = &(pr->partitionData[model]->perSitePartialPars[nodeStartPlusOffset]);
-		nodeStartPlusOffset += 32;
-//		buf = &(pr->partitionData[model]->perSitePartialPars[nodeStart + offset * PLL_PCF + i * ULINT_SIZE]); // Diep's
-//		buf = &(pr->partitionData[model]->perSitePartialPars[nodeStart + offset * PLL_PCF + i]); // Tomas's code
-		for (j = 0; j < 32; ++ j) {
-			buf[j] += ((counts[i] >> j) & 1);
-    }
-	}
-    
+	int bits = 1;
+	while((1 << bits) < tr->mxtips)
+		bits++;
+	return bits;
 }
 
-#else
-
-static inline void storePerSiteNodeScores (partitionList * pr, int model, INT_TYPE v, unsigned int offset , int nodeNumber)
+// score of bit site of the per site scores of nodeNumber
+static inline parsimonyNumber perSiteNodeScore(partitionList *pr, int model, int nodeNumber, size_t site, int bits)
 {
-
-	unsigned long
-		counts[LONG_INTS_PER_VECTOR] __attribute__ ((aligned (PLL_BYTE_ALIGNMENT)));
-		parsimonyNumber * buf;
-
-	int
-		i,
-		j;
-
-	VECTOR_STORE((CAST)counts, v);
-
-	int partialParsLength = pr->partitionData[model]->parsimonyLength * PLL_PCF;
-	int nodeStart = partialParsLength * nodeNumber;
-	int nodeStartPlusOffset = nodeStart + offset * PLL_PCF;
-	for (i = 0; i < LONG_INTS_PER_VECTOR; ++i){
-		buf = &(pr->partitionData[model]->perSitePartialPars[nodeStartPlusOffset]);
-		nodeStartPlusOffset += ULINT_SIZE;
-//		buf = &(pr->partitionData[model]->perSitePartialPars[nodeStart + offset * PLL_PCF + i * ULINT_SIZE]); // Diep's
-//		buf = &(pr->partitionData[model]->perSitePartialPars[nodeStart + offset * PLL_PCF + i]); // Tomas's code
-		for (j = 0; j < ULINT_SIZE; ++ j)
-			buf[j] += ((counts[i] >> j) & 1);
-	}
-    
+	size_t width = pr->partitionData[model]->parsimonyLength;
+	parsimonyNumber
+		*p = &(pr->partitionData[model]->perSitePartialPars[width * bits * nodeNumber + site / PLL_PCF]),
+		score = 0;
+	unsigned int shift = site % PLL_PCF;
+	for(int b = 0; b < bits; b++)
+		score |= ((p[width * b] >> shift) & 1) << b;
+	return score;
 }
 
-#endif
-
+#if (defined(__SSE3) || defined(__AVX))
 
-// Diep:
-// Add site scores in q and r to p
-// q and r are children of p
-template<class VectorClass>
-void addPerSiteSubtreeScoresSIMD(partitionList *pr, int pNumber, int qNumber, int rNumber){
-	assert(VectorClass::size() == INTS_PER_VECTOR);
-	parsimonyNumber * pBuf, * qBuf, *rBuf;
-	for(int i = 0; i < pr->numberOfPartitions; i++){
-		int partialParsLength = pr->partitionData[i]->parsimonyLength * PLL_PCF;
-		pBuf = &(pr->partitionData[i]->perSitePartialPars[partialParsLength * pNumber]);
-		qBuf = &(pr->partitionData[i]->perSitePartialPars[partialParsLength * qNumber]);
-		rBuf = &(pr->partitionData[i]->perSitePartialPars[partialParsLength * rNumber]);
-		for(int k = 0; k < partialParsLength; k+= VectorClass::size()){
-			VectorClass *pBufVC = (VectorClass*) &pBuf[k];
-			VectorClass *qBufVC = (VectorClass*) &qBuf[k];
-			VectorClass *rBufVC = (VectorClass*) &rBuf[k];
-			*pBufVC += *qBufVC + *rBufVC;
-		}
+// per site scores of pNumber at parsimonyNumber offset = those of qNumber + rNumber + the changes v,
+// one ripple-carry addition over the bit planes with v as carry in; pNumber may be qNumber
+static inline void storePerSiteNodeScores (partitionList * pr, int model, INT_TYPE v, unsigned int offset, int pNumber,
+		int qNumber, int rNumber, int bits)
+{
+	size_t width = pr->partitionData[model]->parsimonyLength;
+	parsimonyNumber
+		*p = &(pr->partitionData[model]->perSitePartialPars[width * bits * pNumber + offset]),
+		*q = &(pr->partitionData[model]->perSitePartialPars[width * bits * qNumber + offset]),
+		*r = &(pr->partitionData[model]->perSitePartialPars[width * bits * rNumber + offset]);
+
+	for(int b = 0; b < bits; b++){
+		INT_TYPE
+			q_b = VECTOR_LOAD((CAST)(&q[width * b])),
+			r_b = VECTOR_LOAD((CAST)(&r[width * b])),
+			x = VECTOR_BIT_XOR(q_b, r_b);
+
+		VECTOR_STORE((CAST)(&p[width * b]), VECTOR_BIT_XOR(x, v));
+		v = VECTOR_BIT_OR(VECTOR_BIT_AND(q_b, r_b), VECTOR_BIT_AND(v, x));
 	}
 }
 
-// Diep:
-// Add site scores in q and r to p
-// q and r are children of p
-void addPerSiteSubtreeScores(partitionList *pr, int pNumber, int qNumber, int rNumber){
-//	parsimonyNumber * pBuf, * qBuf, *rBuf;
-//	for(int i = 0; i < pr->numberOfPartitions; i++){
-//		int partialParsLength = pr->partitionData[i]->parsimonyLength * PLL_PCF;
-//		pBuf = &(pr->partitionData[i]->perSitePartialPars[partialParsLength * pNumber]);
-//		qBuf = &(pr->partitionData[i]->perSitePartialPars[partialParsLength * qNumber]);
-//		rBuf = &(pr->partitionData[i]->perSitePartialPars[partialParsLength * rNumber]);
-//		for(int k = 0; k < partialParsLength; k++)
-//			pBuf[k] += qBuf[k] + rBuf[k];
-//	}
-
-#ifdef __AVX
-        addPerSiteSubtreeScoresSIMD<Vec8ui>(pr, pNumber, qNumber, rNumber);
-#else
-        addPerSiteSubtreeScoresSIMD<Vec4ui>(pr, pNumber, qNumber, rNumber);
-#endif
-}
-
-
 // Diep:
 // Reset site scores of p
-void resetPerSiteNodeScores(partitionList *pr, int pNumber){
+void resetPerSiteNodeScores(partitionList *pr, int pNumber, int bits){
 	parsimonyNumber * pBuf;
 	for(int i = 0; i < pr->numberOfPartitions; i++){
-		int partialParsLength = pr->partitionData[i]->parsimonyLength * PLL_PCF;
+		size_t partialParsLength = pr->partitionData[i]->parsimonyLength * bits;
 		pBuf = &(pr->partitionData[i]->perSitePartialPars[partialParsLength * pNumber]);
 		memset(pBuf, 0, partialParsLength * sizeof(parsimonyNumber));
 	}
@@ -433,11 +525,6 @@ static void getxnodeLocal (nodeptr p)
 
 static void computeTraversalInfoParsimony(nodeptr p, int *ti, int *counter, int maxTips, pllBoolean full, int perSiteScores)
 {
-#if (defined(__SSE3) || defined(__AVX))
-	if(perSiteScores && pllCostMatrix == NULL){
-		resetPerSiteNodeScores(iqtree->pllPartitions, p->number);
-	}
-#endif
 
 	nodeptr
 		q = p->next->back,
@@ -553,6 +640,7 @@ void newviewSankoffParsimonyIterativeFastSIMD(pllInstance *tr, partitionList * p
 
 static void newviewParsimonyIterativeFast(pllInstance *tr, partitionList *pr, int perSiteScores)
 {
+	perfCount(PERF_NEWVIEW_NODES, (tr->ti[0] - 4) / 4);
 	if(pllCostMatrix) {
 //        newviewSankoffParsimonyIterativeFast(tr, pr, perSiteScores);
 //        return;
@@ -647,7 +735,38 @@ static void newviewParsimonyIterativeFast(pllInstance *tr, partitionList *pr, in
     model,
     *ti = tr->ti,
     count = ti[0],
-    index;
+    index,
+    siteBits = perSiteBits(tr);
+
+  if(fitchKernels && !perSiteScores)
+    {
+      for(index = 4; index < count; index += 4)
+        {
+          unsigned int
+            totalScore = 0;
+
+          size_t
+            pNumber = (size_t)ti[index],
+            qNumber = (size_t)ti[index + 1],
+            rNumber = (size_t)ti[index + 2];
+
+          for(model = 0; model < pr->numberOfPartitions; model++)
+            {
+              size_t
+                states = pr->partitionData[model]->states,
+                width = pr->partitionData[model]->parsimonyLength;
+
+              parsimonyNumber
+                *vect = pr->partitionData[model]->parsVect;
+
+              totalScore += fitchKernels->newview(states, width, &vect[width * states * qNumber],
+                  &vect[width * states * rNumber], &vect[width * states * pNumber]);
+            }
+
+          tr->parsimonyScore[pNumber] = totalScore + tr->parsimonyScore[rNumber] + tr->parsimonyScore[qNumber];
+        }
+      return;
+    }
 
   for(index = 4; index < count; index += 4)
     {
@@ -660,8 +779,8 @@ static void newviewParsimonyIterativeFast(pllInstance *tr, partitionList *pr, in
         rNumber = (size_t)ti[index + 2];
 
       if(perSiteScores){
-		  if(qNumber <= tr->mxtips) resetPerSiteNodeScores(pr, qNumber);
-		  if(rNumber <= tr->mxtips) resetPerSiteNodeScores(pr, rNumber);
+		  if(qNumber <= tr->mxtips) resetPerSiteNodeScores(pr, qNumber, siteBits);
+		  if(rNumber <= tr->mxtips) resetPerSiteNodeScores(pr, rNumber, siteBits);
       }
 
       for(model = 0; model < pr->numberOfPartitions; model++)
@@ -716,7 +835,7 @@ static void newviewParsimonyIterativeFast(pllInstance *tr, partitionList *pr, in
 
                     totalScore += vectorPopcount(v_N);
                     if (perSiteScores)
-                       storePerSiteNodeScores(pr, model, v_N, i, pNumber);
+                       storePerSiteNodeScores(pr, model, v_N, i, pNumber, qNumber, rNumber, siteBits);
                   }
               }
               break;
@@ -772,7 +891,7 @@ static void newviewParsimonyIterativeFast(pllInstance *tr, partitionList *pr, in
 
                     totalScore += vectorPopcount(v_N);
                     if (perSiteScores)
-                       storePerSiteNodeScores(pr, model, v_N, i, pNumber);
+                       storePerSiteNodeScores(pr, model, v_N, i, pNumber, qNumber, rNumber, siteBits);
                   }
               }
               break;
@@ -817,7 +936,7 @@ static void newviewParsimonyIterativeFast(pllInstance *tr, partitionList *pr, in
 
                     totalScore += vectorPopcount(v_N);
                     if (perSiteScores)
-                       storePerSiteNodeScores(pr, model, v_N, i, pNumber);
+                       storePerSiteNodeScores(pr, model, v_N, i, pNumber, qNumber, rNumber, siteBits);
                   }
               }
               break;
@@ -865,15 +984,13 @@ static void newviewParsimonyIterativeFast(pllInstance *tr, partitionList *pr, in
 
                     totalScore += vectorPopcount(v_N);
                     if (perSiteScores)
-                       storePerSiteNodeScores(pr, model, v_N, i, pNumber);
+                       storePerSiteNodeScores(pr, model, v_N, i, pNumber, qNumber, rNumber, siteBits);
                   }
               }
             }
         }
 
       tr->parsimonyScore[pNumber] = totalScore + tr->parsimonyScore[rNumber] + tr->parsimonyScore[qNumber];
-      if (perSiteScores)
-    	  addPerSiteSubtreeScores(pr, pNumber, qNumber, rNumber); // Diep: add rNumber and qNumber to pNumber
     }
 }
 
@@ -962,7 +1079,12 @@ parsimonyNumber evaluateSankoffParsimonyIterativeFastSIMD(pllInstance *tr, parti
 
 
 
-static unsigned int evaluateParsimonyIterativeFast(pllInstance *tr, partitionList *pr, int perSiteScores)
+/**
+ * Fitch score of the tree at the branch tr->ti[1] -- tr->ti[2] after updating the vectors in tr->ti.
+ * If bestScore is given, the evaluation stops as soon as the score exceeds it and the per-site scores
+ * at the branch are not computed (Fitch parsimony only).
+ */
+static unsigned int evaluateParsimonyIterativeFast(pllInstance *tr, partitionList *pr, int perSiteScores, unsigned int bestScore = UINT_MAX)
 {
 	if(pllCostMatrix) {
 //        return evaluateSankoffParsimonyIterativeFast(tr, pr, perSiteScores);
@@ -1037,22 +1159,52 @@ static unsigned int evaluateParsimonyIterativeFast(pllInstance *tr, partitionLis
     qNumber = (size_t)tr->ti[2];
 
   int
-    model;
+    model,
+    siteBits = perSiteBits(tr);
 
   unsigned int
-    bestScore = tr->bestParsimony,
     sum;
 
+  size_t
+    scanned = 0; // # of vector elements of the finished partitions
+
+  // the per-site scores are only needed for a complete evaluation
+  int
+    storeSites = perSiteScores && bestScore == UINT_MAX;
+
   if(tr->ti[0] > 4)
     newviewParsimonyIterativeFast(tr, pr, perSiteScores);
 
   sum = tr->parsimonyScore[pNumber] + tr->parsimonyScore[qNumber];
 
-  if(perSiteScores){
-	  resetPerSiteNodeScores(pr, tr->start->number);
-	  addPerSiteSubtreeScores(pr, tr->start->number, pNumber, qNumber);
+  if(storeSites){
+	  // tips have no changes below them, but evaluations store the scores of the root at the tip tr->start
+	  if(pNumber <= tr->mxtips) resetPerSiteNodeScores(pr, pNumber, siteBits);
+	  if(qNumber <= tr->mxtips) resetPerSiteNodeScores(pr, qNumber, siteBits);
   }
 
+  if(fitchKernels && !storeSites)
+    {
+      for(model = 0; model < pr->numberOfPartitions; model++)
+        {
+          size_t
+            states = pr->partitionData[model]->states,
+            width  = pr->partitionData[model]->parsimonyLength,
+            stop = 0;
+
+          parsimonyNumber
+            *vect = pr->partitionData[model]->parsVect;
+
+          sum = fitchKernels->evaluate(states, width, &vect[width * states * qNumber], &vect[width * states * pNumber],
+              sum, bestScore, stop);
+          if(stop)
+            return boundedEvaluationCut(sum, scanned + stop);
+
+          scanned += width;
+        }
+      return sum;
+    }
+
   for(model = 0; model < pr->numberOfPartitions; model++)
     {
       size_t
@@ -1085,11 +1237,11 @@ static unsigned int evaluateParsimonyIterativeFast(pllInstance *tr, partitionLis
                  v_N = VECTOR_AND_NOT(v_N, allOne);
 
                  sum += vectorPopcount(v_N);
-                 if(perSiteScores)
-                	 storePerSiteNodeScores(pr, model, v_N, i, tr->start->number);
+                 if(storeSites)
+                	 storePerSiteNodeScores(pr, model, v_N, i, tr->start->number, qNumber, pNumber, siteBits);
 
-//                 if(sum >= bestScore)
-//                   return sum;
+                 if(sum > bestScore)
+                   return boundedEvaluationCut(sum, scanned + i + INTS_PER_VECTOR);
                }
            }
            break;
@@ -1117,10 +1269,10 @@ static unsigned int evaluateParsimonyIterativeFast(pllInstance *tr, partitionLis
                  v_N = VECTOR_AND_NOT(v_N, allOne);
 
                  sum += vectorPopcount(v_N);
-                 if(perSiteScores)
-                	 storePerSiteNodeScores(pr, model, v_N, i, tr->start->number);
-//                 if(sum >= bestScore)
-//                   return sum;
+                 if(storeSites)
+                	 storePerSiteNodeScores(pr, model, v_N, i, tr->start->number, qNumber, pNumber, siteBits);
+                 if(sum > bestScore)
+                   return boundedEvaluationCut(sum, scanned + i + INTS_PER_VECTOR);
                }
            }
            break;
@@ -1154,10 +1306,10 @@ static unsigned int evaluateParsimonyIterativeFast(pllInstance *tr, partitionLis
                   v_N = VECTOR_AND_NOT(v_N, allOne);
 
                   sum += vectorPopcount(v_N);
-                  if(perSiteScores)
-                 	 storePerSiteNodeScores(pr, model, v_N, i, tr->start->number);
-//                  if(sum >= bestScore)
-//                    return sum;
+                  if(storeSites)
+                 	 storePerSiteNodeScores(pr, model, v_N, i, tr->start->number, qNumber, pNumber, siteBits);
+                  if(sum > bestScore)
+                    return boundedEvaluationCut(sum, scanned + i + INTS_PER_VECTOR);
                 }
            }
            break;
@@ -1193,13 +1345,15 @@ static unsigned int evaluateParsimonyIterativeFast(pllInstance *tr, partitionLis
                  v_N = VECTOR_AND_NOT(v_N, allOne);
 
                  sum += vectorPopcount(v_N);
-                 if(perSiteScores)
-                	 storePerSiteNodeScores(pr, model, v_N, i, tr->start->number);
-//                 if(sum >= bestScore)
-//                   return sum;
+                 if(storeSites)
+                	 storePerSiteNodeScores(pr, model, v_N, i, tr->start->number, qNumber, pNumber, siteBits);
+                 if(sum > bestScore)
+                   return boundedEvaluationCut(sum, scanned + i + INTS_PER_VECTOR);
                }
            }
          }
+
+      scanned += width;
     }
 
   return sum;
@@ -1379,6 +1533,7 @@ static void newviewSankoffParsimonyIterativeFast(pllInstance *tr, partitionList
 
 static void newviewParsimonyIterativeFast(pllInstance *tr, partitionList *pr, int perSiteScores)
 {
+	perfCount(PERF_NEWVIEW_NODES, (tr->ti[0] - 4) / 4);
 	if(pllCostMatrix) return newviewSankoffParsimonyIterativeFast(tr, pr, perSiteScores);
   int
     model,
@@ -1714,7 +1869,7 @@ static unsigned int evaluateSankoffParsimonyIterativeFast(pllInstance *tr, parti
 
 
 
-static unsigned int evaluateParsimonyIterativeFast(pllInstance *tr, partitionList *pr, int perSiteScores)
+static unsigned int evaluateParsimonyIterativeFast(pllInstance *tr, partitionList *pr, int perSiteScores, unsigned int bestScore = UINT_MAX)
 {
 	if(pllCostMatrix) return evaluateSankoffParsimonyIterativeFast(tr, pr, perSiteScores);
 
@@ -1726,9 +1881,11 @@ static unsigned int evaluateParsimonyIterativeFast(pllInstance *tr, partitionLis
     model;
 
   unsigned int
-    bestScore = tr->bestParsimony,
     sum;
 
+  size_t
+    scanned = 0; // # of vector elements of the finished partitions
+
   if(tr->ti[0] > 4)
     newviewParsimonyIterativeFast(tr, pr, perSiteScores);
 
@@ -1768,8 +1925,8 @@ static unsigned int evaluateParsimonyIterativeFast(pllInstance *tr, partitionLis
 
                   sum += ((unsigned int) __builtin_popcount(t_N));
 
-//                 if(sum >= bestScore)
-//                   return sum;
+                  if(sum > bestScore)
+                    return boundedEvaluationCut(sum, scanned + i + 1);
                }
            }
            break;
@@ -1801,8 +1958,8 @@ static unsigned int evaluateParsimonyIterativeFast(pllInstance *tr, partitionLis
 
                   sum += ((unsigned int) __builtin_popcount(t_N));
 
-//                 if(sum >= bestScore)
-//                   return sum;
+                  if(sum > bestScore)
+                    return boundedEvaluationCut(sum, scanned + i + 1);
                }
            }
            break;
@@ -1834,8 +1991,8 @@ static unsigned int evaluateParsimonyIterativeFast(pllInstance *tr, partitionLis
 
                   sum += ((unsigned int) __builtin_popcount(t_N));
 
-//                  if(sum >= bestScore)
-//                    return sum;
+                  if(sum > bestScore)
+                    return boundedEvaluationCut(sum, scanned + i + 1);
                 }
            }
            break;
@@ -1869,11 +2026,13 @@ static unsigned int evaluateParsimonyIterativeFast(pllInstance *tr, partitionLis
 
                   sum += ((unsigned int) __builtin_popcount(t_N));
 
-//                 if(sum >= bestScore)
-//                   return sum;
+                  if(sum > bestScore)
+                    return boundedEvaluationCut(sum, scanned + i + 1);
                }
            }
          }
+
+      scanned += width;
     }
 
   return sum;
@@ -1886,7 +2045,12 @@ static unsigned int evaluateParsimonyIterativeFast(pllInstance *tr, partitionLis
 
 
 
-static unsigned int evaluateParsimony(pllInstance *tr, partitionList *pr, nodeptr p, pllBoolean full, int perSiteScores)
+/**
+ * @param bound if given, the evaluation stops as soon as the score exceeds bound (see evaluateParsimonyIterativeFast)
+ * and the per-site scores are only computed for trees scoring at most bound
+ * @return the parsimony score of the tree, or a partial score above bound
+ */
+static unsigned int evaluateParsimony(pllInstance *tr, partitionList *pr, nodeptr p, pllBoolean full, int perSiteScores, unsigned int bound = UINT_MAX)
 {
 	volatile unsigned int result;
 	nodeptr q = p->back;
@@ -1911,7 +2075,19 @@ static unsigned int evaluateParsimony(pllInstance *tr, partitionList *pr, nodept
 
 	ti[0] = counter;
 
-	result = evaluateParsimonyIterativeFast(tr, pr, perSiteScores);
+	result = evaluateParsimonyIterativeFast(tr, pr, perSiteScores, bound);
+
+	if(bound != UINT_MAX){
+		boundCandidates++;
+		if(result > bound){
+			boundCuts++;
+			boundCutFraction += (double)boundStopWidth / parsimonyVectorWidth(pr);
+		}else if(perSiteScores){
+			// the subtrees are up to date, only the per-site scores at the branch are missing
+			ti[0] = 4;
+			result = evaluateParsimonyIterativeFast(tr, pr, perSiteScores);
+		}
+	}
 
 	return result;
 }
@@ -2045,29 +2221,18 @@ static pllBoolean _restoreTree (topol *tpl, pllInstance *tr, partitionList *pr)
 
 static void reorderNodes(pllInstance *tr, nodeptr *np, nodeptr p, int *count)
 {
-  int i, found = 0;
+  int i = p->number, found = 0;
 
   if((p->number <= tr->mxtips))
     return;
   else
     {
-      for(i = tr->mxtips + 1; (i <= (tr->mxtips + tr->mxtips - 1)) && (found == 0); i++)
+      // np is indexed by node number, the nodes of a ring share it
+      if (p == np[i] || p == np[i]->next || p == np[i]->next->next)
         {
-          if (p == np[i] || p == np[i]->next || p == np[i]->next->next)
-            {
-              if(p == np[i])
-                tr->nodep[*count + tr->mxtips + 1] = np[i];
-              else
-                {
-                  if(p == np[i]->next)
-                    tr->nodep[*count + tr->mxtips + 1] = np[i]->next;
-                  else
-                    tr->nodep[*count + tr->mxtips + 1] = np[i]->next->next;
-                }
-
-              found = 1;
-              *count = *count + 1;
-            }
+          tr->nodep[*count + tr->mxtips + 1] = p;
+          found = 1;
+          *count = *count + 1;
         }
 
       assert(found != 0);
@@ -2092,7 +2257,7 @@ static void nodeRectifierPars(pllInstance *tr)
   /* TODO why is tr->rooted set to PLL_FALSE here ?*/
 
   for(i = tr->mxtips + 1; i <= (tr->mxtips + tr->mxtips - 1); i++)
-    np[i] = tr->nodep[i];
+    np[tr->nodep[i]->number] = tr->nodep[i];
 
   reorderNodes(tr, np, tr->start->back, &count);
 
@@ -2103,6 +2268,29 @@ static void nodeRectifierPars(pllInstance *tr)
 
 
 
+/**
+ * @return the score above which a regraft candidate is of no use: it is neither selected as the next move
+ * nor, with per-site scores for UFBoot, saved as a bootstrap candidate tree (see IQTree::saveCurrentTree).
+ * UINT_MAX if the candidates must be evaluated completely.
+ */
+static unsigned int sprCandidateBound(pllInstance *tr, int perSiteScores)
+{
+	if(!globalParam->spr_bound || pllCostMatrix)
+		return UINT_MAX; // Sankoff parsimony has its own bound, see pllRemainderLowerBounds
+	if(!perSiteScores || globalParam->save_trees_off)
+		return tr->bestParsimony;
+	IQTree *search = walkerTree ? walkerTree : iqtree;
+	// on the 1st hill-climbing of a ratchet iteration the trees are saved with their score on the
+	// original alignment, which is not the score computed here
+	if(!search || search->on_ratchet_hclimb1 || search->logl_cutoff >= 0.0)
+		return UINT_MAX;
+	// a new tree is only saved if it scores below -logl_cutoff, a known tree always has the same score
+	double cutoff = ceil(-search->logl_cutoff + 1e-4);
+	if(cutoff >= (double)UINT_MAX)
+		return UINT_MAX;
+	return max(tr->bestParsimony, (unsigned int)cutoff);
+}
+
 static void testInsertParsimony (pllInstance *tr, partitionList *pr, nodeptr p, nodeptr q, pllBoolean saveBranches, int perSiteScores)
 {
   unsigned int
@@ -2147,6 +2335,8 @@ static void testInsertParsimony (pllInstance *tr, partitionList *pr, nodeptr p,
       double
         *z = (double *)rax_malloc(numBranches*sizeof(double)); // Diep: copy from the latest pllrepo (fastDNAparsimony.c)
 
+      perfCount(PERF_SPR_CANDIDATES);
+
       if(saveBranches)
         {
           int i;
@@ -2157,10 +2347,13 @@ static void testInsertParsimony (pllInstance *tr, partitionList *pr, nodeptr p,
 
       insertParsimony(tr, pr, p, q, perSiteScores);
 
-      mp = evaluateParsimony(tr, pr, p->next->next, PLL_FALSE, perSiteScores);
+      unsigned int
+        bound = sprCandidateBound(tr, perSiteScores);
+
+      mp = evaluateParsimony(tr, pr, p->next->next, PLL_FALSE, perSiteScores, bound);
 
 //		if(globalParam->gbo_replicates > 0 && perSiteScores){
-		if(perSiteScores){
+		if(perSiteScores && mp <= bound){
 			// If UFBoot is enabled ...
 			pllSaveCurrentTreeSprParsimony(tr, pr, mp); // run UFBoot
 		}
@@ -2169,7 +2362,7 @@ static void testInsertParsimony (pllInstance *tr, partitionList *pr, nodeptr p,
 		else if(mp == tr->bestParsimony) bestTreeScoreHits++;
 
 		if((mp < tr->bestParsimony) ||
-			((mp == tr->bestParsimony) && (random_double() <= 1.0 / bestTreeScoreHits))){
+			((mp == tr->bestParsimony) && (randomTieBreak(tr) <= 1.0 / bestTreeScoreHits))){
 			tr->bestParsimony = mp;
 			tr->insertNode = q;
 			tr->removeNode = p;
@@ -2218,141 +2411,712 @@ static void addTraverseParsimony (pllInstance *tr, partitionList *pr, nodeptr p,
 }
 
 
-static void makePermutationFast(int *perm, int n, pllInstance *tr)
-{
-  int
-    i,
-    j,
-    k;
-
-  for (i = 1; i <= n; i++)
-    perm[i] = i;
+/**
+ * Parallel SPR:
+ * Instead of testing the regraft positions of a pruned subtree one after another,
+ * collectTraverseParsimony() walks the candidate branches in the same order as addTraverseParsimony(),
+ * brings the two parsimony vectors at the ends of each branch up to date and copies them into sprCandVect.
+ * sprScoreCandidates() then scores all candidates concurrently and reduces them in traversal order,
+ * so that the selected move (including the random tie-breaking) is exactly the one of the serial search.
+ * Only used for Fitch parsimony without per-site scores (i.e. not during UFBoot tree collection).
+ */
+static parsimonyNumber * sprCandVect = NULL; // 2 vectors (q and q->back) per candidate branch
+static nodeptr * sprCandNodes = NULL; // q of each candidate branch
+static unsigned int * sprCandScores = NULL; // score of each candidate insertion
+static size_t sprCandCount = 0; // # of collected candidates
+static size_t sprCandCapacity = 0; // # of candidates sprCandVect can hold
+static size_t sprCandVectLength = 0; // # of parsimonyNumber in one vector over all partitions
+
+#ifdef _OPENMP
+#pragma omp threadprivate(sprCandVect, sprCandNodes, sprCandScores, sprCandCount, sprCandCapacity, sprCandVectLength)
+#endif
 
-  for (i = 1; i <= n; i++)
-    {
-      double d =  randum(&tr->randomNumberSeed);
+/* minimal amount of work (candidates * vector length) for starting a parallel region */
+#define SPR_PARALLEL_MIN_WORK 8192
 
-      k =  (int)((double)(n + 1 - i) * d);
+static void sprFreeEdgeVectors();
+static void tbrFreeBuffers();
 
-      j        = perm[i];
+static void sprFreeCandidates()
+{
+	sprFreeEdgeVectors(); // the edge vectors have the same length
+	if(sprCandVect){
+		rax_free(sprCandVect);
+		rax_free(sprCandNodes);
+		rax_free(sprCandScores);
+	}
+	sprCandVect = NULL;
+	sprCandNodes = NULL;
+	sprCandScores = NULL;
+	sprCandCount = sprCandCapacity = 0;
+	sprCandVectLength = 0;
+}
 
-      perm[i]     = perm[i + k];
-      perm[i + k] = j;
-    }
+static bool sprUseParallel(pllInstance *tr, int perSiteScores)
+{
+#ifdef _OPENMP
+	return globalParam && globalParam->spr_parallel && !perSiteScores && !pllCostMatrix && !tr->grouped
+			&& omp_get_max_threads() > 1 && !omp_in_parallel();
+#else
+	return false;
+#endif
 }
 
-//static nodeptr  removeNodeParsimony (nodeptr p, tree *tr)
-static nodeptr  removeNodeParsimony (nodeptr p)
+static void sprReserveCandidates(partitionList *pr, size_t count)
 {
-  nodeptr  q, r;
+	if(count <= sprCandCapacity)
+		return;
+
+	if(sprCandVectLength == 0)
+		for(int model = 0; model < pr->numberOfPartitions; model++)
+			sprCandVectLength += (size_t)pr->partitionData[model]->parsimonyLength * pr->partitionData[model]->states;
+
+	size_t capacity = max(count, 2 * sprCandCapacity);
+	parsimonyNumber *vect;
+	rax_posix_memalign((void **) &vect, PARS_VECTOR_ALIGNMENT, capacity * 2 * sprCandVectLength * sizeof(parsimonyNumber));
+	nodeptr *nodes = (nodeptr *)rax_malloc(capacity * sizeof(nodeptr));
+	unsigned int *scores = (unsigned int *)rax_malloc(capacity * sizeof(unsigned int));
+	if(sprCandVect){
+		memcpy(vect, sprCandVect, sprCandCount * 2 * sprCandVectLength * sizeof(parsimonyNumber));
+		memcpy(nodes, sprCandNodes, sprCandCount * sizeof(nodeptr));
+		memcpy(scores, sprCandScores, sprCandCount * sizeof(unsigned int));
+		rax_free(sprCandVect);
+		rax_free(sprCandNodes);
+		rax_free(sprCandScores);
+	}
+	sprCandVect = vect;
+	sprCandNodes = nodes;
+	sprCandScores = scores;
+	sprCandCapacity = capacity;
+}
 
-  q = p->next->back;
-  r = p->next->next->back;
+/* same as testInsertParsimony() but only store the vectors of q and q->back facing each other */
+static void collectInsertParsimony(pllInstance *tr, partitionList *pr, nodeptr q)
+{
+	nodeptr r = q->back;
+	int counter = 4;
+
+	if(q->number > tr->mxtips && !q->xPars)
+		computeTraversalInfoParsimony(q, tr->ti, &counter, tr->mxtips, PLL_FALSE, 0);
+	if(r->number > tr->mxtips && !r->xPars)
+		computeTraversalInfoParsimony(r, tr->ti, &counter, tr->mxtips, PLL_FALSE, 0);
+	if(counter > 4){
+		tr->ti[0] = counter;
+		newviewParsimonyIterativeFast(tr, pr, 0);
+	}
 
-  hookupDefault(q, r);
+	sprReserveCandidates(pr, sprCandCount + 1);
 
-  p->next->next->back = p->next->back = (node *) NULL;
+	parsimonyNumber *qVect = &sprCandVect[2 * sprCandVectLength * sprCandCount];
+	parsimonyNumber *rVect = qVect + sprCandVectLength;
+	for(int model = 0; model < pr->numberOfPartitions; model++){
+		size_t length = (size_t)pr->partitionData[model]->parsimonyLength * pr->partitionData[model]->states;
+		memcpy(qVect, &(pr->partitionData[model]->parsVect[length * q->number]), length * sizeof(parsimonyNumber));
+		memcpy(rVect, &(pr->partitionData[model]->parsVect[length * r->number]), length * sizeof(parsimonyNumber));
+		qVect += length;
+		rVect += length;
+	}
 
-  return  q;
+	sprCandScores[sprCandCount] = tr->parsimonyScore[q->number] + tr->parsimonyScore[r->number];
+	sprCandNodes[sprCandCount++] = q;
 }
 
-static int rearrangeParsimony(pllInstance *tr, partitionList *pr, nodeptr p, int mintrav, int maxtrav, pllBoolean doAll, int perSiteScores)
+static void collectTraverseParsimony(pllInstance *tr, partitionList *pr, nodeptr q, int mintrav, int maxtrav, pllBoolean doAll)
 {
-	nodeptr
-		p1,
-		p2,
-		q,
-		q1,
-		q2;
-
-  int
-    mintrav2;
+  if (doAll || (--mintrav <= 0))
+    collectInsertParsimony(tr, pr, q);
 
-  pllBoolean
-    doP = PLL_TRUE,
-    doQ = PLL_TRUE;
+  if (((q->number > tr->mxtips)) && ((--maxtrav > 0) || doAll))
+    {
+      collectTraverseParsimony(tr, pr, q->next->back, mintrav, maxtrav, doAll);
+      collectTraverseParsimony(tr, pr, q->next->next->back, mintrav, maxtrav, doAll);
+    }
+}
 
-  if (maxtrav > tr->ntips - 3)
-    maxtrav = tr->ntips - 3;
+/**
+ * Fitch score of the 3 subtrees whose vectors are qVect, rVect and sVect (without their subtree scores):
+ * the cost of joining q and r plus the cost of joining the result with s.
+ * The joined vector of q and r is kept in registers, i.e. no scratch vector is written.
+ * The evaluation stops as soon as the score exceeds bound, scanned is then set to the # of vector elements scanned.
+ */
+static unsigned int sprInsertionScore(partitionList *pr, const parsimonyNumber *qVect, const parsimonyNumber *rVect, size_t sNumber,
+		unsigned int bound, size_t &scanned)
+{
+	unsigned int sum = 0;
+	size_t done = 0;
 
-  assert(mintrav == 1);
+	for(int model = 0; model < pr->numberOfPartitions; model++){
+		size_t
+			states = pr->partitionData[model]->states,
+			width = pr->partitionData[model]->parsimonyLength,
+			i, j;
 
-  if(maxtrav < mintrav)
-    return 0;
+		const parsimonyNumber *sVect = &(pr->partitionData[model]->parsVect[width * states * sNumber]);
 
-  q = p->back;
+		assert(states <= 32);
 
-	unsigned int mp = evaluateParsimony(tr, pr, p, PLL_FALSE, perSiteScores); // Diep: This is VERY important to make sure SPR is accurate*****
-	if(perSiteScores){
-		// If UFBoot is enabled ...
-		pllSaveCurrentTreeSprParsimony(tr, pr, mp); // run UFBoot
-	}
+#if (defined(__SSE3) || defined(__AVX))
+		INT_TYPE
+			allOne = SET_ALL_BITS_ONE;
+
+		if(fitchKernels){
+			size_t stop = 0;
+			sum = fitchKernels->insertion(states, width, qVect, rVect, sVect, sum, bound, stop);
+			if(stop){
+				scanned = done + stop;
+				return sum;
+			}
+		}else
+		for(i = 0; i < width; i += INTS_PER_VECTOR){
+			INT_TYPE
+				s_r, s_l,
+				v_N = SET_ALL_BITS_ZERO,
+				t_N = SET_ALL_BITS_ZERO,
+				l_A[32],
+				v_A[32];
+
+			for(j = 0; j < states; j++){
+				s_l = VECTOR_LOAD((CAST)(&qVect[width * j + i]));
+				s_r = VECTOR_LOAD((CAST)(&rVect[width * j + i]));
+				l_A[j] = VECTOR_BIT_AND(s_l, s_r);
+				v_A[j] = VECTOR_BIT_OR(s_l, s_r);
+				v_N = VECTOR_BIT_OR(v_N, l_A[j]);
+			}
 
-  if(tr->constrained)
-    {
-      if(! tipHomogeneityCheckerPars(tr, p->back, 0))
-        doP = PLL_FALSE;
+			for(j = 0; j < states; j++){
+				s_l = VECTOR_BIT_OR(l_A[j], VECTOR_AND_NOT(v_N, v_A[j]));
+				s_r = VECTOR_LOAD((CAST)(&sVect[width * j + i]));
+				t_N = VECTOR_BIT_OR(t_N, VECTOR_BIT_AND(s_l, s_r));
+			}
 
-      if(! tipHomogeneityCheckerPars(tr, q->back, 0))
-        doQ = PLL_FALSE;
+			sum += vectorPopcount(VECTOR_AND_NOT(v_N, allOne));
+			sum += vectorPopcount(VECTOR_AND_NOT(t_N, allOne));
+			if(sum > bound){
+				scanned = done + i + INTS_PER_VECTOR;
+				return sum;
+			}
+		}
+#else
+		for(i = 0; i < width; i++){
+			parsimonyNumber
+				v_N = 0,
+				t_N = 0,
+				l_A[32],
+				v_A[32];
+
+			for(j = 0; j < states; j++){
+				l_A[j] = qVect[width * j + i] & rVect[width * j + i];
+				v_A[j] = qVect[width * j + i] | rVect[width * j + i];
+				v_N = v_N | l_A[j];
+			}
 
-      if(doQ == PLL_FALSE && doP == PLL_FALSE)
-        return 0;
-    }
+			for(j = 0; j < states; j++)
+				t_N = t_N | ((l_A[j] | (v_A[j] & ~v_N)) & sVect[width * j + i]);
 
-  if((p->number > tr->mxtips) && doP)
-    {
-      p1 = p->next->back;
-      p2 = p->next->next->back;
+			sum += ((unsigned int) __builtin_popcount(~v_N));
+			sum += ((unsigned int) __builtin_popcount(~t_N));
+			if(sum > bound){
+				scanned = done + i + 1;
+				return sum;
+			}
+		}
+#endif
+		qVect += width * states;
+		rVect += width * states;
+		done += width;
+	}
 
-      if ((p1->number > tr->mxtips) || (p2->number > tr->mxtips))
-        {
-          //removeNodeParsimony(p, tr);
-          removeNodeParsimony(p);
+	return sum;
+}
 
-          if ((p1->number > tr->mxtips))
-            {
-              addTraverseParsimony(tr, pr, p, p1->next->back, mintrav, maxtrav, doAll, PLL_FALSE, perSiteScores);
-              addTraverseParsimony(tr, pr, p, p1->next->next->back, mintrav, maxtrav, doAll, PLL_FALSE, perSiteScores);
-            }
+/* score the collected candidates for inserting p and reduce them like testInsertParsimony() */
+static void sprScoreCandidates(pllInstance *tr, partitionList *pr, nodeptr p)
+{
+	nodeptr s = p->back;
+
+	if(s->number > tr->mxtips && !s->xPars)
+		newviewParsimony(tr, pr, s, 0);
+
+	// local copies, they are shared by the threads below
+	const parsimonyNumber *candVect = sprCandVect;
+	unsigned int *candScores = sprCandScores;
+	size_t vectLength = sprCandVectLength;
+	size_t sNumber = s->number;
+	unsigned int sScore = tr->parsimonyScore[sNumber];
+	long count = sprCandCount, k;
+	// tr->bestParsimony only decreases during the reduction below, so the candidates above its
+	// current value are never selected
+	unsigned int bound = sprCandidateBound(tr, 0);
+	unsigned long cuts = 0;
+	size_t cutWidth = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) reduction(+:cuts,cutWidth) if(count * vectLength >= SPR_PARALLEL_MIN_WORK)
+#endif
+	for(k = 0; k < count; k++){
+		const parsimonyNumber *qVect = &candVect[2 * vectLength * k];
+		unsigned int base = candScores[k] + sScore;
+		size_t scanned = 0;
+		candScores[k] = base;
+		if(base > bound){
+			cuts++;
+			continue;
+		}
+		candScores[k] += sprInsertionScore(pr, qVect, qVect + vectLength, sNumber,
+				bound == UINT_MAX ? UINT_MAX : bound - base, scanned);
+		if(candScores[k] > bound){
+			cuts++;
+			cutWidth += scanned;
+		}
+	}
 
-          if ((p2->number > tr->mxtips))
-            {
-              addTraverseParsimony(tr, pr, p, p2->next->back, mintrav, maxtrav, doAll, PLL_FALSE, perSiteScores);
-              addTraverseParsimony(tr, pr, p, p2->next->next->back, mintrav, maxtrav, doAll, PLL_FALSE, perSiteScores);
-            }
+	perfCount(PERF_SPR_CANDIDATES, count);
 
+	if(bound != UINT_MAX){
+		boundCandidates += count;
+		boundCuts += cuts;
+		boundCutFraction += (double)cutWidth / parsimonyVectorWidth(pr);
+	}
 
-          hookupDefault(p->next,       p1);
-          hookupDefault(p->next->next, p2);
+	for(k = 0; k < count; k++){
+		unsigned int mp = candScores[k];
 
-          newviewParsimony(tr, pr, p, perSiteScores);
-        }
+		if(mp < tr->bestParsimony) bestTreeScoreHits = 1;
+		else if(mp == tr->bestParsimony) bestTreeScoreHits++;
+
+		if((mp < tr->bestParsimony) ||
+			((mp == tr->bestParsimony) && (randomTieBreak(tr) <= 1.0 / bestTreeScoreHits))){
+			tr->bestParsimony = mp;
+			tr->insertNode = sprCandNodes[k];
+			tr->removeNode = p;
+		}
+	}
+
+	sprCandCount = 0;
+}
+
+/**
+ * Edge vectors (-spr_edge):
+ * sprEdgeVect keeps the Fitch vector of the subtree at x seen from x->back for every node x of the rings
+ * (index x - tr->nodeBaseAddress), i.e. both directions of every branch. When the subtree at p->back is pruned
+ * (rearrangeParsimony()), the vectors pointing away from p stay valid. The vector of the rest of the tree at a
+ * candidate branch is that of its parent branch joined with the sibling subtree, one Fitch combine along the
+ * traversal (sprEdgeTraverse()). A regraft candidate then costs one two-way and one three-way combine
+ * (sprInsertionScore()) instead of the newview of insertParsimony() and evaluateParsimony().
+ * The vectors are recomputed (sprRefreshEdgeVectors()) before the first rearrangement after a move.
+ * Only used for Fitch parsimony; with per-site scores for UFBoot, only the candidates within the bound
+ * of sprCandidateBound() are inserted and evaluated by testInsertParsimony().
+ */
+static parsimonyNumber * sprEdgeVect = NULL; // 1 vector per node of the rings
+static unsigned int * sprEdgeScore = NULL; // score of the subtree of each vector of sprEdgeVect
+static parsimonyNumber * sprEdgeUpVect = NULL; // vectors of the rest of the tree along a traversal, 1 per depth
+static size_t sprEdgeUpDepth = 0; // # of vectors sprEdgeUpVect can hold
+static size_t sprEdgeVectLength = 0; // # of parsimonyNumber in one vector over all partitions
+static pllInstance * sprEdgeInst = NULL; // instance sprEdgeVect is allocated for
+static bool sprEdgeValid = false; // are the vectors of sprEdgeVect those of the current tree
+
+#ifdef _OPENMP
+#pragma omp threadprivate(sprEdgeVect, sprEdgeScore, sprEdgeUpVect, sprEdgeUpDepth, sprEdgeVectLength, sprEdgeInst, sprEdgeValid)
+#endif
+
+static void sprFreeEdgeVectors()
+{
+	if(sprEdgeVect){
+		rax_free(sprEdgeVect);
+		rax_free(sprEdgeScore);
+	}
+	if(sprEdgeUpVect)
+		rax_free(sprEdgeUpVect);
+	sprEdgeVect = NULL;
+	sprEdgeScore = NULL;
+	sprEdgeUpVect = NULL;
+	sprEdgeUpDepth = 0;
+	sprEdgeVectLength = 0;
+	sprEdgeInst = NULL;
+	sprEdgeValid = false;
+	tbrFreeBuffers(); // same vector length
+}
+
+static bool sprUseEdgeVectors(pllInstance *tr, int perSiteScores)
+{
+	if(!globalParam || !globalParam->spr_edge || pllCostMatrix || tr->grouped)
+		return false;
+	// without a bound every candidate is inserted anyway to compute its per-site scores
+	return !perSiteScores || sprCandidateBound(tr, perSiteScores) != UINT_MAX;
+}
+
+static inline size_t sprEdgeIndex(pllInstance *tr, nodeptr x)
+{
+	return (size_t)(x - tr->nodeBaseAddress);
+}
+
+static inline parsimonyNumber *sprEdgeVector(pllInstance *tr, nodeptr x)
+{
+	return &sprEdgeVect[sprEdgeVectLength * sprEdgeIndex(tr, x)];
+}
+
+/* cur = Fitch set of left and right (vectors over all partitions), @return # of state changes */
+static unsigned int sprEdgeCombine(partitionList *pr, const parsimonyNumber *left, const parsimonyNumber *right, parsimonyNumber *cur)
+{
+	unsigned int score = 0;
+
+	for(int model = 0; model < pr->numberOfPartitions; model++){
+		size_t
+			states = pr->partitionData[model]->states,
+			width = pr->partitionData[model]->parsimonyLength,
+			i, j;
+
+		assert(states <= 32);
+
+#if (defined(__SSE3) || defined(__AVX))
+		INT_TYPE
+			allOne = SET_ALL_BITS_ONE;
+
+		if(fitchKernels)
+			score += fitchKernels->newview(states, width, left, right, cur);
+		else
+		for(i = 0; i < width; i += INTS_PER_VECTOR){
+			INT_TYPE
+				s_r, s_l,
+				v_N = SET_ALL_BITS_ZERO,
+				l_A[32],
+				v_A[32];
+
+			for(j = 0; j < states; j++){
+				s_l = VECTOR_LOAD((CAST)(&left[width * j + i]));
+				s_r = VECTOR_LOAD((CAST)(&right[width * j + i]));
+				l_A[j] = VECTOR_BIT_AND(s_l, s_r);
+				v_A[j] = VECTOR_BIT_OR(s_l, s_r);
+				v_N = VECTOR_BIT_OR(v_N, l_A[j]);
+			}
+
+			for(j = 0; j < states; j++)
+				VECTOR_STORE((CAST)(&cur[width * j + i]), VECTOR_BIT_OR(l_A[j], VECTOR_AND_NOT(v_N, v_A[j])));
+
+			score += vectorPopcount(VECTOR_AND_NOT(v_N, allOne));
+		}
+#else
+		for(i = 0; i < width; i++){
+			parsimonyNumber
+				t_N = 0,
+				t_A[32],
+				o_A[32];
+
+			for(j = 0; j < states; j++){
+				t_A[j] = left[width * j + i] & right[width * j + i];
+				o_A[j] = left[width * j + i] | right[width * j + i];
+				t_N = t_N | t_A[j];
+			}
+
+			t_N = ~t_N;
+
+			for(j = 0; j < states; j++)
+				cur[width * j + i] = t_A[j] | (t_N & o_A[j]);
+
+			score += ((unsigned int) __builtin_popcount(t_N));
+		}
+#endif
+		left += width * states;
+		right += width * states;
+		cur += width * states;
+	}
+
+	return score;
+}
+
+/* vector of the subtree at x seen from x->back, the vectors of its two child subtrees are up to date */
+static void sprEdgeJoin(pllInstance *tr, partitionList *pr, nodeptr x)
+{
+	nodeptr
+		l = x->next->back,
+		r = x->next->next->back;
+
+	sprEdgeScore[sprEdgeIndex(tr, x)] = sprEdgeCombine(pr, sprEdgeVector(tr, l), sprEdgeVector(tr, r), sprEdgeVector(tr, x))
+			+ sprEdgeScore[sprEdgeIndex(tr, l)] + sprEdgeScore[sprEdgeIndex(tr, r)];
+}
+
+/* vectors pointing away from the root branch, post-order */
+static void sprEdgeDownPass(pllInstance *tr, partitionList *pr, nodeptr x)
+{
+	if(x->number <= tr->mxtips)
+		return;
+	sprEdgeDownPass(tr, pr, x->next->back);
+	sprEdgeDownPass(tr, pr, x->next->next->back);
+	sprEdgeJoin(tr, pr, x);
+}
+
+/* vectors pointing towards the root branch, pre-order, the vector of x->back is up to date */
+static void sprEdgeUpPass(pllInstance *tr, partitionList *pr, nodeptr x)
+{
+	if(x->number <= tr->mxtips)
+		return;
+	sprEdgeJoin(tr, pr, x->next);
+	sprEdgeJoin(tr, pr, x->next->next);
+	sprEdgeUpPass(tr, pr, x->next->back);
+	sprEdgeUpPass(tr, pr, x->next->next->back);
+}
+
+/* recompute the vectors of all directed branches of the tree, rooted at the tip tr->start */
+static void sprRefreshEdgeVectors(pllInstance *tr, partitionList *pr)
+{
+	if(sprEdgeValid && sprEdgeInst == tr)
+		return;
+
+	size_t length = 0;
+	for(int model = 0; model < pr->numberOfPartitions; model++)
+		length += (size_t)pr->partitionData[model]->parsimonyLength * pr->partitionData[model]->states;
+
+	if(sprEdgeInst != tr || sprEdgeVectLength != length){
+		sprFreeEdgeVectors();
+		size_t count = (size_t)tr->mxtips + 3 * (size_t)(tr->mxtips - 1);
+		sprEdgeVectLength = length;
+		rax_posix_memalign((void **) &sprEdgeVect, PARS_VECTOR_ALIGNMENT, count * length * sizeof(parsimonyNumber));
+		sprEdgeScore = (unsigned int *)rax_malloc(count * sizeof(unsigned int));
+		sprEdgeInst = tr;
+	}
+
+	for(int i = 1; i <= tr->mxtips; i++){
+		nodeptr x = tr->nodep[i];
+		parsimonyNumber *vect = sprEdgeVector(tr, x);
+		for(int model = 0; model < pr->numberOfPartitions; model++){
+			size_t modelLength = (size_t)pr->partitionData[model]->parsimonyLength * pr->partitionData[model]->states;
+			memcpy(vect, &(pr->partitionData[model]->parsVect[modelLength * i]), modelLength * sizeof(parsimonyNumber));
+			vect += modelLength;
+		}
+		sprEdgeScore[sprEdgeIndex(tr, x)] = 0;
+	}
+
+	nodeptr root = tr->nodep[1];
+	sprEdgeDownPass(tr, pr, root->back);
+	sprEdgeUpPass(tr, pr, root->back);
+	sprEdgeValid = true;
+}
+
+/* @return the vector of the rest of the tree at depth of a traversal */
+static parsimonyNumber *sprEdgeUp(size_t depth)
+{
+	if(depth >= sprEdgeUpDepth){
+		size_t capacity = max(depth + 1, 2 * sprEdgeUpDepth);
+		parsimonyNumber *vect;
+		rax_posix_memalign((void **) &vect, PARS_VECTOR_ALIGNMENT, capacity * sprEdgeVectLength * sizeof(parsimonyNumber));
+		if(sprEdgeUpVect){
+			memcpy(vect, sprEdgeUpVect, sprEdgeUpDepth * sprEdgeVectLength * sizeof(parsimonyNumber));
+			rax_free(sprEdgeUpVect);
+		}
+		sprEdgeUpVect = vect;
+		sprEdgeUpDepth = capacity;
+	}
+	return &sprEdgeUpVect[depth * sprEdgeVectLength];
+}
+
+/* score inserting p at the branch (q, q->back), up is the vector of the subtree at q->back without p */
+static void sprEdgeInsert(pllInstance *tr, partitionList *pr, nodeptr p, nodeptr q, const parsimonyNumber *up, unsigned int upScore,
+		int perSiteScores, bool collect)
+{
+	const parsimonyNumber *down = sprEdgeVector(tr, q);
+	unsigned int base = sprEdgeScore[sprEdgeIndex(tr, q)] + upScore;
+
+	if(collect){
+		sprReserveCandidates(pr, sprCandCount + 1);
+		parsimonyNumber *qVect = &sprCandVect[2 * sprCandVectLength * sprCandCount];
+		memcpy(qVect, down, sprCandVectLength * sizeof(parsimonyNumber));
+		memcpy(qVect + sprCandVectLength, up, sprCandVectLength * sizeof(parsimonyNumber));
+		sprCandScores[sprCandCount] = base;
+		sprCandNodes[sprCandCount++] = q;
+		return;
+	}
+
+	unsigned int
+		bound = sprCandidateBound(tr, perSiteScores),
+		mp = base + tr->parsimonyScore[p->back->number];
+	size_t scanned = 0;
+
+	if(mp <= bound)
+		mp += sprInsertionScore(pr, down, up, p->back->number, bound == UINT_MAX ? UINT_MAX : bound - mp, scanned);
+
+	if(perSiteScores && mp <= bound){
+		// the per-site scores of the candidate tree are needed for UFBoot
+		testInsertParsimony(tr, pr, p, q, PLL_FALSE, perSiteScores);
+		return;
+	}
+
+	perfCount(PERF_SPR_CANDIDATES);
+	if(bound != UINT_MAX){
+		boundCandidates++;
+		if(mp > bound){
+			boundCuts++;
+			boundCutFraction += (double)scanned / parsimonyVectorWidth(pr);
+		}
+	}
+
+	if(mp < tr->bestParsimony) bestTreeScoreHits = 1;
+	else if(mp == tr->bestParsimony) bestTreeScoreHits++;
+
+	if((mp < tr->bestParsimony) ||
+		((mp == tr->bestParsimony) && (randomTieBreak(tr) <= 1.0 / bestTreeScoreHits))){
+		tr->bestParsimony = mp;
+		tr->insertNode = q;
+		tr->removeNode = p;
+	}
+}
+
+/* same traversal as addTraverseParsimony(), up is the vector of the subtree at q->back without p */
+static void sprEdgeTraverse(pllInstance *tr, partitionList *pr, nodeptr p, nodeptr q, size_t depth, unsigned int upScore,
+		int mintrav, int maxtrav, pllBoolean doAll, int perSiteScores, bool collect)
+{
+  const parsimonyNumber *up = sprEdgeUp(depth);
+
+  if (doAll || (--mintrav <= 0))
+    sprEdgeInsert(tr, pr, p, q, up, upScore, perSiteScores, collect);
+
+  if (((q->number > tr->mxtips)) && ((--maxtrav > 0) || doAll))
+    {
+      nodeptr
+        l = q->next->back,
+        r = q->next->next->back;
+
+      unsigned int score = sprEdgeCombine(pr, sprEdgeUp(depth), sprEdgeVector(tr, r), sprEdgeUp(depth + 1));
+      sprEdgeTraverse(tr, pr, p, l, depth + 1, score + upScore + sprEdgeScore[sprEdgeIndex(tr, r)],
+          mintrav, maxtrav, doAll, perSiteScores, collect);
+      score = sprEdgeCombine(pr, sprEdgeUp(depth), sprEdgeVector(tr, l), sprEdgeUp(depth + 1));
+      sprEdgeTraverse(tr, pr, p, r, depth + 1, score + upScore + sprEdgeScore[sprEdgeIndex(tr, l)],
+          mintrav, maxtrav, doAll, perSiteScores, collect);
     }
+}
 
-  if ((q->number > tr->mxtips) && (maxtrav > 0) && doQ)
+/**
+ * regraft candidates of the subtree pruned at p like addTraverseParsimony() from the children of p1 and p2,
+ * where p1 and p2 are the nodes that were joined by removeNodeParsimony(p)
+ */
+static void sprEdgeTraverseRemoved(pllInstance *tr, partitionList *pr, nodeptr p, nodeptr p1, nodeptr p2,
+		int mintrav, int maxtrav, pllBoolean doAll, int perSiteScores, bool collect)
+{
+	nodeptr
+		l = p1->next->back,
+		r = p1->next->next->back;
+
+	if(p1->number <= tr->mxtips)
+		return;
+
+	sprEdgeUp(doAll ? (size_t)tr->mxtips : (size_t)maxtrav); // reserve the vectors of the whole traversal
+
+	unsigned int
+		otherScore = sprEdgeScore[sprEdgeIndex(tr, p2)],
+		score = sprEdgeCombine(pr, sprEdgeVector(tr, p2), sprEdgeVector(tr, r), sprEdgeUp(0));
+	sprEdgeTraverse(tr, pr, p, l, 0, score + otherScore + sprEdgeScore[sprEdgeIndex(tr, r)],
+			mintrav, maxtrav, doAll, perSiteScores, collect);
+	score = sprEdgeCombine(pr, sprEdgeVector(tr, p2), sprEdgeVector(tr, l), sprEdgeUp(0));
+	sprEdgeTraverse(tr, pr, p, r, 0, score + otherScore + sprEdgeScore[sprEdgeIndex(tr, l)],
+			mintrav, maxtrav, doAll, perSiteScores, collect);
+}
+
+
+static void makePermutationFast(int *perm, int n, pllInstance *tr)
+{
+  int
+    i,
+    j,
+    k;
+
+  for (i = 1; i <= n; i++)
+    perm[i] = i;
+
+  for (i = 1; i <= n; i++)
+    {
+      double d =  randum(&tr->randomNumberSeed);
+
+      k =  (int)((double)(n + 1 - i) * d);
+
+      j        = perm[i];
+
+      perm[i]     = perm[i + k];
+      perm[i + k] = j;
+    }
+}
+
+//static nodeptr  removeNodeParsimony (nodeptr p, tree *tr)
+static nodeptr  removeNodeParsimony (nodeptr p)
+{
+  nodeptr  q, r;
+
+  q = p->next->back;
+  r = p->next->next->back;
+
+  hookupDefault(q, r);
+
+  p->next->next->back = p->next->back = (node *) NULL;
+
+  return  q;
+}
+
+/**
+ * the second half of rearrangeParsimony(): prune q together with the subtree at q->back and regraft it
+ * on the branches between mintrav (at least 2, the nearer ones are moves of the first half) and maxtrav of q
+ */
+static void rearrangeParsimonyBack(pllInstance *tr, partitionList *pr, nodeptr q, int mintrav, int maxtrav, pllBoolean doAll, int perSiteScores)
+{
+  nodeptr
+    q1,
+    q2;
+
+  int
+    mintrav2;
+
+  bool
+    parallel = sprUseParallel(tr, perSiteScores),
+    edge = sprUseEdgeVectors(tr, perSiteScores);
+
+  q1 = q->next->back;
+  q2 = q->next->next->back;
+
+  if (
+      (
+       (q1->number > tr->mxtips) &&
+       ((q1->next->back->number > tr->mxtips) || (q1->next->next->back->number > tr->mxtips))
+       )
+      ||
+      (
+       (q2->number > tr->mxtips) &&
+       ((q2->next->back->number > tr->mxtips) || (q2->next->next->back->number > tr->mxtips))
+       )
+      )
     {
-      q1 = q->next->back;
-      q2 = q->next->next->back;
-
-      if (
-          (
-           (q1->number > tr->mxtips) &&
-           ((q1->next->back->number > tr->mxtips) || (q1->next->next->back->number > tr->mxtips))
-           )
-          ||
-          (
-           (q2->number > tr->mxtips) &&
-           ((q2->next->back->number > tr->mxtips) || (q2->next->next->back->number > tr->mxtips))
-           )
-          )
-        {
 
-          //removeNodeParsimony(q, tr);
-          removeNodeParsimony(q);
+      if(edge)
+        sprRefreshEdgeVectors(tr, pr);
+
+      //removeNodeParsimony(q, tr);
+      removeNodeParsimony(q);
+
+      mintrav2 = mintrav > 2 ? mintrav : 2;
+
+      if(edge)
+        {
+          if(!parallel && q->back->number > tr->mxtips && !q->back->xPars)
+            newviewParsimony(tr, pr, q->back, perSiteScores);
+          sprEdgeTraverseRemoved(tr, pr, q, q1, q2, mintrav2, maxtrav, doAll, perSiteScores, parallel);
+          sprEdgeTraverseRemoved(tr, pr, q, q2, q1, mintrav2, maxtrav, doAll, perSiteScores, parallel);
+          if(parallel)
+            sprScoreCandidates(tr, pr, q);
+        }
+      else if(parallel)
+        {
+          if ((q1->number > tr->mxtips))
+            {
+              collectTraverseParsimony(tr, pr, q1->next->back, mintrav2, maxtrav, doAll);
+              collectTraverseParsimony(tr, pr, q1->next->next->back, mintrav2, maxtrav, doAll);
+            }
 
-          mintrav2 = mintrav > 2 ? mintrav : 2;
+          if ((q2->number > tr->mxtips))
+            {
+              collectTraverseParsimony(tr, pr, q2->next->back, mintrav2, maxtrav, doAll);
+              collectTraverseParsimony(tr, pr, q2->next->next->back, mintrav2, maxtrav, doAll);
+            }
 
+          sprScoreCandidates(tr, pr, q);
+        }
+      else
+        {
           if ((q1->number > tr->mxtips))
             {
               addTraverseParsimony(tr, pr, q, q1->next->back, mintrav2 , maxtrav, doAll, PLL_FALSE, perSiteScores);
@@ -2364,23 +3128,523 @@ static int rearrangeParsimony(pllInstance *tr, partitionList *pr, nodeptr p, int
               addTraverseParsimony(tr, pr, q, q2->next->back, mintrav2 , maxtrav, doAll, PLL_FALSE, perSiteScores);
               addTraverseParsimony(tr, pr, q, q2->next->next->back, mintrav2 , maxtrav, doAll, PLL_FALSE, perSiteScores);
             }
+        }
+
+      hookupDefault(q->next,       q1);
+      hookupDefault(q->next->next, q2);
+
+      newviewParsimony(tr, pr, q, perSiteScores);
+    }
+}
+
+static int rearrangeParsimony(pllInstance *tr, partitionList *pr, nodeptr p, int mintrav, int maxtrav, pllBoolean doAll, int perSiteScores)
+{
+	nodeptr
+		p1,
+		p2,
+		q;
+
+  pllBoolean
+    doP = PLL_TRUE,
+    doQ = PLL_TRUE;
+
+  bool
+    parallel = sprUseParallel(tr, perSiteScores),
+    edge = sprUseEdgeVectors(tr, perSiteScores);
+
+  if (maxtrav > tr->ntips - 3)
+    maxtrav = tr->ntips - 3;
+
+  assert(mintrav == 1);
+
+  if(maxtrav < mintrav)
+    return 0;
+
+  q = p->back;
+
+	unsigned int mp = evaluateParsimony(tr, pr, p, PLL_FALSE, perSiteScores); // Diep: This is VERY important to make sure SPR is accurate*****
+	if(perSiteScores){
+		// If UFBoot is enabled ...
+		pllSaveCurrentTreeSprParsimony(tr, pr, mp); // run UFBoot
+	}
+
+  if(tr->constrained)
+    {
+      if(! tipHomogeneityCheckerPars(tr, p->back, 0))
+        doP = PLL_FALSE;
+
+      if(! tipHomogeneityCheckerPars(tr, q->back, 0))
+        doQ = PLL_FALSE;
+
+      if(doQ == PLL_FALSE && doP == PLL_FALSE)
+        return 0;
+    }
+
+  if((p->number > tr->mxtips) && doP)
+    {
+      p1 = p->next->back;
+      p2 = p->next->next->back;
+
+      if ((p1->number > tr->mxtips) || (p2->number > tr->mxtips))
+        {
+          if(edge)
+            sprRefreshEdgeVectors(tr, pr);
+
+          //removeNodeParsimony(p, tr);
+          removeNodeParsimony(p);
+
+          if(edge)
+            {
+              if(!parallel && p->back->number > tr->mxtips && !p->back->xPars)
+                newviewParsimony(tr, pr, p->back, perSiteScores);
+              sprEdgeTraverseRemoved(tr, pr, p, p1, p2, mintrav, maxtrav, doAll, perSiteScores, parallel);
+              sprEdgeTraverseRemoved(tr, pr, p, p2, p1, mintrav, maxtrav, doAll, perSiteScores, parallel);
+              if(parallel)
+                sprScoreCandidates(tr, pr, p);
+            }
+          else if(parallel)
+            {
+              if ((p1->number > tr->mxtips))
+                {
+                  collectTraverseParsimony(tr, pr, p1->next->back, mintrav, maxtrav, doAll);
+                  collectTraverseParsimony(tr, pr, p1->next->next->back, mintrav, maxtrav, doAll);
+                }
+
+              if ((p2->number > tr->mxtips))
+                {
+                  collectTraverseParsimony(tr, pr, p2->next->back, mintrav, maxtrav, doAll);
+                  collectTraverseParsimony(tr, pr, p2->next->next->back, mintrav, maxtrav, doAll);
+                }
+
+              sprScoreCandidates(tr, pr, p);
+            }
+          else
+            {
+              if ((p1->number > tr->mxtips))
+                {
+                  addTraverseParsimony(tr, pr, p, p1->next->back, mintrav, maxtrav, doAll, PLL_FALSE, perSiteScores);
+                  addTraverseParsimony(tr, pr, p, p1->next->next->back, mintrav, maxtrav, doAll, PLL_FALSE, perSiteScores);
+                }
+
+              if ((p2->number > tr->mxtips))
+                {
+                  addTraverseParsimony(tr, pr, p, p2->next->back, mintrav, maxtrav, doAll, PLL_FALSE, perSiteScores);
+                  addTraverseParsimony(tr, pr, p, p2->next->next->back, mintrav, maxtrav, doAll, PLL_FALSE, perSiteScores);
+                }
+            }
 
-          hookupDefault(q->next,       q1);
-          hookupDefault(q->next->next, q2);
 
-          newviewParsimony(tr, pr, q, perSiteScores);
+          hookupDefault(p->next,       p1);
+          hookupDefault(p->next->next, p2);
+
+          newviewParsimony(tr, pr, p, perSiteScores);
         }
     }
 
+  if ((q->number > tr->mxtips) && (maxtrav > 0) && doQ)
+    rearrangeParsimonyBack(tr, pr, q, mintrav, maxtrav, doAll, perSiteScores);
+
   return 1;
 }
 
 
+/**
+ * TBR (-tbr): like in rearrangeParsimony(), the subtree at p->back is pruned together with p and regrafted on the
+ * branches within maxtrav of p, but it is also rerooted at each of its branches within globalParam->tbr_maxtrav
+ * of p->back. Regrafting it unrooted at its original branch is one more candidate.
+ * From the edge vectors (see sprEdgeTraverse()), the vector of the pruned subtree is computed once per rerooting
+ * (tbrRerootVect) and the vector of both ends of a regraft branch joined once per branch (tbrJoinVect),
+ * so that each pair costs one bounded two-way evaluation.
+ * With per-site scores for UFBoot, the candidate trees within the bound of sprCandidateBound() are built and
+ * evaluated completely (tbrSaveCandidate()). The move of the best candidate is applied by
+ * restoreTreeRearrangeParsimony() with tbrRerootNode.
+ */
+static parsimonyNumber * tbrRerootVect = NULL; // vector of the pruned subtree for each rerooting
+static unsigned int * tbrRerootScore = NULL; // score of each vector of tbrRerootVect
+static nodeptr * tbrRerootNodes = NULL; // the pruned subtree is rerooted at the branch (x, x->back), NULL if not rerooted
+static size_t tbrRerootCount = 0, tbrRerootCapacity = 0;
+static parsimonyNumber * tbrJoinVect = NULL; // joined vector of each regraft branch
+static unsigned int * tbrJoinScore = NULL;
+static size_t tbrJoinCapacity = 0;
+static unsigned int * tbrPairScore = NULL; // score of each pair of regraft branch and rerooting
+static size_t tbrPairCapacity = 0;
+static nodeptr tbrRerootNode = NULL; // rerooting of the best move, NULL for an SPR move
+
+#ifdef _OPENMP
+#pragma omp threadprivate(tbrRerootVect, tbrRerootScore, tbrRerootNodes, tbrRerootCount, tbrRerootCapacity, \
+		tbrJoinVect, tbrJoinScore, tbrJoinCapacity, tbrPairScore, tbrPairCapacity, tbrRerootNode)
+#endif
+
+static void tbrFreeBuffers()
+{
+	if(tbrRerootVect){
+		rax_free(tbrRerootVect);
+		rax_free(tbrRerootScore);
+		rax_free(tbrRerootNodes);
+	}
+	if(tbrJoinVect){
+		rax_free(tbrJoinVect);
+		rax_free(tbrJoinScore);
+	}
+	if(tbrPairScore)
+		rax_free(tbrPairScore);
+	tbrRerootVect = tbrJoinVect = NULL;
+	tbrRerootScore = tbrJoinScore = tbrPairScore = NULL;
+	tbrRerootNodes = NULL;
+	tbrRerootCount = tbrRerootCapacity = tbrJoinCapacity = tbrPairCapacity = 0;
+}
+
+static bool tbrUseRerooting(pllInstance *tr, int perSiteScores)
+{
+	if(!globalParam || !globalParam->tbr_parsimony || pllCostMatrix || tr->grouped || tr->constrained)
+		return false;
+	// without a bound every candidate tree would be built to compute its per-site scores
+	return !perSiteScores || sprCandidateBound(tr, perSiteScores) != UINT_MAX;
+}
+
+/* add a rerooting of the pruned subtree, its vector is that of down joined with up (down itself if up is NULL) */
+static void tbrAddReroot(partitionList *pr, nodeptr x, const parsimonyNumber *down, const parsimonyNumber *up, unsigned int score)
+{
+	if(tbrRerootCount == tbrRerootCapacity){
+		size_t capacity = max((size_t)16, 2 * tbrRerootCapacity);
+		parsimonyNumber *vect;
+		rax_posix_memalign((void **) &vect, PARS_VECTOR_ALIGNMENT, capacity * sprEdgeVectLength * sizeof(parsimonyNumber));
+		unsigned int *scores = (unsigned int *)rax_malloc(capacity * sizeof(unsigned int));
+		nodeptr *nodes = (nodeptr *)rax_malloc(capacity * sizeof(nodeptr));
+		if(tbrRerootVect){
+			memcpy(vect, tbrRerootVect, tbrRerootCount * sprEdgeVectLength * sizeof(parsimonyNumber));
+			memcpy(scores, tbrRerootScore, tbrRerootCount * sizeof(unsigned int));
+			memcpy(nodes, tbrRerootNodes, tbrRerootCount * sizeof(nodeptr));
+			rax_free(tbrRerootVect);
+			rax_free(tbrRerootScore);
+			rax_free(tbrRerootNodes);
+		}
+		tbrRerootVect = vect;
+		tbrRerootScore = scores;
+		tbrRerootNodes = nodes;
+		tbrRerootCapacity = capacity;
+	}
+
+	parsimonyNumber *vect = &tbrRerootVect[tbrRerootCount * sprEdgeVectLength];
+	if(up)
+		score += sprEdgeCombine(pr, down, up, vect);
+	else
+		memcpy(vect, down, sprEdgeVectLength * sizeof(parsimonyNumber));
+	tbrRerootScore[tbrRerootCount] = score;
+	tbrRerootNodes[tbrRerootCount++] = x;
+}
+
+static void tbrReservePairs(size_t joins, size_t pairs)
+{
+	if(joins > tbrJoinCapacity){
+		if(tbrJoinVect){
+			rax_free(tbrJoinVect);
+			rax_free(tbrJoinScore);
+		}
+		tbrJoinCapacity = max(joins, 2 * tbrJoinCapacity);
+		rax_posix_memalign((void **) &tbrJoinVect, PARS_VECTOR_ALIGNMENT, tbrJoinCapacity * sprEdgeVectLength * sizeof(parsimonyNumber));
+		tbrJoinScore = (unsigned int *)rax_malloc(tbrJoinCapacity * sizeof(unsigned int));
+	}
+	if(pairs > tbrPairCapacity){
+		if(tbrPairScore)
+			rax_free(tbrPairScore);
+		tbrPairCapacity = max(pairs, 2 * tbrPairCapacity);
+		tbrPairScore = (unsigned int *)rax_malloc(tbrPairCapacity * sizeof(unsigned int));
+	}
+}
+
+/* add the # of state changes between left and right (vectors over all partitions) to sum, stop as soon as sum exceeds bound */
+static unsigned int tbrEvaluate(partitionList *pr, const parsimonyNumber *left, const parsimonyNumber *right,
+		unsigned int sum, unsigned int bound, size_t &scanned)
+{
+	size_t done = 0;
+
+	for(int model = 0; model < pr->numberOfPartitions; model++){
+		size_t
+			states = pr->partitionData[model]->states,
+			width = pr->partitionData[model]->parsimonyLength,
+			i, j;
+
+		assert(states <= 32);
+
+#if (defined(__SSE3) || defined(__AVX))
+		INT_TYPE
+			allOne = SET_ALL_BITS_ONE;
+
+		if(fitchKernels){
+			size_t stop = 0;
+			sum = fitchKernels->evaluate(states, width, left, right, sum, bound, stop);
+			if(stop){
+				scanned = done + stop;
+				return sum;
+			}
+		}else
+		for(i = 0; i < width; i += INTS_PER_VECTOR){
+			INT_TYPE
+				t_N = SET_ALL_BITS_ZERO;
+
+			for(j = 0; j < states; j++)
+				t_N = VECTOR_BIT_OR(t_N, VECTOR_BIT_AND(VECTOR_LOAD((CAST)(&left[width * j + i])),
+						VECTOR_LOAD((CAST)(&right[width * j + i]))));
+
+			sum += vectorPopcount(VECTOR_AND_NOT(t_N, allOne));
+			if(sum > bound){
+				scanned = done + i + INTS_PER_VECTOR;
+				return sum;
+			}
+		}
+#else
+		for(i = 0; i < width; i++){
+			parsimonyNumber
+				t_N = 0;
+
+			for(j = 0; j < states; j++)
+				t_N = t_N | (left[width * j + i] & right[width * j + i]);
+
+			sum += ((unsigned int) __builtin_popcount(~t_N));
+			if(sum > bound){
+				scanned = done + i + 1;
+				return sum;
+			}
+		}
+#endif
+		left += width * states;
+		right += width * states;
+		done += width;
+	}
+
+	return sum;
+}
+
+/* reroot the subtree at s->back at the branch (x, x->back), @param[out] c1, c2 its children before */
+static void tbrReroot(nodeptr s, nodeptr x, nodeptr &c1, nodeptr &c2)
+{
+	nodeptr y = x->back;
+
+	c1 = s->next->back;
+	c2 = s->next->next->back;
+	hookupDefault(c1, c2);
+	hookupDefault(s->next, x);
+	hookupDefault(s->next->next, y);
+}
+
+/* undo tbrReroot() */
+static void tbrUnroot(nodeptr s, nodeptr c1, nodeptr c2)
+{
+	hookupDefault(s->next->back, s->next->next->back);
+	hookupDefault(s->next, c1);
+	hookupDefault(s->next->next, c2);
+}
+
+/**
+ * build the tree of regrafting the pruned p at the branch (q, q->back) after rerooting its subtree at the branch (x, x->back),
+ * compute its per-site scores for pllSaveCurrentTreeSprParsimony() and restore the pruned tree.
+ * The vectors of the tree must be recomputed completely afterwards.
+ */
+static void tbrSaveCandidate(pllInstance *tr, partitionList *pr, nodeptr p, nodeptr q, nodeptr x, unsigned int mp, int perSiteScores)
+{
+	nodeptr
+		r = q->back,
+		c1 = NULL,
+		c2 = NULL;
+
+	if(x)
+		tbrReroot(p->back, x, c1, c2);
+	hookupDefault(p->next, q);
+	hookupDefault(p->next->next, r);
+
+	unsigned int score = evaluateParsimony(tr, pr, p, PLL_TRUE, perSiteScores);
+	assert(score == mp);
+	pllSaveCurrentTreeSprParsimony(tr, pr, score); // run UFBoot
+
+	hookupDefault(q, r);
+	p->next->next->back = p->next->back = (nodeptr) NULL;
+	if(x)
+		tbrUnroot(p->back, c1, c2);
+}
+
+/**
+ * TBR counterpart of rearrangeParsimony(): all pairs of a rerooting of the subtree at p->back and a regraft branch.
+ * Rerooting the subtree at p->back at a branch covers the SPR move regrafting the subtree at p there, so the
+ * other side is only pruned by rearrangeParsimonyBack() for the branches beyond the rerooting radius (-tbr_rad
+ * smaller than -spr_rad); the moves are thus a superset of those of rearrangeParsimony().
+ * Falls back to rearrangeParsimony() when p is a tip and for Sankoff parsimony.
+ */
+static int tbrRearrangeParsimony(pllInstance *tr, partitionList *pr, nodeptr p, int mintrav, int maxtrav, int perSiteScores)
+{
+	tbrRerootNode = NULL;
+
+	if(p->number <= tr->mxtips || !tbrUseRerooting(tr, perSiteScores))
+		return rearrangeParsimony(tr, pr, p, mintrav, maxtrav, PLL_FALSE, perSiteScores);
+
+	if (maxtrav > tr->ntips - 3)
+		maxtrav = tr->ntips - 3;
+
+	assert(mintrav == 1);
+
+	if(maxtrav < mintrav)
+		return 0;
+
+	unsigned int mp = evaluateParsimony(tr, pr, p, PLL_FALSE, perSiteScores);
+	if(perSiteScores){
+		// If UFBoot is enabled ...
+		pllSaveCurrentTreeSprParsimony(tr, pr, mp); // run UFBoot
+	}
+
+	nodeptr
+		p1 = p->next->back,
+		p2 = p->next->next->back,
+		s = p->back;
+
+	sprRefreshEdgeVectors(tr, pr);
+	removeNodeParsimony(p);
+
+	// rerootings of the pruned subtree, the original root first
+	int rerootTrav = min(globalParam->tbr_maxtrav, tr->ntips - 3);
+	tbrRerootCount = 0;
+	tbrAddReroot(pr, NULL, sprEdgeVector(tr, s), NULL, sprEdgeScore[sprEdgeIndex(tr, s)]);
+	if(s->number > tr->mxtips && rerootTrav > 0){
+		nodeptr
+			c1 = s->next->back,
+			c2 = s->next->next->back;
+
+		sprCandCount = 0;
+		sprEdgeTraverseRemoved(tr, pr, s, c1, c2, 1, rerootTrav, PLL_FALSE, 0, true);
+		sprEdgeTraverseRemoved(tr, pr, s, c2, c1, 1, rerootTrav, PLL_FALSE, 0, true);
+		for(size_t k = 0; k < sprCandCount; k++){
+			const parsimonyNumber *down = &sprCandVect[2 * sprCandVectLength * k];
+			tbrAddReroot(pr, sprCandNodes[k], down, down + sprCandVectLength, sprCandScores[k]);
+		}
+	}
+
+	// regraft branches, the branch p was pruned from first
+	sprCandCount = 0;
+	sprEdgeInsert(tr, pr, p, p1, sprEdgeVector(tr, p2), sprEdgeScore[sprEdgeIndex(tr, p2)], 0, true);
+	sprEdgeTraverseRemoved(tr, pr, p, p1, p2, mintrav, maxtrav, PLL_FALSE, 0, true);
+	sprEdgeTraverseRemoved(tr, pr, p, p2, p1, mintrav, maxtrav, PLL_FALSE, 0, true);
+
+	// local copies, they are shared by the threads below
+	long
+		joins = sprCandCount,
+		reroots = tbrRerootCount,
+		count = joins * reroots,
+		k;
+	size_t vectLength = sprEdgeVectLength;
+
+	tbrReservePairs(joins, count);
+	const parsimonyNumber *rerootVect = tbrRerootVect, *joinVect = tbrJoinVect;
+	unsigned int *rerootScore = tbrRerootScore, *joinScore = tbrJoinScore, *pairScore = tbrPairScore;
+	for(k = 0; k < joins; k++){
+		const parsimonyNumber *down = &sprCandVect[2 * sprCandVectLength * k];
+		joinScore[k] = sprCandScores[k] + sprEdgeCombine(pr, down, down + sprCandVectLength, &tbrJoinVect[vectLength * k]);
+	}
+
+	// tr->bestParsimony and the bound only decrease during the reduction below
+	unsigned int bound = sprCandidateBound(tr, perSiteScores);
+	unsigned long cuts = 0;
+	size_t cutWidth = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) reduction(+:cuts,cutWidth) \
+	if(sprUseParallel(tr, perSiteScores) && count * vectLength >= SPR_PARALLEL_MIN_WORK)
+#endif
+	for(k = 1; k < count; k++){ // k = 0 is the tree itself
+		long
+			join = k / reroots,
+			reroot = k % reroots;
+		unsigned int base = joinScore[join] + rerootScore[reroot];
+		size_t scanned = 0;
+		pairScore[k] = base;
+		if(base > bound){
+			cuts++;
+			continue;
+		}
+		pairScore[k] = tbrEvaluate(pr, &joinVect[vectLength * join], &rerootVect[vectLength * reroot], base, bound, scanned);
+		if(pairScore[k] > bound){
+			cuts++;
+			cutWidth += scanned;
+		}
+	}
+
+	perfCount(PERF_SPR_CANDIDATES, count - 1);
+
+	if(bound != UINT_MAX){
+		boundCandidates += count - 1;
+		boundCuts += cuts;
+		boundCutFraction += (double)cutWidth / parsimonyVectorWidth(pr);
+	}
+
+	bool built = false;
+
+	for(k = 1; k < count; k++){
+		nodeptr
+			q = sprCandNodes[k / reroots],
+			x = tbrRerootNodes[k % reroots];
+
+		mp = pairScore[k];
+
+		if(perSiteScores && mp <= sprCandidateBound(tr, perSiteScores)){
+			tbrSaveCandidate(tr, pr, p, q, x, mp, perSiteScores);
+			built = true;
+		}
+
+		if(mp < tr->bestParsimony) bestTreeScoreHits = 1;
+		else if(mp == tr->bestParsimony) bestTreeScoreHits++;
+
+		if((mp < tr->bestParsimony) ||
+			((mp == tr->bestParsimony) && (randomTieBreak(tr) <= 1.0 / bestTreeScoreHits))){
+			tr->bestParsimony = mp;
+			tr->insertNode = q;
+			tr->removeNode = p;
+			tbrRerootNode = x;
+		}
+	}
+
+	sprCandCount = 0;
+
+	hookupDefault(p->next, p1);
+	hookupDefault(p->next->next, p2);
+
+	if(built)
+		evaluateParsimony(tr, pr, p, PLL_TRUE, perSiteScores);
+	else
+		newviewParsimony(tr, pr, p, perSiteScores);
+
+	// the SPR moves of the subtree at p regrafted farther from s than the rerootings reach
+	if(s->number > tr->mxtips && rerootTrav < maxtrav){
+		rearrangeParsimonyBack(tr, pr, s, rerootTrav + 1, maxtrav, PLL_FALSE, perSiteScores);
+		if(tr->removeNode != p)
+			tbrRerootNode = NULL;
+	}
+
+	return 1;
+}
+
+
 static void restoreTreeRearrangeParsimony(pllInstance *tr, partitionList *pr, int perSiteScores)
 {
+  sprEdgeValid = false;
   removeNodeParsimony(tr->removeNode);
   //removeNodeParsimony(tr->removeNode, tr);
-  restoreTreeParsimony(tr, pr, tr->removeNode, tr->insertNode, perSiteScores);
+  if(tbrRerootNode)
+    {
+      // the vectors of the rerooted subtree point the other way now
+      nodeptr
+        p = tr->removeNode,
+        q = tr->insertNode,
+        r = q->back,
+        c1,
+        c2;
+
+      tbrReroot(p->back, tbrRerootNode, c1, c2);
+      hookupDefault(p->next, q);
+      hookupDefault(p->next->next, r);
+      unsigned int mp = evaluateParsimony(tr, pr, p, PLL_TRUE, perSiteScores);
+      assert(mp == tr->bestParsimony);
+      tbrRerootNode = NULL;
+    }
+  else
+    restoreTreeParsimony(tr, pr, tr->removeNode, tr->insertNode, perSiteScores);
 }
 
 /*
@@ -2825,145 +4089,170 @@ static void compressSankoffDNA(pllInstance *tr, partitionList *pr, int *informat
 }
 
 
-static void compressDNA(pllInstance *tr, partitionList *pr, int *informative, int perSiteScores)
+/**
+ * @return # of parsimonyNumber (padded to whole vectors) per state and node needed for partition model,
+ * i.e. for the informative patterns repeated by their weights in tr->aliaswgt
+ */
+static size_t compressedParsimonyLength(pllInstance *tr, partitionList *pr, int model, int *informative)
 {
-	if(pllCostMatrix != NULL) {
-        if (globalParam->sankoff_short_int)
-            return compressSankoffDNA<parsimonyNumberShort, USHORT_PER_VECTOR>(tr, pr, informative, perSiteScores);
-        else
-            return compressSankoffDNA<parsimonyNumber, INTS_PER_VECTOR>(tr, pr, informative, perSiteScores);
+  size_t
+    i,
+    compressedEntries,
+    compressedEntriesPadded,
+    entries = 0,
+    lower = pr->partitionData[model]->lower,
+    upper = pr->partitionData[model]->upper;
+
+  pr->partitionData[model]->numInformativePatterns = 0; // to fix score bug THAT too many uninformative sites cause out-of-bound array access
+
+  for(i = lower; i < upper; i++)
+    if(informative[i]){
+      entries += (size_t)tr->aliaswgt[i];
+      pr->partitionData[model]->numInformativePatterns++;
     }
 
+  compressedEntries = entries / PLL_PCF;
 
-  size_t
-    totalNodes,
-    i,
-    model;
+  if(entries % PLL_PCF != 0)
+    compressedEntries++;
 
-  totalNodes = 2 * (size_t)tr->mxtips;
+#if (defined(__SSE3) || defined(__AVX))
+  // padded for the widest Fitch kernel, which may be chosen at runtime
+  if(compressedEntries % FITCH_KERNEL_INTS != 0)
+    compressedEntriesPadded = compressedEntries + (FITCH_KERNEL_INTS - (compressedEntries % FITCH_KERNEL_INTS));
+  else
+    compressedEntriesPadded = compressedEntries;
+#else
+  compressedEntriesPadded = compressedEntries;
+#endif
 
+  return compressedEntriesPadded;
+}
 
+/* fill the tip vectors of partition model in parsVect, which has compressedEntriesPadded entries per state and node */
+static void compressTipVectors(pllInstance *tr, partitionList *pr, int model, int *informative, size_t compressedEntriesPadded)
+{
+  size_t
+    i,
+    k,
+    states = (size_t)pr->partitionData[model]->states,
+    lower = pr->partitionData[model]->lower,
+    upper = pr->partitionData[model]->upper;
 
-  for(model = 0; model < (size_t) pr->numberOfPartitions; model++)
+  parsimonyNumber
+    **compressedTips = (parsimonyNumber **)rax_malloc(states * sizeof(parsimonyNumber*)),
+    *compressedValues = (parsimonyNumber *)rax_malloc(states * sizeof(parsimonyNumber));
+
+  for(i = 0; i < (size_t)tr->mxtips; i++)
     {
       size_t
-        k,
-        states = (size_t)pr->partitionData[model]->states,
-        compressedEntries,
-        compressedEntriesPadded,
-        entries = 0,
-        lower = pr->partitionData[model]->lower,
-        upper = pr->partitionData[model]->upper;
-
-      parsimonyNumber
-        **compressedTips = (parsimonyNumber **)rax_malloc(states * sizeof(parsimonyNumber*)),
-        *compressedValues = (parsimonyNumber *)rax_malloc(states * sizeof(parsimonyNumber));
-
-      pr->partitionData[model]->numInformativePatterns = 0; // to fix score bug THAT too many uninformative sites cause out-of-bound array access
+        w = 0,
+        compressedIndex = 0,
+        compressedCounter = 0,
+        index = 0;
 
-      for(i = lower; i < upper; i++)
-        if(informative[i]){
-          entries += (size_t)tr->aliaswgt[i];
-          pr->partitionData[model]->numInformativePatterns++;
+      for(k = 0; k < states; k++)
+        {
+          compressedTips[k] = &(pr->partitionData[model]->parsVect[(compressedEntriesPadded * states * (i + 1)) + (compressedEntriesPadded * k)]);
+          compressedValues[k] = 0;
         }
 
-      compressedEntries = entries / PLL_PCF;
-
-      if(entries % PLL_PCF != 0)
-        compressedEntries++;
+      for(index = lower; index < (size_t)upper; index++)
+        {
+          if(informative[index])
+            {
+              const unsigned int
+                *bitValue = getBitVector(pr->partitionData[model]->dataType);
 
-#if (defined(__SSE3) || defined(__AVX))
-      if(compressedEntries % INTS_PER_VECTOR != 0)
-        compressedEntriesPadded = compressedEntries + (INTS_PER_VECTOR - (compressedEntries % INTS_PER_VECTOR));
-      else
-        compressedEntriesPadded = compressedEntries;
-#else
-      compressedEntriesPadded = compressedEntries;
-#endif
+              parsimonyNumber
+                value = bitValue[tr->yVector[i + 1][index]];
 
+              for(w = 0; w < (size_t)tr->aliaswgt[index]; w++)
+                {
+                  for(k = 0; k < states; k++)
+                    {
+                      if(value & mask32[k])
+                        compressedValues[k] |= mask32[compressedCounter];
+                    }
 
-      rax_posix_memalign ((void **) &(pr->partitionData[model]->parsVect), PLL_BYTE_ALIGNMENT, (size_t)compressedEntriesPadded * states * totalNodes * sizeof(parsimonyNumber));
+                  compressedCounter++;
 
-      for(i = 0; i < compressedEntriesPadded * states * totalNodes; i++)
-        pr->partitionData[model]->parsVect[i] = 0;
+                  if(compressedCounter == PLL_PCF)
+                    {
+                      for(k = 0; k < states; k++)
+                        {
+                          compressedTips[k][compressedIndex] = compressedValues[k];
+                          compressedValues[k] = 0;
+                        }
 
-      if (perSiteScores)
-       {
-         /* for per site parsimony score at each node */
-         rax_posix_memalign ((void **) &(pr->partitionData[model]->perSitePartialPars), PLL_BYTE_ALIGNMENT, totalNodes * (size_t)compressedEntriesPadded * PLL_PCF * sizeof (parsimonyNumber));
-         for (i = 0; i < totalNodes * (size_t)compressedEntriesPadded * PLL_PCF; ++i)
-        	 pr->partitionData[model]->perSitePartialPars[i] = 0;
-       }
+                      compressedCounter = 0;
+                      compressedIndex++;
+                    }
+                }
+            }
+        }
 
-      for(i = 0; i < (size_t)tr->mxtips; i++)
+      for(;compressedIndex < compressedEntriesPadded; compressedIndex++)
         {
-          size_t
-            w = 0,
-            compressedIndex = 0,
-            compressedCounter = 0,
-            index = 0;
+          for(;compressedCounter < PLL_PCF; compressedCounter++)
+            for(k = 0; k < states; k++)
+              compressedValues[k] |= mask32[compressedCounter];
 
           for(k = 0; k < states; k++)
             {
-              compressedTips[k] = &(pr->partitionData[model]->parsVect[(compressedEntriesPadded * states * (i + 1)) + (compressedEntriesPadded * k)]);
+              compressedTips[k][compressedIndex] = compressedValues[k];
               compressedValues[k] = 0;
             }
 
-          for(index = lower; index < (size_t)upper; index++)
-            {
-              if(informative[index])
-                {
-                  const unsigned int
-                    *bitValue = getBitVector(pr->partitionData[model]->dataType);
+          compressedCounter = 0;
+        }
+    }
 
-                  parsimonyNumber
-                    value = bitValue[tr->yVector[i + 1][index]];
+  rax_free(compressedTips);
+  rax_free(compressedValues);
+}
 
-                  for(w = 0; w < (size_t)tr->aliaswgt[index]; w++)
-                    {
-                      for(k = 0; k < states; k++)
-                        {
-                          if(value & mask32[k])
-                            compressedValues[k] |= mask32[compressedCounter];
-                        }
+static void compressDNA(pllInstance *tr, partitionList *pr, int *informative, int perSiteScores)
+{
+	if(pllCostMatrix != NULL) {
+        if (globalParam->sankoff_short_int)
+            return compressSankoffDNA<parsimonyNumberShort, USHORT_PER_VECTOR>(tr, pr, informative, perSiteScores);
+        else
+            return compressSankoffDNA<parsimonyNumber, INTS_PER_VECTOR>(tr, pr, informative, perSiteScores);
+    }
 
-                      compressedCounter++;
 
-                      if(compressedCounter == PLL_PCF)
-                        {
-                          for(k = 0; k < states; k++)
-                            {
-                              compressedTips[k][compressedIndex] = compressedValues[k];
-                              compressedValues[k] = 0;
-                            }
+  size_t
+    totalNodes,
+    i,
+    model;
 
-                          compressedCounter = 0;
-                          compressedIndex++;
-                        }
-                    }
-                }
-            }
+  totalNodes = 2 * (size_t)tr->mxtips;
 
-          for(;compressedIndex < compressedEntriesPadded; compressedIndex++)
-            {
-              for(;compressedCounter < PLL_PCF; compressedCounter++)
-                for(k = 0; k < states; k++)
-                  compressedValues[k] |= mask32[compressedCounter];
 
-              for(k = 0; k < states; k++)
-                {
-                  compressedTips[k][compressedIndex] = compressedValues[k];
-                  compressedValues[k] = 0;
-                }
 
-              compressedCounter = 0;
-            }
-        }
+  for(model = 0; model < (size_t) pr->numberOfPartitions; model++)
+    {
+      size_t
+        states = (size_t)pr->partitionData[model]->states,
+        compressedEntriesPadded = compressedParsimonyLength(tr, pr, model, informative);
+
+      rax_posix_memalign ((void **) &(pr->partitionData[model]->parsVect), PARS_VECTOR_ALIGNMENT, (size_t)compressedEntriesPadded * states * totalNodes * sizeof(parsimonyNumber));
+
+      for(i = 0; i < compressedEntriesPadded * states * totalNodes; i++)
+        pr->partitionData[model]->parsVect[i] = 0;
+
+      if (perSiteScores)
+       {
+         /* for per site parsimony score at each node */
+         rax_posix_memalign ((void **) &(pr->partitionData[model]->perSitePartialPars), PLL_BYTE_ALIGNMENT, totalNodes * (size_t)compressedEntriesPadded * perSiteBits(tr) * sizeof (parsimonyNumber));
+         for (i = 0; i < totalNodes * (size_t)compressedEntriesPadded * perSiteBits(tr); ++i)
+        	 pr->partitionData[model]->perSitePartialPars[i] = 0;
+       }
 
-      pr->partitionData[model]->parsimonyLength = compressedEntriesPadded;
+      compressTipVectors(tr, pr, model, informative, compressedEntriesPadded);
 
-      rax_free(compressedTips);
-      rax_free(compressedValues);
+      pr->partitionData[model]->parsimonyLength = compressedEntriesPadded;
     }
 
   rax_posix_memalign ((void **) &(tr->parsimonyScore), PLL_BYTE_ALIGNMENT, sizeof(unsigned int) * totalNodes);
@@ -3001,7 +4290,7 @@ static void stepwiseAddition(pllInstance *tr, partitionList *pr, nodeptr p, node
   if(mp < tr->bestParsimony) bestTreeScoreHits = 1;
   else if(mp == tr->bestParsimony) bestTreeScoreHits++;
 
-  if((mp < tr->bestParsimony) || ((mp == tr->bestParsimony) && (random_double() <= 1.0 / bestTreeScoreHits)))
+  if((mp < tr->bestParsimony) || ((mp == tr->bestParsimony) && (randomTieBreak(tr) <= 1.0 / bestTreeScoreHits)))
     {
       tr->bestParsimony = mp;
       tr->insertNode = q;
@@ -3019,6 +4308,57 @@ static void stepwiseAddition(pllInstance *tr, partitionList *pr, nodeptr p, node
 }
 
 
+/**
+ * Persistent parsimony data structures of an instance (see _reweightParsimonyDataStructures):
+ * the ratchet-perturbed alignment or a bootstrap sample has the same patterns as the original one, only their
+ * weights differ, so the informative patterns are determined once and the vectors are kept while they are large enough.
+ * Each instance has its own entry, thus several instances can be reweighted at the same time by different threads.
+ */
+struct ReweightCache {
+	int *informative; // informative flag of each pattern
+	size_t *capacity; // # of parsimonyNumber per state and node the vectors of each partition can hold
+};
+static map<pllInstance*, ReweightCache> reweightCaches;
+
+/* @return the entry of tr in reweightCaches, NULL if its data structures are not kept */
+static ReweightCache *findReweightCache(pllInstance *tr)
+{
+	ReweightCache *cache = NULL;
+#ifdef _OPENMP
+#pragma omp critical(reweight_caches)
+#endif
+	{
+		map<pllInstance*, ReweightCache>::iterator it = reweightCaches.find(tr);
+		if(it != reweightCaches.end())
+			cache = &it->second;
+	}
+	return cache;
+}
+
+static void freeReweightCache(pllInstance *tr)
+{
+#ifdef _OPENMP
+#pragma omp critical(reweight_caches)
+#endif
+	{
+		map<pllInstance*, ReweightCache>::iterator it = reweightCaches.find(tr);
+		if(it != reweightCaches.end()){
+			rax_free(it->second.informative);
+			rax_free(it->second.capacity);
+			reweightCaches.erase(it);
+		}
+	}
+}
+
+static void freeReweightCache()
+{
+	for(map<pllInstance*, ReweightCache>::iterator it = reweightCaches.begin(); it != reweightCaches.end(); it++){
+		rax_free(it->second.informative);
+		rax_free(it->second.capacity);
+	}
+	reweightCaches.clear();
+}
+
 void _updateInternalPllOnRatchet(pllInstance *tr, partitionList *pr){
 //	cout << "lower = " << pr->partitionData[0]->lower << ", upper = " << pr->partitionData[0]->upper << ", aln->size() = " << iqtree->aln->size() << endl;
 	for(int i = 0; i < pr->numberOfPartitions; i++){
@@ -3043,6 +4383,7 @@ void _allocateParsimonyDataStructures(pllInstance *tr, partitionList *pr, int pe
 	  }
 
 	  compressDNA(tr, pr, informative, perSiteScores);
+	  sprFreeCandidates(); // vector length changes with the pattern weights
 
 	  for(i = tr->mxtips + 1; i <= tr->mxtips + tr->mxtips - 1; i++)
 	    {
@@ -3064,6 +4405,8 @@ void _pllFreeParsimonyDataStructures(pllInstance *tr, partitionList *pr)
   size_t
     model;
 
+  freeReweightCache(tr);
+
   if(tr->parsimonyScore != NULL){
 	  rax_free(tr->parsimonyScore);
 	  tr->parsimonyScore = NULL;
@@ -3084,6 +4427,7 @@ void _pllFreeParsimonyDataStructures(pllInstance *tr, partitionList *pr)
 	  rax_free(tr->ti);
 	  tr->ti = NULL;
   }
+  sprFreeCandidates();
   if(pllCostMatrix){
 		for(int i = 0; i < pr->numberOfPartitions; i++){
 			if(pr->partitionData[i]->informativePtnWgt != NULL){
@@ -3104,6 +4448,77 @@ void _pllFreeParsimonyDataStructures(pllInstance *tr, partitionList *pr)
 }
 
 
+void _reweightParsimonyDataStructures(pllInstance *tr, partitionList *pr, int perSiteScores)
+{
+	int model, i;
+	size_t totalNodes = 2 * (size_t)tr->mxtips;
+	ReweightCache *cache = pllCostMatrix ? NULL : findReweightCache(tr);
+
+	if(!cache || !pr->partitionData[0]->parsVect){
+		// Sankoff parsimony stores the pattern weights separately, it is simply rebuilt
+		_pllFreeParsimonyDataStructures(tr, pr);
+		_allocateParsimonyDataStructures(tr, pr, perSiteScores);
+		if(pllCostMatrix)
+			return;
+
+		ReweightCache entry;
+		entry.informative = (int *)rax_malloc(sizeof(int) * (size_t)tr->originalCrunchedLength);
+		determineUninformativeSites(tr, pr, entry.informative);
+		entry.capacity = (size_t *)rax_malloc(sizeof(size_t) * pr->numberOfPartitions);
+		for(model = 0; model < pr->numberOfPartitions; model++)
+			entry.capacity[model] = pr->partitionData[model]->parsimonyLength;
+#ifdef _OPENMP
+#pragma omp critical(reweight_caches)
+#endif
+		reweightCaches[tr] = entry;
+		return;
+	}
+
+	int *reweightInformative = cache->informative;
+	size_t *reweightCapacity = cache->capacity;
+	for(model = 0; model < pr->numberOfPartitions; model++){
+		pInfo *partition = pr->partitionData[model];
+		size_t
+			states = (size_t)partition->states,
+			compressedEntriesPadded = compressedParsimonyLength(tr, pr, model, reweightInformative);
+
+		if(compressedEntriesPadded > reweightCapacity[model]){
+			rax_free(partition->parsVect);
+			rax_posix_memalign((void **) &(partition->parsVect), PARS_VECTOR_ALIGNMENT, compressedEntriesPadded * states * totalNodes * sizeof(parsimonyNumber));
+			if(partition->perSitePartialPars){
+				rax_free(partition->perSitePartialPars);
+				partition->perSitePartialPars = NULL;
+			}
+			reweightCapacity[model] = compressedEntriesPadded;
+		}
+
+		if(perSiteScores){
+			size_t perSiteLength = compressedEntriesPadded * perSiteBits(tr);
+			if(!partition->perSitePartialPars){
+				rax_posix_memalign((void **) &(partition->perSitePartialPars), PLL_BYTE_ALIGNMENT, totalNodes * reweightCapacity[model] * perSiteBits(tr) * sizeof(parsimonyNumber));
+				memset(partition->perSitePartialPars, 0, totalNodes * reweightCapacity[model] * perSiteBits(tr) * sizeof(parsimonyNumber));
+			}else{
+				// the per-site scores of the tips must be 0, those of the inner nodes are recomputed
+				memset(partition->perSitePartialPars, 0, perSiteLength * (tr->mxtips + 1) * sizeof(parsimonyNumber));
+			}
+		}
+
+		compressTipVectors(tr, pr, model, reweightInformative, compressedEntriesPadded);
+		partition->parsimonyLength = compressedEntriesPadded;
+	}
+
+	memset(tr->parsimonyScore, 0, sizeof(unsigned int) * totalNodes);
+	sprFreeCandidates(); // vector length changes with the pattern weights
+
+	for(i = tr->mxtips + 1; i <= tr->mxtips + tr->mxtips - 1; i++){
+		nodeptr p = tr->nodep[i];
+		p->xPars = 1;
+		p->next->xPars = 0;
+		p->next->next->xPars = 0;
+	}
+}
+
+
 static void _pllMakeParsimonyTreeFast(pllInstance *tr, partitionList *pr, int sprDist)
 {
   nodeptr
@@ -3175,6 +4590,7 @@ static void _pllMakeParsimonyTreeFast(pllInstance *tr, partitionList *pr, int sp
 //  cout << "DONE stepwise addition" << endl;
 
   randomMP = tr->bestParsimony;
+  sprEdgeValid = false;
 
 //	int * hill_climbing_perm = (int *)rax_malloc((size_t)(tr->mxtips + tr->mxtips - 1) * sizeof(int));
 	int j;
@@ -3196,7 +4612,7 @@ static void _pllMakeParsimonyTreeFast(pllInstance *tr, partitionList *pr, int sp
 			if(tr->bestParsimony == randomMP) bestIterationScoreHits++;
 			if(tr->bestParsimony < randomMP) bestIterationScoreHits = 1;
 			if(((tr->bestParsimony < randomMP) ||
-				((tr->bestParsimony == randomMP) && (random_double() <= 1.0 / bestIterationScoreHits))) &&
+				((tr->bestParsimony == randomMP) && (randomTieBreak(tr) <= 1.0 / bestIterationScoreHits))) &&
 					tr->removeNode && tr->insertNode)
 			{
 				restoreTreeRearrangeParsimony(tr, pr, 0);
@@ -3223,17 +4639,349 @@ static void _pllMakeParsimonyTreeFast(pllInstance *tr, partitionList *pr, int sp
 */
 void _pllComputeRandomizedStepwiseAdditionParsimonyTree(pllInstance * tr, partitionList * partitions, int sprDist, IQTree *_iqtree)
 {
+	PerfPhaseTimer perf_timer(PERF_RAS);
 	doing_stepwise_addition = true;
-	iqtree = _iqtree; // update pointer to IQTree
-	_allocateParsimonyDataStructures(tr, partitions, PLL_FALSE);
+	if(_iqtree)
+		iqtree = _iqtree; // update pointer to IQTree (NULL when called by several threads at once)
+	// the data structures of an instance reused for several pattern weights are only reweighted and kept
+	bool keep = !pllCostMatrix && findReweightCache(tr);
+	if(keep)
+		_reweightParsimonyDataStructures(tr, partitions, PLL_FALSE);
+	else
+		_allocateParsimonyDataStructures(tr, partitions, PLL_FALSE);
 //	cout << "DONE allocate..." << endl;
 	_pllMakeParsimonyTreeFast(tr, partitions, sprDist);
 //	cout << "DONE make...." << endl;
-	_pllFreeParsimonyDataStructures(tr, partitions);
+	if(!keep)
+		_pllFreeParsimonyDataStructures(tr, partitions);
 	doing_stepwise_addition = false;
 //	cout << "Done free..." << endl;
 }
 
+/**
+ * rearrange the branch of p and apply the best move if it is accepted
+ * @param randomMP score of the current tree, updated by the move
+ * @return TRUE if a move was applied
+ */
+static bool sprRearrangeNode(pllInstance *tr, partitionList *pr, nodeptr p, int mintrav, int maxtrav, int perSiteScores,
+		unsigned int &randomMP, unsigned int &bestIterationScoreHits)
+{
+	tr->insertNode = NULL;
+	tr->removeNode = NULL;
+	bestTreeScoreHits = 1;
+
+	tbrRearrangeParsimony(tr, pr, p, mintrav, maxtrav, perSiteScores);
+	if(tr->bestParsimony == randomMP) bestIterationScoreHits++;
+	if(tr->bestParsimony < randomMP) bestIterationScoreHits = 1;
+	if(((tr->bestParsimony < randomMP) ||
+			((tr->bestParsimony == randomMP) &&
+				(randomTieBreak(tr) <= 1.0 / bestIterationScoreHits))) &&
+			tr->removeNode && tr->insertNode){
+		restoreTreeRearrangeParsimony(tr, pr, perSiteScores);
+		randomMP = tr->bestParsimony;
+		return true;
+	}
+	return false;
+}
+
+static int sprHillClimbing(pllInstance * tr, partitionList * pr, int mintrav, int maxtrav, int perSiteScores);
+
+/**
+ * A sector of sectorialSearch(): the clade at root as a reduced instance. Its tips are the taxa of the clade and one
+ * HTU (hypothetical taxonomic unit) holding the vector of the rest of the tree at root->back, so that the score of
+ * the whole tree is that of the reduced instance plus the score of the rest of the tree.
+ */
+struct ParsSector {
+	nodeptr root; // the clade in the whole tree
+	nodeptr outside; // root->back when the sector was cut, the node the HTU stands for
+	vector<nodeptr> tips; // taxon of the whole tree of each tip of tr but the HTU, tips[i - 1] for tip i
+	vector<nodeptr> inner; // node of the whole tree of the first node of each ring of tr, in the order of the rings
+	pllInstance *tr;
+	partitionList pr;
+	unsigned int startMP; // score of tr before the hill-climbing
+	unsigned int bestMP; // score of tr after the hill-climbing
+};
+
+/**
+ * post-order: cut the subtree at x into disjoint clades of at least size taxa (fewer than 2 * size)
+ * @return # of taxa below x, -1 if there is a sector below x
+ */
+static int sectorCut(pllInstance *tr, nodeptr x, int size, vector<nodeptr> &sectors)
+{
+	if(x->number <= tr->mxtips)
+		return 1;
+
+	int
+		left = sectorCut(tr, x->next->back, size, sectors),
+		right = sectorCut(tr, x->next->next->back, size, sectors);
+	if(left < 0 || right < 0)
+		return -1;
+	if(left + right < size)
+		return left + right;
+
+	sectors.push_back(x);
+	return -1;
+}
+
+/* copy the vector of node number from of the whole tree to node number to of the sector */
+static void sectorCopyVector(partitionList *pr, int from, ParsSector &sector, int to)
+{
+	for(int model = 0; model < pr->numberOfPartitions; model++){
+		size_t length = (size_t)pr->partitionData[model]->parsimonyLength * pr->partitionData[model]->states;
+		memcpy(&(sector.pr.partitionData[model]->parsVect[length * to]),
+				&(pr->partitionData[model]->parsVect[length * from]), length * sizeof(parsimonyNumber));
+	}
+}
+
+/* map the clade at p of the whole tree into the sector, its root is joined to q */
+static void sectorBuild(pllInstance *tr, partitionList *pr, ParsSector &sector, nodeptr p, nodeptr q)
+{
+	if(p->number <= tr->mxtips){
+		sector.tips.push_back(p);
+		nodeptr t = sector.tr->nodep[sector.tips.size()];
+		hookupDefault(t, q);
+		sectorCopyVector(pr, p->number, sector, t->number);
+		return;
+	}
+
+	sector.inner.push_back(p);
+	nodeptr r = sector.tr->nodep[sector.tr->mxtips + sector.inner.size()];
+	hookupDefault(r, q);
+	sectorBuild(tr, pr, sector, p->next->back, r->next);
+	sectorBuild(tr, pr, sector, p->next->next->back, r->next->next);
+}
+
+/**
+ * the reduced instance of the clade at root, with the same vector layout as the whole tree
+ * @param seed random number seed of the instance
+ */
+static void sectorCreate(pllInstance *tr, partitionList *pr, nodeptr root, long seed, int perSiteScores, ParsSector &sector)
+{
+	int
+		taxa = 0,
+		tips,
+		i;
+	vector<nodeptr> stack(1, root);
+	while(!stack.empty()){
+		nodeptr p = stack.back();
+		stack.pop_back();
+		if(p->number <= tr->mxtips)
+			taxa++;
+		else{
+			stack.push_back(p->next->back);
+			stack.push_back(p->next->next->back);
+		}
+	}
+	tips = taxa + 1;
+
+	// the node rings as built by pllTreeInitDefaults(), the last one is not used by an unrooted tree
+	pllInstance *sub = (pllInstance *)rax_calloc(1, sizeof(pllInstance));
+	nodeptr p0 = (nodeptr)rax_calloc((size_t)(tips + 3 * (tips - 1)), sizeof(node));
+	sub->mxtips = sub->ntips = tips;
+	sub->nodeBaseAddress = p0;
+	sub->nodep = (nodeptr *)rax_calloc(2 * (size_t)tips, sizeof(nodeptr));
+	for(i = 1; i <= tips; i++){
+		nodeptr p = p0++;
+		p->number = i;
+		p->next = p;
+		sub->nodep[i] = p;
+	}
+	for(i = tips + 1; i <= tips + tips - 1; i++){
+		nodeptr p = p0;
+		p0 += 3;
+		for(int j = 0; j < 3; j++){
+			p[j].number = i;
+			p[j].next = &p[(j + 1) % 3];
+		}
+		p->xPars = 1;
+		sub->nodep[i] = p;
+	}
+	sub->ti = (int *)rax_malloc(sizeof(int) * 4 * (size_t)tips);
+	sub->parsimonyScore = (unsigned int *)rax_calloc(2 * (size_t)tips, sizeof(unsigned int));
+	sub->randomNumberSeed = seed;
+	sub->start = sub->nodep[1];
+
+	sector.pr = *pr;
+	sector.pr.partitionData = (pInfo **)rax_malloc(pr->numberOfPartitions * sizeof(pInfo *));
+	for(int model = 0; model < pr->numberOfPartitions; model++){
+		pInfo *partition = (pInfo *)rax_malloc(sizeof(pInfo));
+		*partition = *pr->partitionData[model];
+		rax_posix_memalign((void **) &(partition->parsVect), PARS_VECTOR_ALIGNMENT,
+				(size_t)partition->parsimonyLength * partition->states * 2 * tips * sizeof(parsimonyNumber));
+		partition->perSitePartialPars = NULL;
+		sector.pr.partitionData[model] = partition;
+	}
+
+	sector.root = root;
+	sector.outside = root->back;
+	sector.tr = sub;
+	sector.tips.clear();
+	sector.inner.clear();
+	sectorBuild(tr, pr, sector, root, sub->nodep[tips]);
+
+	// the HTU: the vector of the rest of the tree pointing to the clade
+	newviewParsimony(tr, pr, sector.outside, perSiteScores);
+	sectorCopyVector(pr, sector.outside->number, sector, tips);
+
+	sector.startMP = sector.bestMP = evaluateParsimony(sub, &sector.pr, sub->start, PLL_TRUE, PLL_FALSE);
+	assert(sector.startMP + (sector.outside->number > tr->mxtips ? tr->parsimonyScore[sector.outside->number] : 0)
+			== tr->bestParsimony);
+}
+
+static void sectorFree(ParsSector &sector)
+{
+	for(int model = 0; model < sector.pr.numberOfPartitions; model++){
+		rax_free(sector.pr.partitionData[model]->parsVect);
+		rax_free(sector.pr.partitionData[model]);
+	}
+	rax_free(sector.pr.partitionData);
+	rax_free(sector.tr->ti);
+	rax_free(sector.tr->parsimonyScore);
+	rax_free(sector.tr->nodep);
+	rax_free(sector.tr->nodeBaseAddress);
+	rax_free(sector.tr);
+	sector.tr = NULL;
+}
+
+/* @return the node of the whole tree x of the sector stands for */
+static nodeptr sectorNode(ParsSector &sector, nodeptr x)
+{
+	int
+		tips = sector.tr->mxtips,
+		index = (int)(x - sector.tr->nodeBaseAddress);
+	if(index == tips - 1)
+		return sector.outside;
+	if(index < tips)
+		return sector.tips[index];
+
+	nodeptr p = sector.inner[(index - tips) / 3];
+	for(int j = (index - tips) % 3; j > 0; j--)
+		p = p->next;
+	return p;
+}
+
+/* hill-climb the reduced instance of a sector, several sectors can be climbed at the same time */
+static void sectorClimb(ParsSector &sector, int mintrav, int maxtrav)
+{
+	bool saved = doing_sector_spr;
+	doing_sector_spr = true;
+	sprFreeEdgeVectors(); // they may belong to a freed instance allocated at the same address as this one
+	sector.tr->bestParsimony = sector.startMP;
+	sector.bestMP = sprHillClimbing(sector.tr, &sector.pr, mintrav, maxtrav, PLL_FALSE);
+	sprFreeEdgeVectors();
+	doing_sector_spr = saved;
+}
+
+/**
+ * replace the clade of a sector by the topology of its reduced instance
+ * @param old the branches replaced, to undo it
+ */
+static void sectorInsert(ParsSector &sector, vector<pair<nodeptr, nodeptr> > &old)
+{
+	size_t count = (size_t)sector.tr->mxtips + 3 * (size_t)(sector.tr->mxtips - 2);
+	old.clear();
+	for(size_t i = 0; i < count; i++){
+		nodeptr p = sectorNode(sector, sector.tr->nodeBaseAddress + i);
+		old.push_back(make_pair(p, p->back));
+	}
+	for(size_t i = 0; i < count; i++){
+		nodeptr x = sector.tr->nodeBaseAddress + i;
+		hookupDefault(sectorNode(sector, x), sectorNode(sector, x->back));
+	}
+}
+
+/**
+ * Sectorial search (-sector): the tree is cut into disjoint clades of globalParam->sector_size to twice as many
+ * taxa (sectorCut()). Each sector becomes a reduced instance with its taxa and one HTU for the rest of the tree
+ * (sectorCreate()), the score of the reduced instance plus that of the rest of the tree is the score of the tree.
+ * The sectors are hill-climbed independently, by several threads when not already in a parallel region. A sector
+ * is put back into the tree if its score decreased and the score of the whole tree, which also depends on the
+ * sectors put back before it, decreases. The next round cuts the tree from another tip, rounds stop when one does
+ * not decrease the score. Only for Fitch parsimony without constraints.
+ * The reduced instances have no per-site scores: with UFBoot, only the whole tree after each sector put back is
+ * saved as a bootstrap candidate, not the trees visited while a sector is hill-climbed.
+ * @param randomMP score of the current tree, updated by the sectors put back
+ */
+static void sectorialSearch(pllInstance *tr, partitionList *pr, int mintrav, int maxtrav, int perSiteScores, unsigned int &randomMP)
+{
+	unsigned int startMP;
+	vector<nodeptr> roots;
+	vector<ParsSector> sectors;
+	vector<pair<nodeptr, nodeptr> > old;
+
+	do{
+		startMP = randomMP;
+		tr->bestParsimony = randomMP;
+
+		int root = 1 + (int)(randomTieBreak(tr) * tr->mxtips);
+		if(root > tr->mxtips)
+			root = tr->mxtips;
+		roots.clear();
+		sectorCut(tr, tr->nodep[root]->back, globalParam->sector_size, roots);
+
+		sectors.resize(roots.size());
+		for(size_t i = 0; i < roots.size(); i++){
+			long seed = 1 + (long)(randomTieBreak(tr) * 2147483646.0);
+			sectorCreate(tr, pr, roots[i], seed, perSiteScores, sectors[i]);
+		}
+
+#ifdef _OPENMP
+		bool parallel = globalParam->spr_parallel && sectors.size() > 1 && omp_get_max_threads() > 1 && !omp_in_parallel();
+#pragma omp parallel for schedule(dynamic) if(parallel)
+#endif
+		for(int i = 0; i < (int)sectors.size(); i++)
+			sectorClimb(sectors[i], mintrav, maxtrav);
+
+		for(size_t i = 0; i < sectors.size(); i++){
+			if(sectors[i].bestMP < sectors[i].startMP){
+				sectorInsert(sectors[i], old);
+				unsigned int mp = evaluateParsimony(tr, pr, tr->start, PLL_TRUE, perSiteScores);
+				if(mp < randomMP){
+					randomMP = mp;
+					if(perSiteScores)
+						pllSaveCurrentTreeSprParsimony(tr, pr, mp); // run UFBoot
+				}else{
+					for(size_t j = 0; j < old.size(); j++)
+						hookupDefault(old[j].first, old[j].second);
+					evaluateParsimony(tr, pr, tr->start, PLL_TRUE, perSiteScores);
+				}
+			}
+			sectorFree(sectors[i]);
+		}
+		tr->bestParsimony = randomMP;
+		sprEdgeValid = false;
+	}while(randomMP < startMP);
+}
+
+/**
+ * SPR hill-climbing from the tree stored in tr, tr->bestParsimony must be the score of this tree
+ * @return best parsimony score found
+ */
+static int sprHillClimbing(pllInstance * tr, partitionList * pr, int mintrav, int maxtrav, int perSiteScores){
+	int i;
+	unsigned int
+		randomMP,
+		startMP;
+
+	unsigned int bestIterationScoreHits = 1;
+	randomMP = tr->bestParsimony;
+	tr->ntips = tr->mxtips;
+	sprEdgeValid = false; // the tree or the pattern weights may have changed since the last call
+	if(globalParam && globalParam->sector_size > 0 && tr->mxtips >= 2 * globalParam->sector_size && !doing_sector_spr
+			&& !pllCostMatrix && !tr->constrained && !tr->grouped)
+		sectorialSearch(tr, pr, mintrav, maxtrav, perSiteScores, randomMP);
+	do{
+		startMP = randomMP;
+		nodeRectifierPars(tr);
+		for(i = 1; i <= tr->mxtips + tr->mxtips - 2; i++)
+			sprRearrangeNode(tr, pr, tr->nodep[i], mintrav, maxtrav, perSiteScores, randomMP, bestIterationScoreHits);
+	}while(randomMP < startMP);
+
+	tbrRerootNode = NULL;
+	sprFlushBoundStats();
+	return startMP;
+}
+
 /**
  * DTH: optimize whatever tree is stored in tr by parsimony SPR
  * @param tr: the tree instance :)
@@ -3242,16 +4990,18 @@ void _pllComputeRandomizedStepwiseAdditionParsimonyTree(pllInstance * tr, partit
  * @return best parsimony score found
  */
 int pllOptimizeSprParsimony(pllInstance * tr, partitionList * pr, int mintrav, int maxtrav, IQTree *_iqtree){
+	PerfPhaseTimer perf_timer(PERF_SPR);
 	int perSiteScores = globalParam->gbo_replicates > 0;
 
 	iqtree = _iqtree; // update pointer to IQTree
 
 	if(globalParam->ratchet_iter >= 0 && (iqtree->on_ratchet_hclimb1 || iqtree->on_ratchet_hclimb2)){
-		// oct 23: in non-ratchet iteration, allocate is not triggered
+		// switch between the original and the perturbed alignment, the vectors are kept for the
+		// following non-ratchet iterations
 		_updateInternalPllOnRatchet(tr, pr);
-		_allocateParsimonyDataStructures(tr, pr, perSiteScores);
-	}else if(first_call || (iqtree && iqtree->on_opt_btree))
-		_allocateParsimonyDataStructures(tr, pr, perSiteScores); // called once if not running ratchet
+		_reweightParsimonyDataStructures(tr, pr, perSiteScores);
+	}else if(first_call || (iqtree && iqtree->on_opt_btree) || !pr->partitionData[0]->parsVect)
+		_allocateParsimonyDataStructures(tr, pr, perSiteScores); // called once unless freed in between
 
 	if(first_call){
 		first_call = false;
@@ -3265,11 +5015,6 @@ int pllOptimizeSprParsimony(pllInstance * tr, partitionList * pr, int mintrav, i
 //		_allocateParsimonyDataStructures(tr, pr, perSiteScores); // called once if not running ratchet
 //	}
 
-	int i;
-	unsigned int
-		randomMP,
-		startMP;
-
 	assert(!tr->constrained);
 
 	nodeRectifierPars(tr);
@@ -3285,57 +5030,188 @@ int pllOptimizeSprParsimony(pllInstance * tr, partitionList * pr, int mintrav, i
 	evaluateParsimony(tr, pr, tr->start, PLL_TRUE, perSiteScores);
 	*/
 
-	int j;
-    // *perm        = (int *)rax_malloc((size_t)(tr->mxtips + tr->mxtips - 1) * sizeof(int));
-//	makePermutationFast(perm, tr->mxtips + tr->mxtips - 2, tr);
+	return sprHillClimbing(tr, pr, mintrav, maxtrav, perSiteScores);
+}
 
-	unsigned int bestIterationScoreHits = 1;
-	randomMP = tr->bestParsimony;
-	tr->ntips = tr->mxtips;
-	do{
-		startMP = randomMP;
-		nodeRectifierPars(tr);
-		for(i = 1; i <= tr->mxtips + tr->mxtips - 2; i++){
-//		for(j = 1; j <= tr->mxtips + tr->mxtips - 2; j++){
-//			i = perm[j];
-			tr->insertNode = NULL;
-			tr->removeNode = NULL;
-			bestTreeScoreHits = 1;
+int pllOptimizeSprParsimonyReweighted(pllInstance * tr, partitionList * pr, const BootValTypePars *ptnWeights, int mintrav, int maxtrav){
+	PerfPhaseTimer perf_timer(PERF_SPR);
+	assert(!pllCostMatrix);
+	assert(!tr->constrained);
 
-			rearrangeParsimony(tr, pr, tr->nodep[i], mintrav, maxtrav, PLL_FALSE, perSiteScores);
-			if(tr->bestParsimony == randomMP) bestIterationScoreHits++;
-			if(tr->bestParsimony < randomMP) bestIterationScoreHits = 1;
-			if(((tr->bestParsimony < randomMP) ||
-					((tr->bestParsimony == randomMP) &&
-						(random_double() <= 1.0 / bestIterationScoreHits))) &&
-					tr->removeNode && tr->insertNode){
-				restoreTreeRearrangeParsimony(tr, pr, perSiteScores);
-				randomMP = tr->bestParsimony;
-			}
+	for(int i = 0; i < pr->numberOfPartitions; i++){
+		for(int ptn = pr->partitionData[i]->lower; ptn < pr->partitionData[i]->upper; ptn++){
+			tr->aliaswgt[ptn] = ptnWeights[ptn];
 		}
-	}while(randomMP < startMP);
+	}
 
-	return startMP;
+	doing_reweighted_spr = true;
+	_reweightParsimonyDataStructures(tr, pr, PLL_FALSE); // kept for the next call with tr
+
+	nodeRectifierPars(tr);
+	tr->bestParsimony = UINT_MAX;
+	tr->bestParsimony = evaluateParsimony(tr, pr, tr->start, PLL_TRUE, PLL_FALSE);
+	int score = sprHillClimbing(tr, pr, mintrav, maxtrav, PLL_FALSE);
+
+	doing_reweighted_spr = false;
+	return score;
+}
+
+
+int pllOptimizeSprParsimonyWalker(pllInstance * tr, partitionList * pr, const BootValTypePars *ptnWeights, int mintrav, int maxtrav,
+		IQTree *search){
+	PerfPhaseTimer perf_timer(PERF_SPR);
+	int perSiteScores = globalParam->gbo_replicates > 0;
+	assert(!pllCostMatrix);
+	assert(!tr->constrained);
+
+	for(int i = 0; i < pr->numberOfPartitions; i++){
+		for(int ptn = pr->partitionData[i]->lower; ptn < pr->partitionData[i]->upper; ptn++){
+			tr->aliaswgt[ptn] = ptnWeights[ptn];
+		}
+	}
+
+	walkerTree = search;
+	_reweightParsimonyDataStructures(tr, pr, perSiteScores); // kept for the next call with tr
+
+	nodeRectifierPars(tr);
+	tr->bestParsimony = UINT_MAX;
+	tr->bestParsimony = evaluateParsimony(tr, pr, tr->start, PLL_TRUE, perSiteScores);
+	int score = sprHillClimbing(tr, pr, mintrav, maxtrav, perSiteScores);
+
+	walkerTree = NULL;
+	return score;
 }
 
 
+void pllBenchmarkFitchKernels(pllInstance * tr, partitionList * pr, int repeats, double &newview_time, double &evaluate_time){
+	_allocateParsimonyDataStructures(tr, pr, PLL_FALSE);
+	nodeRectifierPars(tr);
+
+	nodeptr
+		p = tr->start,
+		q = p->back;
+	int
+		*ti = tr->ti;
+	unsigned int
+		score = 0;
+
+	newview_time = evaluate_time = 0.0;
+	for(int rep = 0; rep < repeats; rep++){
+		int counter = 4;
+		ti[1] = p->number;
+		ti[2] = q->number;
+		if(p->number > tr->mxtips)
+			computeTraversalInfoParsimony(p, ti, &counter, tr->mxtips, PLL_TRUE, PLL_FALSE);
+		if(q->number > tr->mxtips)
+			computeTraversalInfoParsimony(q, ti, &counter, tr->mxtips, PLL_TRUE, PLL_FALSE);
+		ti[0] = counter;
+
+		double start = getRealTime();
+		newviewParsimonyIterativeFast(tr, pr, PLL_FALSE);
+		newview_time += getRealTime() - start;
+
+		ti[0] = 4; // only the branch p -- q
+		start = getRealTime();
+		unsigned int rep_score = evaluateParsimonyIterativeFast(tr, pr, PLL_FALSE);
+		evaluate_time += getRealTime() - start;
+		if(rep > 0 && rep_score != score)
+			outError("Fitch kernels give different scores for the same tree");
+		score = rep_score;
+	}
+
+	tr->bestParsimony = score;
+	_pllFreeParsimonyDataStructures(tr, pr);
+}
+
 int pllSaveCurrentTreeSprParsimony(pllInstance * tr, partitionList * pr, int cur_search_pars){
-	iqtree->saveCurrentTree(-cur_search_pars);
+	if(walkerTree)
+		walkerTree->saveWalkerTree(tr, pr, cur_search_pars);
+	else
+		iqtree->saveCurrentTree(-cur_search_pars);
 	return (int)(cur_search_pars);
 }
 
+/*
+ * compute the smallest taxon ID in the subtree below p (away from p->back) for each inner node
+ * @return smallest taxon ID below p
+ */
+static int subtreeSmallestTaxon(pllInstance *tr, nodeptr p, vector<int> &smallest)
+{
+	if(p->number <= tr->mxtips)
+		return p->number - 1;
+
+	int left = subtreeSmallestTaxon(tr, p->next->back, smallest);
+	int right = subtreeSmallestTaxon(tr, p->next->next->back, smallest);
+	return smallest[p->number] = min(left, right);
+}
+
+static void printSubtreeTopology(pllInstance *tr, nodeptr p, vector<int> &smallest, string &tree_str);
+
+/* print the subtrees below left and right separated by a comma, the one with the smaller taxon ID first */
+static void printChildrenTopology(pllInstance *tr, nodeptr left, nodeptr right, vector<int> &smallest, string &tree_str)
+{
+	int leftId = (left->number <= tr->mxtips) ? left->number - 1 : smallest[left->number];
+	int rightId = (right->number <= tr->mxtips) ? right->number - 1 : smallest[right->number];
+	if(rightId < leftId)
+		swap(left, right);
+	printSubtreeTopology(tr, left, smallest, tree_str);
+	tree_str += ',';
+	printSubtreeTopology(tr, right, smallest, tree_str);
+}
+
+static void printSubtreeTopology(pllInstance *tr, nodeptr p, vector<int> &smallest, string &tree_str)
+{
+	if(p->number <= tr->mxtips){
+		char id[16];
+		sprintf(id, "%d", p->number - 1);
+		tree_str += id;
+		return;
+	}
+	tree_str += '(';
+	printChildrenTopology(tr, p->next->back, p->next->next->back, smallest, tree_str);
+	tree_str += ')';
+}
+
+void pllTreeTopologyString(pllInstance *tr, string &tree_str)
+{
+	// the tree read from pllTreeToNewick(start->back) is printed from the inner node next to taxon 1,
+	// taxon 1 (ID 0) comes first there and the other two children are sorted by their smallest taxon ID
+	nodeptr q = tr->nodep[1]->back;
+	vector<int> smallest(2 * tr->mxtips, 0);
+
+	assert(q->number > tr->mxtips);
+	subtreeSmallestTaxon(tr, q->next->back, smallest);
+	subtreeSmallestTaxon(tr, q->next->next->back, smallest);
+
+	tree_str = "(0,";
+	printChildrenTopology(tr, q->next->back, q->next->next->back, smallest, tree_str);
+	tree_str += ");";
+}
+
+char *pllTreeToNewickString(pllInstance *tr, partitionList *pr, bool branch_lengths)
+{
+	perfCount(PERF_NEWICK);
+	return pllTreeToNewick(tr->tree_string, tr, pr, tr->start->back, branch_lengths ? PLL_TRUE : PLL_FALSE,
+			PLL_TRUE, PLL_FALSE, PLL_FALSE, PLL_FALSE, PLL_SUMMARIZE_LH, PLL_FALSE, PLL_FALSE);
+}
+
+pllNewickTree *pllParseNewickString(const char *newick)
+{
+	perfCount(PERF_NEWICK);
+	return pllNewickParseString(newick);
+}
+
 
 void pllComputePatternParsimony(pllInstance * tr, partitionList * pr, double *ptn_npars, double *cur_npars){
 	int ptn = 0;
 	int site = 0;
 	int sum = 0;
+	int siteBits = perSiteBits(tr);
 
 	for(int i = 0; i < pr->numberOfPartitions; i++){
-		int partialParsLength = pr->partitionData[i]->parsimonyLength * PLL_PCF;
-		parsimonyNumber * p = &(pr->partitionData[i]->perSitePartialPars[partialParsLength * tr->start->number]);
 
 		for(ptn = pr->partitionData[i]->lower; ptn < pr->partitionData[i]->upper; ptn++){
-			ptn_npars[ptn] = -p[site];
+			ptn_npars[ptn] = -(int)perSiteNodeScore(pr, i, tr->start->number, site, siteBits);
 			sum += ptn_npars[ptn] * tr->aliaswgt[ptn];
 			site += tr->aliaswgt[ptn];
 		}
@@ -3371,17 +5247,16 @@ void pllComputePatternParsimony(pllInstance * tr, partitionList * pr, unsigned s
 	int ptn = 0;
 	int site = 0;
 	int sum = 0;
+	int siteBits = perSiteBits(tr);
 
 //	cout << "Pattern pars by PLL: ";
 	for(int i = 0; i < pr->numberOfPartitions; i++){
-		int partialParsLength = pr->partitionData[i]->parsimonyLength * PLL_PCF;
-		parsimonyNumber * p = &(pr->partitionData[i]->perSitePartialPars[partialParsLength * tr->start->number]);
 
 		int upperIndex = pr->partitionData[i]->upper;
 		if(globalParam->sort_alignment) upperIndex = pr->partitionData[i]->numInformativePatterns;
 		for(ptn = pr->partitionData[i]->lower; ptn < upperIndex; ptn++){
 //			cout << p[site] << ", ";
-			ptn_pars[ptn] = p[site];
+			ptn_pars[ptn] = perSiteNodeScore(pr, i, tr->start->number, site, siteBits);
 			sum += ptn_pars[ptn] * tr->aliaswgt[ptn];
 			site += tr->aliaswgt[ptn];
 		}
@@ -3393,7 +5268,6 @@ void pllComputePatternParsimony(pllInstance * tr, partitionList * pr, unsigned s
 
 
 void pllComputePatternParsimonySlow(pllInstance * tr, partitionList * pr, double *ptn_npars, double *cur_npars){
-	iqtree->initializeAllPartialPars();
 	iqtree->clearAllPartialLH();
 	if(cur_npars) *cur_npars = -(iqtree->computeParsimony());
 	else
@@ -3403,13 +5277,12 @@ void pllComputePatternParsimonySlow(pllInstance * tr, partitionList * pr, double
 void pllComputeSiteParsimony(pllInstance * tr, partitionList * pr, int *site_pars, int nsite, int *cur_pars){
 	int site = 0;
 	int sum = 0;
+	int siteBits = perSiteBits(tr);
 
 	for(int i = 0; i < pr->numberOfPartitions; i++){
-		int partialParsLength = pr->partitionData[i]->parsimonyLength * PLL_PCF;
-		parsimonyNumber * p = &(pr->partitionData[i]->perSitePartialPars[partialParsLength * tr->start->number]);
 
 		for(int k = 0; k < pr->partitionData[i]->width; k++){
-			site_pars[site] = p[k];
+			site_pars[site] = perSiteNodeScore(pr, i, tr->start->number, k, siteBits);
 			sum += site_pars[site];
 			site++;
 		}
@@ -3424,13 +5297,12 @@ void pllComputeSiteParsimony(pllInstance * tr, partitionList * pr, int *site_par
 void pllComputeSiteParsimony(pllInstance * tr, partitionList * pr, unsigned short *site_pars, int nsite, int *cur_pars){
 	int site = 0;
 	int sum = 0;
+	int siteBits = perSiteBits(tr);
 
 	for(int i = 0; i < pr->numberOfPartitions; i++){
-		int partialParsLength = pr->partitionData[i]->parsimonyLength * PLL_PCF;
-		parsimonyNumber * p = &(pr->partitionData[i]->perSitePartialPars[partialParsLength * tr->start->number]);
 
 		for(int k = 0; k < pr->partitionData[i]->width; k++){
-			site_pars[site] = p[k];
+			site_pars[site] = perSiteNodeScore(pr, i, tr->start->number, k, siteBits);
 			sum += site_pars[site];
 			site++;
 		}
@@ -3617,12 +5489,8 @@ void computeUserTreeParsimomy(Params &params) {
 
 	if(params.sankoff_cost_file){
 		ptree->initializePLL(params);
-		string tree_string = ptree->getTreeString();
-		pllNewickTree *pll_tree = pllNewickParseString(tree_string.c_str());
-		assert(pll_tree != NULL);
-		pllTreeInitTopologyNewick(ptree->pllInst, pll_tree, PLL_FALSE);
+		ptree->initPLLTopology(ptree->pllInst);
 		iqtree = ptree;
-        pllNewickParseDestroy(&pll_tree);
 		_allocateParsimonyDataStructures(ptree->pllInst, ptree->pllPartitions, false);
 		ptree->pllInst->bestParsimony = UINT_MAX; // Important because of early termination in evaluateSankoffParsimonyIterativeFastSIMD
 		unsigned int pll_score = evaluateParsimony(ptree->pllInst, ptree->pllPartitions, ptree->pllInst->start, PLL_TRUE, false);
@@ -3641,12 +5509,8 @@ void computeUserTreeParsimomy(Params &params) {
 		_pllFreeParsimonyDataStructures(ptree->pllInst, ptree->pllPartitions);
 	}else{
 		ptree->initializePLL(params);
-		string tree_string = ptree->getTreeString();
-		pllNewickTree *pll_tree = pllNewickParseString(tree_string.c_str());
-		assert(pll_tree != NULL);
-		pllTreeInitTopologyNewick(ptree->pllInst, pll_tree, PLL_FALSE);
+		ptree->initPLLTopology(ptree->pllInst);
 		iqtree = ptree;
-        pllNewickParseDestroy(&pll_tree);
 		_allocateParsimonyDataStructures(ptree->pllInst, ptree->pllPartitions, false);
 		ptree->pllInst->bestParsimony = UINT_MAX; // Important because of early termination in evaluateSankoffParsimonyIterativeFastSIMD
 		unsigned int pll_score = evaluateParsimony(ptree->pllInst, ptree->pllPartitions, ptree->pllInst->start, PLL_TRUE, false);
@@ -3658,6 +5522,134 @@ void computeUserTreeParsimomy(Params &params) {
 	delete ptree;
 }
 
+/**
+ * # of trees read from the tree file at once by computeUserTreesParsimonyBatch
+ */
+#define PARS_BATCH_CHUNK 4096
+
+/*
+ * Layout of <prefix>.parsbatch.bin (native byte order):
+ *     char[8] "PARSBAT1", int32 npattern, int32 pattern frequencies[npattern],
+ *     then for every tree: int32 parsimony score, uint16 pattern parsimony[npattern]
+ * <prefix>.parsbatch has the pattern frequencies in its first line, then one line per tree:
+ *     tree number (from 1), parsimony score, pattern parsimony scores
+ */
+void computeUserTreesParsimonyBatch(Params &params) {
+	if (!params.user_file)
+		outError("Please provide the file of trees to score");
+
+	double start = getRealTime();
+	Alignment alignment(params.aln_file, params.sequence_type, params.intype);
+	int nptn = alignment.getNPattern();
+
+	int nthreads = 1;
+#ifdef _OPENMP
+	nthreads = omp_get_max_threads();
+#endif
+	// one kernel per thread, sharing the alignment
+	vector<IQTree*> trees(nthreads);
+	for (int i = 0; i < nthreads; i++) {
+		if (params.sankoff_cost_file) {
+			trees[i] = new ParsTree(&alignment);
+			dynamic_cast<ParsTree *>(trees[i])->initParsData(&params);
+		} else
+			trees[i] = new IQTree(&alignment);
+		trees[i]->params = &params;
+		trees[i]->rooted = params.is_rooted;
+	}
+
+	// igzstream also reads uncompressed files
+	igzstream in;
+	in.open(params.user_file);
+	if (!in.good())
+		outError(ERR_READ_INPUT, params.user_file);
+
+	string out_file = string(params.out_prefix) + (params.pars_batch_binary ? ".parsbatch.bin" : ".parsbatch");
+	ofstream out;
+	out.exceptions(ios::failbit | ios::badbit);
+	try {
+		if (params.pars_batch_binary) {
+			out.open(out_file.c_str(), ios::out | ios::binary);
+			out.write("PARSBAT1", 8);
+			out.write((char*)&nptn, sizeof(int));
+			for (int ptn = 0; ptn < nptn; ptn++) {
+				int freq = alignment[ptn].frequency;
+				out.write((char*)&freq, sizeof(int));
+			}
+		} else {
+			out.open(out_file.c_str());
+			out << "#freq";
+			for (int ptn = 0; ptn < nptn; ptn++)
+				out << "\t" << alignment[ptn].frequency;
+			out << endl;
+		}
+	} catch (ios::failure) {
+		outError(ERR_WRITE_OUTPUT, out_file);
+	}
+
+	cout << "Scoring trees from " << params.user_file << " with " << nthreads << " thread(s)..." << endl;
+
+	vector<string> chunk;
+	chunk.reserve(PARS_BATCH_CHUNK);
+	vector<int> scores(PARS_BATCH_CHUNK);
+	vector<BootValTypePars> pattern_pars((size_t)PARS_BATCH_CHUNK * nptn);
+	size_t ntrees = 0;
+	string tree_str;
+	while (in.good()) {
+		// read the next chunk of trees, one tree per ';'
+		chunk.clear();
+		while (chunk.size() < PARS_BATCH_CHUNK && getline(in, tree_str, ';')) {
+			size_t first = tree_str.find_first_not_of(" \t\r\n");
+			if (first == string::npos)
+				continue;
+			chunk.push_back(tree_str.substr(first) + ";");
+		}
+		int nchunk = chunk.size();
+		if (nchunk == 0)
+			break;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+		for (int i = 0; i < nchunk; i++) {
+			int thread = 0;
+#ifdef _OPENMP
+			thread = omp_get_thread_num();
+#endif
+			IQTree *tree = trees[thread];
+			tree->readTreeString(chunk[i]);
+			scores[i] = tree->computeParsimony();
+			memcpy(&pattern_pars[(size_t)i * nptn], tree->getPatternPars(), sizeof(BootValTypePars) * nptn);
+		}
+
+		try {
+			for (int i = 0; i < nchunk; i++) {
+				BootValTypePars *ptn_pars = &pattern_pars[(size_t)i * nptn];
+				if (params.pars_batch_binary) {
+					out.write((char*)&scores[i], sizeof(int));
+					out.write((char*)ptn_pars, sizeof(BootValTypePars) * nptn);
+				} else {
+					out << ntrees + i + 1 << "\t" << scores[i];
+					for (int ptn = 0; ptn < nptn; ptn++)
+						out << "\t" << ptn_pars[ptn];
+					out << endl;
+				}
+			}
+		} catch (ios::failure) {
+			outError(ERR_WRITE_OUTPUT, out_file);
+		}
+		ntrees += nchunk;
+	}
+	in.close();
+	out.close();
+
+	for (int i = 0; i < nthreads; i++)
+		delete trees[i];
+
+	cout << ntrees << " trees scored in " << getRealTime() - start << " seconds" << endl;
+	cout << "Parsimony scores written to " << out_file << endl;
+}
+
 // Given an alignment A (-s) and a tree T (-nwtree)
 // Convert T into TNT format (clear all bootstrap supports, use tread syntax)
 // @param: Params
@@ -9,17 +9,40 @@
 #define SPRPARSIMONY_H_
 
 #include "iqtree.h"
+#include "sprparsimonykernel.h"
 
 void resetGlobalParamOnNewAln(); // Diep 2021-12-28: This serves analysis composed of multiple runs (such as SBS);
 
+/**
+ * choose the Fitch parsimony kernels for the CPU running the program, called once at startup
+ * @param kernel "auto" or NULL for the fastest one supported by the CPU, "avx512" or "avx2" for at most
+ *        this instruction set, anything else for the SSE3/AVX code of the build
+ * @return name of the instruction set of the chosen kernels
+ */
+const char *pllSelectFitchKernel(const char *kernel);
+
+/**
+ * @return the RELL tile kernel of the instruction set chosen by pllSelectFitchKernel()
+ * (see FitchKernels::rellTile), NULL to use the SSE3/AVX code of the build
+ */
+RellTileKernel pllRellTileKernel();
+
 /*
  * An alternative for pllComputeRandomizedStepwiseAdditionParsimonyTree
- * because the original one seems to have the wrong deallocation function
+ * because the original one seems to have the wrong deallocation function.
+ * The parsimony vectors kept by pllOptimizeSprParsimonyReweighted() for tr are reused.
  */
 void _pllComputeRandomizedStepwiseAdditionParsimonyTree(pllInstance * tr, partitionList * partitions, int sprDist, IQTree *_iqtree);
 
 void _allocateParsimonyDataStructures(pllInstance *tr, partitionList *pr);
 void _pllFreeParsimonyDataStructures(pllInstance *tr, partitionList *pr);
+/**
+ * update the parsimony data structures of tr to new weights of the same patterns (tr->aliaswgt), e.g. when
+ * switching between the original and the ratchet-perturbed alignment: the tip vectors are recompressed in
+ * place and the vectors are only reallocated if they are too small. Allocates them if needed.
+ * Each instance is handled on its own, thus different threads can reweight different instances.
+ */
+void _reweightParsimonyDataStructures(pllInstance *tr, partitionList *pr, int perSiteScores);
 
 /**
  * DTH: optimize whatever tree is stored in tr by parsimony SPR
@@ -30,8 +53,72 @@ void _pllFreeParsimonyDataStructures(pllInstance *tr, partitionList *pr);
  */
 int pllOptimizeSprParsimony(pllInstance * tr, partitionList * pr, int mintrav, int maxtrav, IQTree *iqtree);
 
+/**
+ * optimize the tree stored in tr by parsimony SPR on reweighted patterns (e.g. a bootstrap sample) without
+ * rebuilding the PLL instance: tr->aliaswgt is overwritten and the parsimony vectors are reweighted in place
+ * (see _reweightParsimonyDataStructures). They are kept for the next call with tr, free them with
+ * _pllFreeParsimonyDataStructures() before destroying tr. Ties are broken with tr->randomNumberSeed, thus several
+ * instances can be optimized at the same time by different threads. Not for Sankoff parsimony.
+ * @param ptnWeights weight of each pattern of the alignment loaded into tr
+ * @param mintrav, maxtrav are PLL limitations for SPR radius
+ * @return parsimony score of the optimized tree under ptnWeights
+ */
+int pllOptimizeSprParsimonyReweighted(pllInstance * tr, partitionList * pr, const BootValTypePars *ptnWeights, int mintrav, int maxtrav);
+
+/**
+ * optimize the tree stored in tr by parsimony SPR for a UFBoot-MP walker (see IQTree::doWalkerSearch): as
+ * pllOptimizeSprParsimonyReweighted() but with per-site scores if bootstrapping, every tree visited is saved by
+ * search->saveWalkerTree() instead of IQTree::saveCurrentTree(). Several walkers can run at the same time.
+ * @param ptnWeights weight of each pattern of the alignment loaded into tr
+ * @param search the tree search keeping the bootstrap candidate trees
+ * @return parsimony score of the optimized tree
+ */
+int pllOptimizeSprParsimonyWalker(pllInstance * tr, partitionList * pr, const BootValTypePars *ptnWeights, int mintrav, int maxtrav,
+		IQTree *search);
+
+/**
+ * time the Fitch (or Sankoff) kernels on the tree stored in tr for the benchmark (see benchmark.h): each repetition
+ * recomputes the vectors of all inner nodes by newviewParsimonyIterativeFast and then scores the tree at tr->start
+ * by evaluateParsimonyIterativeFast. The parsimony data structures are allocated and freed again.
+ * @param repeats # of repetitions
+ * @param[out] newview_time, evaluate_time wall-clock seconds spent in the two kernels
+ * The parsimony score of the tree is stored in tr->bestParsimony.
+ */
+void pllBenchmarkFitchKernels(pllInstance * tr, partitionList * pr, int repeats, double &newview_time, double &evaluate_time);
+
 int pllSaveCurrentTreeSprParsimony(pllInstance * tr, partitionList * pr, int cur_search_pars);
 
+/**
+ * statistics of the bounded evaluation of SPR regraft candidates (on unless -spr_bound_off) over all threads so far
+ * @param candidates # of candidates evaluated with a bound
+ * @param cuts # of them whose evaluation was stopped early
+ * @param cutFraction average fraction of the parsimony vectors scanned before a candidate was cut
+ */
+void pllGetSprBoundStats(unsigned long &candidates, unsigned long &cuts, double &cutFraction);
+
+/**
+ * print the unrooted topology stored in tr directly from its nodeptr structure as
+ * MTree::printTree(WT_TAXON_ID | WT_SORT_TAXA) prints it after the tree is read from pllTreeToNewick
+ * (taxon ID = tip number - 1), equal topologies always get the same string regardless of how they are stored
+ * @param tree_str (OUT) the topology string
+ */
+void pllTreeTopologyString(pllInstance *tr, string &tree_str);
+
+/**
+ * write the tree of tr as Newick into tr->tree_string, i.e. pllTreeToNewick from tr->start->back.
+ * PLL trees are converted to and from Newick only by this function and pllParseNewickString(),
+ * which count the conversions as PERF_NEWICK
+ * @param branch_lengths FALSE to print the topology only
+ * @return tr->tree_string
+ */
+char *pllTreeToNewickString(pllInstance *tr, partitionList *pr, bool branch_lengths = true);
+
+/**
+ * parse a Newick string for a PLL instance, see pllTreeToNewickString()
+ * @return the parsed tree (pllNewickParseDestroy() it), NULL if the string is not a valid tree
+ */
+pllNewickTree *pllParseNewickString(const char *newick);
+
 void pllComputePatternParsimony(pllInstance * tr, partitionList * pr, double *ptn_npars, double *cur_npars);
 void pllComputePatternParsimony(pllInstance * tr, partitionList * pr, unsigned short *ptn_pars, int *cur_pars);
 void pllComputePatternParsimonySlow(pllInstance * tr, partitionList * pr, double *ptn_npars, double *cur_npars); // old version
@@ -46,6 +133,13 @@ int pllCalcMinParsScorePattern(pllInstance *tr, int dataType, int site);
 void testSiteParsimony(Params &params);
 
 void computeUserTreeParsimomy(Params &params);
+
+/**
+ * compute the parsimony and pattern parsimony scores of all trees in params.user_file (plain or gzipped),
+ * loading the alignment once and scoring the trees in parallel with one IQTree kernel per thread.
+ * The scores are written in tree order into <prefix>.parsbatch (TSV) or <prefix>.parsbatch.bin (params.pars_batch_binary)
+ */
+void computeUserTreesParsimonyBatch(Params &params);
 void convertNewickToTnt(Params &params);
 void convertNewickToNexus(Params &params);
 
@@ -0,0 +1,171 @@
+/*
+ * sprparsimonyavx2.cpp
+ *
+ *  Fitch parsimony and RELL kernels with AVX2 integer instructions and hardware popcount,
+ *  compiled with -mavx2 -mpopcnt (see CMakeLists.txt) and only called on CPUs supporting them.
+ */
+
+#include "sprparsimonykernel.h"
+
+#if defined(__AVX2__) && defined(__POPCNT__) && (defined(__x86_64__) || defined(_M_X64))
+
+#include <immintrin.h>
+
+#define AVX2_INTS 8
+
+static inline unsigned int popcount256(__m256i v)
+{
+	return (unsigned int)(_mm_popcnt_u64(_mm256_extract_epi64(v, 0)) + _mm_popcnt_u64(_mm256_extract_epi64(v, 1))
+			+ _mm_popcnt_u64(_mm256_extract_epi64(v, 2)) + _mm_popcnt_u64(_mm256_extract_epi64(v, 3)));
+}
+
+/* # of patterns without common state, i.e. the zero bits of v_N */
+static inline unsigned int changes256(__m256i v_N)
+{
+	return popcount256(_mm256_xor_si256(v_N, _mm256_set1_epi32(-1)));
+}
+
+/* STATES = 0 if the # of states is only known at runtime */
+template <size_t STATES>
+static unsigned int fitchNewviewAVX2(size_t states, size_t width, const parsimonyNumber *left, const parsimonyNumber *right,
+		parsimonyNumber *cur)
+{
+	if(STATES)
+		states = STATES;
+	unsigned int score = 0;
+
+	for(size_t i = 0; i < width; i += AVX2_INTS){
+		__m256i
+			l_A[STATES ? STATES : 32],
+			v_A[STATES ? STATES : 32],
+			v_N = _mm256_setzero_si256();
+
+		for(size_t j = 0; j < states; j++){
+			__m256i
+				s_l = _mm256_load_si256((const __m256i *)&left[width * j + i]),
+				s_r = _mm256_load_si256((const __m256i *)&right[width * j + i]);
+			l_A[j] = _mm256_and_si256(s_l, s_r);
+			v_A[j] = _mm256_or_si256(s_l, s_r);
+			v_N = _mm256_or_si256(v_N, l_A[j]);
+		}
+
+		for(size_t j = 0; j < states; j++)
+			_mm256_store_si256((__m256i *)&cur[width * j + i], _mm256_or_si256(l_A[j], _mm256_andnot_si256(v_N, v_A[j])));
+
+		score += changes256(v_N);
+	}
+
+	return score;
+}
+
+template <size_t STATES>
+static unsigned int fitchEvaluateAVX2(size_t states, size_t width, const parsimonyNumber *left, const parsimonyNumber *right,
+		unsigned int sum, unsigned int bound, size_t &scanned)
+{
+	if(STATES)
+		states = STATES;
+
+	for(size_t i = 0; i < width; i += AVX2_INTS){
+		__m256i v_N = _mm256_setzero_si256();
+
+		for(size_t j = 0; j < states; j++)
+			v_N = _mm256_or_si256(v_N, _mm256_and_si256(_mm256_load_si256((const __m256i *)&left[width * j + i]),
+					_mm256_load_si256((const __m256i *)&right[width * j + i])));
+
+		sum += changes256(v_N);
+		if(sum > bound){
+			scanned = i + AVX2_INTS;
+			return sum;
+		}
+	}
+
+	return sum;
+}
+
+template <size_t STATES>
+static unsigned int fitchInsertionAVX2(size_t states, size_t width, const parsimonyNumber *q, const parsimonyNumber *r,
+		const parsimonyNumber *s, unsigned int sum, unsigned int bound, size_t &scanned)
+{
+	if(STATES)
+		states = STATES;
+
+	for(size_t i = 0; i < width; i += AVX2_INTS){
+		__m256i
+			l_A[STATES ? STATES : 32],
+			v_A[STATES ? STATES : 32],
+			v_N = _mm256_setzero_si256(),
+			t_N = _mm256_setzero_si256();
+
+		for(size_t j = 0; j < states; j++){
+			__m256i
+				s_l = _mm256_load_si256((const __m256i *)&q[width * j + i]),
+				s_r = _mm256_load_si256((const __m256i *)&r[width * j + i]);
+			l_A[j] = _mm256_and_si256(s_l, s_r);
+			v_A[j] = _mm256_or_si256(s_l, s_r);
+			v_N = _mm256_or_si256(v_N, l_A[j]);
+		}
+
+		for(size_t j = 0; j < states; j++)
+			t_N = _mm256_or_si256(t_N, _mm256_and_si256(_mm256_or_si256(l_A[j], _mm256_andnot_si256(v_N, v_A[j])),
+					_mm256_load_si256((const __m256i *)&s[width * j + i])));
+
+		sum += changes256(v_N) + changes256(t_N);
+		if(sum > bound){
+			scanned = i + AVX2_INTS;
+			return sum;
+		}
+	}
+
+	return sum;
+}
+
+static unsigned int fitchNewview(size_t states, size_t width, const parsimonyNumber *left, const parsimonyNumber *right,
+		parsimonyNumber *cur)
+{
+	return (states == 4) ? fitchNewviewAVX2<4>(states, width, left, right, cur)
+			: fitchNewviewAVX2<0>(states, width, left, right, cur);
+}
+
+static unsigned int fitchEvaluate(size_t states, size_t width, const parsimonyNumber *left, const parsimonyNumber *right,
+		unsigned int sum, unsigned int bound, size_t &scanned)
+{
+	return (states == 4) ? fitchEvaluateAVX2<4>(states, width, left, right, sum, bound, scanned)
+			: fitchEvaluateAVX2<0>(states, width, left, right, sum, bound, scanned);
+}
+
+static unsigned int fitchInsertion(size_t states, size_t width, const parsimonyNumber *q, const parsimonyNumber *r,
+		const parsimonyNumber *s, unsigned int sum, unsigned int bound, size_t &scanned)
+{
+	return (states == 4) ? fitchInsertionAVX2<4>(states, width, q, r, s, sum, bound, scanned)
+			: fitchInsertionAVX2<0>(states, width, q, r, s, sum, bound, scanned);
+}
+
+static void rellTile(const unsigned short *pattern_pars, const unsigned short *tile_weights, int begin, int end,
+		unsigned short *lane_sums)
+{
+	__m256i vc_rell0 = _mm256_setzero_si256(), vc_rell1 = _mm256_setzero_si256();
+	for(int ptn = begin; ptn < end; ptn++){
+		__m256i vc_pars = _mm256_set1_epi16(pattern_pars[ptn]);
+		const unsigned short *w = &tile_weights[ptn * RELL_KERNEL_REPS];
+		vc_rell0 = _mm256_add_epi16(vc_rell0, _mm256_mullo_epi16(vc_pars, _mm256_loadu_si256((const __m256i *)w)));
+		vc_rell1 = _mm256_add_epi16(vc_rell1, _mm256_mullo_epi16(vc_pars, _mm256_loadu_si256((const __m256i *)(w + 16))));
+	}
+	_mm256_storeu_si256((__m256i *)lane_sums, vc_rell0);
+	_mm256_storeu_si256((__m256i *)(lane_sums + 16), vc_rell1);
+}
+
+static const FitchKernels kernelsAVX2 = {"AVX2", fitchNewview, fitchEvaluate, fitchInsertion, rellTile};
+
+const FitchKernels *fitchKernelsAVX2()
+{
+	return &kernelsAVX2;
+}
+
+#else
+
+const FitchKernels *fitchKernelsAVX2()
+{
+	return NULL;
+}
+
+#endif
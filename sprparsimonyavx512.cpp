@@ -0,0 +1,164 @@
+/*
+ * sprparsimonyavx512.cpp
+ *
+ *  Fitch parsimony kernels with AVX-512 integer instructions and the VPOPCNTDQ vector popcount,
+ *  compiled with -mavx512f -mavx512bw -mavx512vpopcntdq (see CMakeLists.txt) and only called on CPUs supporting them.
+ */
+
+#include "sprparsimonykernel.h"
+
+#if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512VPOPCNTDQ__)
+
+#include <immintrin.h>
+
+#define AVX512_INTS 16
+
+/* truth table of l | (v & ~n) for _mm512_ternarylogic_epi64(l, v, n, FITCH_SET) */
+#define FITCH_SET 0xF4
+
+/* # of patterns without common state, i.e. the zero bits of v_N, added to the 64-bit lanes of acc */
+static inline __m512i addChanges512(__m512i acc, __m512i v_N)
+{
+	return _mm512_add_epi64(acc, _mm512_popcnt_epi64(_mm512_ternarylogic_epi64(v_N, v_N, v_N, 0x55)));
+}
+
+/* STATES = 0 if the # of states is only known at runtime */
+template <size_t STATES>
+static unsigned int fitchNewviewAVX512(size_t states, size_t width, const parsimonyNumber *left, const parsimonyNumber *right,
+		parsimonyNumber *cur)
+{
+	if(STATES)
+		states = STATES;
+	__m512i score = _mm512_setzero_si512();
+
+	for(size_t i = 0; i < width; i += AVX512_INTS){
+		__m512i
+			l_A[STATES ? STATES : 32],
+			v_A[STATES ? STATES : 32],
+			v_N = _mm512_setzero_si512();
+
+		for(size_t j = 0; j < states; j++){
+			__m512i
+				s_l = _mm512_load_si512(&left[width * j + i]),
+				s_r = _mm512_load_si512(&right[width * j + i]);
+			l_A[j] = _mm512_and_si512(s_l, s_r);
+			v_A[j] = _mm512_or_si512(s_l, s_r);
+			v_N = _mm512_or_si512(v_N, l_A[j]);
+		}
+
+		for(size_t j = 0; j < states; j++)
+			_mm512_store_si512(&cur[width * j + i], _mm512_ternarylogic_epi64(l_A[j], v_A[j], v_N, FITCH_SET));
+
+		score = addChanges512(score, v_N);
+	}
+
+	return (unsigned int)_mm512_reduce_add_epi64(score);
+}
+
+template <size_t STATES>
+static unsigned int fitchEvaluateAVX512(size_t states, size_t width, const parsimonyNumber *left, const parsimonyNumber *right,
+		unsigned int sum, unsigned int bound, size_t &scanned)
+{
+	if(STATES)
+		states = STATES;
+
+	for(size_t i = 0; i < width; i += AVX512_INTS){
+		__m512i v_N = _mm512_setzero_si512();
+
+		for(size_t j = 0; j < states; j++)
+			v_N = _mm512_or_si512(v_N, _mm512_and_si512(_mm512_load_si512(&left[width * j + i]),
+					_mm512_load_si512(&right[width * j + i])));
+
+		sum += (unsigned int)_mm512_reduce_add_epi64(addChanges512(_mm512_setzero_si512(), v_N));
+		if(sum > bound){
+			scanned = i + AVX512_INTS;
+			return sum;
+		}
+	}
+
+	return sum;
+}
+
+template <size_t STATES>
+static unsigned int fitchInsertionAVX512(size_t states, size_t width, const parsimonyNumber *q, const parsimonyNumber *r,
+		const parsimonyNumber *s, unsigned int sum, unsigned int bound, size_t &scanned)
+{
+	if(STATES)
+		states = STATES;
+
+	for(size_t i = 0; i < width; i += AVX512_INTS){
+		__m512i
+			l_A[STATES ? STATES : 32],
+			v_A[STATES ? STATES : 32],
+			v_N = _mm512_setzero_si512(),
+			t_N = _mm512_setzero_si512();
+
+		for(size_t j = 0; j < states; j++){
+			__m512i
+				s_l = _mm512_load_si512(&q[width * j + i]),
+				s_r = _mm512_load_si512(&r[width * j + i]);
+			l_A[j] = _mm512_and_si512(s_l, s_r);
+			v_A[j] = _mm512_or_si512(s_l, s_r);
+			v_N = _mm512_or_si512(v_N, l_A[j]);
+		}
+
+		for(size_t j = 0; j < states; j++)
+			t_N = _mm512_or_si512(t_N, _mm512_and_si512(_mm512_ternarylogic_epi64(l_A[j], v_A[j], v_N, FITCH_SET),
+					_mm512_load_si512(&s[width * j + i])));
+
+		sum += (unsigned int)_mm512_reduce_add_epi64(addChanges512(addChanges512(_mm512_setzero_si512(), v_N), t_N));
+		if(sum > bound){
+			scanned = i + AVX512_INTS;
+			return sum;
+		}
+	}
+
+	return sum;
+}
+
+static unsigned int fitchNewview(size_t states, size_t width, const parsimonyNumber *left, const parsimonyNumber *right,
+		parsimonyNumber *cur)
+{
+	return (states == 4) ? fitchNewviewAVX512<4>(states, width, left, right, cur)
+			: fitchNewviewAVX512<0>(states, width, left, right, cur);
+}
+
+static unsigned int fitchEvaluate(size_t states, size_t width, const parsimonyNumber *left, const parsimonyNumber *right,
+		unsigned int sum, unsigned int bound, size_t &scanned)
+{
+	return (states == 4) ? fitchEvaluateAVX512<4>(states, width, left, right, sum, bound, scanned)
+			: fitchEvaluateAVX512<0>(states, width, left, right, sum, bound, scanned);
+}
+
+static unsigned int fitchInsertion(size_t states, size_t width, const parsimonyNumber *q, const parsimonyNumber *r,
+		const parsimonyNumber *s, unsigned int sum, unsigned int bound, size_t &scanned)
+{
+	return (states == 4) ? fitchInsertionAVX512<4>(states, width, q, r, s, sum, bound, scanned)
+			: fitchInsertionAVX512<0>(states, width, q, r, s, sum, bound, scanned);
+}
+
+static void rellTile(const unsigned short *pattern_pars, const unsigned short *tile_weights, int begin, int end,
+		unsigned short *lane_sums)
+{
+	__m512i vc_rell = _mm512_setzero_si512();
+	for(int ptn = begin; ptn < end; ptn++)
+		vc_rell = _mm512_add_epi16(vc_rell, _mm512_mullo_epi16(_mm512_set1_epi16(pattern_pars[ptn]),
+				_mm512_loadu_si512((const void *)&tile_weights[ptn * RELL_KERNEL_REPS])));
+	_mm512_storeu_si512((void *)lane_sums, vc_rell);
+}
+
+static const FitchKernels kernelsAVX512 = {"AVX-512", fitchNewview, fitchEvaluate, fitchInsertion, rellTile};
+
+const FitchKernels *fitchKernelsAVX512()
+{
+	return &kernelsAVX512;
+}
+
+#else
+
+const FitchKernels *fitchKernelsAVX512()
+{
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * sprparsimonykernel.h
+ *
+ *  Fitch parsimony kernels for instruction sets that are chosen at runtime (see pllSelectFitchKernel()),
+ *  together with the RELL kernel of UFBoot-MP (see IQTree::computeRellParsBatched()).
+ *  Each kernel is compiled in its own file with the compiler flags of its instruction set, so that the
+ *  rest of the program still runs on CPUs without it. Do not include other headers here, their inline
+ *  functions would otherwise be compiled with these flags, too.
+ */
+
+#ifndef SPRPARSIMONYKERNEL_H_
+#define SPRPARSIMONYKERNEL_H_
+
+#include <stddef.h>
+
+typedef unsigned int parsimonyNumber;
+
+/*
+ * # of parsimonyNumber each parsimony vector is padded to, i.e. the widest kernel (AVX-512)
+ */
+#define FITCH_KERNEL_INTS 16
+
+/*
+ * # of bootstrap replicates the RELL kernel scores at once, must be REPS_TILE of iqtree.h
+ */
+#define RELL_KERNEL_REPS 32
+
+/*
+ * lane_sums[r] = sum of pattern_pars[ptn] * tile_weights[ptn * RELL_KERNEL_REPS + r] over the patterns [begin, end)
+ * modulo 2^16, for the RELL_KERNEL_REPS replicates r of one tile (see IQTree::buildTiledBootSamplesPars())
+ */
+typedef void (*RellTileKernel)(const unsigned short *pattern_pars, const unsigned short *tile_weights, int begin, int end,
+		unsigned short *lane_sums);
+
+/*
+ * The kernels work on the bit vectors of sprparsimony.cpp: the vector of a node has width parsimonyNumber per
+ * state, state j at [width * j, width * (j + 1)), one bit per pattern. width is a multiple of FITCH_KERNEL_INTS
+ * and the vectors are aligned to 64 bytes. states is at most 32.
+ */
+struct FitchKernels {
+	/* name of the instruction set */
+	const char *name;
+
+	/*
+	 * cur = Fitch set of left and right
+	 * @return # of state changes
+	 */
+	unsigned int (*newview)(size_t states, size_t width, const parsimonyNumber *left, const parsimonyNumber *right,
+			parsimonyNumber *cur);
+
+	/*
+	 * add the # of state changes between left and right to sum, stop as soon as sum exceeds bound
+	 * @param scanned (OUT) # of parsimonyNumber per state scanned when stopped early, unchanged otherwise
+	 * @return sum
+	 */
+	unsigned int (*evaluate)(size_t states, size_t width, const parsimonyNumber *left, const parsimonyNumber *right,
+			unsigned int sum, unsigned int bound, size_t &scanned);
+
+	/*
+	 * add the cost of joining q and r plus the cost of joining the result with s to sum,
+	 * stop as soon as sum exceeds bound (see sprInsertionScore())
+	 * @param scanned (OUT) # of parsimonyNumber per state scanned when stopped early, unchanged otherwise
+	 * @return sum
+	 */
+	unsigned int (*insertion)(size_t states, size_t width, const parsimonyNumber *q, const parsimonyNumber *r,
+			const parsimonyNumber *s, unsigned int sum, unsigned int bound, size_t &scanned);
+
+	/* RELL score of a tile of bootstrap replicates */
+	RellTileKernel rellTile;
+};
+
+/* @return the AVX2 kernels, NULL if the compiler could not build them (sprparsimonyavx2.cpp) */
+const FitchKernels *fitchKernelsAVX2();
+
+/* @return the AVX-512BW/VPOPCNTDQ kernels, NULL if the compiler could not build them (sprparsimonyavx512.cpp) */
+const FitchKernels *fitchKernelsAVX512();
+
+#endif /* SPRPARSIMONYKERNEL_H_ */
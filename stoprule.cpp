@@ -19,6 +19,7 @@
  ***************************************************************************/
 #include "stoprule.h"
 #include "timeutil.h"
+#include "checkpoint.h"
 
 StopRule::StopRule()
 {
@@ -177,6 +178,16 @@ void StopRule::addImprovedIteration(int iteration) {
 	//	<< (predicted_iteration - iteration) << " more iterations)" << endl;
 }
 
+void StopRule::saveCheckpoint(Checkpoint &checkpoint) {
+	checkpoint.putVector("stop_rule.time_vec", time_vec);
+	checkpoint.put("stop_rule.predicted_iteration", predicted_iteration);
+}
+
+void StopRule::restoreCheckpoint(Checkpoint &checkpoint) {
+	checkpoint.getVector("stop_rule.time_vec", time_vec);
+	predicted_iteration = checkpoint.getInt("stop_rule.predicted_iteration");
+}
+
 int StopRule::getLastImprovedIteration() {
 	if (time_vec.empty())
 		return 0;
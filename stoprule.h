@@ -22,6 +22,8 @@
 
 #include "tools.h"
 
+class Checkpoint;
+
 
 /**
 Stopping rule
@@ -71,6 +73,16 @@ public:
 	/** get the remaining time to converge, in seconds */
 	double getRemainingTime(int cur_iteration, double cur_correlation);
 
+	/**
+		save the improved iterations and the predicted iteration into a checkpoint
+	*/
+	void saveCheckpoint(Checkpoint &checkpoint);
+
+	/**
+		restore the state saved by saveCheckpoint()
+	*/
+	void restoreCheckpoint(Checkpoint &checkpoint);
+
 	/**
 		@return the number of iterations required to stop the search
 	*/
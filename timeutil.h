@@ -142,6 +142,23 @@ __inline double getRealTime() {
 	return (tv.tv_sec + (double)tv.tv_usec / 1.0e6);
 #endif
 }
+
+/**
+ * @return peak resident memory of the process in bytes, 0 if not available
+ */
+__inline uint64_t getPeakMemory() {
+#ifdef HAVE_GETRUSAGE
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__) && defined(__MACH__)
+	return (uint64_t)usage.ru_maxrss; // in bytes on OSX
+#else
+	return (uint64_t)usage.ru_maxrss * 1024; // in kilobytes
+#endif
+#else
+	return 0;
+#endif
+}
 /*
 #if defined _WIN32 || defined __WIN32__ || defined WIN32
 #include <windows.h>
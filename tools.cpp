@@ -779,6 +779,8 @@ void parseArg(int argc, char *argv[], Params &params) {
     params.ratchet_wgt = 1; // default if just specify -ratchet
     params.ratchet_percent = 50; // default if just specify -ratchet
     params.compute_parsimony = false;
+    params.compute_parsimony_batch = false;
+    params.pars_batch_binary = false;
     params.newick_to_tnt = false;
     params.newick_to_nexus = false;
     params.sankoff_cost_file = NULL;
@@ -787,6 +789,23 @@ void parseArg(int argc, char *argv[], Params &params) {
     params.spr_parsimony = true;// Diep: Revert for UFBoot-MP release
     params.spr_mintrav = 1; // same as PLL
     params.spr_maxtrav = 6; // PLL default is 20
+    params.spr_parallel = true;
+    params.spr_bound = true;
+    params.spr_edge = false;
+    params.tbr_parsimony = false;
+    params.tbr_maxtrav = 3;
+    params.sector_size = 0;
+    params.fitch_kernel = "auto";
+    params.num_walkers = 1;
+    params.fuse_iter = 0;
+    params.perf_report = false;
+    params.bench_mode = false;
+    params.bench_data = "dna,aa,bin,dna+cost";
+    params.bench_repeats = 100;
+    params.bench_iterations = 20;
+    params.bench_seed = 12345;
+    params.checkpoint_resume = false;
+    params.checkpoint_dump_interval = 60.0;
     params.test_site_pars = false;
     params.auto_vectorize = false;
     params.sort_alignment = true;
@@ -2113,7 +2132,8 @@ void parseArg(int argc, char *argv[], Params &params) {
 					throw "#replicates must be >= 1000";
 				params.consensus_type = CT_CONSENSUS_TREE;
 //				params.stop_condition = SC_BOOTSTRAP_CORRELATION;
-				params.stop_condition = SC_UNSUCCESS_ITERATION; // Diep: because MP already has refinement
+				if (params.stop_condition != SC_BOOTSTRAP_CORRELATION)
+					params.stop_condition = SC_UNSUCCESS_ITERATION; // Diep: because MP already has refinement
 				//params.nni5Branches = true;
 				continue;
 			}
@@ -2149,6 +2169,8 @@ void parseArg(int argc, char *argv[], Params &params) {
 				if (cnt >= argc)
 					throw "Use -bcor <min_correlation>";
 				params.min_correlation = convert_double(argv[cnt]);
+				// explicit -bcor: also require split frequencies to converge before stopping
+				params.stop_condition = SC_BOOTSTRAP_CORRELATION;
 				continue;
 			}
 			if (strcmp(argv[cnt], "-nstep") == 0) {
@@ -2335,6 +2357,15 @@ void parseArg(int argc, char *argv[], Params &params) {
             	params.nni5 = false;
             	params.nni_type = NNI1;
             	continue;
+            }
+			if(strcmp(argv[cnt], "-comppars-batch") == 0){
+            	params.compute_parsimony_batch = true;
+            	continue;
+            }
+			if(strcmp(argv[cnt], "-comppars-bin") == 0){
+            	params.compute_parsimony_batch = true;
+            	params.pars_batch_binary = true;
+            	continue;
             }
 			if(strcmp(argv[cnt], "-wspars-user-tree") == 0){
             	params.print_site_pars_user_tree = true;
@@ -2395,6 +2426,131 @@ void parseArg(int argc, char *argv[], Params &params) {
             	params.spr_maxtrav = convert_int(argv[cnt]);
             	params.sprDist = params.spr_maxtrav; // Diep: hopefully this speed the pllMakeParsimonyTreeFast...
             	continue;
+            }
+			if(strcmp(argv[cnt], "-spr_par") == 0){
+            	params.spr_parallel = true;
+            	continue;
+            }
+			if(strcmp(argv[cnt], "-spr_par_off") == 0){
+            	params.spr_parallel = false;
+            	continue;
+            }
+			if(strcmp(argv[cnt], "-spr_bound_off") == 0){
+            	params.spr_bound = false;
+            	continue;
+            }
+			if(strcmp(argv[cnt], "-spr_edge") == 0){
+            	params.spr_edge = true;
+            	continue;
+            }
+			if(strcmp(argv[cnt], "-spr_edge_off") == 0){
+            	params.spr_edge = false;
+            	continue;
+            }
+			if(strcmp(argv[cnt], "-tbr") == 0){
+            	params.tbr_parsimony = true;
+            	continue;
+            }
+			if(strcmp(argv[cnt], "-tbr_rad") == 0){
+				cnt++;
+				if (cnt >= argc)
+					throw "Use -tbr_rad <maximal TBR rerooting radius>";
+				params.tbr_maxtrav = convert_int(argv[cnt]);
+				if (params.tbr_maxtrav < 0)
+					throw "-tbr_rad must be non-negative";
+				params.tbr_parsimony = true;
+				continue;
+			}
+			if(strcmp(argv[cnt], "-sector") == 0){
+				cnt++;
+				if (cnt >= argc)
+					throw "Use -sector <number of taxa per sector>";
+				params.sector_size = convert_int(argv[cnt]);
+				if (params.sector_size < 0 || params.sector_size == 1 || params.sector_size == 2)
+					throw "-sector must be 0 or at least 3";
+				continue;
+			}
+			if(strcmp(argv[cnt], "-fitch_kernel") == 0){
+				cnt++;
+				if (cnt >= argc)
+					throw "Use -fitch_kernel auto|avx512|avx2|sse";
+				if (strcmp(argv[cnt], "auto") != 0 && strcmp(argv[cnt], "avx512") != 0
+						&& strcmp(argv[cnt], "avx2") != 0 && strcmp(argv[cnt], "sse") != 0)
+					throw "Use -fitch_kernel auto|avx512|avx2|sse";
+            	params.fitch_kernel = argv[cnt];
+            	continue;
+            }
+			if(strcmp(argv[cnt], "-perf") == 0){
+            	params.perf_report = true;
+            	continue;
+            }
+			if(strcmp(argv[cnt], "-bench") == 0){
+            	params.bench_mode = true;
+            	continue;
+            }
+			if(strcmp(argv[cnt], "-bench_data") == 0){
+				cnt++;
+				if (cnt >= argc)
+					throw "Use -bench_data <type>[+cost][:<taxa>x<sites>],...";
+				params.bench_mode = true;
+				params.bench_data = argv[cnt];
+				continue;
+			}
+			if(strcmp(argv[cnt], "-bench_reps") == 0){
+				cnt++;
+				if (cnt >= argc)
+					throw "Use -bench_reps <number>";
+				params.bench_repeats = convert_int(argv[cnt]);
+				if (params.bench_repeats < 1)
+					throw "-bench_reps must be positive";
+				continue;
+			}
+			if(strcmp(argv[cnt], "-bench_iter") == 0){
+				cnt++;
+				if (cnt >= argc)
+					throw "Use -bench_iter <number>";
+				params.bench_iterations = convert_int(argv[cnt]);
+				if (params.bench_iterations < 1)
+					throw "-bench_iter must be positive";
+				continue;
+			}
+			if(strcmp(argv[cnt], "-bench_seed") == 0){
+				cnt++;
+				if (cnt >= argc)
+					throw "Use -bench_seed <number>";
+				params.bench_seed = convert_int(argv[cnt]);
+				continue;
+			}
+			if(strcmp(argv[cnt], "-walkers") == 0){
+				cnt++;
+				if (cnt >= argc)
+					throw "Use -walkers <number>";
+            	params.num_walkers = convert_int(argv[cnt]);
+            	if (params.num_walkers < 1)
+            		throw "Number of walkers must be positive";
+            	continue;
+            }
+			if(strcmp(argv[cnt], "-fuse") == 0){
+				cnt++;
+				if (cnt >= argc)
+					throw "Use -fuse <number of iterations>";
+            	params.fuse_iter = convert_int(argv[cnt]);
+            	if (params.fuse_iter < 0)
+            		throw "Number of iterations between tree fusings must be non-negative";
+            	continue;
+            }
+			if(strcmp(argv[cnt], "-resume") == 0){
+            	params.checkpoint_resume = true;
+            	continue;
+            }
+			if(strcmp(argv[cnt], "-cptime") == 0){
+				cnt++;
+				if (cnt >= argc)
+					throw "Use -cptime <seconds>";
+            	params.checkpoint_dump_interval = convert_double(argv[cnt]);
+            	if (params.checkpoint_dump_interval < 0)
+            		throw "Checkpoint interval must not be negative";
+            	continue;
             }
 			if(strcmp(argv[cnt], "-sitepars") == 0){
             	params.test_site_pars = true;
@@ -2726,7 +2882,8 @@ void parseArg(int argc, char *argv[], Params &params) {
         }
 
     } // for
-    if (!params.user_file && !params.aln_file && !params.ngs_file && !params.ngs_mapped_reads && !params.partition_file)
+    if (!params.user_file && !params.aln_file && !params.ngs_file && !params.ngs_mapped_reads && !params.partition_file
+    		&& !params.bench_mode)
 #ifdef IQ_TREE
 //        usage_iqtree(argv, false);
 //		usage_mpboot(argv, false);
@@ -2745,6 +2902,8 @@ void parseArg(int argc, char *argv[], Params &params) {
             params.out_prefix = params.ngs_file;
         else if (params.ngs_mapped_reads)
             params.out_prefix = params.ngs_mapped_reads;
+        else if (params.bench_mode)
+            params.out_prefix = (char*)"mpboot";
         else
             params.out_prefix = params.user_file;
     }
@@ -3017,6 +3176,8 @@ void usage_mpboot(char* argv[], bool full_command) {
             << "  -pre <PREFIX>        Using <PREFIX> for output files (default: alignment name)" << endl
             << "  -seed <number>       Random seed number, normally used for debugging purpose" << endl
             << "  -v, -vv, -vvv        Verbose mode, printing more messages to screen" << endl
+            << "  -resume              Continue an interrupted run from the checkpoint file PREFIX.ckp.gz" << endl
+            << "  -cptime <seconds>    Minimum time between two checkpoints (default: 60, 0 to turn off)" << endl
 
 			<< endl << "MPBOOT - MAXIMUM PARSIMONY BOOTSTRAP APPROXIMATION:" << endl
 			<< "  -mulhits                  Store multiple equally parsimonious trees per bootstrap replicate" << endl
@@ -3025,6 +3186,26 @@ void usage_mpboot(char* argv[], bool full_command) {
 			<< "  -ratchet_percent <number> Percentage of informative sites selected for perturbation during ratchet (default: 50)" << endl
 			<< "  -ratchet_off              Turn of ratchet, i.e. Only use tree perturbation" << endl
 			<< "  -spr_rad <number>         Maximum radius of SPR (default: 3)" << endl
+			<< "  -spr_par_off              Score SPR regraft candidates on one thread only (see -omp)" << endl
+			<< "  -spr_bound_off            Score every SPR regraft candidate in full, not only until it exceeds the best score" << endl
+			<< "  -spr_edge                 Keep Fitch vectors of both directions of every branch to score SPR regraft" << endl
+			<< "                            candidates without newview, worthwhile with a large -spr_rad" << endl
+			<< "  -tbr                      Search by TBR instead of SPR: also reroot the pruned subtree (Fitch parsimony only)" << endl
+			<< "  -tbr_rad <number>         Maximum radius of rerooting the pruned subtree in TBR, implies -tbr (default: 3)" << endl
+			<< "  -sector <number>          Hill-climb clades of <number> to twice as many taxa as separate reduced trees," << endl
+			<< "                            in parallel, before the whole tree; for trees of at least twice as many taxa," << endl
+			<< "                            Fitch parsimony only (default: 0, off). With -bb, the trees visited inside a" << endl
+			<< "                            sector are not bootstrap candidates, which leaves fewer candidate trees" << endl
+			<< "  -fitch_kernel <name>      auto, avx512, avx2 or sse: instruction set of the parsimony kernels (default: auto)" << endl
+			<< "  -walkers <number>         Number of candidate trees perturbed and hill-climbed in parallel per iteration (default: 1)" << endl
+			<< "  -fuse <number>            Fuse the current tree with the candidate trees every <number> iterations (default: 0, off)" << endl
+			<< "  -perf                     Write phase times and parsimony event counts into <prefix>.perf.json" << endl
+			<< "  -bench                    Benchmark the parsimony kernels and UFBoot-MP on synthetic alignments, see <prefix>.bench.json" << endl
+			<< "  -bench_data <list>        Data sets of -bench: <type>[+cost][:<taxa>x<sites>],... with type dna, aa or bin" << endl
+			<< "                            (default: dna,aa,bin,dna+cost with 100 taxa and 2000 sites)" << endl
+			<< "  -bench_reps <number>      Number of timed repetitions of the Fitch kernels per data set (default: 100)" << endl
+			<< "  -bench_iter <number>      Number of tree search iterations per data set (default: 20)" << endl
+			<< "  -bench_seed <number>      Random seed of the simulated data sets and searches of -bench (default: 12345)" << endl
 			<< "  -cand_cutoff <#s>         Use top #s percentile as cutoff for selecting bootstrap candidates (default: 10)" << endl
 			<< "  -opt_btree_off            Turn off refinement step on the final bootstrap tree set" << endl
 			<< "  -nni_pars                 Hill-climb by NNI instead of SPR" << endl
@@ -3047,6 +3228,11 @@ void usage_mpboot(char* argv[], bool full_command) {
 			<< "  -nstep <#iterations> #Iterations for UFBoot stopping rule (default: 100)" << endl
             << "  -bcor <min_corr>     Minimum correlation coefficient (default: 0.99)" << endl
 			<< "  -beps <epsilon>      RELL epsilon to break tie (default: 0.5)" << endl
+            << endl << "STANDARD BOOTSTRAP:" << endl
+            << "  -b <#replicates>     Standard bootstrap (>=100). Unless -cost is given, each replicate is searched by" << endl
+            << "                       randomized stepwise addition and SPR, then by ratchet cycles (new starting trees" << endl
+            << "                       with -ratchet_off) until -numstop cycles do not improve it. The replicates run on" << endl
+            << "                       the threads of -omp, the trees do not depend on the number of threads" << endl
             << endl << "CONSENSUS RECONSTRUCTION:" << endl
             << "  <tree_file>          Set of input trees for consensus reconstruction" << endl
             << "  -t <threshold>       Min split support in range [0,1]. 0.5 for majority-rule" << endl
@@ -3074,7 +3260,10 @@ void usage_mpboot(char* argv[], bool full_command) {
 
 			cout << "PRINTING SITE PARSIMONY SCORES:" << endl;
 			cout << "  -wspars              When using together with parsimony tree inference, print site parsimony scores of the best tree found." << endl;
-            cout << "  -wspars-user-tree <treefile> Print site parsimony scores of the user tree in <treefile>" << endl
+            cout << "  -wspars-user-tree <treefile> Print site parsimony scores of the user tree in <treefile>" << endl;
+            cout << "  -comppars-batch <treefile> Print parsimony and pattern parsimony scores of all trees in the (gzipped)" << endl
+                 << "                       <treefile> into <prefix>.parsbatch, trees are scored in parallel with -omp" << endl;
+            cout << "  -comppars-bin <treefile> Like -comppars-batch, but write binary <prefix>.parsbatch.bin" << endl
             << endl;
 
 			cout << endl;
@@ -3194,6 +3383,14 @@ int finish_random() {
 	return 0;
 }
 
+string get_random_state() {
+	return "";
+}
+
+void set_random_state(string state) {
+	outWarning("State of rand() cannot be restored, random numbers will differ");
+}
+
 
 #elif RAN_TYPE == RAN_RAND4
 /******************************************************************************/
@@ -3309,6 +3506,14 @@ int init_random(int seed) /* RAND4 */ {
 int finish_random() {
 	return 0;
 }
+
+string get_random_state() {
+	return "";
+}
+
+void set_random_state(string state) {
+	outWarning("State of RAND4 cannot be restored, random numbers will differ");
+}
 /******************/
 
 #else /* SPRNG */
@@ -3345,6 +3550,37 @@ int finish_random() {
 	return free_sprng(randstream);
 }
 
+string get_random_state() {
+	char *buffer;
+	int size = pack_sprng(randstream, &buffer);
+	if (size == 0)
+		outError("Could not save random number generator state");
+	// hexadecimal, the packed stream contains binary data
+	string state;
+	const char hex_digits[] = "0123456789abcdef";
+	for (int i = 0; i < size; i++) {
+		state += hex_digits[(unsigned char)buffer[i] >> 4];
+		state += hex_digits[(unsigned char)buffer[i] & 15];
+	}
+	free(buffer);
+	return state;
+}
+
+void set_random_state(string state) {
+	if (state.empty() || state.length() % 2 != 0)
+		outError("Invalid random number generator state");
+	int size = state.length() / 2;
+	char *buffer = new char[size];
+	for (int i = 0; i < size; i++)
+		buffer[i] = (char)strtol(state.substr(2 * i, 2).c_str(), NULL, 16);
+	int *stream = unpack_sprng(buffer);
+	delete [] buffer;
+	if (!stream)
+		outError("Invalid random number generator state");
+	free_sprng(randstream);
+	randstream = stream;
+}
+
 #endif /* USE_SPRNG */
 
 /******************/
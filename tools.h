@@ -1498,6 +1498,8 @@ struct Params {
 	int ratchet_percent; // 0-100; percent of informative sites to upweight during ratchet
 
     bool compute_parsimony; // to compute parsimony of a user tree
+    bool compute_parsimony_batch; // to compute parsimony and pattern parsimony of all trees in the user tree file
+    bool pars_batch_binary; // write the output of compute_parsimony_batch in binary instead of TSV
     bool newick_to_tnt; // to convert a tree in Newick format into TNT syntax
     bool newick_to_nexus; // to convert a tree in Newick format into TNT syntax
 
@@ -1524,6 +1526,97 @@ struct Params {
     int spr_mintrav;
     int spr_maxtrav;
 
+    /*
+     * TRUE to score the SPR regraft candidates of a pruned subtree with several threads
+     * (only effective with -omp and more than one thread), default: true
+     */
+    bool spr_parallel;
+
+    /*
+     * TRUE to stop scoring an SPR regraft candidate as soon as its partial score shows that
+     * it can neither be the next move nor a saved UFBoot candidate tree, default: true
+     */
+    bool spr_bound;
+
+    /*
+     * TRUE to keep the Fitch vectors of both directions of every branch during the SPR search, so that
+     * each regraft candidate is scored by one combine along the traversal instead of a newview, default: false
+     */
+    bool spr_edge;
+
+    /*
+     * TRUE to search by TBR instead of SPR: the pruned subtree is also rerooted at each of its branches
+     * within tbr_maxtrav of the pruned branch (Fitch parsimony only), default: false
+     */
+    bool tbr_parsimony;
+    int tbr_maxtrav;
+
+    /*
+     * sectorial search: minimum # of taxa of the clades hill-climbed as reduced trees before each hill-climbing,
+     * only for trees of at least twice as many taxa, default: 0 (off)
+     */
+    int sector_size;
+
+    /*
+     * instruction set of the Fitch parsimony kernels: "auto" (default) for the fastest one supported by the CPU,
+     * "avx512" or "avx2" for at most this one, "sse" for the SSE3/AVX code of the build
+     */
+    const char *fitch_kernel;
+
+    /*
+     * TRUE to write the time of the phases of the run and the counts of the main
+     * parsimony events into <prefix>.perf.json (see perfcounter.h), default: FALSE
+     */
+    bool perf_report;
+
+    /*
+     * TRUE to run the parsimony benchmark on synthetic alignments instead of an analysis (see benchmark.h)
+     */
+    bool bench_mode;
+
+    /*
+     * comma-separated data sets of the benchmark, each <type>[+cost][:<taxa>x<sites>] with type dna, aa or bin,
+     * +cost for Sankoff parsimony with a cost matrix, default: "dna,aa,bin,dna+cost"
+     */
+    const char *bench_data;
+
+    /*
+     * number of times the Fitch kernels are timed on each data set of the benchmark, default: 100
+     */
+    int bench_repeats;
+
+    /*
+     * number of iterations of the UFBoot-MP tree search run on each data set of the benchmark, default: 20
+     */
+    int bench_iterations;
+
+    /*
+     * random seed of the benchmark, used to simulate the data sets and for the tree searches, default: 12345
+     */
+    int bench_seed;
+
+    /*
+     * number of UFBoot-MP walkers that perturb and hill-climb candidate trees at the same time in one
+     * iteration of the tree search, sharing the bootstrap trees (see IQTree::doWalkerSearch), default: 1
+     */
+    int num_walkers;
+
+    /*
+     * MP tree search: every fuse_iter iterations, the current tree is fused with the best candidate trees
+     * (see IQTree::fuseCandidateTrees), default: 0 (off)
+     */
+    int fuse_iter;
+
+    /*
+     * TRUE to continue an interrupted MP tree search from the checkpoint file <out_prefix>.ckp.gz
+     */
+    bool checkpoint_resume;
+
+    /*
+     * minimum wall-clock time (seconds) between two checkpoints of the MP tree search, 0 to turn checkpointing off
+     */
+    double checkpoint_dump_interval;
+
     /*
      * Diep: option for comparing PLL site parsimony and IQTree
      */
@@ -2081,6 +2174,18 @@ int init_random(int seed);
  */
 int finish_random();
 
+/**
+ * @return the state of the random number generator as a string, e.g. for checkpointing,
+ * empty if the generator in use cannot be saved
+ */
+string get_random_state();
+
+/**
+ * continue the random number stream from a state returned by get_random_state()
+ * @param state the saved state
+ */
+void set_random_state(string state);
+
 /**
  * returns a random integer in the range [0; n - 1]
  * @param n upper-bound of random number